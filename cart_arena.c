@@ -0,0 +1,188 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_arena.c
+//  Description    : This is the implementation of the arena allocator.  An
+//                   allocation bumps the offset of the current chunk; a full
+//                   chunk is kept on the list and a new one started, so
+//                   addresses stay stable until the arena is released.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+
+// Project Includes
+#include <cart_arena.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_ARENA_HEADER ((sizeof(CartArenaChunk) + CART_ARENA_ALIGN - 1) & ~(size_t)(CART_ARENA_ALIGN - 1))
+#define CART_ARENA_TEST_ALLOCS 10000 // Allocations made by the unit test
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_arena_init
+// Description  : Setup an empty arena
+//
+// Inputs       : arena - the arena
+//                chunkSize - bytes per chunk (0 for the default)
+// Outputs      : none
+
+void cart_arena_init(CartArena *arena, size_t chunkSize) {
+	memset(arena, 0x0, sizeof(CartArena));
+	arena->chunkSize = (chunkSize == 0) ? CART_ARENA_CHUNK_SIZE : chunkSize;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_arena_alloc
+// Description  : Allocate zeroed memory from the arena
+//
+// Inputs       : arena - the arena
+//                size - bytes to allocate
+// Outputs      : pointer to the memory, NULL if failure
+
+void * cart_arena_alloc(CartArena *arena, size_t size) {
+	CartArenaChunk *chunk = arena->chunks;
+	size_t csize;
+	void *mem;
+
+	// Round up so the next allocation stays aligned
+	size = (size + CART_ARENA_ALIGN - 1) & ~(size_t)(CART_ARENA_ALIGN - 1);
+
+	// Start a new chunk if this one is full (oversized requests get their own)
+	if((chunk == NULL) || (chunk->size - chunk->used < size)) {
+		csize = (size > arena->chunkSize) ? size : arena->chunkSize;
+		if((chunk = malloc(CART_ARENA_HEADER + csize)) == NULL) {
+			return NULL;
+		}
+		chunk->size = csize;
+		chunk->used = 0;
+		if((arena->chunks != NULL) && (csize > arena->chunkSize)) {
+			// Keep filling the current chunk, put the oversized one behind it
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+		arena->mallocs++;
+	}
+
+	mem = (char *)chunk + CART_ARENA_HEADER + chunk->used;
+	chunk->used += size;
+	arena->bytes += size;
+	memset(mem, 0x0, size);
+	return mem;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_arena_strdup
+// Description  : Copy a string into the arena
+//
+// Inputs       : arena - the arena
+//                str - the string
+// Outputs      : the copy, NULL if failure
+
+char * cart_arena_strdup(CartArena *arena, const char *str) {
+	size_t len = strlen(str) + 1;
+	char *copy;
+
+	if((copy = cart_arena_alloc(arena, len)) != NULL) {
+		memcpy(copy, str, len);
+	}
+	return copy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_arena_release
+// Description  : Free everything allocated from the arena
+//
+// Inputs       : arena - the arena
+// Outputs      : none
+
+void cart_arena_release(CartArena *arena) {
+	CartArenaChunk *chunk, *next;
+
+	for(chunk=arena->chunks; chunk!=NULL; chunk=next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	cart_arena_init(arena, arena->chunkSize);
+}
+
+//
+// Unit test
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cartArenaUnitTest
+// Description  : Run a UNIT test checking that arena allocations are aligned,
+//                zeroed, disjoint and stable across chunk growth
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cartArenaUnitTest(void) {
+	CartArena arena;
+	unsigned char *ptrs[CART_ARENA_TEST_ALLOCS];
+	size_t sizes[CART_ARENA_TEST_ALLOCS];
+	char *name;
+	int i, j;
+
+	// Small chunks, so the test crosses many of them (and has oversized requests)
+	cart_arena_init(&arena, 4096);
+	for(i=0; i<CART_ARENA_TEST_ALLOCS; i++) {
+		sizes[i] = 1 + (rand() % ((i % 100 == 0) ? 10000 : 200));
+		if((ptrs[i] = cart_arena_alloc(&arena, sizes[i])) == NULL) {
+			logMessage(LOG_ERROR_LEVEL, "Arena unit test failed: allocation %d failed.", i);
+			return(-1);
+		}
+		if(((uintptr_t)ptrs[i] % CART_ARENA_ALIGN) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Arena unit test failed: allocation %d not aligned.", i);
+			return(-1);
+		}
+		for(j=0; j<sizes[i]; j++) {
+			if(ptrs[i][j] != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Arena unit test failed: allocation %d not zeroed.", i);
+				return(-1);
+			}
+		}
+		memset(ptrs[i], i & 0xff, sizes[i]);
+	}
+
+	// Nothing moved or was overwritten by a later allocation
+	for(i=0; i<CART_ARENA_TEST_ALLOCS; i++) {
+		for(j=0; j<sizes[i]; j++) {
+			if(ptrs[i][j] != (i & 0xff)) {
+				logMessage(LOG_ERROR_LEVEL, "Arena unit test failed: allocation %d overwritten.", i);
+				return(-1);
+			}
+		}
+	}
+	name = cart_arena_strdup(&arena, "cartfile.txt");
+	if((name == NULL) || (strcmp(name, "cartfile.txt") != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Arena unit test failed: bad string copy.");
+		return(-1);
+	}
+
+	// Release leaves an empty, reusable arena
+	cart_arena_release(&arena);
+	if((arena.chunks != NULL) || (arena.bytes != 0) || (cart_arena_alloc(&arena, 1) == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Arena unit test failed: bad release.");
+		return(-1);
+	}
+	cart_arena_release(&arena);
+
+	// Return successfully
+	logMessage(LOG_OUTPUT_LEVEL, "Arena unit test completed successfully.");
+	return(0);
+}
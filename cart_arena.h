@@ -0,0 +1,57 @@
+#ifndef CART_ARENA_INCLUDED
+#define CART_ARENA_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_arena.h
+//  Description    : This is the interface for the arena allocator used for the
+//                   driver's file metadata.  Memory is carved out of large
+//                   chunks, never moves and is never freed on its own; the
+//                   whole arena is released at once.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stddef.h>
+#include <stdint.h>
+
+// Defines
+#define CART_ARENA_CHUNK_SIZE (64 * 1024) // Default bytes per chunk
+#define CART_ARENA_ALIGN 16               // Alignment of every allocation
+
+// This is a chunk of arena memory (allocations follow the header)
+typedef struct CartArenaChunk {
+	struct CartArenaChunk *next; // The previously filled chunk
+	size_t size;                 // Bytes of memory in the chunk
+	size_t used;                 // Bytes handed out
+} CartArenaChunk;
+
+// This is an arena
+typedef struct {
+	CartArenaChunk *chunks;    // The current chunk (the rest follow it)
+	size_t          chunkSize; // Bytes per chunk (larger requests get their own)
+	uint64_t        mallocs;   // Chunks allocated
+	uint64_t        bytes;     // Bytes handed out
+} CartArena;
+
+//
+// Functional Prototypes
+
+void cart_arena_init(CartArena *arena, size_t chunkSize);
+	// Setup an empty arena (chunkSize 0 for the default)
+
+void * cart_arena_alloc(CartArena *arena, size_t size);
+	// Allocate zeroed memory from the arena
+
+char * cart_arena_strdup(CartArena *arena, const char *str);
+	// Copy a string into the arena
+
+void cart_arena_release(CartArena *arena);
+	// Free everything allocated from the arena (it may be reused)
+
+int cartArenaUnitTest(void);
+	// Run a UNIT test checking the arena
+
+#endif
@@ -0,0 +1,725 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_bulk.c
+//  Description    : This is the bulk import/export tool for the CART driver.
+//                   It loads every file of a host directory into CART and
+//                   (with -e) dumps the CART files back out to another.  The
+//                   driver only does the bookkeeping: cart_map reserves each
+//                   file's frames and says where they are, and the data is
+//                   streamed onto them in batches of CART_NET_MAX_BATCH
+//                   frames, several batches in flight on each connection so
+//                   the server is never waiting on a round trip.  With -j the
+//                   chunks are spread over several connections, one thread
+//                   each.  The driver keeps its file table in memory, so the
+//                   export (and the -c check) run in the same session as the
+//                   import.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+// Project Includes
+#include <cart_controller.h>
+#include <cart_driver.h>
+#include <cart_cache.h>
+#include <cart_codec.h>
+#include <cart_network.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_BULK_ARGUMENTS "hvcj:d:B:C:e:i:p:"
+#define CART_BULK_MAX_STREAMS 16    // Most connections the data is streamed over
+#define CART_BULK_DEFAULT_DEPTH 4   // Batches each connection keeps in flight
+#define CART_BULK_MAX_DEPTH 64      // Most batches in flight on a connection
+#define CART_BULK_CHECK_IO (CART_FRAME_SIZE * 64) // Bytes per cart_read of the -c check
+#define USAGE \
+	"USAGE: cart_bulk [-h] [-v] [-c] [-j <streams>] [-d <depth>] [-B <bytes>] [-C <sz>]\n" \
+	"                 [-e <dir>] [-i <ip>] [-p <port>] <dir>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - list each file as it is moved\n" \
+	"    -c - read every file back through the driver and check it against its source\n" \
+	"    -j - connections the data is streamed over (default 1, at most 16; more than one\n" \
+	"         needs a server that serves connections at once, the reference cart_server\n" \
+	"         serves them one at a time)\n" \
+	"    -d - batches each connection keeps in flight (default 4, at most 64)\n" \
+	"    -B - set the file block size to <bytes> (1024, 4096, 16384 or 65536)\n" \
+	"    -C - set the cart frame cache to size <sz>\n" \
+	"    -e - export the files from CART into <dir> after importing them\n" \
+	"    -i - IP address of server to connect to.\n" \
+	"    -p - port number of server to connect to.\n" \
+	"\n" \
+	"    <dir> - the directory whose files are imported\n" \
+	"\n" \
+
+// This is a file being moved
+typedef struct {
+	char    *name; // Name of the file (in CART and in both directories)
+	char    *data; // The source file, mapped
+	char    *out;  // The exported file, mapped while it is written
+	uint32_t size; // Bytes in the file
+	int16_t  fd;   // CART file handle
+} CartBulkFile;
+
+// This is a run of frames of a file moved as one batch
+typedef struct {
+	int      file;      // Index of the file
+	uint32_t offset;    // Offset of the first frame in the file
+	uint16_t cartridge; // Cartridge holding the frames
+	uint16_t frame;     // The first frame
+	uint16_t frames;    // Frames in the chunk (at most CART_NET_MAX_BATCH)
+} CartBulkChunk;
+
+// This is a batch in flight on a connection
+typedef struct {
+	CartXferRegister regs[CART_NET_MAX_BATCH]; // The requests, replaced by the responses
+	int  n;     // Requests in the batch
+	int  chunk; // The chunk it moves, -1 for a LDCART
+	char buf[CART_NET_MAX_BATCH * CART_FRAME_SIZE]; // The frames
+} CartBulkBatch;
+
+// This is a stream, a connection (and thread) moving chunks
+typedef struct {
+	pthread_t thread;  // The thread
+	uint8_t   opcode;  // WRFRME to import, RDFRME to export
+	int       failed;  // Non-zero if the stream failed
+	uint64_t  frames;  // Frames moved
+	uint64_t  batches; // Batches sent (LDCARTs included)
+} CartBulkStream;
+
+//
+// Global Data
+
+static CartBulkFile *bulkFiles = NULL;   // The files
+static int bulkFileCount = 0;            // Number of files
+static CartBulkChunk *bulkChunks = NULL; // The chunks of the current pass
+static int bulkChunkCount = 0;           // Number of chunks
+static int bulkChunkCapacity = 0;        // Entries allocated in bulkChunks
+static int bulkNextChunk = 0;            // Next chunk a stream takes (taken atomically)
+static int bulkDepth = CART_BULK_DEFAULT_DEPTH; // Batches in flight on each connection
+static int verbose = 0;                  // List each file as it is moved
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_ns
+// Description  : Get the monotonic clock
+//
+// Inputs       : none
+// Outputs      : nanoseconds
+
+static uint64_t now_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000ULL) + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_files
+// Description  : Order the files by name (qsort)
+//
+// Inputs       : a, b - the files
+// Outputs      : <0, 0 or >0
+
+static int compare_files(const void *a, const void *b) {
+	return strcmp(((const CartBulkFile *)a)->name, ((const CartBulkFile *)b)->name);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : scan_directory
+// Description  : Find and map the regular files of the source directory
+//
+// Inputs       : dir - the directory
+// Outputs      : 0 if successful, -1 if failure
+
+static int scan_directory(const char *dir) {
+	char path[PATH_MAX];
+	struct dirent *entry;
+	struct stat stats;
+	CartBulkFile *file;
+	DIR *dp;
+	int fh;
+
+	if ((dp = opendir(dir)) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot open directory [%s]: %s", dir, strerror(errno));
+		return(-1);
+	}
+	if ((bulkFiles = calloc(CART_MAX_TOTAL_FILES, sizeof(CartBulkFile))) == NULL) {
+		closedir(dp);
+		return(-1);
+	}
+	while ((entry = readdir(dp)) != NULL) {
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if ((stat(path, &stats) != 0) || !S_ISREG(stats.st_mode)) {
+			continue;
+		}
+		if ((strlen(entry->d_name) >= CART_MAX_PATH_LENGTH) || (stats.st_size > INT32_MAX)) {
+			logMessage(LOG_WARNING_LEVEL, "Skipping [%s], its name or size is too large for CART.", entry->d_name);
+			continue;
+		}
+		if (bulkFileCount == CART_MAX_TOTAL_FILES) {
+			logMessage(LOG_ERROR_LEVEL, "More than %d files in [%s].", CART_MAX_TOTAL_FILES, dir);
+			closedir(dp);
+			return(-1);
+		}
+
+		// Map the file (an empty one has nothing to map)
+		file = &bulkFiles[bulkFileCount];
+		file->name = strdup(entry->d_name);
+		file->size = stats.st_size;
+		if (file->size > 0) {
+			if ((fh = open(path, O_RDONLY)) == -1) {
+				logMessage(LOG_ERROR_LEVEL, "Cannot open [%s]: %s", path, strerror(errno));
+				closedir(dp);
+				return(-1);
+			}
+			file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fh, 0);
+			close(fh);
+			if (file->data == MAP_FAILED) {
+				logMessage(LOG_ERROR_LEVEL, "Cannot map [%s]: %s", path, strerror(errno));
+				closedir(dp);
+				return(-1);
+			}
+		}
+		bulkFileCount++;
+	}
+	closedir(dp);
+	qsort(bulkFiles, bulkFileCount, sizeof(CartBulkFile), compare_files);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_chunks
+// Description  : Cut the runs of frames of a file into chunks (the frames of
+//                unwritten runs read as zero, so they are not moved)
+//
+// Inputs       : file - the index of the file
+//                runs - the runs, in the order of the file
+//                n - the number of runs
+// Outputs      : 0 if successful, -1 if failure
+
+static int add_chunks(int file, CartFrameRun *runs, int n) {
+	CartBulkChunk *chunks;
+	uint32_t offset = 0;
+	int i, done, frames, capacity;
+
+	for (i=0; i<n; i++) {
+		for (done=0; done<runs[i].frames; done+=frames) {
+			frames = (runs[i].frames - done < CART_NET_MAX_BATCH) ? runs[i].frames - done : CART_NET_MAX_BATCH;
+			if (runs[i].unwritten) {
+				continue;
+			}
+			if (bulkChunkCount == bulkChunkCapacity) {
+				capacity = (bulkChunkCapacity == 0) ? 1024 : bulkChunkCapacity * 2;
+				if ((chunks = realloc(bulkChunks, sizeof(CartBulkChunk) * capacity)) == NULL) {
+					return(-1);
+				}
+				bulkChunks = chunks;
+				bulkChunkCapacity = capacity;
+			}
+			bulkChunks[bulkChunkCount].file = file;
+			bulkChunks[bulkChunkCount].offset = offset + (done * CART_FRAME_SIZE);
+			bulkChunks[bulkChunkCount].cartridge = runs[i].cartridge;
+			bulkChunks[bulkChunkCount].frame = runs[i].frame + done;
+			bulkChunks[bulkChunkCount].frames = frames;
+			bulkChunkCount++;
+		}
+		offset += runs[i].frames * CART_FRAME_SIZE;
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : map_file
+// Description  : Map a file's frames (reserving them, for the import) and add
+//                its chunks to the pass
+//
+// Inputs       : file - the index of the file
+//                writing - non-zero for the import
+// Outputs      : 0 if successful, -1 if failure
+
+static int map_file(int file, int writing) {
+	int frames = (bulkFiles[file].size + CART_FRAME_SIZE - 1) / CART_FRAME_SIZE, n;
+	CartFrameRun *runs;
+
+	if (frames == 0) {
+		return(0);
+	}
+	if ((runs = malloc(sizeof(CartFrameRun) * frames)) == NULL) {
+		return(-1);
+	}
+	if (((n = cart_map(bulkFiles[file].fd, 0, bulkFiles[file].size, writing, runs, frames)) == -1) ||
+			(add_chunks(file, runs, n) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Mapping the frames of [%s] failed.", bulkFiles[file].name);
+		free(runs);
+		return(-1);
+	}
+	free(runs);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : send_batch
+// Description  : Send the requests of a batch: a LDCART, or a chunk's frames
+//                (copied from the source file, the last one padded with zeros)
+//
+// Inputs       : batch - the batch
+//                opcode - the frame request (WRFRME or RDFRME)
+//                chunk - the chunk, -1 to load cartridge
+//                cartridge - the cartridge to load
+// Outputs      : 0 if successful, -1 if failure
+
+static int send_batch(CartBulkBatch *batch, uint8_t opcode, int chunk, int cartridge) {
+	CartBulkChunk *ch;
+	CartBulkFile *file;
+	uint32_t bytes;
+	int i;
+
+	batch->chunk = chunk;
+	if (chunk == -1) {
+		batch->n = 1;
+		batch->regs[0] = cart_pack_registers(CART_OP_LDCART, 0, 0, cartridge, 0);
+		return(client_cart_bus_send(batch->regs, 1, NULL));
+	}
+	ch = &bulkChunks[chunk];
+	batch->n = ch->frames;
+	for (i=0; i<ch->frames; i++) {
+		batch->regs[i] = cart_pack_registers(opcode, 0, 0, 0, ch->frame + i);
+	}
+	if (opcode == CART_OP_WRFRME) {
+		file = &bulkFiles[ch->file];
+		bytes = ch->frames * CART_FRAME_SIZE;
+		if (bytes > file->size - ch->offset) {
+			bytes = file->size - ch->offset;
+			memset(&batch->buf[bytes], 0x0, (ch->frames * CART_FRAME_SIZE) - bytes);
+		}
+		memcpy(batch->buf, &file->data[ch->offset], bytes);
+	}
+	return(client_cart_bus_send(batch->regs, batch->n, batch->buf));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : receive_batch
+// Description  : Collect the responses of a batch, placing the frames read
+//                in the exported file
+//
+// Inputs       : batch - the batch (the oldest in flight)
+//                opcode - the frame request (WRFRME or RDFRME)
+// Outputs      : 0 if successful, -1 if failure
+
+static int receive_batch(CartBulkBatch *batch, uint8_t opcode) {
+	CartBulkChunk *ch;
+	CartBulkFile *file;
+	uint32_t bytes;
+	int i;
+
+	if (client_cart_bus_receive(batch->regs, batch->n, batch->buf) != 0) {
+		return(-1);
+	}
+	for (i=0; i<batch->n; i++) {
+		if (cart_register_rt1(batch->regs[i]) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "CART failed a bulk request (opcode %d).", cart_register_ky1(batch->regs[i]));
+			return(-1);
+		}
+	}
+	if ((batch->chunk != -1) && (opcode == CART_OP_RDFRME)) {
+		ch = &bulkChunks[batch->chunk];
+		file = &bulkFiles[ch->file];
+		bytes = ch->frames * CART_FRAME_SIZE;
+		if (bytes > file->size - ch->offset) {
+			bytes = file->size - ch->offset;
+		}
+		memcpy(&file->out[ch->offset], batch->buf, bytes);
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : make_room
+// Description  : Collect the oldest batch in flight if the window is full
+//
+// Inputs       : stream - the stream
+//                window - the batches in flight
+//                head, inflight - the oldest batch and how many there are
+// Outputs      : 0 if successful, -1 if failure
+
+static int make_room(CartBulkStream *stream, CartBulkBatch *window, int *head, int *inflight) {
+	if (*inflight < bulkDepth) {
+		return(0);
+	}
+	if (receive_batch(&window[*head], stream->opcode) != 0) {
+		return(-1);
+	}
+	*head = (*head + 1) % bulkDepth;
+	(*inflight)--;
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_stream
+// Description  : Move chunks over this thread's connection until none are
+//                left, keeping up to bulkDepth batches in flight.  The
+//                server answers in order, so the oldest batch is collected
+//                whenever the window is full.  A chunk on another cartridge
+//                than the last is preceded by a LDCART.
+//
+// Inputs       : arg - the stream
+// Outputs      : NULL
+
+static void * run_stream(void *arg) {
+	CartBulkStream *stream = arg;
+	CartBulkBatch *window;
+	int head = 0, inflight = 0, loaded = -1, chunk;
+
+	if ((window = malloc(sizeof(CartBulkBatch) * bulkDepth)) == NULL) {
+		stream->failed = 1;
+		return(NULL);
+	}
+	while ((chunk = __sync_fetch_and_add(&bulkNextChunk, 1)) < bulkChunkCount) {
+		if (bulkChunks[chunk].cartridge != loaded) {
+			loaded = bulkChunks[chunk].cartridge;
+			if ((make_room(stream, window, &head, &inflight) != 0) ||
+					(send_batch(&window[(head + inflight) % bulkDepth], stream->opcode, -1, loaded) != 0)) {
+				stream->failed = 1;
+				break;
+			}
+			inflight++;
+			stream->batches++;
+		}
+		if ((make_room(stream, window, &head, &inflight) != 0) ||
+				(send_batch(&window[(head + inflight) % bulkDepth], stream->opcode, chunk, loaded) != 0)) {
+			stream->failed = 1;
+			break;
+		}
+		inflight++;
+		stream->batches++;
+		stream->frames += bulkChunks[chunk].frames;
+	}
+
+	// Collect what is still in flight (after a failure the connection is unusable)
+	while ((inflight > 0) && !stream->failed) {
+		stream->failed = (receive_batch(&window[head], stream->opcode) != 0);
+		head = (head + 1) % bulkDepth;
+		inflight--;
+	}
+	free(window);
+	return(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : move_chunks
+// Description  : Move all of the chunks of the pass over the streams.  A
+//                single stream runs on this thread, over the driver's own
+//                connection; more each get a thread and connection.
+//
+// Inputs       : opcode - WRFRME to import, RDFRME to export
+//                nstreams - the number of streams
+//                what - the name of the pass (for the report)
+// Outputs      : 0 if successful, -1 if failure
+
+static int move_chunks(uint8_t opcode, int nstreams, const char *what) {
+	CartBulkStream streams[CART_BULK_MAX_STREAMS];
+	uint64_t start, elapsed, frames = 0, batches = 0, bytes = 0;
+	int i, started, failed = 0;
+
+	memset(streams, 0x0, sizeof(streams));
+	bulkNextChunk = 0;
+	start = now_ns();
+	if (nstreams == 1) {
+		streams[0].opcode = opcode;
+		run_stream(&streams[0]);
+		started = 1;
+	} else {
+		for (started=0; started<nstreams; started++) {
+			streams[started].opcode = opcode;
+			if (pthread_create(&streams[started].thread, NULL, run_stream, &streams[started]) != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Cannot start stream %d.", started);
+				failed = 1;
+				break;
+			}
+		}
+		for (i=0; i<started; i++) {
+			pthread_join(streams[i].thread, NULL);
+		}
+	}
+	elapsed = now_ns() - start;
+	for (i=0; i<started; i++) {
+		failed |= streams[i].failed;
+		frames += streams[i].frames;
+		batches += streams[i].batches;
+	}
+	for (i=0; i<bulkFileCount; i++) {
+		bytes += bulkFiles[i].size;
+	}
+	if (failed) {
+		logMessage(LOG_ERROR_LEVEL, "Bulk %s failed.", what);
+		return(-1);
+	}
+	printf("%s: %d files, %lu bytes (%lu frames in %lu batches) in %.3f s, %.1f MB/s over %d connection%s\n",
+		what, bulkFileCount, (unsigned long)bytes, (unsigned long)frames, (unsigned long)batches, elapsed / 1e9,
+		(elapsed > 0) ? (frames * CART_FRAME_SIZE) / (elapsed / 1e3) : 0.0, nstreams, (nstreams == 1) ? "" : "s");
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : import_files
+// Description  : Create the files in CART, reserve their frames and stream
+//                the data onto them
+//
+// Inputs       : nstreams - the number of streams
+// Outputs      : 0 if successful, -1 if failure
+
+static int import_files(int nstreams) {
+	int i;
+
+	bulkChunkCount = 0;
+	for (i=0; i<bulkFileCount; i++) {
+		if (verbose) {
+			logMessage(LOG_OUTPUT_LEVEL, "Importing [%s], %u bytes", bulkFiles[i].name, bulkFiles[i].size);
+		}
+		if ((bulkFiles[i].fd = cart_open_mode(bulkFiles[i].name, CART_OPEN_RDWR)) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "Open of [%s] failed.", bulkFiles[i].name);
+			return(-1);
+		}
+		if (map_file(i, 1) != 0) {
+			return(-1);
+		}
+	}
+	return(move_chunks(CART_OP_WRFRME, nstreams, "import"));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : check_files
+// Description  : Read every file back through the driver and compare it to
+//                its source
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int check_files(void) {
+	char buf[CART_BULK_CHECK_IO];
+	uint32_t done;
+	int32_t chunk;
+	int i;
+
+	for (i=0; i<bulkFileCount; i++) {
+		if (cart_seek(bulkFiles[i].fd, 0) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Seek of [%s] failed.", bulkFiles[i].name);
+			return(-1);
+		}
+		for (done=0; done<bulkFiles[i].size; done+=chunk) {
+			chunk = (bulkFiles[i].size - done < sizeof(buf)) ? bulkFiles[i].size - done : sizeof(buf);
+			if ((cart_read(bulkFiles[i].fd, buf, chunk) != chunk) || (memcmp(buf, &bulkFiles[i].data[done], chunk) != 0)) {
+				logMessage(LOG_ERROR_LEVEL, "Check of [%s] failed near offset %u.", bulkFiles[i].name, done);
+				return(-1);
+			}
+		}
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "Checked %d files against their sources.", bulkFileCount);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : export_files
+// Description  : Stream the files out of CART into a directory
+//
+// Inputs       : dir - the directory (created if needed)
+//                nstreams - the number of streams
+// Outputs      : 0 if successful, -1 if failure
+
+static int export_files(const char *dir, int nstreams) {
+	char path[PATH_MAX];
+	int i, fh, ret;
+
+	if ((mkdir(dir, 0755) != 0) && (errno != EEXIST)) {
+		logMessage(LOG_ERROR_LEVEL, "Cannot create directory [%s]: %s", dir, strerror(errno));
+		return(-1);
+	}
+	bulkChunkCount = 0;
+	for (i=0; i<bulkFileCount; i++) {
+		if (verbose) {
+			logMessage(LOG_OUTPUT_LEVEL, "Exporting [%s], %u bytes", bulkFiles[i].name, bulkFiles[i].size);
+		}
+
+		// Size the file, its frames are written straight into the mapping (unwritten ones stay zero)
+		snprintf(path, sizeof(path), "%s/%s", dir, bulkFiles[i].name);
+		if (((fh = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1) || (ftruncate(fh, bulkFiles[i].size) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "Cannot create [%s]: %s", path, strerror(errno));
+			return(-1);
+		}
+		if (bulkFiles[i].size > 0) {
+			bulkFiles[i].out = mmap(NULL, bulkFiles[i].size, PROT_READ | PROT_WRITE, MAP_SHARED, fh, 0);
+			if (bulkFiles[i].out == MAP_FAILED) {
+				logMessage(LOG_ERROR_LEVEL, "Cannot map [%s]: %s", path, strerror(errno));
+				close(fh);
+				return(-1);
+			}
+		}
+		close(fh);
+		if (map_file(i, 0) != 0) {
+			return(-1);
+		}
+	}
+	ret = move_chunks(CART_OP_RDFRME, nstreams, "export");
+	for (i=0; i<bulkFileCount; i++) {
+		if (bulkFiles[i].size > 0) {
+			munmap(bulkFiles[i].out, bulkFiles[i].size);
+		}
+	}
+	return(ret);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the bulk import/export tool
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, check = 0, nstreams = 1, i, ret;
+	uint32_t block_size, cache_size = 0;
+	char *export_dir = NULL;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_BULK_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // List the files
+			verbose = 1;
+			break;
+
+		case 'c': // Check the files through the driver
+			check = 1;
+			break;
+
+		case 'j': // Set the number of connections
+			if ( (sscanf(optarg, "%d", &nstreams) != 1) || (nstreams < 1) || (nstreams > CART_BULK_MAX_STREAMS) ) {
+				fprintf( stderr, "Bad connection count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'd': // Set the batches in flight
+			if ( (sscanf(optarg, "%d", &bulkDepth) != 1) || (bulkDepth < 1) || (bulkDepth > CART_BULK_MAX_DEPTH) ) {
+				fprintf( stderr, "Bad depth [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'B': // Set the block size
+			if ( (sscanf(optarg, "%u", &block_size) != 1) || (cart_set_block_size(block_size) != 0) ) {
+				fprintf( stderr, "Bad block size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'C': // Set the cache size
+			if ( sscanf(optarg, "%u", &cache_size) != 1 ) {
+				fprintf( stderr, "Bad cache size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'e': // Export into a directory
+			export_dir = optarg;
+			break;
+
+		case 'i': // Get the IP address
+			if (inet_addr(optarg) == INADDR_NONE) {
+				fprintf( stderr, "Bad IP address [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			cart_network_address = (unsigned char *)strdup(optarg);
+			break;
+
+		case 'p': // Set the network port number
+			if ( sscanf(optarg, "%hu", &cart_network_port) != 1 ) {
+				fprintf( stderr, "Bad port number [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	if ( optind != argc - 1 ) {
+		fprintf( stderr, "Missing or extra directory argument.\n\n" USAGE );
+		return( -1 );
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	if ( cache_size != 0 ) {
+		set_cart_cache_size(cache_size);
+	}
+	if ( scan_directory(argv[optind]) != 0 ) {
+		return( -1 );
+	}
+
+	// Power on, import, then check and export
+	if ( cart_poweron() != 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "CART power on failed, is cart_server running?" );
+		return( -1 );
+	}
+	ret = import_files(nstreams);
+	if ( (ret == 0) && check ) {
+		ret = check_files();
+	}
+	if ( (ret == 0) && (export_dir != NULL) ) {
+		ret = export_files(export_dir, nstreams);
+	}
+
+	// Clean up
+	for (i=0; i<bulkFileCount; i++) {
+		if ( bulkFiles[i].size > 0 ) {
+			munmap(bulkFiles[i].data, bulkFiles[i].size);
+		}
+		free(bulkFiles[i].name);
+	}
+	free(bulkFiles);
+	free(bulkChunks);
+	if ( cart_poweroff() != 0 ) {
+		ret = -1;
+	}
+	return( ret );
+}
@@ -16,24 +16,39 @@
 #include <cmpsc311_log.h>
 #include <cart_cache.h>
 #include <cart_controller.h>
+#include <cart_trace.h>
+#include <cart_ring.h>
+#include <cart_probe.h>
 // Defines
+#define CART_CACHE_UNIT_ENTRIES 8  // Entries in the unit test's cache
+#define CART_CACHE_UNIT_CARTS 4    // Cartridges the unit test's frames are on
+#define CART_CACHE_UNIT_KEYS (CART_CACHE_UNIT_CARTS * 8) // Blocks the unit test's operations pick from
+#define CART_CACHE_UNIT_OPS 20000  // Random operations per block size in the unit test
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Structure    : cachedFrame
 // Description  : A structure for my cache. Each one will correspond to one frame
+//		  (or one block of myBlockFrames frames, keyed by its first frame)
 //		  The number of these created is determined by myMaxFrames
 
 typedef struct cachedFrame {
 	int frame; // frame number corresponding to the cached frame
 	int cartridge; // cartridge number corresponding to the cached frame
-	char cache[CART_FRAME_SIZE]; // the frame itself
+	char *cache; // the frame itself (its slot in the memory allocated after the entries)
 	int priority; // the priority of the frame to determine if it should be evicted.  If the priority equals myMaxFrames, it is next in line to be evicted
 } cachedFrame;
 
 cachedFrame* myCache; // pointer to all the cached frames.  It will be alloc in init_cart_cache
-int myMaxFrames; // the size of the cache determined in set_cart_cache_size
+int myMaxFrames; // the number of entries in the cache, set from the size and the block size in init_cart_cache
 int numberOfUnoccupiedFrames; // number of frames that have not been occupied yet in the cache. Once this reaches zero, it signals to my cache that it is time to evict frames
+uint32_t myCacheFrames; // the size of the cache in frames determined in set_cart_cache_size
+uint32_t myBlockFrames = 1; // the frames in each entry determined in set_cart_cache_block
+
+// The unit test's model of the cache
+static int unitOrder[CART_CACHE_UNIT_ENTRIES]; // Blocks cached, most recently used first
+static int unitCount; // Blocks cached
+static uint8_t unitVersion[CART_CACHE_UNIT_KEYS]; // Times each block was put, which sets its contents
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -44,11 +59,42 @@ int numberOfUnoccupiedFrames; // number of frames that have not been occupied ye
 // Outputs      : 0 if successful, -1 if failure
 
 int set_cart_cache_size(uint32_t max_frames) {
-	myMaxFrames = max_frames;
-	numberOfUnoccupiedFrames = max_frames;
+	myCacheFrames = max_frames;
+	myMaxFrames = max_frames / myBlockFrames;
+	numberOfUnoccupiedFrames = myMaxFrames;
 	return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : set_cart_cache_block
+// Description  : Set the frames in each entry of the cache (must be called
+//                before init).  An entry then holds that many consecutive
+//                frames, and the cache holds its size / frames entries.
+//
+// Inputs       : frames - frames per entry (at least 1)
+// Outputs      : 0 if successful, -1 if failure
+
+int set_cart_cache_block(uint32_t frames) {
+	if(frames == 0) {
+		return -1;
+	}
+	myBlockFrames = frames;
+	return set_cart_cache_size(myCacheFrames);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_cart_cache_size
+// Description  : Get the size of the cache
+//
+// Inputs       : none
+// Outputs      : the maximum number of frames the cache can hold
+
+uint32_t get_cart_cache_size(void) {
+	return myCacheFrames;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : init_cart_cache
@@ -58,12 +104,18 @@ int set_cart_cache_size(uint32_t max_frames) {
 // Outputs      : 0 if successful, -1 if failure
 
 int init_cart_cache(void) {
-	// Alloc the number of cachedFrames needed based on the myMaxFrames
-	myCache = (cachedFrame *) malloc(sizeof(struct cachedFrame) * myMaxFrames);
+	int i;
+
+	// Alloc the number of cachedFrames needed based on the myMaxFrames, with their frames after them
+	myCache = (cachedFrame *) malloc((sizeof(struct cachedFrame) + ((size_t)CART_FRAME_SIZE * myBlockFrames)) * myMaxFrames);
 	if(myCache == NULL) { // Return -1 is error will malloc
 		printf("Error with malloc for myCache\n");
 		return -1;
 	}
+	for(i=0; i<myMaxFrames; i++) {
+		myCache[i].cache = (char *)&myCache[myMaxFrames] + ((size_t)CART_FRAME_SIZE * myBlockFrames * i);
+	}
+	numberOfUnoccupiedFrames = myMaxFrames;
 	return 0;
 }
 
@@ -120,13 +172,17 @@ int adjust_priority(int exempt, int abovePriority) {
 int put_cart_cache(CartridgeIndex cart, CartFrameIndex frm, void *buf)  {
 	int i, prioritiesToAdjust;
 	
+	CART_TRACE(CART_TRACE_CACHE_PUT, 0, cart, frm, 0, 0);
+	CART_RING(CART_RING_LEVEL_CACHE, CART_RING_CACHE_PUT, cart, frm, 0, 0);
+	CART_PROBE2(cache_put, cart, frm);
+
 	// This for statement searches the current cache, to see if we need to update it
 	for(i=(myMaxFrames - 1); i>=numberOfUnoccupiedFrames; i--) {
 		if(myCache[i].frame == frm && myCache[i].cartridge == cart) { 
 			prioritiesToAdjust = myCache[i].priority; // Save the previous priority of this cachedFrame for our adjust_priority function (refer to this function for the reason why)
 			myCache[i].priority = numberOfUnoccupiedFrames + 1; // Since the cached frame is being updated, we adjust the priority to one, so it is last to be evicted.
 			adjust_priority(i, prioritiesToAdjust); // Call adjust_priority to adjust the priority of cached frames, so they are closer to being evicted.
-			memcpy(myCache[i].cache, buf, CART_FRAME_SIZE);  // Place the buf into the cached frame.
+			memcpy(myCache[i].cache, buf, (size_t)CART_FRAME_SIZE * myBlockFrames);  // Place the buf into the cached frame.
 			return 0;
 		}
 	}
@@ -140,7 +196,7 @@ int put_cart_cache(CartridgeIndex cart, CartFrameIndex frm, void *buf)  {
 				adjust_priority(i, prioritiesToAdjust); // Call adjust_priority to adjust the priority of cached frames, so they are closer to being evicted.
 				myCache[i].frame = frm; // Update the frame number 
 				myCache[i].cartridge = cart; // Update the cart number
-				memcpy(myCache[i].cache, buf, CART_FRAME_SIZE); // Place the buf into the cached frame.
+				memcpy(myCache[i].cache, buf, (size_t)CART_FRAME_SIZE * myBlockFrames); // Place the buf into the cached frame.
 				return 0;
 			}
 		}
@@ -154,7 +210,7 @@ int put_cart_cache(CartridgeIndex cart, CartFrameIndex frm, void *buf)  {
 	numberOfUnoccupiedFrames--;
 	myCache[i].frame = frm;
 	myCache[i].cartridge = cart;
-	memcpy(myCache[i].cache, buf, CART_FRAME_SIZE);
+	memcpy(myCache[i].cache, buf, (size_t)CART_FRAME_SIZE * myBlockFrames);
 	return 0;
 }
 
@@ -176,39 +232,254 @@ void * get_cart_cache(CartridgeIndex cart, CartFrameIndex frm) {
 			prioritiesToAdjust = myCache[i].priority; // Save the previous priority of this cachedFrame for our adjust_priority function (refer to this function for the reason why)
 			myCache[i].priority = numberOfUnoccupiedFrames + 1; // Since the cached frame is being updated, we adjust the priority to one, so it is last to be evicted.
 			adjust_priority(i, prioritiesToAdjust); // Call adjust_priority to adjust the priority of cached frames, so they are closer to being evicted.
+			CART_TRACE(CART_TRACE_CACHE_GET, 0, cart, frm, 1, 0);
+			CART_RING(CART_RING_LEVEL_CACHE, CART_RING_CACHE_GET, cart, frm, 1, 0);
+			CART_PROBE3(cache_get, cart, frm, 1);
 			return myCache[i].cache;	
 		}
 	}
+	CART_TRACE(CART_TRACE_CACHE_GET, 0, cart, frm, 0, 0);
+	CART_RING(CART_RING_LEVEL_CACHE, CART_RING_CACHE_GET, cart, frm, 0, 0);
+	CART_PROBE3(cache_get, cart, frm, 0);
 	return NULL;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : delete_cart_cache
-// Description  : Remove a frame from the cache (and return it).  I do not use 
-//   		  this function in my project.
+// Description  : Remove a frame from the cache.  The most recently filled
+//                entry moves into its place, so the occupied entries stay
+//                together, and the frames more recently used than it move one
+//                closer to eviction, so the priorities stay a permutation.
 //
 // Inputs       : cart - the cart number of the frame to remove from cache
 //                blk - the frame number of the frame to remove from cache
-// Outputs      : pointe buffer inserted into the object
+// Outputs      : 0 if the frame was removed, -1 if it was not cached
 
-void * delete_cart_cache(CartridgeIndex cart, CartFrameIndex blk) {
-	// Not used
-	return 0;
+int delete_cart_cache(CartridgeIndex cart, CartFrameIndex blk) {
+	int i, j, removedPriority;
+	char *removedFrame;
+
+	for(i=(myMaxFrames - 1); i>=numberOfUnoccupiedFrames; i--) {
+		if(myCache[i].frame == blk && myCache[i].cartridge == cart) {
+			removedPriority = myCache[i].priority;
+			for(j=(myMaxFrames - 1); j>=numberOfUnoccupiedFrames; j--) {
+				if(myCache[j].priority < removedPriority) {
+					myCache[j].priority++;
+				}
+			}
+			if(i != numberOfUnoccupiedFrames) {
+				// The entries trade frame memory, so every entry keeps its own
+				removedFrame = myCache[i].cache;
+				memcpy(&myCache[i], &myCache[numberOfUnoccupiedFrames], sizeof(cachedFrame));
+				myCache[numberOfUnoccupiedFrames].cache = removedFrame;
+			}
+			numberOfUnoccupiedFrames++;
+			return 0;
+		}
+	}
+	return -1;
 }
 
 //
 // Unit test
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_fill
+// Description  : Fill a block with the unit test's contents for a block (each
+//                frame of the block differs, and so does each version)
+//
+// Inputs       : key - the block
+//                buf - the block's memory
+// Outputs      : none
+
+static void unit_fill(int key, char *buf) {
+	uint32_t i;
+
+	for(i=0; i<myBlockFrames; i++) {
+		memset(&buf[(size_t)i * CART_FRAME_SIZE], (key * 7) + unitVersion[key] + (i * 61), CART_FRAME_SIZE);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_find
+// Description  : Find a block in the unit test's model
+//
+// Inputs       : key - the block
+// Outputs      : its place (0 is the most recently used), -1 if not cached
+
+static int unit_find(int key) {
+	int i;
+
+	for(i=0; (i<unitCount) && (unitOrder[i] != key); i++);
+	return (i == unitCount) ? -1 : i;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_check
+// Description  : Check the cache against the unit test's model: it holds the
+//                same blocks, with their contents, its priorities are a
+//                permutation ranking them in the order they were used, and
+//                every entry has its own memory
+//
+// Inputs       : expect - the expected contents of a block (scratch)
+// Outputs      : 0 if they agree, -1 if not
+
+static int unit_check(char *expect) {
+	char seen[CART_CACHE_UNIT_ENTRIES];
+	size_t slot, bytes = (size_t)CART_FRAME_SIZE * myBlockFrames;
+	int i, rank, key;
+
+	if(myMaxFrames - numberOfUnoccupiedFrames != unitCount) {
+		logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: %d entries cached, expected %d.", myMaxFrames - numberOfUnoccupiedFrames, unitCount);
+		return(-1);
+	}
+
+	// The occupied entries rank 0 (numberOfUnoccupiedFrames + 1) to unitCount - 1 (myMaxFrames), each once
+	memset(seen, 0x0, sizeof(seen));
+	for(i=numberOfUnoccupiedFrames; i<myMaxFrames; i++) {
+		rank = myCache[i].priority - (numberOfUnoccupiedFrames + 1);
+		if((rank < 0) || (rank >= unitCount) || seen[rank]) {
+			logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: priorities are not a permutation (entry %d has %d).", i, myCache[i].priority);
+			return(-1);
+		}
+		seen[rank] = 1;
+		key = unitOrder[rank];
+		if((myCache[i].cartridge != key / 8) || (myCache[i].frame != (key % 8) * (int)myBlockFrames)) {
+			logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: entry %d (rank %d) holds the wrong block.", i, rank);
+			return(-1);
+		}
+		unit_fill(key, expect);
+		if(memcmp(myCache[i].cache, expect, bytes) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: entry %d holds the wrong contents.", i);
+			return(-1);
+		}
+	}
+
+	// Deletes trade the memory of entries, which must still each have a slot of their own
+	memset(seen, 0x0, sizeof(seen));
+	for(i=0; i<myMaxFrames; i++) {
+		slot = (myCache[i].cache - (char *)&myCache[myMaxFrames]) / bytes;
+		if((myCache[i].cache < (char *)&myCache[myMaxFrames]) || (slot >= myMaxFrames) || seen[slot]) {
+			logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: entry %d does not have its own memory.", i);
+			return(-1);
+		}
+		seen[slot] = 1;
+	}
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_run
+// Description  : Run random puts, gets and deletes against a cache of blocks
+//                of the given number of frames, checking it after each
+//
+// Inputs       : blockFrames - frames in each entry
+// Outputs      : 0 if successful, -1 if failure
+
+static int unit_run(uint32_t blockFrames) {
+	uint64_t state = 0x9e3779b97f4a7c15ULL;
+	char *buf, *expect, *got;
+	int op, key, at, err = 0;
+
+	set_cart_cache_block(blockFrames);
+	set_cart_cache_size(CART_CACHE_UNIT_ENTRIES * blockFrames);
+	buf = malloc((size_t)CART_FRAME_SIZE * blockFrames);
+	expect = malloc((size_t)CART_FRAME_SIZE * blockFrames);
+	if((buf == NULL) || (expect == NULL) || (init_cart_cache() != 0)) {
+		free(buf);
+		free(expect);
+		return(-1);
+	}
+	unitCount = 0;
+	memset(unitVersion, 0x0, sizeof(unitVersion));
+
+	for(op=0; (op<CART_CACHE_UNIT_OPS) && (err == 0); op++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		key = (state >> 8) % CART_CACHE_UNIT_KEYS;
+		at = unit_find(key);
+		switch(state % 3) {
+
+		case 0: // A put replaces the contents, and evicts the least recently used block if the cache is full
+			unitVersion[key]++;
+			unit_fill(key, buf);
+			if(put_cart_cache(key / 8, (key % 8) * blockFrames, buf) != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: put %d failed.", op);
+				err = -1;
+				break;
+			}
+			if(at == -1) {
+				at = (unitCount < CART_CACHE_UNIT_ENTRIES) ? unitCount++ : unitCount - 1;
+			}
+			memmove(&unitOrder[1], &unitOrder[0], sizeof(int) * at);
+			unitOrder[0] = key;
+			break;
+
+		case 1: // A get finds exactly the cached blocks, and makes them the most recently used
+			got = get_cart_cache(key / 8, (key % 8) * blockFrames);
+			unit_fill(key, expect);
+			if((got == NULL) != (at == -1) || ((got != NULL) && (memcmp(got, expect, (size_t)CART_FRAME_SIZE * blockFrames) != 0))) {
+				logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: get %d of block %d was wrong.", op, key);
+				err = -1;
+				break;
+			}
+			if(at != -1) {
+				memmove(&unitOrder[1], &unitOrder[0], sizeof(int) * at);
+				unitOrder[0] = key;
+			}
+			break;
+
+		default: // A delete removes exactly the cached blocks
+			if((delete_cart_cache(key / 8, (key % 8) * blockFrames) == 0) != (at != -1)) {
+				logMessage(LOG_ERROR_LEVEL, "Cache unit test failed: delete %d of block %d was wrong.", op, key);
+				err = -1;
+				break;
+			}
+			if(at != -1) {
+				memmove(&unitOrder[at], &unitOrder[at + 1], sizeof(int) * (unitCount - at - 1));
+				unitCount--;
+			}
+			break;
+		}
+		if((err == 0) && (unit_check(expect) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "Cache unit test failed after operation %d with %u frame blocks.", op, blockFrames);
+			err = -1;
+		}
+	}
+
+	close_cart_cache();
+	free(buf);
+	free(expect);
+	return(err);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : cartCacheUnitTest
-// Description  : Run a UNIT test checking the cache implementation
+// Description  : Run a UNIT test checking the cache implementation: random
+//                puts, gets and deletes against a model of an LRU cache, of
+//                single frames and of blocks of frames.  The cache's settings
+//                are restored afterwards.
 //
 // Inputs       : none
 // Outputs      : 0 if successful, -1 if failure
 
 int cartCacheUnitTest(void) {
+	uint32_t frames = myCacheFrames, block = myBlockFrames;
+	int err;
+
+	err = ((unit_run(1) == 0) && (unit_run(4) == 0)) ? 0 : -1;
+	set_cart_cache_block(block);
+	set_cart_cache_size(frames);
+	if(err != 0) {
+		return(-1);
+	}
 
 	// Return successfully
 	logMessage(LOG_OUTPUT_LEVEL, "Cache unit test completed successfully.");
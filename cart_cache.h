@@ -23,6 +23,12 @@
 int set_cart_cache_size(uint32_t max_frames);
 	// Set the size of the cache (must be called before init)
 
+int set_cart_cache_block(uint32_t frames);
+	// Set the frames in each entry of the cache (must be called before init)
+
+uint32_t get_cart_cache_size(void);
+	// Get the size of the cache
+
 int init_cart_cache(void);
 	// Initialize the cache 
 
@@ -35,6 +41,9 @@ int put_cart_cache(CartridgeIndex cart, CartFrameIndex frm, void *frame);
 void * get_cart_cache(CartridgeIndex dsk, CartFrameIndex blk);
 	// Get an object from the cache (and return it)
 
+int delete_cart_cache(CartridgeIndex cart, CartFrameIndex blk);
+	// Remove an object from the cache
+
 //
 // Unit test
 
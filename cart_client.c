@@ -12,16 +12,20 @@
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <string.h>
 // Project Include Files
 #include <cart_network.h>
+#include <cart_codec.h>
+#include <cart_probe.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 //#include <cart_driver.h>
 //
 //  Global data
-int 		   client_socket = -1;
+static __thread int client_socket = -1; // Connection to the server (each thread has its own)
+static __thread char batch_buf[CART_NET_MAX_BATCH * (CART_NET_HEADER_SIZE + CART_FRAME_SIZE)]; // Requests of a batch, sent with one write
 int                cart_network_shutdown = 0;   // Flag indicating shutdown
 unsigned char     *cart_network_address = NULL; // Address of CART server
 unsigned short     cart_network_port = 0;       // Port of CART serve
@@ -33,39 +37,80 @@ unsigned long      CartSimulatorLLevel = 0;  // Driver log level (global)
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Structure    : regstate
-// Description  : A structure for the packed registers. Variable "regstate" will be updated each time 
-//                a bus request is called.
+// Function     : client_connect
+// Description  : Connect this thread to the CART server.  Nagle's algorithm is
+//                turned off: every request is a small write waiting on a
+//                reply, so delaying it to coalesce segments only adds latency.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int client_connect(void) {
+	struct sockaddr_in caddr; 
+	int nodelay = 1;
+
+	// Set the address
+	caddr.sin_family = AF_INET;
+	caddr.sin_port = htons((cart_network_port != 0) ? cart_network_port : CART_DEFAULT_PORT);
+	if(inet_aton((cart_network_address != NULL) ? (char *)cart_network_address : CART_DEFAULT_IP, &caddr.sin_addr) == 0) {
+		printf("Error setting the address\n");
+		return -1;
+	}
+
+	// Create the socket
+	client_socket = socket(PF_INET, SOCK_STREAM, 0);
+	if(client_socket == -1) {
+		printf("Error on socket creation\n");
+		return -1;
+	}
+	setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
 
-struct {
-	uint8_t kyOne;
-	uint16_t ctOne;
-	uint16_t fmOne;
-	uint8_t rt;
-} regstate;
+	// Create the Connection
+	if(connect(client_socket, (const struct sockaddr *) &caddr, sizeof(caddr)) == -1) {
+		printf("Error on socket connect\n");
+		close(client_socket);
+		client_socket = -1;
+		return -1;
+	}
+	return 0;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : readBusResponse
-// Description  : Reads the return 64-bit unsigned int from the bus request. Places results in regstate.
-//
-// Inputs       : busResponse - an uint64_t that is used to read each register
-// Outputs      : none
-
-void readBusResponseClient(uint64_t busResponse) { 	
-	uint64_t temp;
-	
-	temp = busResponse & 0xff00000000000000; // Reads key register one
-	regstate.kyOne = temp >> 56;
-
-	temp = busResponse & 0x7fff80000000; // Reads cartridge register one
-	regstate.ctOne = temp >> 31;
-	
-	temp = busResponse & 0x7fff8000; // Reads frame register one
-	regstate.fmOne = temp >> 15;
-	
-	temp = busResponse & 0x800000000000; // Reads return code
-	regstate.rt = temp >> 47;
+// Function     : client_send / client_recv
+// Description  : Write or read exactly len bytes on this thread's connection
+//                (a frame can arrive in more than one segment)
+//
+// Inputs       : data - the bytes to send, or where to place those received
+//                len - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
+
+static int client_send(void *data, size_t len) {
+	ssize_t ret;
+
+	while(len > 0) {
+		if((ret = write(client_socket, data, len)) <= 0) {
+			printf("Error writing network data\n");
+			return -1;
+		}
+		data = (char *)data + ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+static int client_recv(void *data, size_t len) {
+	ssize_t ret;
+
+	while(len > 0) {
+		if((ret = read(client_socket, data, len)) <= 0) {
+			printf("Error reading network data\n");
+			return -1;
+		}
+		data = (char *)data + ret;
+		len -= ret;
+	}
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -74,135 +119,161 @@ void readBusResponseClient(uint64_t busResponse) {
 // Description  : This the client operation that sends a request to the CART
 //                server process.   It will:
 //
-//                1) if INIT make a connection to the server
+//                1) if not yet connected, make this thread's connection
 //                2) send any request to the server, returning results
-//                3) if CLOSE, will close the connection
+//                3) if POWOFF, will close the connection
+//
+//                All state is the caller's or the calling thread's, so
+//                threads can issue requests concurrently.
 //
 // Inputs       : reg - the request reqisters for the command
 //                buf - the block to be read/written from (READ/WRITE)
 // Outputs      : the response structure encoded as needed
 
 CartXferRegister client_cart_bus_request(CartXferRegister reg, void *buf) {
-	struct sockaddr_in caddr; 
 	CartXferRegister registerValue;
-	char bufValue[CART_FRAME_SIZE];	
+	uint8_t opcode;
 
-	if(client_socket == -1) {
-		// Set the address
-		caddr.sin_family = AF_INET;
-		caddr.sin_port = htons(CART_DEFAULT_PORT);
-		if(inet_aton(CART_DEFAULT_IP, &caddr.sin_addr) == 0) {
-			printf("Error setting the address\n");
-			return -1;
-		}
-
-		// Create the socket
-		client_socket = socket(PF_INET, SOCK_STREAM, 0);
-		if(client_socket == -1) {
-			printf("Error on socket creation\n");
-			// printf("Error on socket creation [%s]\n", strerror(errno));
-			return -1;
-		}
-	
-		// Create the Connection
-		if(connect(client_socket, (const struct sockaddr *) &caddr, sizeof(caddr)) == -1) {
-			printf("Error on socket connect\n");
-			// printf("Error on socket connect [%s]\n", strerror(errno));
-			return -1;
-		}
+	if((client_socket == -1) && (client_connect() == -1)) {
+		return -1;
 	}
 
-	readBusResponseClient(reg);
+	// Network Format: Send the register reg (and the frame to write) to the network
+	opcode = cart_register_ky1(reg);
+	CART_PROBE2(net_request, opcode, reg);
 	registerValue = htonll64(reg);	
+	if(client_send(&registerValue, sizeof(registerValue)) == -1) {
+		return -1;
+	}
+	if((opcode == CART_OP_WRFRME) && (client_send(buf, CART_FRAME_SIZE) == -1)) {
+		return -1;
+	}
 
-	// RD Operation
-	if(regstate.kyOne == 3) {
-		// Network Format: Send the register reg to the network after converting the register to 'network format'
-		if(write(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error writing network data\n");
-			// printf("Error writing network data [%s]\n", strerror(errno));
-			return -1;
-		}
-
-		// Host Format: Receive the register reg from the network.  Need to convert the register to 'host format'
-		if(read(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error reading network data\n");
-			// printf("Error reading network data [%s]\n", strerror(errno));
-			return -1;
-		}
+	// Host Format: Receive the register reg (and the frame read) from the network
+	if(client_recv(&registerValue, sizeof(registerValue)) == -1) {
+		return -1;
+	}
+	if((opcode == CART_OP_RDFRME) && (client_recv(buf, CART_FRAME_SIZE) == -1)) {
+		return -1;
+	}
 
-		// Data read from that frame
-		if(read(client_socket, &bufValue, CART_FRAME_SIZE) != CART_FRAME_SIZE) {
-			printf("Error reading network data\n");
-			// printf("Error reading network data [%s]\n", strerror(errno));
-			return -1;
-		}
+	registerValue = ntohll64(registerValue);
+	CART_PROBE2(net_response, opcode, registerValue);
 
-		memcpy(buf, bufValue, CART_FRAME_SIZE);
+	// SHUTDOWN Operation closes the connection
+	if(opcode == CART_OP_POWOFF) {
+		close(client_socket);	
+		client_socket = -1;
 	}
+	return registerValue;
+}
 
-	// WR Operation
-	else if(regstate.kyOne == 4) {
-		// Network Format: Send the register reg to the network after converting the register to 'network format'
-		if(write(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error writing network data\n");
-			// printf("Error writing network data [%s]\n", strerror(errno));
-			return -1;
-		}
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_cart_bus_send
+// Description  : Send a run of requests to the CART server with one write,
+//                without waiting for the responses.  The server answers in
+//                order, so a caller may send several runs before collecting
+//                the responses of the first (client_cart_bus_receive), and
+//                keep the connection busy while they are in flight.  Any
+//                opcode may be sent; only WRFRME carries a frame.
+//
+// Inputs       : regs - the request registers
+//                n - the number of requests (at most CART_NET_MAX_BATCH)
+//                buf - the frames to be written, indexed by request (frame i
+//                      of the buffer for request i, so the slots of the other
+//                      requests are skipped), NULL if none
+// Outputs      : 0 if successful, -1 if failure
 
-		memcpy(bufValue, buf, CART_FRAME_SIZE);
+int client_cart_bus_send(CartXferRegister *regs, int n, void *buf) {
+	CartXferRegister registerValue;
+	size_t len = 0;
+	uint8_t opcode;
+	int i;
 
-		// Data to write to that frame
-		if(write(client_socket, &bufValue, CART_FRAME_SIZE) != CART_FRAME_SIZE) {
-			printf("Error writing network data\n");
-			// printf("Error writing network data [%s]\n", strerror(errno));
-			return -1;
-		}
+	if((n < 1) || (n > CART_NET_MAX_BATCH)) {
+		return -1;
+	}
+	if((client_socket == -1) && (client_connect() == -1)) {
+		return -1;
+	}
 
-		// Host Format: Receive the register reg from the network.  Need to convert the register to 'host format'
-		if(read(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error reading network data\n");
-			// printf("Error reading network data [%s]\n", strerror(errno));
-			return -1;
+	// Network Format: Gather the requests (and the frames to write) and send them together
+	for(i=0; i<n; i++) {
+		opcode = cart_register_ky1(regs[i]);
+		CART_PROBE2(net_request, opcode, regs[i]);
+		registerValue = htonll64(regs[i]);
+		memcpy(&batch_buf[len], &registerValue, sizeof(registerValue));
+		len += sizeof(registerValue);
+		if(opcode == CART_OP_WRFRME) {
+			memcpy(&batch_buf[len], (char *)buf + ((size_t)i * CART_FRAME_SIZE), CART_FRAME_SIZE);
+			len += CART_FRAME_SIZE;
 		}
 	}
+	return client_send(batch_buf, len);
+}
 
-	// SHUTDOWN Operation
-	else if(regstate.kyOne == 5) {
-		// Network Format: Send the register reg to the network after converting the register to 'network format'
-		if(write(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error writing network data\n");
-			// printf("Error writing network data [%s]\n", strerror(errno));
-			return -1;
-		}
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_cart_bus_receive
+// Description  : Collect the responses to a run of requests sent by
+//                client_cart_bus_send (the oldest run not yet collected).
+//                The server answers with Nagle's algorithm on, holding each
+//                response until the last is acknowledged, so every response
+//                is acknowledged at once rather than after the delayed ACK
+//                timeout.
+//
+// Inputs       : regs - the request registers, replaced by the responses
+//                n - the number of requests
+//                buf - where to place the frames read, one after the other
+//                      (frame i of the buffer for request i)
+// Outputs      : 0 if successful, -1 if failure
 
-		// Host Format: Receive the register reg from the network.  Need to convert the register to 'host format'
-		if(read(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error reading network data\n");
-			// printf("Error reading network data [%s]\n", strerror(errno));
-			return -1;
-		}
+int client_cart_bus_receive(CartXferRegister *regs, int n, void *buf) {
+	CartXferRegister registerValue;
+	uint8_t opcode;
+	int i, quickack = 1;
 
-		close(client_socket);	
-		client_socket = -1;
+	if(client_socket == -1) {
+		return -1;
 	}
 
-	// Other
-	else {
-		// Network Format: Send the register reg to the network after converting the register to 'network format'
-		if(write(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error writing network data\n");
-			// printf("Error writing network data [%s]\n", strerror(errno));
+	// Host Format: Receive the responses (and the frames read) in order
+	for(i=0; i<n; i++) {
+		opcode = cart_register_ky1(regs[i]);
+#ifdef TCP_QUICKACK
+		setsockopt(client_socket, IPPROTO_TCP, TCP_QUICKACK, &quickack, sizeof(quickack)); // Cleared by the kernel, so set for each response
+#endif
+		if(client_recv(&registerValue, sizeof(registerValue)) == -1) {
 			return -1;
 		}
-
-		// Host Format: Receive the register reg from the network.  Need to convert the register to 'host format'
-		if(read(client_socket, &registerValue, sizeof(registerValue)) != sizeof(registerValue)) {
-			printf("Error reading network data\n");
-			// printf("Error reading network data [%s]\n", strerror(errno));
+		if((opcode == CART_OP_RDFRME) && (client_recv((char *)buf + ((size_t)i * CART_FRAME_SIZE), CART_FRAME_SIZE) == -1)) {
 			return -1;
 		}
+		regs[i] = ntohll64(registerValue);
+		CART_PROBE2(net_response, opcode, regs[i]);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_cart_bus_batch
+// Description  : Send a run of RDFRME or WRFRME requests to the CART server
+//                with one write, then collect the responses.  This is the
+//                same exchange as n calls of client_cart_bus_request with
+//                one round trip instead of n.  (The requests of a batch are
+//                all written before any response is read, which the socket
+//                buffers absorb at CART_NET_MAX_BATCH frames.)
+//
+// Inputs       : regs - the request registers, replaced by the responses
+//                n - the number of requests (at most CART_NET_MAX_BATCH)
+//                buf - the n frames to be read/written, one after the other
+// Outputs      : 0 if the exchange succeeded, -1 if failure
+
+int client_cart_bus_batch(CartXferRegister *regs, int n, void *buf) {
+	if(client_cart_bus_send(regs, n, buf) == -1) {
+		return -1;
 	}
-	
-	return ntohll64(registerValue);
+	return client_cart_bus_receive(regs, n, buf);
 }
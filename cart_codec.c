@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_codec.c
+//  Description    : This is the unit test for the CART register codec (the
+//                   codec itself is inline, in cart_codec.h).
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdlib.h>
+
+// Project includes
+#include <cmpsc311_log.h>
+#include <cart_codec.h>
+
+// Defines
+#define CART_CODEC_TEST_ITERATIONS 10000 // Random round trips checked
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : spec_mask
+// Description  : Build the mask of a register from the bit numbers used in
+//                the cart_controller.h specification (bit 0 is the top bit)
+//
+// Inputs       : first - the first bit of the register
+//                last - the last bit of the register
+// Outputs      : the mask
+
+static CartXferRegister spec_mask(int first, int last) {
+	CartXferRegister mask = 0;
+	int bit;
+
+	for(bit=first; bit<=last; bit++) {
+		mask |= (CartXferRegister)1 << (63 - bit);
+	}
+	return mask;
+}
+
+//
+// Unit test
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cartCodecUnitTest
+// Description  : Run a UNIT test checking the codec against the documented
+//                layout, round trips and batch encoding
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cartCodecUnitTest(void) {
+	CartRegisterValue regs, back, batch[4];
+	CartXferRegister reg, out[4];
+	unsigned char *bytes;
+	int i;
+
+	// Each register, set to all ones, must land exactly on its documented bits
+	if ((cart_pack_registers(0xff, 0, 0, 0, 0) != spec_mask(0, 7)) ||
+			(cart_pack_registers(0, 0xff, 0, 0, 0) != spec_mask(8, 15)) ||
+			(cart_pack_registers(0, 0, 1, 0, 0) != spec_mask(16, 16)) ||
+			(cart_pack_registers(0, 0, 0, 0xffff, 0) != spec_mask(17, 32)) ||
+			(cart_pack_registers(0, 0, 0, 0, 0xffff) != spec_mask(33, 48))) {
+		logMessage(LOG_ERROR_LEVEL, "Codec unit test failed: register not on its documented bits.");
+		return(-1);
+	}
+
+	// The return code is a single bit, wider values must not spill
+	if (cart_pack_registers(0, 0, 0xff, 0, 0) != spec_mask(16, 16)) {
+		logMessage(LOG_ERROR_LEVEL, "Codec unit test failed: return code spilled.");
+		return(-1);
+	}
+
+	// Decoding ignores the unused bits and the single field getters agree
+	reg = cart_pack_registers(CART_OP_RDFRME, 0, 1, 63, 1023) | spec_mask(49, 63);
+	back = cart_decode_registers(reg);
+	if ((back.ky1 != CART_OP_RDFRME) || (back.ky2 != 0) || (back.rt1 != 1) || (back.ct1 != 63) ||
+			(back.fm1 != 1023) || (cart_register_ky1(reg) != CART_OP_RDFRME) || (cart_register_rt1(reg) != 1)) {
+		logMessage(LOG_ERROR_LEVEL, "Codec unit test failed: bad decode of %016llx.", (unsigned long long)reg);
+		return(-1);
+	}
+
+	// Random round trips
+	for (i=0; i<CART_CODEC_TEST_ITERATIONS; i++) {
+		regs.ky1 = rand() & 0xff;
+		regs.ky2 = rand() & 0xff;
+		regs.rt1 = rand() & 0x1;
+		regs.ct1 = rand() & 0xffff;
+		regs.fm1 = rand() & 0xffff;
+		back = cart_decode_registers(cart_encode_registers(&regs));
+		if ((back.ky1 != regs.ky1) || (back.ky2 != regs.ky2) || (back.rt1 != regs.rt1) ||
+				(back.ct1 != regs.ct1) || (back.fm1 != regs.fm1)) {
+			logMessage(LOG_ERROR_LEVEL, "Codec unit test failed: round trip %d.", i);
+			return(-1);
+		}
+	}
+
+	// Batches are in network order: KY1 is the first byte on the wire
+	for (i=0; i<4; i++) {
+		batch[i].ky1 = CART_OP_WRFRME;
+		batch[i].ky2 = 0;
+		batch[i].rt1 = 0;
+		batch[i].ct1 = i;
+		batch[i].fm1 = 1000 + i;
+	}
+	if (cart_encode_batch(batch, 4, out) != 4 * sizeof(CartXferRegister)) {
+		logMessage(LOG_ERROR_LEVEL, "Codec unit test failed: bad batch length.");
+		return(-1);
+	}
+	for (i=0; i<4; i++) {
+		bytes = (unsigned char *)&out[i];
+		back = cart_decode_registers(cart_register_to_network(out[i]));
+		if ((bytes[0] != CART_OP_WRFRME) || (back.ct1 != i) || (back.fm1 != 1000 + i)) {
+			logMessage(LOG_ERROR_LEVEL, "Codec unit test failed: bad batch entry %d.", i);
+			return(-1);
+		}
+	}
+
+	// Return successfully
+	logMessage(LOG_OUTPUT_LEVEL, "Codec unit test completed successfully.");
+	return(0);
+}
@@ -0,0 +1,151 @@
+#ifndef CART_CODEC_INCLUDED
+#define CART_CODEC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_codec.h
+//  Description    : This is the codec for the packed CART controller register
+//                   (see the CartXferRegister specification in
+//                   cart_controller.h, where bit 0 is the top bit).  The
+//                   functions are inline shifts and masks with no branches, so
+//                   the driver and the client share one definition of the
+//                   layout instead of each hand-coding the masks.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+#include <cart_controller.h>
+
+// Defines (shifts and widths of the registers in the 64-bit value)
+#define CART_KY1_SHIFT 56
+#define CART_KY2_SHIFT 48
+#define CART_RT1_SHIFT 47
+#define CART_CT1_SHIFT 31
+#define CART_FM1_SHIFT 15
+#define CART_KY_MASK 0xffULL
+#define CART_RT_MASK 0x1ULL
+#define CART_CT_MASK 0xffffULL
+#define CART_FM_MASK 0xffffULL
+
+// This is the unpacked value of the controller registers
+typedef struct {
+	uint8_t  ky1; // Key register 1 (the CART_OP_* opcode)
+	uint8_t  ky2; // Key register 2
+	uint8_t  rt1; // Return code register 1 (0 success, 1 failure)
+	uint16_t ct1; // Cartridge register 1
+	uint16_t fm1; // Frame register 1
+} CartRegisterValue;
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_pack_registers
+// Description  : Pack register values into the 64-bit transfer register
+//
+// Inputs       : ky1, ky2, rt1, ct1, fm1 - the register values
+// Outputs      : the packed register
+
+static inline CartXferRegister cart_pack_registers(uint8_t ky1, uint8_t ky2, uint8_t rt1,
+		uint16_t ct1, uint16_t fm1) {
+	return ((CartXferRegister)ky1 << CART_KY1_SHIFT) |
+		((CartXferRegister)ky2 << CART_KY2_SHIFT) |
+		(((CartXferRegister)rt1 & CART_RT_MASK) << CART_RT1_SHIFT) |
+		((CartXferRegister)ct1 << CART_CT1_SHIFT) |
+		((CartXferRegister)fm1 << CART_FM1_SHIFT);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_encode_registers
+// Description  : Pack a register value into the 64-bit transfer register
+//
+// Inputs       : regs - the register value
+// Outputs      : the packed register
+
+static inline CartXferRegister cart_encode_registers(const CartRegisterValue *regs) {
+	return cart_pack_registers(regs->ky1, regs->ky2, regs->rt1, regs->ct1, regs->fm1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_decode_registers
+// Description  : Unpack the 64-bit transfer register
+//
+// Inputs       : reg - the packed register
+// Outputs      : the register value
+
+static inline CartRegisterValue cart_decode_registers(CartXferRegister reg) {
+	CartRegisterValue regs;
+
+	regs.ky1 = (reg >> CART_KY1_SHIFT) & CART_KY_MASK;
+	regs.ky2 = (reg >> CART_KY2_SHIFT) & CART_KY_MASK;
+	regs.rt1 = (reg >> CART_RT1_SHIFT) & CART_RT_MASK;
+	regs.ct1 = (reg >> CART_CT1_SHIFT) & CART_CT_MASK;
+	regs.fm1 = (reg >> CART_FM1_SHIFT) & CART_FM_MASK;
+	return regs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_register_ky1 / cart_register_rt1
+// Description  : Get a single register without unpacking the rest
+//
+// Inputs       : reg - the packed register
+// Outputs      : the register value
+
+static inline uint8_t cart_register_ky1(CartXferRegister reg) {
+	return (reg >> CART_KY1_SHIFT) & CART_KY_MASK;
+}
+
+static inline uint8_t cart_register_rt1(CartXferRegister reg) {
+	return (reg >> CART_RT1_SHIFT) & CART_RT_MASK;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_register_to_network
+// Description  : Convert a packed register to network (big endian) order
+//
+// Inputs       : reg - the packed register
+// Outputs      : the register in network order
+
+static inline CartXferRegister cart_register_to_network(CartXferRegister reg) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return __builtin_bswap64(reg);
+#else
+	return reg;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_encode_batch
+// Description  : Encode a run of requests into a buffer in network order,
+//                ready to be written to the server in one go
+//
+// Inputs       : regs - the requests
+//                n - the number of requests
+//                out - the buffer (n registers)
+// Outputs      : the number of bytes encoded
+
+static inline int cart_encode_batch(const CartRegisterValue *regs, int n, CartXferRegister *out) {
+	int i;
+
+	for(i=0; i<n; i++) {
+		out[i] = cart_register_to_network(cart_encode_registers(&regs[i]));
+	}
+	return n * sizeof(CartXferRegister);
+}
+
+//
+// Unit test
+
+int cartCodecUnitTest(void);
+	// Run a UNIT test checking the codec against the documented layout
+
+#endif
@@ -12,27 +12,35 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 
 // Project Includes
 #include <cart_driver.h>
 #include <cart_controller.h>
+#include <cart_codec.h>
 #include <cart_cache.h>
 #include <cart_network.h>
-//
-// Implementation
+#include <cart_trace.h>
+#include <cart_ring.h>
+#include <cart_probe.h>
+#include <cart_arena.h>
+#include <cart_tier.h>
+#include <cart_shcache.h>
 
-////////////////////////////////////////////////////////////////////////////////
-//
-// Structure    : regstate
-// Description  : A structure for the packed registers. Variable "regstate" will be updated each time 
-//                a bus request is called.
+// Defines
+#define CART_DRIVER_INITIAL_FILES 64  // Entries in the first filesystem table
+#define CART_DRIVER_INITIAL_FRAMES 4  // Entries in a new file's frame lists
+#define CART_DRIVER_COPY_FRAMES 16   // Frames bounced at a time by cart_copy_range
+#define CART_DRIVER_FRAME_KEY(c, f) (((c) * CART_CARTRIDGE_SIZE) + (f)) // Index of a frame in frameShares, frameOwner and frameSlot
+#define CART_DRIVER_LOG_RESERVE 2    // Free cartridges the log layout keeps in reserve for its cleaner
+#define CART_DRIVER_MAX_BLOCK_FRAMES CART_NET_MAX_BATCH // Frames in the largest block (it must fit in one batched transfer)
+#define CART_DRIVER_SHCACHE_FRAMES 4096 // Frames the shared cache holds if no cache size was set
+#define CART_DRIVER_UNWRITTEN(c, f) ((frameUnwritten != NULL) && frameUnwritten[CART_DRIVER_FRAME_KEY(c, f)]) // A frame cart_fallocate reserved that reads as zero
+#define CART_DRIVER_CART(file, i) ((file)->location.occupiedCartridges[(i) >> blockShift]) // Cartridge holding frame i of a file
+#define CART_DRIVER_FRAME(file, i) ((file)->location.occupiedFrames[(i) >> blockShift] + ((i) & (blockFrames - 1))) // Frame number of frame i of a file
 
-struct {
-	uint8_t kyOne;
-	uint16_t ctOne;
-	uint16_t fmOne;
-	uint8_t rt;
-} regstate;
+//
+// Implementation
 
 ////////////////////////////////////////////////////////////////////////////////
 //
@@ -41,93 +49,985 @@ struct {
 //		  created is determined by the number of files that are opened.
 
 typedef struct files {
-	char* fileName;
-	int32_t length;
-	int32_t filePointer;
+	char* fileName; // Interned in the file arena
 	struct location {
 		int cartridges; // Keeps track of number of cartridges that are occupied
 		int* occupiedCartridges; // Number of the cartridges occupied
 		int frames; // Keeps track of number of frames that are occupied
 		int* occupiedFrames; // Number of the frames occupied
+		int capacity; // Entries allocated in occupiedCartridges and occupiedFrames
 	} location;
-	int16_t fileHandle;
 } files;
 
-files *filesystem; // Pointer to the filesystem. It will be alloc when the first file is opened, and expaneded as new files are openeded.
-int fileSystemSize = 0; // Keeps track of the number of files occupying the filesystem.  0 means 1 file exist, 1 mean means 2 files exist, and so on.
-int currentlyLoadedCartridge; // Global int for the cartridge that is currently loaded
+files **filesystem = NULL; // The files, indexed by fileHandle - 1.  The table grows by doubling, the files themselves never move.
+
+// The scalar fields of the files are kept in their own arrays (indexed like
+// the filesystem), so whole-namespace scans walk contiguous memory instead of
+// chasing a pointer per file.  A file is open if it has open descriptions.
+int32_t *fileOpens = NULL; // Open descriptions of each file (0 means closed)
+int32_t *fileLengths = NULL; // Length of each file
+uint32_t *fileNameHashes = NULL; // Hash of each file's name (see hash_name)
+int fileCount = 0; // Number of files in the filesystem
+int fileCapacity = 0; // Number of entries in the filesystem table
+int32_t *nameTable = NULL; // Open addressing hash table of the file names, holds the file index + 1 (0 is empty)
+int nameTableSize = 0; // Number of slots in the nameTable (a power of 2)
+
+// Each cart_open makes an open file description, with its own position and
+// access mode, referring to the file.  A handle is its description's index + 1.
+// Any number of descriptions may refer to the same file, which holds the state
+// they share (the length and frames).  Reads through read-only descriptions
+// may run in several threads at once (see cart_read).
+int32_t *descFiles = NULL; // File index of each description, -1 if the description is free
+int32_t *descPointers = NULL; // Position of each description (for a free one, the next free description or -1)
+uint8_t *descModes = NULL; // Access mode of each description (CART_OPEN_READ and CART_OPEN_WRITE bits)
+int descCount = 0; // Number of descriptions ever used
+int descCapacity = 0; // Number of entries in the description arrays
+int32_t descFree = -1; // First free description, -1 if none
+CartArena fileArena; // All of the file metadata above is allocated from this arena, and released at poweroff
+__thread int currentlyLoadedCartridge = -1; // The cartridge loaded on this thread's connection (each thread has its own connection)
+pthread_mutex_t readLock = PTHREAD_MUTEX_INITIALIZER; // Held by the reads of read-only descriptions, except while they wait on the bus
+__thread int readLockHeld = 0; // Non-zero while this thread's cart_read holds readLock
+__thread int readBusUnlocked = 0; // Non-zero while this thread's bus requests let go of readLock (see read_frame)
 int nextFrame = 0; // Number of the next empty frame to write to
 int nextCartridge = 0; // Number of the next cartridge with empty frames
+int cartridgeBudget = CART_MAX_CARTRIDGES; // Cartridges files may use from the next poweron (see cart_set_cartridges)
+int driverCartridges = CART_MAX_CARTRIDGES; // Cartridges files may use (the first ones)
+CartDriverStats driverStats; // Counters reported by cart_driver_stats
+CartDriverLayout driverLayout = CART_LAYOUT_INPLACE; // Layout of the file frames from the next poweron (see cart_set_layout)
+
+// The log layout writes every frame at the head of the log (nextCartridge/nextFrame), so a cartridge is a
+// segment of the log.  These track which frames are live, so the cleaner can empty a segment for reuse.
+int32_t *frameOwner = NULL; // File index owning each frame, -1 if the frame is dead or was never written
+int32_t *frameSlot = NULL; // Position of each frame in its owner's frame list
+uint16_t segmentLive[CART_MAX_CARTRIDGES]; // Live frames on each cartridge
+int logCleaning = 0; // Non-zero while the cleaner is moving frames (it does not clean recursively)
+static int next_log_segment(void);
+static int allocate_head_frame(int fileSystemIndex, int slot, int *cartridge, int *frame);
+uint8_t *frameUnwritten = NULL; // Non-zero for each frame reserved by cart_fallocate and not written since (it reads as zero without a bus read), allocated by the first cart_fallocate
+int holeCartridge, holeFrame, holeFrames = 0; // Frames skipped so a cart_fallocate run could start on a fresh cartridge, used by the next single frame allocations
+uint16_t *frameShares = NULL; // Number of extra files each frame is shared with by cart_copy_range (0 means only one file uses it), allocated by the first copy
+
+// Files are made of logical blocks of blockFrames consecutive frames on one cartridge.  The frame lists hold
+// one entry per block (use CART_DRIVER_CART/CART_DRIVER_FRAME), the allocator hands out whole blocks, the cache
+// holds whole blocks keyed by their first frame, and a block is moved over the bus with one batched transfer.
+int blockSizeFrames = 1; // Frames per block from the next poweron (see cart_set_block_size)
+int blockFrames = 1; // Frames per block (a power of 2)
+int blockShift = 0; // log2 of blockFrames
+char *blockBuf = NULL; // The last block read from the bus when blocks are larger than a frame, so reads of its other frames do not go back to the bus if the cache is off or dropped it
+int blockBufCartridge = -1, blockBufFrame; // The cartridge and first frame of the block in blockBuf (-1 if none)
+
+// The local tier (see cart_tier.h) keeps the hot extents in a file on a local disk.  read_frame and write_frames
+// use it instead of the bus for the frames of those extents, and each operation runs a step of its migration.
+char *tierStorePath = NULL; // The local store from the next poweron, NULL for none (see cart_set_tier)
+uint32_t tierStoreExtents = CART_TIER_DEFAULT_EXTENTS; // The extents it holds
+char *tierExtentBuf = NULL; // An extent on its way from CART to the local store
+
+// The shared cache (see cart_shcache.h) replaces the private one, so the processes of a host using the same
+// segment read a block from the bus once between them.  A copy is only good while its token is current.
+char *sharedCacheName = NULL; // The segment from the next poweron, NULL for none (see cart_set_shared_cache)
+int sharedCache = 0; // Non-zero if the shared cache is on
+uint64_t blockBufToken = CART_SHCACHE_NO_TOKEN; // The shared cache token of the block in blockBuf
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : generateBusRequest
-// Description  : This function generates the registers need to communicate with the HRAM bus.
+// Function     : driver_malloc
+// Description  : malloc, counted in the driver statistics
 //
-// Inputs       : busResponse - an uint64_t that is used to read each register
-// Outputs      : unint64_t - sent to the cart_io_bus
+// Inputs       : size - number of bytes to allocate
+// Outputs      : pointer to the memory, NULL if failure
 
-uint64_t generateBusRequest() {
-	uint64_t toReturn = 0; // Zero out 64-bit unsigned int. Return code zeroed out.
-	uint64_t temp = 0;
+static void * driver_malloc(size_t size) {
+	driverStats.allocations++;
+	return malloc(size);
+}
 
-	temp = regstate.kyOne; // Key register one. No key register two for this project.
-	temp = temp << 56;
-	toReturn = temp;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : hash_name
+// Description  : Hash a file name (FNV-1a)
+//
+// Inputs       : name - the file name
+// Outputs      : the hash
 
-	temp = regstate.ctOne; // Cartridge register one.
-	temp = temp << 31;
-	toReturn = toReturn + temp;
+static uint32_t hash_name(const char *name) {
+	uint32_t hash = 2166136261u;
 
-	temp = regstate.fmOne; // Frame register one
-	temp = temp << 15;
-	toReturn = toReturn + temp;
+	while(*name != '\0') {
+		hash = (hash ^ (uint8_t)*name++) * 16777619u;
+	}
+	return hash;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_file
+// Description  : Look a file up by name in the nameTable
+//
+// Inputs       : path - the file name
+//                hash - hash_name(path)
+// Outputs      : index of the file in the filesystem, -1 if it doesn't exist
 
-	return toReturn;
+static int find_file(const char *path, uint32_t hash) {
+	uint32_t slot;
+	int i;
+
+	if(nameTable == NULL) {
+		return -1;
+	}
+	for(slot = hash & (nameTableSize - 1); nameTable[slot] != 0; slot = (slot + 1) & (nameTableSize - 1)) {
+		i = nameTable[slot] - 1;
+		if((fileNameHashes[i] == hash) && (strcmp(path, filesystem[i]->fileName) == 0)) {
+			return i;
+		}
+	}
+	return -1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : readBusResponse
-// Description  : Reads the return 64-bit unsigned int from the bus request. Places results in regstate.
+// Function     : grow_array
+// Description  : Allocate a bigger copy of one of the filesystem arrays
 //
-// Inputs       : busResponse - an uint64_t that is used to read each register
-// Outputs      : none
+// Inputs       : old - the array (fileCount entries used, may be NULL)
+//                elem - bytes per entry
+//                size - entries in the new array
+// Outputs      : the new array, NULL if failure
 
-void readBusResponse(uint64_t busResponse) { 	
-	uint64_t temp;
-	
-	temp = busResponse & 0xff00000000000000; // Reads key register one
-	regstate.kyOne = temp >> 56;
+static void * grow_array(void *old, size_t elem, int size) {
+	void *array;
 
-	temp = busResponse & 0x7fff80000000; // Reads cartridge register one
-	regstate.ctOne = temp >> 31;
-	
-	temp = busResponse & 0x7fff8000; // Reads frame register one
-	regstate.fmOne = temp >> 15;
-	
-	temp = busResponse & 0x800000000000; // Reads return code
-	regstate.rt = temp >> 47;
+	if(((array = cart_arena_alloc(&fileArena, elem * size)) != NULL) && (fileCount > 0)) {
+		memcpy(array, old, elem * fileCount);
+	}
+	return array;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_file
+// Description  : Create a new, closed, empty file
+//
+// Inputs       : path - the file name
+//                hash - hash_name(path)
+// Outputs      : index of the file in the filesystem, -1 if failure
+
+static int add_file(const char *path, uint32_t hash) {
+	files **table, *file;
+	int32_t *names, *lengths, *opens;
+	uint32_t slot, *hashes;
+	int i, size;
+
+	// Double the filesystem table and the field arrays when they are full
+	// (only the pointers and scalars move, the files themselves stay put)
+	if(fileCount == fileCapacity) {
+		size = (fileCapacity == 0) ? CART_DRIVER_INITIAL_FILES : fileCapacity * 2;
+		if(((table = grow_array(filesystem, sizeof(files *), size)) == NULL) ||
+				((opens = grow_array(fileOpens, sizeof(int32_t), size)) == NULL) ||
+				((lengths = grow_array(fileLengths, sizeof(int32_t), size)) == NULL) ||
+				((hashes = grow_array(fileNameHashes, sizeof(uint32_t), size)) == NULL)) {
+			printf("cart_open: Error allocating filesystem\n");
+			return -1;
+		}
+		filesystem = table;
+		fileOpens = opens;
+		fileLengths = lengths;
+		fileNameHashes = hashes;
+		fileCapacity = size;
+	}
+
+	// Keep the nameTable at most half full, rehashing into a bigger one
+	if((fileCount + 1) * 2 > nameTableSize) {
+		size = (nameTableSize == 0) ? CART_DRIVER_INITIAL_FILES * 2 : nameTableSize * 2;
+		if((names = cart_arena_alloc(&fileArena, sizeof(int32_t) * size)) == NULL) {
+			printf("cart_open: Error allocating file name table\n");
+			return -1;
+		}
+		for(i = 0; i < fileCount; i++) {
+			for(slot = fileNameHashes[i] & (size - 1); names[slot] != 0; slot = (slot + 1) & (size - 1));
+			names[slot] = i + 1;
+		}
+		nameTable = names;
+		nameTableSize = size;
+	}
+
+	// Allocate the file, its name and its frame lists
+	file = cart_arena_alloc(&fileArena, sizeof(files));
+	if((file == NULL) || ((file->fileName = cart_arena_strdup(&fileArena, path)) == NULL) ||
+			((file->location.occupiedFrames = cart_arena_alloc(&fileArena, sizeof(int) * CART_DRIVER_INITIAL_FRAMES)) == NULL) ||
+			((file->location.occupiedCartridges = cart_arena_alloc(&fileArena, sizeof(int) * CART_DRIVER_INITIAL_FRAMES)) == NULL)) {
+		printf("cart_open: Error allocating file %d\n", fileCount);
+		return -1;
+	}
+	file->location.capacity = CART_DRIVER_INITIAL_FRAMES;
+
+	// Add it to the table, the field arrays and the nameTable
+	for(slot = hash & (nameTableSize - 1); nameTable[slot] != 0; slot = (slot + 1) & (nameTableSize - 1));
+	nameTable[slot] = fileCount + 1;
+	filesystem[fileCount] = file;
+	fileOpens[fileCount] = 0;
+	fileLengths[fileCount] = 0;
+	fileNameHashes[fileCount] = hash;
+	return fileCount++;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_description
+// Description  : Make a new open file description, reusing a free one if
+//                there is one
+//
+// Inputs       : fileSystemIndex - the file it refers to
+//                mode - the access mode
+// Outputs      : index of the description, -1 if failure
+
+static int add_description(int fileSystemIndex, uint8_t mode) {
+	int32_t *files, *pointers;
+	uint8_t *modes;
+	int d, size;
+
+	if(descFree != -1) {
+		d = descFree;
+		descFree = descPointers[d];
+	}
+	else {
+		// Handles are int16_t, which limits the number of open descriptions
+		if(descCount >= INT16_MAX) {
+			printf("cart_open: Too many open files (%d)\n", descCount);
+			return -1;
+		}
+		if(descCount == descCapacity) {
+			size = (descCapacity == 0) ? CART_DRIVER_INITIAL_FILES : descCapacity * 2;
+			files = cart_arena_alloc(&fileArena, sizeof(int32_t) * size);
+			pointers = cart_arena_alloc(&fileArena, sizeof(int32_t) * size);
+			modes = cart_arena_alloc(&fileArena, sizeof(uint8_t) * size);
+			if((files == NULL) || (pointers == NULL) || (modes == NULL)) {
+				printf("cart_open: Error allocating the open file table\n");
+				return -1;
+			}
+			if(descCount > 0) {
+				memcpy(files, descFiles, sizeof(int32_t) * descCount);
+				memcpy(pointers, descPointers, sizeof(int32_t) * descCount);
+				memcpy(modes, descModes, sizeof(uint8_t) * descCount);
+			}
+			descFiles = files;
+			descPointers = pointers;
+			descModes = modes;
+			descCapacity = size;
+		}
+		d = descCount++;
+	}
+	descFiles[d] = fileSystemIndex;
+	descPointers[d] = 0;
+	descModes[d] = mode;
+	fileOpens[fileSystemIndex]++;
+	return d;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : file_index
+// Description  : Find a file from the handle of an open description
+//
+// Inputs       : fd - the file handle
+// Outputs      : index of the file in the filesystem, -1 if the handle is bad
+//                or not open
+
+static int file_index(int16_t fd) {
+	if((fd < 1) || (fd > descCount)) {
+		return -1;
+	}
+	return descFiles[fd - 1];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : grow_locations
+// Description  : Make room in a file's frame lists for location.frames + 1
+//                entries, doubling them as needed
+//
+// Inputs       : file - the file
+// Outputs      : 0 if successful, -1 if failure
+
+static int grow_locations(files *file) {
+	int *frames, *cartridges, size;
+
+	if((file->location.frames >> blockShift) < file->location.capacity) {
+		return 0;
+	}
+	size = file->location.capacity * 2;
+	frames = cart_arena_alloc(&fileArena, sizeof(int) * size);
+	cartridges = cart_arena_alloc(&fileArena, sizeof(int) * size);
+	if((frames == NULL) || (cartridges == NULL)) {
+		return -1;
+	}
+	memcpy(frames, file->location.occupiedFrames, sizeof(int) * file->location.capacity);
+	memcpy(cartridges, file->location.occupiedCartridges, sizeof(int) * file->location.capacity);
+	file->location.occupiedFrames = frames;
+	file->location.occupiedCartridges = cartridges;
+	file->location.capacity = size;
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : runBusRequest
-// Description  : Runs a bus request using the parameters passed to it.
+// Description  : Runs a bus request using the parameters passed to it. The
+//                response registers go to the caller, not to shared state, so
+//                requests from different threads do not overwrite each other.
 //
-// Inputs       : kyOne - int for key register one
+// Inputs       : response - where to place the response registers (may be NULL)
+//		: kyOne - int for key register one
 //		: ctOne - int for cartridge register one
 //		: fmOne - int for frame register one
 //		: buf - Buffur for reading or writing
+// Outputs      : 0 if successful, -1 if the controller returned a failure
+
+static int runBusRequest(CartRegisterValue *response, uint8_t kyOne, uint16_t ctOne, uint16_t fmOne, void *buf) { 	
+	CartRegisterValue regs;
+
+	// Pack the registers, send the request and unpack the response (letting
+	// the other readers run while a reader waits on its own connection)
+	CART_PROBE3(bus_entry, kyOne, ctOne, fmOne);
+	if(readBusUnlocked) {
+		pthread_mutex_unlock(&readLock);
+	}
+	regs = cart_decode_registers(client_cart_bus_request(cart_pack_registers(kyOne, 0, 0, ctOne, fmOne), buf));
+	if(readBusUnlocked) {
+		pthread_mutex_lock(&readLock);
+	}
+	CART_PROBE2(bus_return, kyOne, regs.rt1);
+	if(response != NULL) {
+		*response = regs;
+	}
+	if(kyOne < CART_OP_MAXVAL) {
+		driverStats.busOps[kyOne]++;
+	}
+	CART_TRACE(CART_TRACE_BUS, kyOne, (kyOne == CART_OP_LDCART) ? ctOne : currentlyLoadedCartridge, fmOne, 0, regs.rt1);
+	CART_RING(CART_RING_LEVEL_BUS, CART_RING_BUS, kyOne, (kyOne == CART_OP_LDCART) ? ctOne : currentlyLoadedCartridge, fmOne, regs.rt1);
+	return (regs.rt1 == 0) ? 0 : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : runBusBatch
+// Description  : Runs the same frame request (RDFRME or WRFRME) on a run of
+//                consecutive frames of the loaded cartridge as one batched
+//                transfer (see client_cart_bus_batch)
+//
+// Inputs       : kyOne - int for key register one
+//                fmOne - the first frame
+//                n - the number of frames (at most CART_NET_MAX_BATCH)
+//                buf - the frames, one after the other
+// Outputs      : 0 if successful, -1 if the controller returned a failure
+
+static int runBusBatch(uint8_t kyOne, uint16_t fmOne, int n, void *buf) {
+	CartXferRegister regs[CART_NET_MAX_BATCH];
+	CartRegisterValue response;
+	int i, failed = 0;
+
+	if(n == 1) {
+		return runBusRequest(NULL, kyOne, 0, fmOne, buf);
+	}
+	for(i=0; i<n; i++) {
+		regs[i] = cart_pack_registers(kyOne, 0, 0, 0, fmOne + i);
+	}
+	CART_PROBE3(bus_entry, kyOne, 0, fmOne);
+	if(client_cart_bus_batch(regs, n, buf) != 0) {
+		return -1;
+	}
+	for(i=0; i<n; i++) {
+		response = cart_decode_registers(regs[i]);
+		driverStats.busOps[kyOne]++;
+		CART_TRACE(CART_TRACE_BUS, kyOne, currentlyLoadedCartridge, fmOne + i, 0, response.rt1);
+		CART_RING(CART_RING_LEVEL_BUS, CART_RING_BUS, kyOne, currentlyLoadedCartridge, fmOne + i, response.rt1);
+		failed |= (response.rt1 != 0);
+	}
+	CART_PROBE2(bus_return, kyOne, failed);
+	return failed ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : tier_writeback
+// Description  : Write a run of frames demoted from the local tier back to
+//                CART (the writeback of cart_tier_admit and cart_tier_step)
+//
+// Inputs       : cartridge, frame - the first frame
+//                n - the number of frames
+//                data - the frames
+// Outputs      : 0 if successful, -1 if failure
+
+static int tier_writeback(int cartridge, int frame, int n, void *data) {
+	if(currentlyLoadedCartridge != cartridge) {
+		if(runBusRequest(NULL, CART_OP_LDCART, cartridge, 0, NULL) != 0) {
+			printf("tier_writeback: Error loading cartridge %d\n", cartridge);
+			return -1;
+		}
+		currentlyLoadedCartridge = cartridge;
+	}
+	if(runBusBatch(CART_OP_WRFRME, frame, n, data) != 0) {
+		printf("tier_writeback: error writing to frame %d\n", frame);
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : promote_extent
+// Description  : Copy the extent holding a frame from CART to the local tier
+//                (one batched read), if the tier takes it
+//
+// Inputs       : cartridge, frame - the frame
+// Outputs      : 0 if successful, -1 if failure
+
+static int promote_extent(int cartridge, int frame) {
+	int first = frame - (frame % CART_TIER_EXTENT_FRAMES);
+
+	if(currentlyLoadedCartridge != cartridge) {
+		if(runBusRequest(NULL, CART_OP_LDCART, cartridge, 0, NULL) != 0) {
+			return -1;
+		}
+		currentlyLoadedCartridge = cartridge;
+	}
+	if(runBusBatch(CART_OP_RDFRME, first, CART_TIER_EXTENT_FRAMES, tierExtentBuf) != 0) {
+		return -1;
+	}
+	return (cart_tier_admit(cartridge, first, tierExtentBuf, tier_writeback) < 0) ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_frame
+// Description  : Get a frame of a file, from the cache if it is there and
+//                otherwise from the bus.  A block larger than a frame is
+//                read whole, in one batched transfer, and cached, so the
+//                reads of its other frames do not go back to the bus.
+//
+// Inputs       : fileSystemIndex - the file
+//                index - the frame of the file
+//                frameBuf - a frame the data may be read into
+//                caller - the function to name in error messages
+// Outputs      : pointer to the frame's data (frameBuf or a cached copy), NULL if failure
+
+static char * read_frame(int fileSystemIndex, int index, char *frameBuf, const char *caller) {
+	files *file = filesystem[fileSystemIndex];
+	int cartridge = CART_DRIVER_CART(file, index), frame = CART_DRIVER_FRAME(file, index);
+	int first = frame - (index & (blockFrames - 1)); // The block's first frame, which the cache keys it by
+	uint64_t token;
+	char *cached;
+
+	// A reserved frame that was never written reads as zero
+	if(CART_DRIVER_UNWRITTEN(cartridge, frame)) {
+		memset(frameBuf, 0x0, CART_FRAME_SIZE);
+		return frameBuf;
+	}
+	if(!sharedCache && ((cached = get_cart_cache(cartridge, first)) != NULL)) {
+		driverStats.cacheHits++;
+		return &cached[(frame - first) * CART_FRAME_SIZE];
+	}
+	if((blockBufCartridge == cartridge) && (blockBufFrame == first) && (!sharedCache || cart_shcache_valid(cartridge, first, blockBufToken))) {
+		driverStats.cacheHits++;
+		return &blockBuf[(frame - first) * CART_FRAME_SIZE];
+	}
+
+	// A shared block is copied out, as another process may replace it
+	if(sharedCache) {
+		if(blockFrames == 1) {
+			if(cart_shcache_get(cartridge, first, frameBuf, NULL)) {
+				driverStats.cacheHits++;
+				return frameBuf;
+			}
+		}
+		else {
+			blockBufCartridge = -1;
+			if(cart_shcache_get(cartridge, first, blockBuf, &blockBufToken)) {
+				driverStats.cacheHits++;
+				blockBufCartridge = cartridge;
+				blockBufFrame = first;
+				return &blockBuf[(frame - first) * CART_FRAME_SIZE];
+			}
+		}
+	}
+	driverStats.cacheMisses++;
+
+	// Then the local tier, copying the frame's extent there first if it has become hot
+	if(cart_tier_touch(cartridge, frame, fileSystemIndex) && (promote_extent(cartridge, frame) != 0)) {
+		printf("%s: Error promoting cartridge %d frame %d to the local tier\n", caller, cartridge, frame);
+		return NULL;
+	}
+	if(cart_tier_resident(cartridge, frame)) {
+		if(blockFrames == 1) {
+			return (cart_tier_read(cartridge, frame, 1, frameBuf) == 0) ? frameBuf : NULL;
+		}
+		blockBufCartridge = -1;
+		if(cart_tier_read(cartridge, first, blockFrames, blockBuf) != 0) {
+			return NULL;
+		}
+		blockBufCartridge = cartridge;
+		blockBufFrame = first;
+		put_cart_cache(cartridge, first, blockBuf);
+		return &blockBuf[(frame - first) * CART_FRAME_SIZE];
+	}
+
+	// A single frame read into the caller's buffer shares nothing while on the
+	// bus (the connection and loaded cartridge are this thread's), so a reader
+	// holding readLock lets it go meanwhile.  Blocks go through blockBuf, and
+	// the shared cache and tier have state of their own, so those keep it.
+	readBusUnlocked = readLockHeld && (blockFrames == 1) && !sharedCache && !cart_tier_enabled();
+
+	// Load cartridge file is located in if it isn't already loaded 
+	if(currentlyLoadedCartridge != cartridge) {
+		if(runBusRequest(NULL, CART_OP_LDCART, cartridge, 0, NULL) != 0) {
+			readBusUnlocked = 0;
+			printf("%s: Error loading cartridge %d\n", caller, cartridge);
+			return NULL;
+		}
+		currentlyLoadedCartridge = cartridge;
+	}
+	token = cart_shcache_fill_begin(cartridge, first); // Before the read, so a write racing it leaves the fill stale
+	if(blockFrames == 1) {
+		if(runBusRequest(NULL, CART_OP_RDFRME, 0, frame, frameBuf) != 0) {
+			readBusUnlocked = 0;
+			printf("%s: failed to read cartridge %d frame %d\n", caller, cartridge, frame);
+			return NULL;
+		}
+		readBusUnlocked = 0;
+		cart_shcache_fill(cartridge, frame, token, frameBuf);
+		return frameBuf;
+	}
+	readBusUnlocked = 0;
+	blockBufCartridge = -1;
+	if(runBusBatch(CART_OP_RDFRME, first, blockFrames, blockBuf) != 0) {
+		printf("%s: failed to read cartridge %d frames %d-%d\n", caller, cartridge, first, first + blockFrames - 1);
+		return NULL;
+	}
+	blockBufCartridge = cartridge;
+	blockBufFrame = first;
+	if(sharedCache) {
+		cart_shcache_fill(cartridge, first, token, blockBuf);
+		blockBufToken = token;
+	}
+	else {
+		put_cart_cache(cartridge, first, blockBuf);
+	}
+	return &blockBuf[(frame - first) * CART_FRAME_SIZE];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_frames
+// Description  : Write a run of frames of a file, all in one block, to the
+//                cache and (in one batched transfer) the bus, or the local
+//                tier if their extent is there
+//
+// Inputs       : fileSystemIndex - the file
+//                index - the first frame of the file to write
+//                n - the number of frames (they may not cross a block)
+//                data - the frames, one after the other
+//                caller - the function to name in error messages
+// Outputs      : 0 if successful, -1 if failure
+
+static int write_frames(int fileSystemIndex, int index, int n, char *data, const char *caller) {
+	files *file = filesystem[fileSystemIndex];
+	int cartridge = CART_DRIVER_CART(file, index), frame = CART_DRIVER_FRAME(file, index);
+	int first = frame - (index & (blockFrames - 1)), i;
+	int hot = !logCleaning && cart_tier_touch(cartridge, frame, fileSystemIndex), local = cart_tier_resident(cartridge, frame);
+	int inBuf = (blockFrames > 1) && (blockBufCartridge == cartridge) && (blockBufFrame == first);
+	int bufCurrent = inBuf && cart_shcache_valid(cartridge, first, blockBufToken);
+	uint64_t ticket = CART_SHCACHE_NO_TOKEN, token;
+	char *cached;
+
+	// Load cartridge file is located in if it isn't already loaded 
+	if(!local && (currentlyLoadedCartridge != cartridge)) {
+		if(runBusRequest(NULL, CART_OP_LDCART, cartridge, 0, NULL) != 0) {
+			printf("%s: Error loading cartridge %d\n", caller, cartridge);
+			return -1;
+		}
+		currentlyLoadedCartridge = cartridge;
+	}
+
+	// Place the frames into the cache (which copies them); a block is only added whole, a part of one
+	// updates the cached block, if there is one.  Then write them to the bus.  (The shared cache is
+	// told before and after the bus write, see below.)
+	if(sharedCache) {
+		ticket = cart_shcache_write_begin(cartridge, first);
+	}
+	else if(blockFrames == 1) {
+		put_cart_cache(cartridge, frame, data);
+	}
+	else if((cached = get_cart_cache(cartridge, first)) != NULL) {
+		memcpy(&cached[(frame - first) * CART_FRAME_SIZE], data, CART_FRAME_SIZE * n);
+	}
+	else if(n == blockFrames) {
+		put_cart_cache(cartridge, first, data);
+	}
+	if(inBuf) {
+		memcpy(&blockBuf[(frame - first) * CART_FRAME_SIZE], data, CART_FRAME_SIZE * n);
+	}
+	if(local) {
+		if(cart_tier_write(cartridge, frame, n, data) != 0) {
+			return -1;
+		}
+	}
+	else {
+		if(runBusBatch(CART_OP_WRFRME, frame, n, data) != 0) {
+			printf("%s: error writing to frame %d\n", caller, frame);
+			cart_shcache_write_end(cartridge, first, ticket, NULL);
+			return -1;
+		}
+		if(hot && (promote_extent(cartridge, frame) != 0)) {
+			printf("%s: Error promoting cartridge %d frame %d to the local tier\n", caller, cartridge, frame);
+			return -1;
+		}
+	}
+
+	// A whole block is shared as written.  Part of one is shared from blockBuf, if it held the block
+	// current before this write and no other process wrote it since (the token moved on just once).
+	if(sharedCache) {
+		token = cart_shcache_write_end(cartridge, first, ticket, (n == blockFrames) ? data : NULL);
+		if((n < blockFrames) && bufCurrent && (token != CART_SHCACHE_NO_TOKEN) && (token == blockBufToken + 1)) {
+			cart_shcache_fill(cartridge, first, token, blockBuf);
+		}
+		if(inBuf) {
+			blockBufToken = ((n == blockFrames) || bufCurrent) ? token : CART_SHCACHE_NO_TOKEN;
+		}
+	}
+	if(frameUnwritten != NULL) {
+		for(i=0; i<n; i++) {
+			frameUnwritten[CART_DRIVER_FRAME_KEY(cartridge, frame + i)] = 0;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocate_frame
+// Description  : Take the next free block (blockFrames consecutive frames of
+//                one cartridge, a single frame unless cart_set_block_size
+//                said otherwise) for a file.  Blocks are handed out in order
+//                (after any a cart_fallocate run skipped over in place); in
+//                the log layout the frame is recorded as live and a full
+//                cartridge moves the head of the log to a free one (running
+//                the cleaner if few are left).
+//
+// Inputs       : fileSystemIndex - the file the block is for
+//                slot - the position of the block in the file's frame list
+//                cartridge, frame - where to place the first frame taken
+// Outputs      : 0 if successful, -1 if failure
+
+static int allocate_frame(int fileSystemIndex, int slot, int *cartridge, int *frame) {
+	// Fill the frames a cart_fallocate run skipped first
+	if((driverLayout == CART_LAYOUT_INPLACE) && (holeFrames > 0)) {
+		*cartridge = holeCartridge;
+		*frame = holeFrame;
+		holeFrame += blockFrames;
+		holeFrames -= blockFrames;
+		return 0;
+	}
+	return allocate_head_frame(fileSystemIndex, slot, cartridge, frame);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : allocate_head_frame
+// Description  : Take the block at the allocation cursor (the head of the log
+//                in the log layout), see allocate_frame
+//
+// Inputs       : fileSystemIndex - the file the block is for
+//                slot - the position of the block in the file's frame list
+//                cartridge, frame - where to place the first frame taken
+// Outputs      : 0 if successful, -1 if failure
+
+static int allocate_head_frame(int fileSystemIndex, int slot, int *cartridge, int *frame) {
+	int i;
+
+	if(nextCartridge >= driverCartridges) {
+		printf("allocate_frame: out of frames\n");
+		return -1;
+	}
+	*cartridge = nextCartridge;
+	*frame = nextFrame;
+	if(frameUnwritten != NULL) {
+		for(i=0; i<blockFrames; i++) {
+			frameUnwritten[CART_DRIVER_FRAME_KEY(*cartridge, *frame + i)] = 0; // The log layout reuses frames
+		}
+	}
+	if(driverLayout == CART_LAYOUT_LOG) {
+		frameOwner[CART_DRIVER_FRAME_KEY(*cartridge, *frame)] = fileSystemIndex;
+		frameSlot[CART_DRIVER_FRAME_KEY(*cartridge, *frame)] = slot;
+		segmentLive[*cartridge]++;
+	}
+
+	// If the nextFrame is out of the scope of the current cartridge, move to the next cartridge, and set the frame back to zero.
+	// (A cartridge holds a whole number of blocks, so a block never straddles two.)
+	nextFrame += blockFrames;
+	if(nextFrame == CART_CARTRIDGE_SIZE) {
+		nextFrame = 0;
+		if(driverLayout == CART_LAYOUT_LOG) {
+			next_log_segment(); // A failure leaves nextCartridge out of range, failing the next allocation
+		}
+		else {
+			nextCartridge++;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : retire_frame
+// Description  : Mark a frame of the log layout dead (it was superseded), and
+//                drop it from the cache
+//
+// Inputs       : cartridge, frame - the frame
 // Outputs      : none
 
-void runBusRequest(uint8_t kyOne, uint16_t ctOne, uint16_t fmOne, void *buf) { 	
-	regstate.kyOne = kyOne; // Assigns key register one
-	regstate.ctOne = ctOne; // Assigns cartridge register one
-	regstate.fmOne = fmOne; // Assigns frame register one
-	regstate.rt = 0; 
+static void retire_frame(int cartridge, int frame) {
+	if((driverLayout == CART_LAYOUT_LOG) && (frameOwner[CART_DRIVER_FRAME_KEY(cartridge, frame)] != -1)) {
+		frameOwner[CART_DRIVER_FRAME_KEY(cartridge, frame)] = -1;
+		segmentLive[cartridge]--;
+		if(!sharedCache) {
+			delete_cart_cache(cartridge, frame); // A dead frame would only push live ones out of the cache
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clean_log_segment
+// Description  : Empty a cartridge of the log layout by reading its live
+//                frames (from the cache where possible) and rewriting them at
+//                the head of the log
+//
+// Inputs       : victim - the cartridge to empty
+// Outputs      : 0 if successful, -1 if failure
+
+static int clean_log_segment(int victim) {
+	int frames[CART_CARTRIDGE_SIZE], count = 0, i, j, owner, slot, cartridge, frame;
+	char *localBuf;
+	void *cached;
 
-	readBusResponse(client_cart_bus_request(generateBusRequest(), buf)); // Call readBusResponse to read the returned 64-bit unsigned int.
+	if((localBuf = driver_malloc((size_t)segmentLive[victim] * CART_FRAME_SIZE)) == NULL) {
+		return -1;
+	}
+
+	// Gather the live frames, with a single cartridge load for the ones not cached
+	for(i=0; i<CART_CARTRIDGE_SIZE; i++) {
+		if(frameOwner[CART_DRIVER_FRAME_KEY(victim, i)] == -1) {
+			continue;
+		}
+		if(CART_DRIVER_UNWRITTEN(victim, i)) {
+			memset(&localBuf[count * CART_FRAME_SIZE], 0x0, CART_FRAME_SIZE);
+		}
+		else if(sharedCache && cart_shcache_get(victim, i, &localBuf[count * CART_FRAME_SIZE], NULL)) {
+			// Copied out of the shared cache
+		}
+		else if(!sharedCache && ((cached = get_cart_cache(victim, i)) != NULL)) {
+			memcpy(&localBuf[count * CART_FRAME_SIZE], cached, CART_FRAME_SIZE);
+		}
+		else if(cart_tier_resident(victim, i)) {
+			if(cart_tier_read(victim, i, 1, &localBuf[count * CART_FRAME_SIZE]) != 0) {
+				free(localBuf);
+				return -1;
+			}
+		}
+		else {
+			if(currentlyLoadedCartridge != victim) {
+				if(runBusRequest(NULL, CART_OP_LDCART, victim, 0, NULL) != 0) {
+					printf("clean_log_segment: Error loading cartridge %d\n", victim);
+					free(localBuf);
+					return -1;
+				}
+				currentlyLoadedCartridge = victim;
+			}
+			if(runBusRequest(NULL, CART_OP_RDFRME, 0, i, &localBuf[count * CART_FRAME_SIZE]) != 0) {
+				printf("clean_log_segment: failed to read cartridge %d frame %d\n", victim, i);
+				free(localBuf);
+				return -1;
+			}
+		}
+		frames[count++] = i;
+	}
+
+	// Rewrite them at the head, pointing their files at the new copies
+	for(j=0; j<count; j++) {
+		owner = frameOwner[CART_DRIVER_FRAME_KEY(victim, frames[j])];
+		slot = frameSlot[CART_DRIVER_FRAME_KEY(victim, frames[j])];
+		if(allocate_frame(owner, slot, &cartridge, &frame) != 0) {
+			free(localBuf);
+			return -1;
+		}
+		retire_frame(victim, frames[j]);
+		filesystem[owner]->location.occupiedCartridges[slot] = cartridge;
+		filesystem[owner]->location.occupiedFrames[slot] = frame;
+		if(write_frames(owner, slot, 1, &localBuf[j * CART_FRAME_SIZE], "clean_log_segment") != 0) {
+			free(localBuf);
+			return -1;
+		}
+	}
+	driverStats.cleanedSegments++;
+	driverStats.cleanedFrames += count;
+	free(localBuf);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_log_segment
+// Description  : Move the head of the log to a free cartridge (one with no
+//                live frames), then clean the cartridges with the fewest live
+//                frames until CART_DRIVER_LOG_RESERVE are free again
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int next_log_segment(void) {
+	int i, freeSegments, victim;
+
+	for(i=0; (i<driverCartridges) && ((i == nextCartridge) || (segmentLive[i] != 0)); i++);
+	if(i == driverCartridges) {
+		printf("next_log_segment: no free cartridges left\n");
+		nextCartridge = driverCartridges;
+		return -1;
+	}
+	nextCartridge = i;
+	nextFrame = 0;
+
+	// The cleaner's own allocations may move the head, but do not clean again
+	if(logCleaning) {
+		return 0;
+	}
+	logCleaning = 1;
+	while(1) {
+		freeSegments = 0;
+		victim = -1;
+		for(i=0; i<driverCartridges; i++) {
+			if(i == nextCartridge) {
+				continue;
+			}
+			if(segmentLive[i] == 0) {
+				freeSegments++;
+			}
+			else if((victim == -1) || (segmentLive[i] < segmentLive[victim])) {
+				victim = i;
+			}
+		}
+		// Stop with enough in reserve, or when cleaning would gain nothing (the log is full of live data)
+		if((freeSegments >= CART_DRIVER_LOG_RESERVE) || (victim == -1) || (segmentLive[victim] == CART_CARTRIDGE_SIZE)) {
+			break;
+		}
+		if(clean_log_segment(victim) != 0) {
+			logCleaning = 0;
+			return -1;
+		}
+	}
+	logCleaning = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_set_layout
+// Description  : Choose how file frames are placed, from the next poweron
+//
+// Inputs       : layout - CART_LAYOUT_INPLACE (frames are rewritten where they
+//                are) or CART_LAYOUT_LOG (frames are written at the head of a log)
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_set_layout(CartDriverLayout layout) {
+	if((layout != CART_LAYOUT_INPLACE) && (layout != CART_LAYOUT_LOG)) {
+		return -1;
+	}
+	driverLayout = layout;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_set_block_size
+// Description  : Choose the logical block size of the files, from the next
+//                poweron.  Larger blocks shrink the frame lists, the cache
+//                entries and the allocator's work per byte, and move over
+//                the bus in one batched transfer, at the cost of space
+//                (every file takes whole blocks).
+//
+// Inputs       : bytes - the block size, CART_FRAME_SIZE times a power of 2
+//                up to CART_DRIVER_MAX_BLOCK_FRAMES frames (1, 4, 16 or 64 KB)
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_set_block_size(uint32_t bytes) {
+	uint32_t frames = bytes / CART_FRAME_SIZE;
+
+	if((bytes % CART_FRAME_SIZE != 0) || (frames == 0) || (frames > CART_DRIVER_MAX_BLOCK_FRAMES) || ((frames & (frames - 1)) != 0)) {
+		return -1;
+	}
+	blockSizeFrames = frames;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_set_cartridges
+// Description  : Limit the files to the first cartridges, from the next
+//                poweron, so a small workload fills them (in the log layout,
+//                this makes the cleaner run)
+//
+// Inputs       : cartridges - the cartridges files may use (1 to CART_MAX_CARTRIDGES)
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_set_cartridges(int cartridges) {
+	if((cartridges < 1) || (cartridges > CART_MAX_CARTRIDGES)) {
+		return -1;
+	}
+	cartridgeBudget = cartridges;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_set_tier
+// Description  : Keep the hot extents in a local store, from the next
+//                poweron (see cart_tier.h)
+//
+// Inputs       : path - the store file, NULL for no local tier
+//                extents - the extents it holds (0 for the default)
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_set_tier(const char *path, uint32_t extents) {
+	char *copy = NULL;
+
+	if((path != NULL) && ((copy = strdup(path)) == NULL)) {
+		return -1;
+	}
+	free(tierStorePath);
+	tierStorePath = copy;
+	tierStoreExtents = (extents == 0) ? CART_TIER_DEFAULT_EXTENTS : extents;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_set_shared_cache
+// Description  : Cache blocks in a shared memory segment, from the next
+//                poweron, instead of the private cache.  The processes of
+//                a host naming the same segment share the blocks they read
+//                (see cart_shcache.h); it holds the cache size set with
+//                set_cart_cache_size (CART_DRIVER_SHCACHE_FRAMES if none).
+//
+// Inputs       : name - the segment (as for shm_open), NULL for none
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_set_shared_cache(const char *name) {
+	char *copy = NULL;
+
+	if((name != NULL) && ((copy = strdup(name)) == NULL)) {
+		return -1;
+	}
+	free(sharedCacheName);
+	sharedCacheName = copy;
+	return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -138,29 +1038,84 @@ void runBusRequest(uint8_t kyOne, uint16_t ctOne, uint16_t fmOne, void *buf) {
 // Inputs       : none
 // Outputs      : 0 if successful, -1 if failure
 
-int32_t cart_poweron(void) {
-	runBusRequest(0, 0, 0, NULL); // Bus request to initialize memory system.
-	if(regstate.rt != 0) { // Returns -1 and prints error if the memory system cannot be initialized.
+int32_t cart_poweron(void) {
+	// The log layout moves single frames (see clean_log_segment), so it keeps 1 KB blocks
+	if((blockSizeFrames > 1) && (driverLayout == CART_LAYOUT_LOG)) {
+		printf("cart_poweron: The log layout needs %d byte blocks\n", CART_FRAME_SIZE);
+		return -1;
+	}
+
+	// The log layout needs a cartridge for the head besides the ones its cleaner keeps in reserve
+	if((driverLayout == CART_LAYOUT_LOG) && (cartridgeBudget <= CART_DRIVER_LOG_RESERVE)) {
+		printf("cart_poweron: The log layout needs more than %d cartridges\n", CART_DRIVER_LOG_RESERVE);
+		return -1;
+	}
+	driverCartridges = cartridgeBudget;
+
+	// The local tier keeps frames other processes cannot see, so it does not go with the shared cache
+	if((sharedCacheName != NULL) && (tierStorePath != NULL)) {
+		printf("cart_poweron: The shared cache cannot be used with the local tier\n");
+		return -1;
+	}
+	blockFrames = blockSizeFrames;
+	for(blockShift=0; (1 << blockShift) < blockFrames; blockShift++);
+	blockBufCartridge = -1;
+	if(blockFrames > 1) {
+		if((blockBuf = driver_malloc(CART_FRAME_SIZE * blockFrames)) == NULL) {
+			printf("cart_poweron: Error allocating the block buffer\n");
+			return -1;
+		}
+	}
+
+	if(runBusRequest(NULL, 0, 0, 0, NULL) != 0) { // Bus request to initialize memory system. Returns -1 and prints error if it fails.
 		printf("cart_poweron: Error initializing the memory system\n");
 		return -1;
 	}
 	for(int i = 0;  i < CART_MAX_CARTRIDGES; i++) {
-		runBusRequest(2, i, 0, NULL); // Loads cartridge i.
-		if(regstate.rt != 0) { // Returns -1 and prints error if it cannot load cartridge i.
+		if(runBusRequest(NULL, 2, i, 0, NULL) != 0) { // Loads cartridge i. Returns -1 and prints error if it cannot load cartridge i.
 			printf("cart_poweron: Error loading cartridge %d\n", i);
 			return -1;
 		}
+		currentlyLoadedCartridge = i;
 		
-		runBusRequest(1, 0, 0, NULL); // Zeros cartridge i.
-		if(regstate.rt != 0) { // Returns -1 and prints error if it cannot zero cartridge i.
+		if(runBusRequest(NULL, 1, 0, 0, NULL) != 0) { // Zeros cartridge i. Returns -1 and prints error if it cannot zero cartridge i.
 			printf("cart_poweron: Error zeroing currently loaded cartridge %d\n", i);
 			return -1;
 		}
-		currentlyLoadedCartridge = i;
 	}
-	if(init_cart_cache() != 0) {
-		printf("cart_poweron: Error initializing cache\n");
-		return -1;
+	sharedCache = (sharedCacheName != NULL);
+	blockBufToken = CART_SHCACHE_NO_TOKEN;
+	if(sharedCache) {
+		if(cart_shcache_open(sharedCacheName, (get_cart_cache_size() != 0) ? get_cart_cache_size() : CART_DRIVER_SHCACHE_FRAMES, blockFrames) != 0) {
+			printf("cart_poweron: Error attaching the shared cache [%s]\n", sharedCacheName);
+			sharedCache = 0;
+			return -1;
+		}
+		cart_shcache_reset(); // The cartridges were just zeroed
+	}
+	else {
+		set_cart_cache_block(blockFrames);
+		if(init_cart_cache() != 0) {
+			printf("cart_poweron: Error initializing cache\n");
+			return -1;
+		}
+	}
+	if(tierStorePath != NULL) {
+		if(((tierExtentBuf = driver_malloc(CART_TIER_EXTENT_FRAMES * CART_FRAME_SIZE)) == NULL) ||
+				(cart_tier_open(tierStorePath, tierStoreExtents) != 0)) {
+			printf("cart_poweron: Error creating the local tier [%s]\n", tierStorePath);
+			return -1;
+		}
+	}
+	if(driverLayout == CART_LAYOUT_LOG) {
+		frameOwner = driver_malloc(sizeof(int32_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE);
+		frameSlot = driver_malloc(sizeof(int32_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE);
+		if((frameOwner == NULL) || (frameSlot == NULL)) {
+			printf("cart_poweron: Error allocating the log layout frame tables\n");
+			return -1;
+		}
+		memset(frameOwner, 0xff, sizeof(int32_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE); // All -1, nothing live
+		memset(segmentLive, 0x0, sizeof(segmentLive));
 	}
 	return(0);
 }
@@ -174,21 +1129,46 @@ int32_t cart_poweron(void) {
 // Outputs      : 0 if successful, -1 if failure
 
 int32_t cart_poweroff(void) {
-	int i;
-	for(i=0; i <= fileSystemSize; i++) { // Goes through each file in the filesystem, and frees all the alloced memory
-		filesystem[i].fileHandle = 0; 
-		free(filesystem[i].fileName); 
-		free(filesystem[i].location.occupiedFrames);
-		free(filesystem[i].location.occupiedCartridges);
-	}
+	// All of the file metadata lives in the arena, so one release frees it
+	driverStats.allocations += fileArena.mallocs;
+	driverStats.metadataBytes = fileArena.bytes;
+	cart_arena_release(&fileArena);
+	filesystem = NULL;
+	fileOpens = fileLengths = NULL;
+	fileNameHashes = NULL;
+	fileCount = fileCapacity = 0;
+	nameTable = NULL;
+	nameTableSize = 0;
+	descFiles = descPointers = NULL;
+	descModes = NULL;
+	descCount = descCapacity = 0;
+	descFree = -1;
+	free(frameShares);
+	frameShares = NULL;
+	free(frameUnwritten);
+	frameUnwritten = NULL;
+	holeFrames = 0;
+	free(frameOwner);
+	free(frameSlot);
+	frameOwner = frameSlot = NULL;
+	free(blockBuf);
+	blockBuf = NULL;
+	blockBufCartridge = -1;
+	cart_tier_close(); // The cartridges are zeroed at the next poweron, so nothing is written back
+	free(tierExtentBuf);
+	tierExtentBuf = NULL;
+	nextFrame = nextCartridge = 0; // The cartridges are zeroed at the next poweron, so every frame is free again
 
-	free(filesystem); // free the whole filesystem itself
-	runBusRequest(5, 0, 0, NULL); // Bus request to turn off memory system.
-	if(regstate.rt != 0) { // Returns -1 and prints error if it cannot turn off the memory system.
+	if(runBusRequest(NULL, 5, 0, 0, NULL) != 0) { // Bus request to turn off memory system. Returns -1 and prints error if it fails.
 		printf("cart_poweroff: Failed to shutdown filesystem\n");
 		return -1;
 	}	
 	
+	if(sharedCache) {
+		cart_shcache_close();
+		sharedCache = 0;
+		return(0);
+	}
 	if(close_cart_cache() != 0) {
 		printf("cart_poweroff: Error shutting down cache\n");
 		return -1;
@@ -199,111 +1179,54 @@ int32_t cart_poweroff(void) {
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : cart_open
-// Description  : This function opens the file and returns a file handle
+// Description  : This function opens the file for reading and writing and
+//                returns a file handle
 //
 // Inputs       : path - filename of the file to open
 // Outputs      : file handle if successful, -1 if failure
 
 int16_t cart_open(char *path) {
-	int fileHandleAssign = 0;
-	int i, j;
-	char fileHandleAvailable;
-	files *rfilesystem; // used to see if a pointer initialized by a malloc is null
+	return cart_open_mode(path, CART_OPEN_RDWR);
+}
 
-	// If no file has been open yet in our filesystem, malloc the filesystem, and return the first filehandle
-	if(filesystem == NULL) {
-		filesystem = (files *) malloc(sizeof(struct files)); // Sets filesystem pointer to size big enough for one files struct. This will get progressively bigger 
-								     // in the next project as new files are created.
-		filesystem[0].fileName = malloc(sizeof(char) * strlen(path));
-		if(filesystem[0].fileName == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error allocating filesystem.filename 0\n");
-			return -1;
-		}
-		
- 		filesystem[0].location.occupiedFrames = malloc(sizeof(int));
-		if(filesystem[0].location.occupiedFrames == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error allocating filesystem.occupiedFrames 0\n");
-			return -1;
-		}
-	
-		filesystem[0].location.occupiedCartridges = malloc(sizeof(int));
-		if(filesystem[0].location.occupiedCartridges == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error allocating filesystem.occupiedCartridges 0\n");
-			return -1;
-		}
-		strncpy(filesystem[0].fileName, path, strlen(path)); // Copys String from path to the filename in the filesystem		
-		filesystem[0].length = 0; // set length to zero
-		filesystem[0].filePointer = 0; // sets filepointer to zero
-		filesystem[0].fileHandle = 1; // sets filehandle to one. A file in my system is open if the filehandle > 0
-		return 1;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_open_mode
+// Description  : This function opens the file with the given access mode and
+//                returns a file handle.  Every open gets its own description
+//                (and position), so a file may be open any number of times.
+//
+// Inputs       : path - filename of the file to open
+//                mode - CART_OPEN_READ, CART_OPEN_WRITE or CART_OPEN_RDWR
+// Outputs      : file handle if successful, -1 if failure
+
+int16_t cart_open_mode(char *path, int mode) {
+	uint32_t hash = hash_name(path);
+	int i, d;
+
+	CART_PROBE1(open_entry, (uintptr_t)path);
+	if(((mode & CART_OPEN_RDWR) == 0) || ((mode & ~CART_OPEN_RDWR) != 0)) {
+		printf("cart_open: bad mode %d\n", mode);
+		return -1;
 	}
-	else { 
-		for(i = 0; i <= fileSystemSize; i++) { // looks if a file with the filename path already exists
-			if(strcmp(path, filesystem[i].fileName) == 0) { 
-				if(filesystem[i].fileHandle > 0) { // if path does exist and is open, return -1 (again, files in my system with filehandles > 0 are considered open
-					return -1;
-				}
-				else {
-					do { // if path does exist and is not open, looks for filehandle that is not already assigned.
-						fileHandleAssign += 1;
-						fileHandleAvailable = 't';	
-						for(j = 0; j <= fileSystemSize; j++) {
-							if(filesystem[j].fileHandle == fileHandleAssign) {
-								fileHandleAvailable = 'f';
-							}
-						}
-					} while (fileHandleAvailable == 'f');
-					filesystem[i].filePointer = 0; // sets filepointer to zero
-					// Set file's fileHandle to fileHandleAssign
-					filesystem[fileSystemSize].fileHandle = fileHandleAssign;
-					// Returns successful with file's fileHandlea
-					return filesystem[fileSystemSize].fileHandle;
-				}	
-			}
-		}
-		
-		// if file with filename path doesn't exist, create it
-		fileSystemSize++;
-		rfilesystem = realloc(filesystem, sizeof(struct files) * (fileSystemSize + 1)); // reallocs filesystem to add another file
-		if(rfilesystem == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error reallocating filesystem\n");
-			return -1;
-		}
-		filesystem = rfilesystem;
-		filesystem[fileSystemSize].fileName = malloc(strlen(path));
-		if(filesystem[fileSystemSize].fileName == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error allocating filesystem.filename %d\n", fileSystemSize);
-			return -1;
-		}
-		filesystem[fileSystemSize].location.occupiedFrames = malloc(sizeof(int));
-		if(filesystem[fileSystemSize].location.occupiedFrames == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error allocating filesystem.filename %d\n", fileSystemSize);
+
+	// Find the file, creating it if it doesn't exist yet (and it is opened for writing)
+	if((i = find_file(path, hash)) == -1) {
+		if((mode & CART_OPEN_WRITE) == 0) {
+			printf("cart_open: %s does not exist\n", path);
 			return -1;
 		}
-		filesystem[fileSystemSize].location.occupiedCartridges = malloc(sizeof(int));
-		if(filesystem[fileSystemSize].location.occupiedCartridges == NULL) { // returns -1 is error with malloc
-			printf("cart_open: Error allocating filesystem.filename %d\n", fileSystemSize);
+		if((i = add_file(path, hash)) == -1) {
 			return -1;
 		}
-		strncpy(filesystem[fileSystemSize].fileName, path, strlen(path)); // copys path to filename
-		filesystem[fileSystemSize].length = 0; // sets length to zero
-		filesystem[fileSystemSize].filePointer = 0; // sets filepointer to zero
-		do { // looks for filehandle that is not already assigned
-			fileHandleAssign += 1;
-			fileHandleAvailable = 't';
-			for(i = 0; i < fileSystemSize; i++) {
-				if(filesystem[i].fileHandle == fileHandleAssign) {
-					fileHandleAvailable = 'f';	
-				}
-			}
-		} while (fileHandleAvailable == 'f');
-		// Set file's fileHandle to fileHandleAssign
-		filesystem[fileSystemSize].fileHandle = fileHandleAssign;
-		// Returns successful with file's fileHandle
-		return filesystem[fileSystemSize].fileHandle;
+	}
+	if((d = add_description(i, mode)) == -1) {
+		return -1;
 	}
 
-	// THIS SHOULD RETURN A FILE HANDLE
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_OPEN, d + 1, mode, 0, 0);
+	CART_PROBE1(open_return, d + 1);
+	return d + 1;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -317,116 +1240,164 @@ int16_t cart_open(char *path) {
 int16_t cart_close(int16_t fd) {
 	int fileSystemIndex = -1; // fileSystemIndex is used in the filesystem array to determine which file fd is referring to
 				  // ultimately in this project it will be one
-	int i;
-	for(i=0; i <= fileSystemSize; i++) { // determines fileSystemIndex by looking for the fd in the filesystem array
-		if(filesystem[i].fileHandle == fd) {
-			fileSystemIndex = i;
-			break;
-		}
-	}
-	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad
-		printf("cart_close: filehandle %d is bad\n", fd);
-		return -1;
-	}
-	else if(filesystem[fileSystemIndex].fileHandle == 0) { // returns -1 if the filehandle is not open. A filehandle that equals zero in my filesystem means it is closed
-		printf("cart_close: filehandle %d is not open\n", fd);
+	fileSystemIndex = file_index(fd); // determines fileSystemIndex from the fd
+	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad or not open
+		printf("cart_close: filehandle %d is bad or not open\n", fd);
+		CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_CLOSE, fd, -1, 0, 0);
 		return -1;
 	}
-	filesystem[fileSystemIndex].fileHandle = 0; // sets filehandle to zero (meaning it is closed)
-	filesystem[fileSystemIndex].filePointer = 0; // sets pointer to zero
+	fileOpens[fileSystemIndex]--;
+	descFiles[fd - 1] = -1; // frees the description (handle) for the next open
+	descPointers[fd - 1] = descFree;
+	descFree = fd - 1;
 
 	// Return successfully
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_CLOSE, fd, 0, 0, 0);
 	return (0);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : cart_read
-// Description  : Reads "count" bytes from the file handle "fh" into the 
-//                buffer "buf"
+// Function     : read_description
+// Description  : Read "count" bytes through an open file description into
+//                "buf" (the work of cart_read)
 //
-// Inputs       : fd - filename of the file to read from
+// Inputs       : fd - the file handle
 //                buf - pointer to buffer to read into
 //                count - number of bytes to read
 // Outputs      : bytes read if successful, -1 if failure
 
-int32_t cart_read(int16_t fd, void *buf, int32_t count) {
+static int32_t read_description(int16_t fd, void *buf, int32_t count) {
 	char* localBuf; // the local buffer.  Its size is alloced later in this function based on the number of frames that need to be read
-	void* get_cart_cache_results; // pointer to determine if the frame exists in the cache.  If it does, it is used to memcpy the frame over to the localBuf
 	int fileSystemIndex = -1; // fileSystemIndex is used in the filesystem array to determine which file fd is referring to
 	int i; // previousFrame will be compared to the currentFrame to determine if the next cartridge should be loaded 
 	int startFrameIndex, endFrameIndex; // used to determine which frames should be loaded
+	char sizeOfFrameBuf[CART_FRAME_SIZE]; // holds a frame read from the bus by the single frame fast path
+	char* frameData; // the frame read (in the cache, or in the buffer given to read_frame)
 
-	for(i=0; i <= fileSystemSize; i++) { // determines fileSystemIndex by looking for the fd in the filesystem array
-		if(filesystem[i].fileHandle == fd) { 
-			fileSystemIndex = i;
-			break;
-		} 
+	fileSystemIndex = file_index(fd); // determines fileSystemIndex from the fd
+	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad or not open
+		printf("cart_read: filehandle %d is bad or not open\n", fd);
+		return -1;
 	}
-	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad
-		printf("cart_read: filehandle %d is bad\n", fd);
+	else if((descModes[fd - 1] & CART_OPEN_READ) == 0) { // returns -1 if the filehandle was not opened for reading
+		printf("cart_read: filehandle %d is not open for reading\n", fd);
 		return -1;
 	}
-	else if(filesystem[fileSystemIndex].fileHandle == 0) { // returns -1 if the filehandle is not open. A filehandle that equals zero in my filesystem means it is closed
-		printf("cart_read: filehandle %d is not open\n", fd);
+	CART_PROBE3(read_entry, fd, descPointers[fd - 1], count);
+
+	// At (or past) the end of the file there is nothing to read, so do not touch the bus or the cache
+	if(descPointers[fd - 1] >= fileLengths[fileSystemIndex]) {
+		CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_READ, fd, descPointers[fd - 1], count, 0);
+		CART_PROBE2(read_return, fd, 0);
+		return 0;
+	}
+	if(cart_tier_step(tier_writeback) != 0) { // Migrate a little of the local tier first
+		printf("cart_read: Error migrating the local tier\n");
 		return -1;
 	}
 	
 	// In assign2, I was reading each frame the file was occupying.  This was very inefficient and costly, especially since in assign3 the file size can be as large as desired.
 	// So to solve this, I am doing some quick math with the file's filePointer and CART_FRAME SIZE to determine which frames are actually needed.
-	startFrameIndex = filesystem[fileSystemIndex].filePointer / CART_FRAME_SIZE;
-	endFrameIndex = (filesystem[fileSystemIndex].filePointer + count) / CART_FRAME_SIZE;
+	// The last frame is the one holding the last byte, so a read ending on a frame boundary does not fetch the next frame.
+	startFrameIndex = descPointers[fd - 1] / CART_FRAME_SIZE;
+	endFrameIndex = (count == 0) ? startFrameIndex : (descPointers[fd - 1] + count - 1) / CART_FRAME_SIZE;
+
+	// Most reads fall inside a single frame.  For those, skip the localBuf: copy just the requested bytes
+	// straight out of the cached frame (or out of a stack frame filled from the bus on a cache miss).
+	if((startFrameIndex == endFrameIndex) && (startFrameIndex <= filesystem[fileSystemIndex]->location.frames)) {
+		i = ((descPointers[fd - 1] + count) > fileLengths[fileSystemIndex]) ? (fileLengths[fileSystemIndex] - descPointers[fd - 1]) : count;
+		if((frameData = read_frame(fileSystemIndex, startFrameIndex, sizeOfFrameBuf, "cart_read")) == NULL) {
+			return -1;
+		}
+		memcpy(buf, &frameData[descPointers[fd - 1] % CART_FRAME_SIZE], i);
+		descPointers[fd - 1] += i;
+		driverStats.bytesRead += i;
+		CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_READ, fd, descPointers[fd - 1] - i, count, i);
+		CART_PROBE2(read_return, fd, i);
+		return i;
+	}
 
 	// Since we know how many frames we need to load, we can make the localBuf significantly smaller, and thus saving memory in the heap
-	localBuf = malloc(sizeof(char) * CART_FRAME_SIZE * ((endFrameIndex - startFrameIndex) + 1));
-	
+	localBuf = driver_malloc(sizeof(char) * CART_FRAME_SIZE * ((endFrameIndex - startFrameIndex) + 1));
+	if(localBuf == NULL) {
+		printf("cart_read: Error allocating the local buffer\n");
+		return -1;
+	}
 	
 	// We load the frame(s) within this for's scope.  To ensure we do not accidently step outside the filesystem.location.occupiedFrames array,
 	// I check the size of filesystem.location.frames (the int that keeps track of the size of filesystem.location.occupiedFrames) too.
-	for(i=0; i<=(endFrameIndex - startFrameIndex) && i<=filesystem[fileSystemIndex].location.frames; i++) {
-		// Check if the frame is located in the cache.  If it is not, fetch the frame from the bus.
-		get_cart_cache_results = get_cart_cache(filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex]);	
-		if(get_cart_cache_results == NULL) {	
-			// Load cartridge file is located in if it isn't already loaded 
-			if(currentlyLoadedCartridge != filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]) {
-				runBusRequest(2, filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], 0, NULL);
-				if(regstate.rt != 0) {
-					printf("cart_read: Error loading cartridge %d\n", filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]);
-					return -1;
-				}
-				currentlyLoadedCartridge = filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex];
-			}
-			runBusRequest(3, 0, filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex], &localBuf[CART_FRAME_SIZE * i]);
-			if(regstate.rt != 0) { // Returns -1 if the frame cannot be read
-				printf("cart_read: failed to read cartridge %d frame %d\n", filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex]);
-				return -1;
-			}
+	for(i=0; i<=(endFrameIndex - startFrameIndex) && (i + startFrameIndex)<=filesystem[fileSystemIndex]->location.frames; i++) {
+		// Get the frame from the cache or the bus, copying it to the local buf if it is not already there
+		if((frameData = read_frame(fileSystemIndex, i + startFrameIndex, &localBuf[CART_FRAME_SIZE * i], "cart_read")) == NULL) {
+			free(localBuf);
+			return -1;
 		}
-		else {
-			// Copy void frame from cache to the local buf
-			memcpy(&localBuf[CART_FRAME_SIZE * i], get_cart_cache_results, CART_FRAME_SIZE);
+		if(frameData != &localBuf[CART_FRAME_SIZE * i]) {
+			memcpy(&localBuf[CART_FRAME_SIZE * i], frameData, CART_FRAME_SIZE);
 		}
 	}	
 
 	// If the length of the file < (filePointer + count), only read the remains bytes of the file, and set the filePointer equal to the file's length
-	if((filesystem[fileSystemIndex].filePointer + count) > filesystem[fileSystemIndex].length) {
-		i = filesystem[fileSystemIndex].length - filesystem[fileSystemIndex].filePointer;
-		strncpy(buf, &localBuf[filesystem[fileSystemIndex].filePointer - (startFrameIndex * CART_FRAME_SIZE)], i);
-		filesystem[fileSystemIndex].filePointer = filesystem[fileSystemIndex].length;
+	if((descPointers[fd - 1] + count) > fileLengths[fileSystemIndex]) {
+		i = fileLengths[fileSystemIndex] - descPointers[fd - 1];
+		memcpy(buf, &localBuf[descPointers[fd - 1] - (startFrameIndex * CART_FRAME_SIZE)], i);
+		descPointers[fd - 1] = fileLengths[fileSystemIndex];
 		// Return successfully with i bytes read
 		free(localBuf);
+		driverStats.bytesRead += i;
+		CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_READ, fd, descPointers[fd - 1] - i, count, i);
+		CART_PROBE2(read_return, fd, i);
 		return i;
 	}
 
-	// Copy count characters from the localBuf starting at the filePointer into buf
-	strncpy(buf, &localBuf[filesystem[fileSystemIndex].filePointer - (startFrameIndex * CART_FRAME_SIZE)], count); 
+	// Copy count bytes from the localBuf starting at the filePointer into buf (the data is binary, so NULs are copied too)
+	memcpy(buf, &localBuf[descPointers[fd - 1] - (startFrameIndex * CART_FRAME_SIZE)], count);
 	// Update filePointer
-	filesystem[fileSystemIndex].filePointer += count;
+	descPointers[fd - 1] += count;
 	// Return successfully with count bytes read
 	free(localBuf);
+	driverStats.bytesRead += count;
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_READ, fd, descPointers[fd - 1] - count, count, count);
+	CART_PROBE2(read_return, fd, count);
 	return (count);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_read
+// Description  : Reads "count" bytes from the file handle "fh" into the 
+//                buffer "buf"
+//
+//                Reads through read-only descriptions may be made from
+//                several threads at once, each thread using its own
+//                descriptions, as long as no other driver call runs
+//                alongside them.  They hold readLock, which covers the
+//                cache, the driver's buffers and counters, except while
+//                waiting on the bus for a frame (each thread has its own
+//                connection and loaded cartridge), so readers missing the
+//                cache overlap their transfers.
+//
+// Inputs       : fd - filename of the file to read from
+//                buf - pointer to buffer to read into
+//                count - number of bytes to read
+// Outputs      : bytes read if successful, -1 if failure
+
+int32_t cart_read(int16_t fd, void *buf, int32_t count) {
+	int32_t ret;
+
+	// Other descriptions may not be used by more than one thread, so need no lock
+	if((file_index(fd) == -1) || (descModes[fd - 1] != CART_OPEN_READ)) {
+		return read_description(fd, buf, count);
+	}
+	pthread_mutex_lock(&readLock);
+	readLockHeld = 1;
+	ret = read_description(fd, buf, count);
+	readLockHeld = 0;
+	pthread_mutex_unlock(&readLock);
+	return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : cart_write
@@ -443,186 +1414,157 @@ int32_t cart_write(int16_t fd, void *buf, int32_t count) {
 	int fileSystemIndex = -1; // fileSystemIndex is used in the filesystem array to determine which file fd is referring to
 	int i;
 	int startFrameIndex, endFrameIndex; // used to determine which frames should be loaded
+	int firstNewFrame; // the first frame this write adds to the file
+	int run; // frames written to the bus at a time
 	char sizeOfFrameBuf[CART_FRAME_SIZE];
-	int *myRalloc; // used to see if a pointer initialized by a malloc is null
-	void* get_cart_cache_results; // pointer to determine if the frame exists in the cache.  If it does, it is used to memcpy the frame over to the localBuf
+	char* frameData; // the frame read (in the cache, or in the localBuf)
 
-	struct newFrame {
+	struct movedFrame {
 		int frame;
 		int cartridge;
-	} newFrame;
+	} movedFrame;
 
-	for(i=0; i <= fileSystemSize; i++) { // determines fileSystemIndex by looking for the fd in the filesystem array
-		if(filesystem[i].fileHandle == fd) { 
-			fileSystemIndex = i;
-			break;
-		} 
+	fileSystemIndex = file_index(fd); // determines fileSystemIndex from the fd
+	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad or not open
+		printf("cart_write: filehandle %d is bad or not open\n", fd);
+		return -1;
 	}
-	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad
-		printf("cart_write: filehandle %d is bad\n", fd);
+	else if((descModes[fd - 1] & CART_OPEN_WRITE) == 0) { // returns -1 if the filehandle was not opened for writing
+		printf("cart_write: filehandle %d is not open for writing\n", fd);
 		return -1;
 	}
-	else if(filesystem[fileSystemIndex].fileHandle == 0) { // returns -1 if the filehandle is not open. A filehandle that equals zero in my filesystem means it is closed
-		printf("cart_write: filehandle %d is not open\n", fd);
+	CART_PROBE3(write_entry, fd, descPointers[fd - 1], count);
+	if(cart_tier_step(tier_writeback) != 0) { // Migrate a little of the local tier first
+		printf("cart_write: Error migrating the local tier\n");
 		return -1;
 	}
 
-	// Code used for writing to the file's first frame
-	if(filesystem[fileSystemIndex].length == 0) {
-		filesystem[fileSystemIndex].location.frames = 0; // The number of frames this file occupies.  0 means 1 frame, 1 means 2 frames, and so on...
-		filesystem[fileSystemIndex].location.cartridges = 0; // The number of cartridges this file occupies.  0 means 1 frame, 1 means 2 frames, and so on...
-		filesystem[fileSystemIndex].location.occupiedFrames[0] = nextFrame; // The int array that keeps track of what specific frames this file is in.
-		filesystem[fileSystemIndex].location.occupiedCartridges[0] = nextCartridge; // The int array that keeps track of what specific cartridges this file is in
-		nextFrame++;
-		if(nextFrame == CART_FRAME_SIZE) { // If the nextFrame is out of the scope of the current cartridge, load the next cartridge, and set the frame back to zero.
-			nextFrame = 0;
-			nextCartridge++;
+	// Code used for writing to the file's first frame (a longer first write takes the general path below)
+	if((fileLengths[fileSystemIndex] == 0) && (count <= CART_FRAME_SIZE)) {
+		filesystem[fileSystemIndex]->location.frames = 0; // The number of frames this file occupies.  0 means 1 frame, 1 means 2 frames, and so on...
+		filesystem[fileSystemIndex]->location.cartridges = 0; // The number of cartridges this file occupies.  0 means 1 frame, 1 means 2 frames, and so on...
+		// The int arrays that keep track of what specific cartridges and frames this file is in
+		if(allocate_frame(fileSystemIndex, 0, &filesystem[fileSystemIndex]->location.occupiedCartridges[0], &filesystem[fileSystemIndex]->location.occupiedFrames[0]) != 0) {
+			printf("cart_write: Error allocating a frame for file %d\n", fd);
+			return -1;
 		}
-		filesystem[fileSystemIndex].length = count; // Set file's length to count 
-		filesystem[fileSystemIndex].filePointer = count; // Set file's filePointer to count
-		// Updates the sizeOfFrameBuf with count characters from buf
-		strncpy(sizeOfFrameBuf, buf, count); 
+		fileLengths[fileSystemIndex] = count; // Set file's length to count 
+		descPointers[fd - 1] = count; // Set file's filePointer to count
+		// Updates the sizeOfFrameBuf with count bytes from buf, the rest of the frame is zeroed
+		memcpy(sizeOfFrameBuf, buf, count);
+		memset(&sizeOfFrameBuf[count], 0x0, CART_FRAME_SIZE - count);
 		
-		// Load the cartridge this file occupies
-		if(currentlyLoadedCartridge != filesystem[fileSystemIndex].location.occupiedCartridges[0]) {
-			runBusRequest(2, filesystem[fileSystemIndex].location.occupiedCartridges[0], 0, NULL);
-			if(regstate.rt != 0) {
-				printf("cart_write: Error loading cartridge %d\n", filesystem[fileSystemIndex].location.cartridges);
-				return -1;
-			}
-			currentlyLoadedCartridge = filesystem[fileSystemIndex].location.occupiedCartridges[0];
-		}
-		// Place the frame into the cache
-		put_cart_cache(filesystem[fileSystemIndex].location.occupiedCartridges[0], filesystem[fileSystemIndex].location.occupiedFrames[0], sizeOfFrameBuf);
-		// printf("cart_write: Cart/Fram %d/%d placed in cache\n", filesystem[fileSystemIndex].location.occupiedCartridges[0], filesystem[fileSystemIndex].location.occupiedFrames[0]);
-		// Place the frame into the bus
-		runBusRequest(4, 0, filesystem[fileSystemIndex].location.occupiedFrames[0], sizeOfFrameBuf);
-		if(regstate.rt != 0) {
-			printf("cart_write: error writing to frame %d\n", filesystem[fileSystemIndex].location.occupiedFrames[0]);	
+		// Place the frame into the cache and the bus
+		if(write_frames(fileSystemIndex, 0, 1, sizeOfFrameBuf, "cart_write") != 0) {
 			return -1;
 		}
 	} 
 	// Code used for writing to the file's exists frames and additionally need frames
 	else {
-		// Run code within if statement's scope if more frames are needed to accomodate the number of characters to be written (count)
-		if((filesystem[fileSystemIndex].filePointer + count) > ((filesystem[fileSystemIndex].location.frames + 1) * CART_FRAME_SIZE)) {
-			filesystem[fileSystemIndex].location.frames++; // Increase the number of occupied frames by one, and add the new frame to the aarry.
-			myRalloc = realloc(filesystem[fileSystemIndex].location.occupiedFrames, sizeof(int) * (filesystem[fileSystemIndex].location.frames + 1));
-			if(myRalloc == NULL) {
-				printf("cart_write: filesystem[fileSystemIndex].location.occupiedFrames\n");
+		// Add the frames needed to accomodate the number of characters to be written (count).  The frames of a block
+		// are allocated together, when the file reaches its first frame.
+		firstNewFrame = (fileLengths[fileSystemIndex] == 0) ? 0 : filesystem[fileSystemIndex]->location.frames + 1;
+		for(i=firstNewFrame; (descPointers[fd - 1] + count) > (i * CART_FRAME_SIZE); i++) {
+			filesystem[fileSystemIndex]->location.frames = i; // The last frame this file occupies.  0 means 1 frame, 1 means 2 frames, and so on...
+			if(grow_locations(filesystem[fileSystemIndex]) != 0) {
+				printf("cart_write: Error growing the frame list of file %d\n", fd);
 				return -1;
 			}
-			filesystem[fileSystemIndex].location.occupiedFrames = myRalloc;
-			filesystem[fileSystemIndex].location.occupiedFrames[filesystem[fileSystemIndex].location.frames] = nextFrame;
-			newFrame.frame = filesystem[fileSystemIndex].location.occupiedFrames[filesystem[fileSystemIndex].location.frames];
-			nextFrame++;
-
-			// filesystem[fileSystemIndex].location.cartridges++; // Increase the number of occupied cartridges for this file by one, and add the new cartridge to the array/
-			myRalloc = realloc(filesystem[fileSystemIndex].location.occupiedCartridges, sizeof(int) * (filesystem[fileSystemIndex].location.frames + 1));
-			if(myRalloc == NULL) {
-				printf("cart_write: filesystem[fileSystemIndex].location.occupiedCartridges\n");
+			if(((i & (blockFrames - 1)) == 0) && (allocate_frame(fileSystemIndex, i >> blockShift, &filesystem[fileSystemIndex]->location.occupiedCartridges[i >> blockShift], &filesystem[fileSystemIndex]->location.occupiedFrames[i >> blockShift]) != 0)) {
+				printf("cart_write: Error allocating a frame for file %d\n", fd);
 				return -1;
 			}
-			filesystem[fileSystemIndex].location.occupiedCartridges = myRalloc;
-			filesystem[fileSystemIndex].location.occupiedCartridges[filesystem[fileSystemIndex].location.frames] = nextCartridge;
-			newFrame.cartridge = filesystem[fileSystemIndex].location.occupiedCartridges[filesystem[fileSystemIndex].location.frames];
-			// If the nextFrame is equal to CART_FRAME_SIZE (which does not exist), time to go to the next cartridge.
-			if(nextFrame == CART_FRAME_SIZE) {
-				nextFrame = 0;
-				nextCartridge++;
-			}
-
-			newFrame.cartridge = filesystem[fileSystemIndex].location.occupiedCartridges[filesystem[fileSystemIndex].location.frames];
-			newFrame.frame = filesystem[fileSystemIndex].location.occupiedFrames[filesystem[fileSystemIndex].location.frames];
-		}
-		else {
-			newFrame.frame = -1;
-			newFrame.cartridge = -1;
 		}
 		
 		// In assign2, I was reading each frame the file was occupying.  This was very inefficient and costly, especially since in assign3 the file size can be as large as desired.
 		// So to solve this, I am doing some quick math with the file's filePointer and CART_FRAME SIZE to determine which frames are actually needed.
-		if((filesystem[fileSystemIndex].filePointer + count) % CART_FRAME_SIZE != 0) {
-			startFrameIndex = filesystem[fileSystemIndex].filePointer / CART_FRAME_SIZE;
-			endFrameIndex = (filesystem[fileSystemIndex].filePointer + count) / CART_FRAME_SIZE;
-		}
-		else {
-			startFrameIndex = filesystem[fileSystemIndex].filePointer / CART_FRAME_SIZE;
-			endFrameIndex = startFrameIndex;
-		}
+		// The last frame is the one holding the last byte written.
+		startFrameIndex = descPointers[fd - 1] / CART_FRAME_SIZE;
+		endFrameIndex = (count == 0) ? startFrameIndex : (descPointers[fd - 1] + count - 1) / CART_FRAME_SIZE;
 		// Since we know how many frames we need to load, we can make the localBuf significantly smaller, and thus saving memory in the heap
-		localBuf = malloc(sizeof(char) * CART_FRAME_SIZE * ((endFrameIndex - startFrameIndex) + 1));
+		localBuf = driver_malloc(sizeof(char) * CART_FRAME_SIZE * ((endFrameIndex - startFrameIndex) + 1));
+		if(localBuf == NULL) {
+			printf("cart_write: Error allocating the local buffer\n");
+			return -1;
+		}
 		
 		// Read each frame the file is occupying, and place it into the localBuf	
 		// We load the frame(s) within this for's scope.  To ensure we do not accidently step outside the filesystem.location.occupiedFrames array,
 		// I check the size of filesystem.location.frames (the int that keeps track of the size of filesystem.location.occupiedFrames) too.
-		for(i=0; i<=(endFrameIndex - startFrameIndex) && !((newFrame.cartridge == filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]) & (newFrame.frame == filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex])); i++) {
-			// Check if the frame is located in the cache.  If it is not, fetch the frame from the bus.
-			get_cart_cache_results = get_cart_cache(filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex]);	
-			if(get_cart_cache_results == NULL) {	
-				// Load cartridge file is located in if it isn't already loaded 
-				if(currentlyLoadedCartridge != filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]) {
-					runBusRequest(2, filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], 0, NULL);
-					if(regstate.rt != 0) {
-						printf("cart_write: Error loading cartridge %d\n", filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]);
-						return -1;
-					}
-					currentlyLoadedCartridge = filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex];
-				}
-				runBusRequest(3, 0, filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex], &localBuf[CART_FRAME_SIZE * i]);
-				if(regstate.rt != 0) { // Returns -1 if the frame cannot be read
-					printf("cart_write: failed to read cartridge %d frame %d\n", filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex]);
-					return -1;
-				}
+		for(i=0; i<=(endFrameIndex - startFrameIndex) && (i + startFrameIndex) < firstNewFrame; i++) {
+			// A frame the write covers completely does not need to be read
+			if((descPointers[fd - 1] <= (i + startFrameIndex) * CART_FRAME_SIZE) && (descPointers[fd - 1] + count >= (i + startFrameIndex + 1) * CART_FRAME_SIZE)) {
+				continue;
 			}
-			else {
-				// Copy void frame from cache to the local buf
-				memcpy(&localBuf[CART_FRAME_SIZE * i], get_cart_cache_results, CART_FRAME_SIZE);
+			// Get the frame from the cache or the bus, copying it to the local buf if it is not already there
+			if((frameData = read_frame(fileSystemIndex, i + startFrameIndex, &localBuf[CART_FRAME_SIZE * i], "cart_write")) == NULL) {
+				free(localBuf);
+				return -1;
+			}
+			if(frameData != &localBuf[CART_FRAME_SIZE * i]) {
+				memcpy(&localBuf[CART_FRAME_SIZE * i], frameData, CART_FRAME_SIZE);
 			}
 		}
-		
+		// The loop stops at the frames the write added, which start out zeroed
+		if(i <= (endFrameIndex - startFrameIndex)) {
+			memset(&localBuf[CART_FRAME_SIZE * i], 0x0, CART_FRAME_SIZE * ((endFrameIndex - startFrameIndex) + 1 - i));
+		}
 
-		// Updates the localBuf at offset filesystem[fileSystemIndex].filePointer with count characters from buf
-		strncpy(&localBuf[filesystem[fileSystemIndex].filePointer - (startFrameIndex * CART_FRAME_SIZE)], buf, count);
+		// Updates the localBuf at offset descPointers[fd - 1] with count bytes from buf
+		memcpy(&localBuf[descPointers[fd - 1] - (startFrameIndex * CART_FRAME_SIZE)], buf, count);
 		
 		// We write the frame(s) within this for's scope.  To ensure we do not accidently step outside the filesystem.location.occupiedFrames array,
 		// I check the size of filesystem.location.frames (the int that keeps track of the size of filesystem.location.occupiedFrames) too.
-		for(i=0; i<=(endFrameIndex - startFrameIndex)/* && i<=filesystem[fileSystemIndex].location.frames*/; i++) {
-			// Load cartridge file is located in if it isn't already loaded 
-			if(currentlyLoadedCartridge != filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]) {
-				runBusRequest(2, filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], 0, NULL);
-				if(regstate.rt != 0) {
-					printf("cart_write: Error loading cartridge %d\n", filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex]);
+		for(i=0; i<=(endFrameIndex - startFrameIndex)/* && i<=filesystem[fileSystemIndex]->location.frames*/; i+=run) {
+			// The frames of a block go to the bus together
+			run = blockFrames - ((i + startFrameIndex) & (blockFrames - 1));
+			if(run > (endFrameIndex - startFrameIndex) + 1 - i) {
+				run = (endFrameIndex - startFrameIndex) + 1 - i;
+			}
+
+			// A frame shared with another file by cart_copy_range is copied on write, and in the log layout every
+			// frame written (other than the one just added) goes to the head of the log, leaving the old copy dead.
+			// Either way this file moves to a new frame, and the localBuf already holds the whole frame.
+			// (Neither happens to blocks larger than a frame, so only single frame blocks move.)
+			movedFrame.cartridge = CART_DRIVER_CART(filesystem[fileSystemIndex], i + startFrameIndex);
+			movedFrame.frame = CART_DRIVER_FRAME(filesystem[fileSystemIndex], i + startFrameIndex);
+			if(((frameShares != NULL) && (frameShares[CART_DRIVER_FRAME_KEY(movedFrame.cartridge, movedFrame.frame)] > 0)) ||
+					((driverLayout == CART_LAYOUT_LOG) && ((i + startFrameIndex) < firstNewFrame))) {
+				if((frameShares != NULL) && (frameShares[CART_DRIVER_FRAME_KEY(movedFrame.cartridge, movedFrame.frame)] > 0)) {
+					frameShares[CART_DRIVER_FRAME_KEY(movedFrame.cartridge, movedFrame.frame)]--;
+				}
+				else {
+					retire_frame(movedFrame.cartridge, movedFrame.frame);
+				}
+				if(allocate_frame(fileSystemIndex, i + startFrameIndex, &filesystem[fileSystemIndex]->location.occupiedCartridges[i + startFrameIndex], &filesystem[fileSystemIndex]->location.occupiedFrames[i + startFrameIndex]) != 0) {
+					printf("cart_write: Error allocating a frame for file %d\n", fd);
+					free(localBuf);
 					return -1;
 				}
-				currentlyLoadedCartridge = filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex];
 			}
 
-			// Updates the sizeOfFrameBuf from localBuf at offset j * CART_FRAME_SIZE with CART_FRAME_SIZE characters
-			strncpy(sizeOfFrameBuf, &localBuf[i * CART_FRAME_SIZE], CART_FRAME_SIZE);
-			
-			// Place the frame into the cache
-			put_cart_cache(filesystem[fileSystemIndex].location.occupiedCartridges[i + startFrameIndex], filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex], sizeOfFrameBuf);
-			// Place the frame into the bus
-			runBusRequest(4, 0, filesystem[fileSystemIndex].location.occupiedFrames[i + startFrameIndex], sizeOfFrameBuf);
-			if(regstate.rt != 0) {
-				printf("cart_write: error writing to frame %d\n", i);	
+			// Place the frames into the cache and the bus, straight from the localBuf
+			if(write_frames(fileSystemIndex, i + startFrameIndex, run, &localBuf[i * CART_FRAME_SIZE], "cart_write") != 0) {
+				free(localBuf);
 				return -1;
-			}	
+			}
 		}
 
 		// If the length of the file < (filePointer + count), expand the size of the file, and set filePointer equal to length
-		if(filesystem[fileSystemIndex].length < (filesystem[fileSystemIndex].filePointer + count)) {
-			filesystem[fileSystemIndex].length += count - (filesystem[fileSystemIndex].length - filesystem[fileSystemIndex].filePointer);
-			filesystem[fileSystemIndex].filePointer = filesystem[fileSystemIndex].length;
+		if(fileLengths[fileSystemIndex] < (descPointers[fd - 1] + count)) {
+			fileLengths[fileSystemIndex] += count - (fileLengths[fileSystemIndex] - descPointers[fd - 1]);
+			descPointers[fd - 1] = fileLengths[fileSystemIndex];
 		}
 		else {
-			filesystem[fileSystemIndex].filePointer += count; // Update file's filePointer += count
+			descPointers[fd - 1] += count; // Update file's filePointer += count
 		}
 		free(localBuf);
 	}
 
 	// Return successfully with count bytes written
+	driverStats.bytesWritten += count;
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_WRITE, fd, descPointers[fd - 1] - count, count, count);
+	CART_PROBE2(write_return, fd, count);
 	return (count);
 }
 
@@ -636,31 +1578,343 @@ int32_t cart_write(int16_t fd, void *buf, int32_t count) {
 // Outputs      : 0 if successful, -1 if failure
 
 int32_t cart_seek(int16_t fd, uint32_t loc) {
-	int i;
 	int fileSystemIndex = -1;	
 
-	for(i=0; i <= fileSystemSize; i++) { // determines fileSystemIndex by looking for the fd in the filesystem array
-		if(filesystem[i].fileHandle == fd) {
-			fileSystemIndex = i;
-			break;
-		}
-	}
-	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad
-		printf("cart_write: filehandle %d is bad\n", fd);
-		return -1;
-	}
-	else if(filesystem[fileSystemIndex].fileHandle == 0) { // returns -1 if the filehandle is not open. A filehandle that equals zero in my filesystem means it is closed
-		printf("cart_write: filehandle %d is not open\n", fd);
+	fileSystemIndex = file_index(fd); // determines fileSystemIndex from the fd
+	if(fileSystemIndex == -1) { // returns -1 if the filehandle is bad or not open
+		printf("cart_seek: filehandle %d is bad or not open\n", fd);
 		return -1;
 	}
 	
 	// Cannot seek if location to seek is greater than the length, so returns -1
-	if(filesystem[fileSystemIndex].length < loc) {
+	if(fileLengths[fileSystemIndex] < loc) {
 		return -1;
 	}
  
-	filesystem[fileSystemIndex].filePointer = loc;
+	descPointers[fd - 1] = loc;
 	
 	// Return successfully
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_SEEK, fd, loc, 0, 0);
+	return (0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_copy_range
+// Description  : Copies "len" bytes from offset "src_off" of one file to offset
+//                "dst_off" of another, without moving the file positions.
+//                Where both offsets are frame aligned, whole frames are shared
+//                (except in the log layout, which tracks a single owner per frame)
+//                with the destination instead of copied (no bus traffic), and
+//                a later write to either file copies the frame it writes.
+//                The remaining bytes are bounced through a buffer, read in
+//                runs of frames and written a destination frame at a time.
+//
+// Inputs       : src_fd - the file to copy from
+//                src_off - the offset in the source
+//                dst_fd - the file to copy to
+//                dst_off - the offset in the destination (not past its end)
+//                len - the number of bytes to copy
+// Outputs      : bytes copied (short at the end of the source) if successful, -1 if failure
+
+int32_t cart_copy_range(int16_t src_fd, uint32_t src_off, int16_t dst_fd, uint32_t dst_off, int32_t len) {
+	char localBuf[CART_DRIVER_COPY_FRAMES * CART_FRAME_SIZE]; // Bounce buffer for the bytes that cannot be shared
+	int src = file_index(src_fd), dst = file_index(dst_fd);
+	int32_t done, chunk, piece, j, srcPointer, dstPointer;
+	int srcFrame, dstFrame, shared = 0;
+
+	if((src == -1) || (dst == -1) || ((descModes[src_fd - 1] & CART_OPEN_READ) == 0) || ((descModes[dst_fd - 1] & CART_OPEN_WRITE) == 0)) {
+		printf("cart_copy_range: filehandle %d or %d is bad, not open or the wrong mode\n", src_fd, dst_fd);
+		return -1;
+	}
+	if((len < 0) || (src_off > fileLengths[src]) || (dst_off > fileLengths[dst])) {
+		printf("cart_copy_range: range outside of file (src %u, dst %u, len %d)\n", src_off, dst_off, len);
+		return -1;
+	}
+	if(len > fileLengths[src] - src_off) {
+		len = fileLengths[src] - src_off;
+	}
+	if(frameShares == NULL) {
+		if((frameShares = driver_malloc(sizeof(uint16_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE)) == NULL) {
+			printf("cart_copy_range: Error allocating the frame share counts\n");
+			return -1;
+		}
+		memset(frameShares, 0x0, sizeof(uint16_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE);
+	}
+	if((src == dst) && (src_off < dst_off + len) && (dst_off < src_off + len)) {
+		printf("cart_copy_range: overlapping ranges in file %d\n", src_fd);
+		return -1;
+	}
+
+	srcPointer = descPointers[src_fd - 1];
+	dstPointer = descPointers[dst_fd - 1];
+	for(done=0; done<len; done+=chunk) {
+		srcFrame = (src_off + done) / CART_FRAME_SIZE;
+		dstFrame = (dst_off + done) / CART_FRAME_SIZE;
+
+		// A whole, aligned frame is shared: the destination points at the source's frame
+		if((driverLayout != CART_LAYOUT_LOG) && (blockFrames == 1) && (((src_off + done) % CART_FRAME_SIZE) == 0) && (((dst_off + done) % CART_FRAME_SIZE) == 0) && (len - done >= CART_FRAME_SIZE) &&
+				(frameShares[CART_DRIVER_FRAME_KEY(filesystem[src]->location.occupiedCartridges[srcFrame], filesystem[src]->location.occupiedFrames[srcFrame])] < UINT16_MAX)) {
+			chunk = CART_FRAME_SIZE;
+			if(dst_off + done < fileLengths[dst]) {
+				// Replaces a frame of the destination, which drops its share of that frame
+				if(frameShares[CART_DRIVER_FRAME_KEY(filesystem[dst]->location.occupiedCartridges[dstFrame], filesystem[dst]->location.occupiedFrames[dstFrame])] > 0) {
+					frameShares[CART_DRIVER_FRAME_KEY(filesystem[dst]->location.occupiedCartridges[dstFrame], filesystem[dst]->location.occupiedFrames[dstFrame])]--;
+				}
+			}
+			else {
+				// Extends the destination by a frame
+				filesystem[dst]->location.frames = dstFrame;
+				if(grow_locations(filesystem[dst]) != 0) {
+					printf("cart_copy_range: Error growing the frame list of file %d\n", dst_fd);
+					return -1;
+				}
+			}
+			filesystem[dst]->location.occupiedCartridges[dstFrame] = filesystem[src]->location.occupiedCartridges[srcFrame];
+			filesystem[dst]->location.occupiedFrames[dstFrame] = filesystem[src]->location.occupiedFrames[srcFrame];
+			frameShares[CART_DRIVER_FRAME_KEY(filesystem[src]->location.occupiedCartridges[srcFrame], filesystem[src]->location.occupiedFrames[srcFrame])]++;
+			if(fileLengths[dst] < dst_off + done + chunk) {
+				fileLengths[dst] = dst_off + done + chunk;
+			}
+			shared++;
+			continue;
+		}
+
+		// Otherwise read a run of frames, up to the next point the frames could be shared again, and write it
+		// out a destination frame at a time (so each write adds at most one frame)
+		chunk = (CART_DRIVER_COPY_FRAMES * CART_FRAME_SIZE) - ((dst_off + done) % CART_FRAME_SIZE);
+		if(chunk > len - done) {
+			chunk = len - done;
+		}
+		if((((src_off + done) % CART_FRAME_SIZE) == ((dst_off + done) % CART_FRAME_SIZE)) && (chunk > CART_FRAME_SIZE - ((dst_off + done) % CART_FRAME_SIZE))) {
+			chunk = CART_FRAME_SIZE - ((dst_off + done) % CART_FRAME_SIZE);
+		}
+		if((cart_seek(src_fd, src_off + done) != 0) || (cart_read(src_fd, localBuf, chunk) != chunk) ||
+				(cart_seek(dst_fd, dst_off + done) != 0)) {
+			printf("cart_copy_range: failed reading %d bytes at %d\n", chunk, done);
+			return -1;
+		}
+		for(j=0; j<chunk; j+=piece) {
+			piece = CART_FRAME_SIZE - ((dst_off + done + j) % CART_FRAME_SIZE);
+			if(piece > chunk - j) {
+				piece = chunk - j;
+			}
+			if(cart_write(dst_fd, &localBuf[j], piece) != piece) {
+				printf("cart_copy_range: failed writing %d bytes at %d\n", piece, done + j);
+				return -1;
+			}
+		}
+	}
+
+	// The positions are left where they were
+	descPointers[src_fd - 1] = srcPointer;
+	descPointers[dst_fd - 1] = dstPointer;
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_COPY, src_fd, dst_fd, len, shared);
+	return len;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_fallocate
+// Description  : Reserves the frames a file needs to hold "len" bytes at
+//                "offset", extending the file if they end past it, without
+//                writing anything.  The frames are taken as one contiguous run
+//                (on a fresh cartridge if the run fits on one but not on the
+//                rest of the current one) and read as zero until written, so
+//                later writes into them read nothing and allocate nothing.
+//
+// Inputs       : fd - the file handle
+//                offset - start of the range
+//                len - bytes in the range
+// Outputs      : 0 if successful, -1 if failure
+
+int32_t cart_fallocate(int16_t fd, uint32_t offset, uint32_t len) {
+	int fileSystemIndex = file_index(fd);
+	int first, last, slot, frames, i;
+
+	if((fileSystemIndex == -1) || ((descModes[fd - 1] & CART_OPEN_WRITE) == 0)) {
+		printf("cart_fallocate: filehandle %d is bad, not open or not open for writing\n", fd);
+		return -1;
+	}
+	if((len == 0) || (offset > INT32_MAX - len)) {
+		printf("cart_fallocate: bad range (offset %u, len %u)\n", offset, len);
+		return -1;
+	}
+	if(frameUnwritten == NULL) {
+		if((frameUnwritten = driver_malloc(sizeof(uint8_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE)) == NULL) {
+			printf("cart_fallocate: Error allocating the unwritten frame flags\n");
+			return -1;
+		}
+		memset(frameUnwritten, 0x0, sizeof(uint8_t) * CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE);
+	}
+
+	// The frames past the file's last one (an empty file has none)
+	first = (fileLengths[fileSystemIndex] == 0) ? 0 : filesystem[fileSystemIndex]->location.frames + 1;
+	last = (offset + len - 1) / CART_FRAME_SIZE;
+	frames = ((last >> blockShift) - ((first + blockFrames - 1) >> blockShift) + 1) * blockFrames; // In the new blocks
+
+	// Start a run that fits on a cartridge on a fresh one rather than splitting it, keeping the
+	// frames skipped for the next single frame allocations (only one such hole is kept)
+	if((driverLayout == CART_LAYOUT_INPLACE) && (frames > 0) && (frames <= CART_CARTRIDGE_SIZE) &&
+			(nextFrame + frames > CART_CARTRIDGE_SIZE) && (holeFrames == 0) && (nextCartridge + 1 < driverCartridges)) {
+		holeCartridge = nextCartridge;
+		holeFrame = nextFrame;
+		holeFrames = CART_CARTRIDGE_SIZE - nextFrame;
+		nextCartridge++;
+		nextFrame = 0;
+	}
+	for(slot=first; slot<=last; slot++) {
+		filesystem[fileSystemIndex]->location.frames = slot;
+		if(grow_locations(filesystem[fileSystemIndex]) != 0) {
+			printf("cart_fallocate: Error growing the frame list of file %d\n", fd);
+			return -1;
+		}
+		if((slot & (blockFrames - 1)) != 0) {
+			continue; // Reserved with the rest of its block
+		}
+		if(allocate_head_frame(fileSystemIndex, slot >> blockShift, &filesystem[fileSystemIndex]->location.occupiedCartridges[slot >> blockShift], &filesystem[fileSystemIndex]->location.occupiedFrames[slot >> blockShift]) != 0) {
+			printf("cart_fallocate: Error allocating a frame for file %d\n", fd);
+			return -1;
+		}
+		for(i=0; i<blockFrames; i++) {
+			frameUnwritten[CART_DRIVER_FRAME_KEY(CART_DRIVER_CART(filesystem[fileSystemIndex], slot), CART_DRIVER_FRAME(filesystem[fileSystemIndex], slot) + i)] = 1;
+		}
+	}
+	if(fileLengths[fileSystemIndex] < offset + len) {
+		fileLengths[fileSystemIndex] = offset + len;
+	}
+
+	// Return successfully
+	CART_RING(CART_RING_LEVEL_OPS, CART_RING_DRV_FALLOCATE, fd, offset, len, (frames > 0) ? frames : 0);
 	return (0);
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_map
+// Description  : Maps a range of a file to the runs of frames holding it, so
+//                the caller can move its data over the bus itself (on other
+//                connections, or many batches at a time) instead of through
+//                cart_read and cart_write.  A writing map appends the range
+//                to the file, reserving its frames as cart_fallocate does
+//                and marking them written: the caller must write them all.
+//                Frames mapped for reading that were never written are in
+//                runs marked unwritten, which read as zero.  Only the
+//                in-place layout maps frames (the log's cleaner moves them)
+//                and not with the local tier (it holds newer copies), and the
+//                driver forgets which cartridge is loaded, as the caller will
+//                load others.
+//
+// Inputs       : fd - the file handle
+//                offset - start of the range (a whole number of frames, and
+//                         for writing the end of the file on a block boundary)
+//                len - bytes in the range
+//                writing - non-zero to append the range, zero to read it
+//                runs - where to place the runs
+//                max - the number of entries in runs
+// Outputs      : the number of runs, -1 if failure
+
+int32_t cart_map(int16_t fd, uint32_t offset, uint32_t len, int writing, CartFrameRun *runs, int max) {
+	int fileSystemIndex = file_index(fd);
+	int cartridge, frame, unwritten, n = 0, i;
+	files *file;
+
+	if((fileSystemIndex == -1) || ((descModes[fd - 1] & (writing ? CART_OPEN_WRITE : CART_OPEN_READ)) == 0)) {
+		printf("cart_map: filehandle %d is bad, not open or not open for %s\n", fd, writing ? "writing" : "reading");
+		return -1;
+	}
+	if((driverLayout != CART_LAYOUT_INPLACE) || cart_tier_enabled()) {
+		printf("cart_map: frames are only mapped with the in-place layout and no local tier\n");
+		return -1;
+	}
+	if((len == 0) || ((offset % CART_FRAME_SIZE) != 0) || (offset > INT32_MAX - len)) {
+		printf("cart_map: bad range (offset %u, len %u)\n", offset, len);
+		return -1;
+	}
+	if(writing) {
+		if((offset != fileLengths[fileSystemIndex]) || ((offset % (blockFrames * CART_FRAME_SIZE)) != 0)) {
+			printf("cart_map: a writing map must start at the end of the file, on a block boundary (offset %u)\n", offset);
+			return -1;
+		}
+		if(cart_fallocate(fd, offset, len) != 0) {
+			return -1;
+		}
+	} else if(offset + len > fileLengths[fileSystemIndex]) {
+		printf("cart_map: range past the end of file %d (offset %u, len %u)\n", fd, offset, len);
+		return -1;
+	}
+
+	// Gather the frames into runs of consecutive frames on a cartridge
+	file = filesystem[fileSystemIndex];
+	for(i=offset / CART_FRAME_SIZE; i<=(offset + len - 1) / CART_FRAME_SIZE; i++) {
+		cartridge = CART_DRIVER_CART(file, i);
+		frame = CART_DRIVER_FRAME(file, i);
+		if(writing) {
+			frameUnwritten[CART_DRIVER_FRAME_KEY(cartridge, frame)] = 0;
+		}
+		unwritten = CART_DRIVER_UNWRITTEN(cartridge, frame);
+		if((n > 0) && (runs[n - 1].cartridge == cartridge) && (runs[n - 1].frame + runs[n - 1].frames == frame) &&
+				(runs[n - 1].unwritten == unwritten)) {
+			runs[n - 1].frames++;
+			continue;
+		}
+		if(n == max) {
+			printf("cart_map: range of file %d needs more than %d runs\n", fd, max);
+			return -1;
+		}
+		runs[n].cartridge = cartridge;
+		runs[n].frame = frame;
+		runs[n].frames = 1;
+		runs[n].unwritten = unwritten;
+		n++;
+	}
+	currentlyLoadedCartridge = -1;
+
+	// Return successfully
+	return (n);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_driver_scan
+// Description  : Scan the whole namespace, summarizing the files and checking
+//                the positions against the lengths (only the field arrays
+//                are read, so this is a few sequential passes)
+//
+// Inputs       : scan - where to place the summary
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_driver_scan(CartDriverScan *scan) {
+	int i;
+
+	memset(scan, 0x0, sizeof(CartDriverScan));
+	scan->files = fileCount;
+	for(i = 0; i < fileCount; i++) {
+		scan->openFiles += (fileOpens[i] > 0);
+		scan->bytes += fileLengths[i];
+		if(fileLengths[i] > scan->maxLength) {
+			scan->maxLength = fileLengths[i];
+		}
+	}
+	for(i = 0; i < descCount; i++) {
+		scan->badPointers += (descFiles[i] != -1) && ((descPointers[i] > fileLengths[descFiles[i]]) || (descPointers[i] < 0));
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_driver_stats
+// Description  : Get the counters the driver keeps of the work it has done
+//
+// Inputs       : stats - where to place the counters
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_driver_stats(CartDriverStats *stats) {
+	memcpy(stats, &driverStats, sizeof(CartDriverStats));
+	stats->allocations += fileArena.mallocs;
+	if(fileArena.bytes != 0) {
+		stats->metadataBytes = fileArena.bytes; // Powered on, otherwise the size at the last poweroff
+	}
+	return 0;
+}
@@ -13,14 +13,69 @@
 
 // Include files
 #include <stdint.h>
+#include <cart_controller.h>
 
 // Defines
 #define CART_MAX_TOTAL_FILES 1024 // Maximum number of files ever
 #define CART_MAX_PATH_LENGTH 128 // Maximum length of filename length
+#define CART_OPEN_READ 0x1  // cart_open_mode: the handle may read
+#define CART_OPEN_WRITE 0x2 // cart_open_mode: the handle may write (and create the file)
+#define CART_OPEN_RDWR (CART_OPEN_READ | CART_OPEN_WRITE)
+
+// These are the counters the driver keeps of the work it has done
+typedef struct {
+	uint64_t busOps[CART_OP_MAXVAL]; // Bus requests issued, by opcode
+	uint64_t cacheHits;    // Frames found in the frame cache
+	uint64_t cacheMisses;  // Frames that had to be read from the bus
+	uint64_t allocations;  // Heap allocations (malloc/realloc) made by the driver
+	uint64_t bytesRead;    // Bytes returned by cart_read
+	uint64_t bytesWritten; // Bytes accepted by cart_write
+	uint64_t cleanedSegments; // Cartridges emptied by the log layout's cleaner
+	uint64_t cleanedFrames;   // Live frames the cleaner moved
+	uint64_t metadataBytes;   // Bytes of file metadata (the tables, names and frame lists) allocated
+} CartDriverStats;
+
+// These are the layouts of the file frames on the cartridges
+typedef enum {
+	CART_LAYOUT_INPLACE = 0, // A frame is rewritten where it is (the default)
+	CART_LAYOUT_LOG     = 1  // Every frame written goes to the head of a log, cleaned a cartridge at a time
+} CartDriverLayout;
+
+// This is the summary of a scan of the whole namespace
+typedef struct {
+	uint32_t files;       // Files in the filesystem
+	uint32_t openFiles;   // Files currently open
+	uint64_t bytes;       // Total length of the files
+	uint32_t maxLength;   // Length of the largest file
+	uint32_t badPointers; // Open handles whose position is outside the file (should be 0)
+} CartDriverScan;
+
+// This is a run of consecutive frames of a file on one cartridge (see cart_map)
+typedef struct {
+	uint16_t cartridge; // The cartridge
+	uint16_t frame;     // The first frame
+	uint16_t frames;    // Frames in the run
+	uint8_t  unwritten; // Non-zero if the frames were reserved and never written (they read as zero)
+} CartFrameRun;
 
 //
 // Interface functions
 
+int cart_set_layout(CartDriverLayout layout);
+	// Choose how file frames are placed, from the next poweron
+
+int cart_set_block_size(uint32_t bytes);
+	// Choose the logical block size of the files (1, 4, 16 or 64 KB), from the next poweron
+
+int cart_set_cartridges(int cartridges);
+	// Limit the files to the first cartridges, from the next poweron
+
+int cart_set_tier(const char *path, uint32_t extents);
+	// Keep the hot extents in a local store (NULL for none), from the next poweron
+
+int cart_set_shared_cache(const char *name);
+	// Cache blocks in the named shared memory segment, shared with other processes (NULL for none), from the next poweron
+
 int32_t cart_poweron(void);
 	// Startup up the CART interface, initialize filesystem
 
@@ -28,13 +83,17 @@ int32_t cart_poweroff(void);
 	// Shut down the CART interface, close all files
 
 int16_t cart_open(char *path);
-	// This function opens the file and returns a file handle
+	// This function opens the file for reading and writing and returns a file handle
+
+int16_t cart_open_mode(char *path, int mode);
+	// This function opens the file with the given access mode and returns a file handle
 
 int16_t cart_close(int16_t fd);
 	// This function closes the file
 
 int32_t cart_read(int16_t fd, void *buf, int32_t count);
 	// Reads "count" bytes from the file handle "fh" into the buffer  "buf"
+	// (several threads may read at once through read-only descriptions, if no other call runs alongside)
 
 int32_t cart_write(int16_t fd, void *buf, int32_t count);
 	// Writes "count" bytes to the file handle "fh" from the buffer  "buf"
@@ -42,6 +101,21 @@ int32_t cart_write(int16_t fd, void *buf, int32_t count);
 int32_t cart_seek(int16_t fd, uint32_t loc);
 	// Seek to specific point in the file
 
+int32_t cart_fallocate(int16_t fd, uint32_t offset, uint32_t len);
+	// Reserve contiguous frames for a range of a file, which read as zero until written
+
+int32_t cart_map(int16_t fd, uint32_t offset, uint32_t len, int writing, CartFrameRun *runs, int max);
+	// Map a range of a file to the runs of frames holding it, for moving its data over the bus directly
+
+int32_t cart_copy_range(int16_t src_fd, uint32_t src_off, int16_t dst_fd, uint32_t dst_off, int32_t len);
+	// Copy a range of one file into another, sharing whole frames where aligned
+
+int cart_driver_stats(CartDriverStats *stats);
+	// Get the counters the driver keeps of the work it has done
+
+int cart_driver_scan(CartDriverScan *scan);
+	// Scan the whole namespace, summarizing the files
+
 
 #endif
 
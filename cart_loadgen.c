@@ -0,0 +1,872 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_loadgen.c
+//  Description    : This is the open-loop load generator for the CART stack
+//                   (driver, client and server).  cart_sim is closed loop: it
+//                   issues the next operation only when the last one finishes,
+//                   so it never shows how latency grows with offered load.
+//                   This tool schedules operations at a target rate with
+//                   Poisson arrivals and measures each one from its scheduled
+//                   start, so time spent queued behind a slow operation is
+//                   counted (the coordinated omission correction).  It sweeps
+//                   a list of rates and prints throughput against the latency
+//                   percentiles, one row per rate.
+//
+//                   With -t the load is issued by several threads, each on
+//                   its own connection with its own share of the arrivals
+//                   and its own latency histograms (merged for the report).
+//                   The driver's file table and cache are single-threaded,
+//                   so, as in cart_bulk, the driver only maps the files
+//                   (cart_map) and the threads move the frames themselves,
+//                   reading the frames a write only covers in part first.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+// Project Includes
+#include <cart_controller.h>
+#include <cart_driver.h>
+#include <cart_cache.h>
+#include <cart_tier.h>
+#include <cart_shcache.h>
+#include <cart_codec.h>
+#include <cart_network.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_LOADGEN_ARGUMENTS "hcf:z:n:w:Z:R:d:S:C:B:T:E:M:t:i:p:"
+#define CART_LOADGEN_DEFAULT_RATES "500,1000,2000,5000,10000,20000"
+#define CART_LOADGEN_DEFAULT_FILES 32      // Files the operations are spread over
+#define CART_LOADGEN_DEFAULT_FILE_SIZE 65536 // Bytes in each file
+#define CART_LOADGEN_DEFAULT_IO 256        // Bytes per read or write
+#define CART_LOADGEN_MAX_IO (CART_FRAME_SIZE * 64) // Largest read or write
+#define CART_LOADGEN_DEFAULT_WRITES 30     // Percent of operations that are writes
+#define CART_LOADGEN_DEFAULT_DURATION 2.0  // Seconds per rate
+#define CART_LOADGEN_SUB_BUCKETS 32        // Histogram buckets per power of two
+#define CART_LOADGEN_BUCKETS (64 * CART_LOADGEN_SUB_BUCKETS)
+#define CART_LOADGEN_MAX_THREADS 64        // Most issuer threads
+#define CART_LOADGEN_MAX_FRAMES ((CART_LOADGEN_MAX_IO / CART_FRAME_SIZE) + 1) // Most frames an operation touches
+#define USAGE \
+	"USAGE: cart_loadgen [-h] [-c] [-f <files>] [-z <bytes>] [-n <bytes>] [-w <pct>] [-Z <skew>]\n" \
+	"                    [-R <rates>] [-d <seconds>] [-S <seed>] [-C <sz>] [-B <bytes>]\n" \
+	"                    [-T <tierfile>] [-E <extents>] [-M <segment>] [-t <threads>]\n" \
+	"                    [-i <ip>] [-p <port>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -c - print the results as CSV\n" \
+	"    -f - number of files (default 32)\n" \
+	"    -z - size of each file in bytes (default 65536)\n" \
+	"    -n - bytes per read or write (default 256, at most 65536)\n" \
+	"    -w - percent of operations that are writes (default 30)\n" \
+	"    -Z - pick the files with a zipf distribution of exponent <skew> (default 0, uniform)\n" \
+	"    -R - comma separated target rates in ops/sec (default 500,...,20000)\n" \
+	"    -d - seconds to run each rate (default 2)\n" \
+	"    -S - seed for the arrivals and offsets (default 1)\n" \
+	"    -C - set the cart frame cache to size <sz>\n" \
+	"    -B - set the file block size to <bytes> (1024, 4096, 16384 or 65536)\n" \
+	"    -T - keep the hot extents in the local store <tierfile> (a local disk)\n" \
+	"    -E - extents of 64 KB the local store holds (default 64)\n" \
+	"    -M - cache in the shared memory <segment> (e.g. /cart), of the size set with -C\n" \
+	"    -t - issue the load from <threads> threads, each on its own connection (at most\n" \
+	"         64; the frames bypass the driver's cache, and more than one thread needs a\n" \
+	"         server that serves connections at once, the reference cart_server serves\n" \
+	"         them one at a time)\n" \
+	"    -i - IP address of server to connect to.\n" \
+	"    -p - port number of server to connect to.\n" \
+	"\n" \
+
+// This is a latency histogram (log-linear, ns)
+typedef struct {
+	uint64_t counts[CART_LOADGEN_BUCKETS]; // Operations per bucket
+	uint64_t total;                        // Operations recorded
+	uint64_t max;                          // Largest value recorded
+} CartLoadgenHistogram;
+
+// This is an issuer thread of -t
+typedef struct {
+	pthread_t thread;              // The thread
+	int       index;               // Its number (the seed of its arrivals)
+	double    rate;                // Its share of the target rate (ops/sec)
+	uint64_t  start, end;          // When it starts and stops issuing (ns)
+	uint64_t  ops;                 // Operations it finished
+	int       failed;              // Non-zero if an operation failed
+	CartLoadgenHistogram corrected; // Latency from the scheduled start
+	CartLoadgenHistogram service;   // Latency from the actual start
+} CartLoadgenIssuer;
+
+//
+// Global data
+
+static __thread uint64_t random_state; // xorshift64 state (each issuer thread has its own)
+static uint64_t random_seed;            // Seed of the arrivals and offsets
+static double *file_cdf = NULL; // Cumulative probability of picking each file, NULL if they are equally likely
+
+// The workload, shared by the issuer threads (read only while they run)
+static int load_files, load_writes;       // Number of files, percent of operations that are writes
+static uint32_t load_fsize, load_iosize;  // Bytes in each file, bytes per operation
+static uint32_t *file_frames = NULL;      // Where each frame of each file is (cartridge << 16 | frame), for -t
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_random
+// Description  : Get the next value of the xorshift64 generator
+//
+// Inputs       : none
+// Outputs      : the random value
+
+static uint64_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : make_zipf
+// Description  : Make the files zipf distributed (file i picked with
+//                probability proportional to 1 / (i + 1)^skew)
+//
+// Inputs       : nfiles - the number of files
+//                skew - the exponent
+// Outputs      : 0 if successful, -1 if failure
+
+static int make_zipf(int nfiles, double skew) {
+	double sum = 0.0;
+	int i;
+
+	if((file_cdf = malloc(sizeof(double) * nfiles)) == NULL) {
+		return -1;
+	}
+	for(i=0; i<nfiles; i++) {
+		sum += 1.0 / pow(i + 1, skew);
+		file_cdf[i] = sum;
+	}
+	for(i=0; i<nfiles; i++) {
+		file_cdf[i] /= sum;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pick_file
+// Description  : Pick the file of the next operation
+//
+// Inputs       : nfiles - the number of files
+// Outputs      : the file
+
+static int pick_file(int nfiles) {
+	double u;
+	int lo = 0, hi = nfiles - 1, mid;
+
+	if(file_cdf == NULL) {
+		return next_random() % nfiles;
+	}
+	u = (next_random() >> 11) * (1.0 / 9007199254740992.0);
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if(file_cdf[mid] <= u) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_arrival
+// Description  : Get the time to the next Poisson arrival (exponential gap)
+//
+// Inputs       : rate - the arrival rate in ops/sec
+// Outputs      : the gap in ns
+
+static uint64_t next_arrival(double rate) {
+	double u = ((next_random() >> 11) + 1) * (1.0 / 9007199254740993.0);
+
+	return (uint64_t)((-log(u) / rate) * 1e9);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_ns
+// Description  : Get the monotonic time
+//
+// Inputs       : none
+// Outputs      : the time in ns
+
+static uint64_t now_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : record_latency
+// Description  : Add a value to a histogram (buckets are exact below 64 and
+//                1/32 of a power of two wide above)
+//
+// Inputs       : hist - the histogram
+//                value - the latency in ns
+// Outputs      : none
+
+static void record_latency(CartLoadgenHistogram *hist, uint64_t value) {
+	int msb, shift, idx;
+
+	if(value < 2 * CART_LOADGEN_SUB_BUCKETS) {
+		idx = value;
+	} else {
+		msb = 63 - __builtin_clzll(value);
+		shift = msb - 5;
+		idx = ((shift + 1) * CART_LOADGEN_SUB_BUCKETS) + ((value >> shift) - CART_LOADGEN_SUB_BUCKETS);
+	}
+	hist->counts[idx]++;
+	hist->total++;
+	if(value > hist->max) {
+		hist->max = value;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : percentile
+// Description  : Get a percentile of a histogram (the top of its bucket)
+//
+// Inputs       : hist - the histogram
+//                pct - the percentile (0-100)
+// Outputs      : the latency in ns
+
+static uint64_t percentile(CartLoadgenHistogram *hist, double pct) {
+	uint64_t want, seen = 0, top;
+	int idx, shift;
+
+	if(hist->total == 0) {
+		return 0;
+	}
+	want = (uint64_t)ceil((pct / 100.0) * hist->total);
+	for(idx=0; idx<CART_LOADGEN_BUCKETS; idx++) {
+		seen += hist->counts[idx];
+		if((seen >= want) && (hist->counts[idx] > 0)) {
+			if(idx < 2 * CART_LOADGEN_SUB_BUCKETS) {
+				return idx;
+			}
+			shift = (idx / CART_LOADGEN_SUB_BUCKETS) - 1;
+			top = ((uint64_t)((idx % CART_LOADGEN_SUB_BUCKETS) + CART_LOADGEN_SUB_BUCKETS + 1) << shift) - 1;
+			return (top < hist->max) ? top : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : merge_histogram
+// Description  : Add a histogram into another
+//
+// Inputs       : into - the histogram added to
+//                from - the histogram added
+// Outputs      : none
+
+static void merge_histogram(CartLoadgenHistogram *into, CartLoadgenHistogram *from) {
+	int idx;
+
+	for(idx=0; idx<CART_LOADGEN_BUCKETS; idx++) {
+		into->counts[idx] += from->counts[idx];
+	}
+	into->total += from->total;
+	if(from->max > into->max) {
+		into->max = from->max;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : print_row
+// Description  : Print a rate's row of the curve
+//
+// Inputs       : rate - the target rate in ops/sec
+//                ops - the operations finished
+//                seconds - the time they took
+//                corrected, service - their latency histograms
+//                csv - print CSV rather than a table
+// Outputs      : none
+
+static void print_row(double rate, uint64_t ops, double seconds, CartLoadgenHistogram *corrected,
+		CartLoadgenHistogram *service, int csv) {
+	if(csv) {
+		printf("%.0f,%.1f,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", rate,
+			ops / seconds, (unsigned long)ops,
+			percentile(corrected, 50) / 1e3, percentile(corrected, 90) / 1e3,
+			percentile(corrected, 99) / 1e3, percentile(corrected, 99.9) / 1e3,
+			corrected->max / 1e3, percentile(service, 50) / 1e3, percentile(service, 99) / 1e3);
+	} else {
+		printf("%10.0f %10.1f %9lu %10.1f %10.1f %10.1f %10.1f %11.1f %10.1f %10.1f\n", rate,
+			ops / seconds, (unsigned long)ops,
+			percentile(corrected, 50) / 1e3, percentile(corrected, 90) / 1e3,
+			percentile(corrected, 99) / 1e3, percentile(corrected, 99.9) / 1e3,
+			corrected->max / 1e3, percentile(service, 50) / 1e3, percentile(service, 99) / 1e3);
+	}
+	fflush(stdout);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_rate
+// Description  : Offer load at one rate and print its row of the curve
+//
+// Inputs       : rate - the target rate in ops/sec
+//                duration - the seconds to run
+//                fds - the open files
+//                nfiles - the number of files
+//                fsize - the size of each file
+//                iosize - the bytes per operation
+//                writes - the percent of operations that are writes
+//                csv - print CSV rather than a table
+// Outputs      : 0 if successful, -1 if failure
+
+static int run_rate(double rate, double duration, int16_t *fds, int nfiles, uint32_t fsize,
+		uint32_t iosize, int writes, int csv) {
+	static CartLoadgenHistogram corrected, service;
+	struct timespec pause;
+	char buf[CART_LOADGEN_MAX_IO];
+	uint64_t start, end, intended, issued, finished, ops = 0;
+	int16_t fd;
+	uint32_t off;
+	int write;
+
+	memset(&corrected, 0x0, sizeof(corrected));
+	memset(&service, 0x0, sizeof(service));
+	memset(buf, 'l', sizeof(buf));
+	start = now_ns();
+	end = start + (uint64_t)(duration * 1e9);
+	for(intended=start+next_arrival(rate); intended<end; intended+=next_arrival(rate)) {
+
+		// Wait for the scheduled start, but never skip or delay the schedule
+		while((issued = now_ns()) < intended) {
+			if(intended - issued > 100000) {
+				pause.tv_sec = 0;
+				pause.tv_nsec = (intended - issued) - 50000;
+				nanosleep(&pause, NULL);
+			}
+		}
+
+		// Issue the operation
+		fd = fds[pick_file(nfiles)];
+		off = next_random() % (fsize - iosize + 1);
+		write = (next_random() % 100) < writes;
+		if((cart_seek(fd, off) != 0) ||
+				((write ? cart_write(fd, buf, iosize) : cart_read(fd, buf, iosize)) != iosize)) {
+			logMessage(LOG_ERROR_LEVEL, "Operation on file handle %d at offset %u failed.", fd, off);
+			return -1;
+		}
+		finished = now_ns();
+
+		// Measure from the scheduled start (corrected) and the actual start
+		record_latency(&corrected, finished - intended);
+		record_latency(&service, finished - issued);
+		ops++;
+	}
+	finished = now_ns();
+	print_row(rate, ops, (finished - start) / 1e9, &corrected, &service, csv);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : issue_frames
+// Description  : Move a run of frames of one cartridge over this thread's
+//                connection, loading the cartridge first if it is not the
+//                one loaded (the LDCART leads the first batch)
+//
+// Inputs       : opcode - CART_OP_RDFRME or CART_OP_WRFRME
+//                cartridge, frame - the first frame
+//                n - the number of frames
+//                buf - the frames (read into or written from)
+//                loaded - the cartridge loaded on the connection, updated
+// Outputs      : 0 if successful, -1 if failure
+
+static int issue_frames(uint8_t opcode, int cartridge, int frame, int n, char *buf, int *loaded) {
+	static __thread char batch[(CART_NET_MAX_BATCH + 1) * CART_FRAME_SIZE];
+	CartXferRegister regs[CART_NET_MAX_BATCH];
+	int lead, count, i;
+
+	while(n > 0) {
+		lead = (*loaded != cartridge);
+		count = (n < CART_NET_MAX_BATCH - lead) ? n : CART_NET_MAX_BATCH - lead;
+		if(lead) {
+			regs[0] = cart_pack_registers(CART_OP_LDCART, 0, 0, cartridge, 0);
+		}
+		for(i=0; i<count; i++) {
+			regs[lead + i] = cart_pack_registers(opcode, 0, 0, 0, frame + i);
+		}
+
+		// The buffer is indexed by request, so the frames follow the LDCART's slot
+		if(opcode == CART_OP_WRFRME) {
+			memcpy(&batch[lead * CART_FRAME_SIZE], buf, (size_t)count * CART_FRAME_SIZE);
+		}
+		if(client_cart_bus_batch(regs, lead + count, batch) != 0) {
+			return -1;
+		}
+		for(i=0; i<lead + count; i++) {
+			if(cart_register_rt1(regs[i]) != 0) {
+				return -1;
+			}
+		}
+		if(opcode == CART_OP_RDFRME) {
+			memcpy(buf, &batch[lead * CART_FRAME_SIZE], (size_t)count * CART_FRAME_SIZE);
+		}
+		*loaded = cartridge;
+		frame += count;
+		buf += (size_t)count * CART_FRAME_SIZE;
+		n -= count;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : issue_operation
+// Description  : Read or write a range of a file directly over this thread's
+//                connection.  A write first reads the frames it only covers
+//                in part (as cart_write does).
+//
+// Inputs       : file - the file
+//                off - the first byte
+//                write - non-zero for a write
+//                loaded - the cartridge loaded on the connection, updated
+// Outputs      : 0 if successful, -1 if failure
+
+static int issue_operation(int file, uint32_t off, int write, int *loaded) {
+	char frames[CART_LOADGEN_MAX_FRAMES * CART_FRAME_SIZE];
+	uint32_t *where = &file_frames[(size_t)file * ((load_fsize + CART_FRAME_SIZE - 1) / CART_FRAME_SIZE)];
+	int first = off / CART_FRAME_SIZE, last = (off + load_iosize - 1) / CART_FRAME_SIZE;
+	int i, run, edge;
+
+	for(i=first; i<=last; i+=run) {
+
+		// A run of consecutive frames on one cartridge
+		for(run=1; (i + run <= last) && (where[i + run] == where[i] + run); run++);
+
+		// A write needs the old contents of the frames at either end it does not cover
+		edge = (i == first) && ((off % CART_FRAME_SIZE) != 0);
+		edge |= (i + run - 1 == last) && (((off + load_iosize) % CART_FRAME_SIZE) != 0);
+		if((!write || edge) && (issue_frames(CART_OP_RDFRME, where[i] >> 16, where[i] & 0xffff, run,
+				&frames[(i - first) * CART_FRAME_SIZE], loaded) != 0)) {
+			return -1;
+		}
+	}
+	if(!write) {
+		return 0;
+	}
+
+	// Fill the range (keeping the bytes of the end frames outside it), then write every frame
+	memset(&frames[off % CART_FRAME_SIZE], 'l', load_iosize);
+	for(i=first; i<=last; i+=run) {
+		for(run=1; (i + run <= last) && (where[i + run] == where[i] + run); run++);
+		if(issue_frames(CART_OP_WRFRME, where[i] >> 16, where[i] & 0xffff, run, &frames[(i - first) * CART_FRAME_SIZE], loaded) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_issuer
+// Description  : Issue one thread's share of the load of a rate (the thread
+//                function of -t)
+//
+// Inputs       : arg - the CartLoadgenIssuer
+// Outputs      : NULL
+
+static void * run_issuer(void *arg) {
+	CartLoadgenIssuer *issuer = arg;
+	struct timespec pause;
+	uint64_t intended, issued, finished;
+	int loaded = -1, file, write;
+	uint32_t off;
+
+	random_state = random_seed ^ ((uint64_t)(issuer->index + 1) * 0x9e3779b97f4a7c15ULL);
+	for(intended=issuer->start+next_arrival(issuer->rate); intended<issuer->end; intended+=next_arrival(issuer->rate)) {
+
+		// Wait for the scheduled start, but never skip or delay the schedule
+		while((issued = now_ns()) < intended) {
+			if(intended - issued > 100000) {
+				pause.tv_sec = 0;
+				pause.tv_nsec = (intended - issued) - 50000;
+				nanosleep(&pause, NULL);
+			}
+		}
+
+		// Issue the operation, and measure it from the scheduled and the actual start
+		file = pick_file(load_files);
+		off = next_random() % (load_fsize - load_iosize + 1);
+		write = (next_random() % 100) < load_writes;
+		if(issue_operation(file, off, write, &loaded) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Issuer %d operation on file %d at offset %u failed.", issuer->index, file, off);
+			issuer->failed = 1;
+			break;
+		}
+		finished = now_ns();
+		record_latency(&issuer->corrected, finished - intended);
+		record_latency(&issuer->service, finished - issued);
+		issuer->ops++;
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_rate_threads
+// Description  : Offer load at one rate from several threads (each issuing
+//                its share on its own connection) and print its row of the
+//                curve, from the threads' histograms merged
+//
+// Inputs       : rate - the target rate in ops/sec
+//                duration - the seconds to run
+//                threads - the number of issuer threads (one runs inline)
+//                csv - print CSV rather than a table
+// Outputs      : 0 if successful, -1 if failure
+
+static int run_rate_threads(double rate, double duration, int threads, int csv) {
+	static CartLoadgenIssuer issuers[CART_LOADGEN_MAX_THREADS];
+	static CartLoadgenHistogram corrected, service;
+	uint64_t start, ops = 0;
+	int started, failed = 0, i;
+
+	memset(issuers, 0x0, sizeof(issuers));
+	start = now_ns();
+	for(i=0; i<threads; i++) {
+		issuers[i].index = i;
+		issuers[i].rate = rate / threads;
+		issuers[i].start = start;
+		issuers[i].end = start + (uint64_t)(duration * 1e9);
+	}
+
+	// A single issuer runs on this thread, keeping to this thread's connection
+	if(threads == 1) {
+		run_issuer(&issuers[0]);
+		started = 1;
+	} else {
+		for(started=0; started<threads; started++) {
+			if(pthread_create(&issuers[started].thread, NULL, run_issuer, &issuers[started]) != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Failure starting issuer thread %d.", started);
+				failed = 1;
+				break;
+			}
+		}
+		for(i=0; i<started; i++) {
+			pthread_join(issuers[i].thread, NULL);
+		}
+	}
+
+	// Merge the threads' histograms
+	memset(&corrected, 0x0, sizeof(corrected));
+	memset(&service, 0x0, sizeof(service));
+	for(i=0; i<started; i++) {
+		merge_histogram(&corrected, &issuers[i].corrected);
+		merge_histogram(&service, &issuers[i].service);
+		ops += issuers[i].ops;
+		failed |= issuers[i].failed;
+	}
+	if(failed) {
+		return -1;
+	}
+	print_row(rate, ops, (now_ns() - start) / 1e9, &corrected, &service, csv);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : map_files
+// Description  : Find where every frame of every file is (cart_map), for the
+//                issuer threads of -t
+//
+// Inputs       : fds - the open files
+//                nfiles - the number of files
+//                fsize - the size of each file
+// Outputs      : 0 if successful, -1 if failure
+
+static int map_files(int16_t *fds, int nfiles, uint32_t fsize) {
+	uint32_t frames = (fsize + CART_FRAME_SIZE - 1) / CART_FRAME_SIZE, k;
+	CartFrameRun *runs;
+	int file, n, r, f, ret = 0;
+
+	file_frames = malloc(sizeof(uint32_t) * frames * nfiles);
+	runs = malloc(sizeof(CartFrameRun) * frames);
+	if((file_frames == NULL) || (runs == NULL)) {
+		free(runs);
+		return -1;
+	}
+	for(file=0; file<nfiles; file++) {
+		if((n = cart_map(fds[file], 0, fsize, 0, runs, frames)) == -1) {
+			ret = -1;
+			break;
+		}
+		for(r=0, k=0; r<n; r++) {
+			for(f=0; f<runs[r].frames; f++) {
+				file_frames[((size_t)file * frames) + k++] = ((uint32_t)runs[r].cartridge << 16) | (runs[r].frame + f);
+			}
+		}
+	}
+	free(runs);
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the load generator
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, csv = 0, nfiles = CART_LOADGEN_DEFAULT_FILES, writes = CART_LOADGEN_DEFAULT_WRITES, threads = 0, i;
+	uint32_t fsize = CART_LOADGEN_DEFAULT_FILE_SIZE, iosize = CART_LOADGEN_DEFAULT_IO, cache_size = 0, block_size, tier_extents = 0, written, chunk;
+	double duration = CART_LOADGEN_DEFAULT_DURATION, rate, skew = 0.0;
+	uint64_t seed = 1;
+	char *ratelist, *tok, *save, *tier_file = NULL, *shared_cache = NULL, fname[CART_MAX_PATH_LENGTH], buf[CART_FRAME_SIZE];
+	CartTierStats tier;
+	CartShcacheStats shared;
+	int16_t *fds;
+
+	// Process the command line parameters
+	ratelist = strdup(CART_LOADGEN_DEFAULT_RATES);
+	while ((ch = getopt(argc, argv, CART_LOADGEN_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'c': // CSV output
+			csv = 1;
+			break;
+
+		case 'f': // Set the number of files
+			if ( (sscanf(optarg, "%d", &nfiles) != 1) || (nfiles < 1) ) {
+				fprintf( stderr, "Bad file count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'z': // Set the file size
+			if ( sscanf(optarg, "%u", &fsize) != 1 ) {
+				fprintf( stderr, "Bad file size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'n': // Set the operation size
+			if ( (sscanf(optarg, "%u", &iosize) != 1) || (iosize < 1) || (iosize > CART_LOADGEN_MAX_IO) ) {
+				fprintf( stderr, "Bad operation size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'w': // Set the write percentage
+			if ( (sscanf(optarg, "%d", &writes) != 1) || (writes < 0) || (writes > 100) ) {
+				fprintf( stderr, "Bad write percentage [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'Z': // Set the skew
+			if ( (sscanf(optarg, "%lf", &skew) != 1) || (skew < 0) ) {
+				fprintf( stderr, "Bad skew [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'R': // Set the rates
+			free(ratelist);
+			ratelist = strdup(optarg);
+			break;
+
+		case 'd': // Set the duration
+			if ( (sscanf(optarg, "%lf", &duration) != 1) || (duration <= 0) ) {
+				fprintf( stderr, "Bad duration [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'S': // Set the seed
+			if ( (sscanf(optarg, "%lu", &seed) != 1) || (seed == 0) ) {
+				fprintf( stderr, "Bad seed [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'C': // Set the cache size
+			if ( sscanf(optarg, "%u", &cache_size) != 1 ) {
+				fprintf( stderr, "Bad cache size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'B': // Set the block size
+			if ( (sscanf(optarg, "%u", &block_size) != 1) || (cart_set_block_size(block_size) != 0) ) {
+				fprintf( stderr, "Bad block size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'T': // Keep the hot extents in a local store
+			tier_file = optarg;
+			break;
+
+		case 'E': // Set the local store size
+			if ( (sscanf(optarg, "%u", &tier_extents) != 1) || (tier_extents == 0) ) {
+				fprintf( stderr, "Bad extent count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'M': // Cache in a shared memory segment
+			shared_cache = optarg;
+			break;
+
+		case 't': // Set the number of issuer threads
+			if ( (sscanf(optarg, "%d", &threads) != 1) || (threads < 1) || (threads > CART_LOADGEN_MAX_THREADS) ) {
+				fprintf( stderr, "Bad thread count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'i': // Get the IP address
+			if (inet_addr(optarg) == INADDR_NONE) {
+				fprintf( stderr, "Bad IP address [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			cart_network_address = (unsigned char *)strdup(optarg);
+			break;
+
+		case 'p': // Set the network port number
+			if ( sscanf(optarg, "%hu", &cart_network_port) != 1 ) {
+				fprintf( stderr, "Bad port number [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	random_state = random_seed = seed;
+	if ( fsize < iosize ) {
+		fprintf( stderr, "File size must be at least the operation size, aborting.\n" );
+		return( -1 );
+	}
+	if ( (threads > 0) && ((tier_file != NULL) || (shared_cache != NULL)) ) {
+		fprintf( stderr, "The issuer threads (-t) bypass the driver, so cannot use -T or -M, aborting.\n" );
+		return( -1 );
+	}
+	load_files = nfiles;
+	load_writes = writes;
+	load_fsize = fsize;
+	load_iosize = iosize;
+	if ( cache_size != 0 ) {
+		set_cart_cache_size(cache_size);
+	}
+	if ( ((skew > 0) && (make_zipf(nfiles, skew) != 0)) || ((tier_file != NULL) && (cart_set_tier(tier_file, tier_extents) != 0)) ||
+			((shared_cache != NULL) && (cart_set_shared_cache(shared_cache) != 0)) ) {
+		fprintf( stderr, "Setup failed, aborting.\n" );
+		return( -1 );
+	}
+
+	// Power on and create the files
+	if ( cart_poweron() != 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "CART power on failed, is cart_server running?" );
+		return( -1 );
+	}
+	fds = malloc(sizeof(int16_t) * nfiles);
+	memset(buf, 'i', sizeof(buf));
+	for (i=0; i<nfiles; i++) {
+		snprintf(fname, sizeof(fname), "loadgen%04d", i);
+		if ( (fds[i] = cart_open(fname)) == -1 ) {
+			logMessage( LOG_ERROR_LEVEL, "Open of [%s] failed.", fname );
+			return( -1 );
+		}
+		for (written=0; written<fsize; written+=chunk) {
+			chunk = (fsize - written < CART_FRAME_SIZE) ? fsize - written : CART_FRAME_SIZE;
+			if ( cart_write(fds[i], buf, chunk) != chunk ) {
+				logMessage( LOG_ERROR_LEVEL, "Setup write of [%s] failed.", fname );
+				return( -1 );
+			}
+		}
+	}
+
+	// The issuer threads need to know where the frames of the files are
+	if ( (threads > 0) && (map_files(fds, nfiles, fsize) != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "Mapping the files for the issuer threads failed." );
+		return( -1 );
+	}
+
+	// Sweep the rates (latencies in usec, from the scheduled start)
+	if ( csv ) {
+		printf("target,achieved,ops,p50_us,p90_us,p99_us,p999_us,max_us,service_p50_us,service_p99_us\n");
+	} else {
+		printf("%10s %10s %9s %10s %10s %10s %10s %11s %10s %10s\n", "target/s", "achieved/s", "ops",
+			"p50 us", "p90 us", "p99 us", "p99.9 us", "max us", "svc p50", "svc p99");
+	}
+	for (tok=strtok_r(ratelist, ",", &save); tok!=NULL; tok=strtok_r(NULL, ",", &save)) {
+		if ( (sscanf(tok, "%lf", &rate) != 1) || (rate <= 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad rate [%s], skipping.", tok );
+			continue;
+		}
+		if ( ((threads > 0) ? run_rate_threads(rate, duration, threads, csv) :
+				run_rate(rate, duration, fds, nfiles, fsize, iosize, writes, csv)) != 0 ) {
+			return( -1 );
+		}
+	}
+
+	// The work of the local tier, over all of the rates
+	if ( (tier_file != NULL) && !csv ) {
+		cart_tier_stats(&tier);
+		printf("local tier: %lu promotions, %lu demotions, %lu frames read and %lu written locally, %lu written back\n",
+			(unsigned long)tier.promotions, (unsigned long)tier.demotions, (unsigned long)tier.reads,
+			(unsigned long)tier.writes, (unsigned long)tier.writebacks);
+	}
+
+	// The work of the shared cache, over all of the processes using it
+	if ( (shared_cache != NULL) && !csv ) {
+		cart_shcache_stats(&shared);
+		printf("shared cache: %lu hits, %lu misses, %lu fills, %lu stale fills dropped\n",
+			(unsigned long)shared.hits, (unsigned long)shared.misses, (unsigned long)shared.fills, (unsigned long)shared.stale);
+	}
+
+	// Clean up
+	for (i=0; i<nfiles; i++) {
+		cart_close(fds[i]);
+	}
+	free(fds);
+	free(ratelist);
+	free(file_cdf);
+	free(file_frames);
+	return( (cart_poweroff() == 0) ? 0 : -1 );
+}
@@ -0,0 +1,1718 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_microbench.c
+//  Description    : This is the microbenchmark suite for the CART driver
+//                   primitives.  It times the frame cache (hit, miss, insert,
+//                   evict and promote, plus mixed access streams with uniform,
+//                   zipf and looping key distributions) across cache sizes,
+//                   and the offset-to-frame mapping of cart_read/cart_write on
+//                   small and huge files, the copy throughput of sequential
+//                   reads and writes and of cart_copy_range, the latency of
+//                   small reads, files grown side by side with and without
+//                   cart_fallocate, readers of a file each through its own
+//                   read-only handle, taking turns on one thread and in
+//                   threads of their own, random overwrites in place and in
+//                   the log layout, and whole-namespace scans of the file
+//                   metadata.
+//                   The driver is linked against a null bus
+//                   (client_cart_bus_request below), so no server is needed
+//                   and only the driver's own work is measured; the copy
+//                   benchmarks switch it to keep the frames in memory.
+//                   Results are in ns/op, with cycles and cache misses per op
+//                   from perf_event_open where the kernel allows it.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+// Project Includes
+#include <cart_controller.h>
+#include <cart_driver.h>
+#include <cart_cache.h>
+#include <cart_codec.h>
+#include <cart_network.h>
+#include <cart_arena.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_MICROBENCH_ARGUMENTS "hn:s:S:f:"
+#define CART_MICROBENCH_DEFAULT_OPS 50000 // Operations per benchmark
+#define CART_MICROBENCH_DEFAULT_SIZES "16,64,256,1024,4096"
+#define CART_MICROBENCH_KEYS (CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE) // Distinct frames
+#define CART_MICROBENCH_ZIPF 0.99 // Skew of the zipf distribution
+#define CART_MICROBENCH_SMALL_FILE 512 // Bytes in the small file
+#define CART_MICROBENCH_HUGE_FILE (16 * 1024 * 1024) // Bytes in the huge file
+#define CART_MICROBENCH_IO 64 // Bytes per mapped read/write
+#define CART_MICROBENCH_COPY_FILE (4 * 1024 * 1024) // Bytes in the copy file
+#define CART_MICROBENCH_READ_FRAMES 64 // Frames in the small read file
+#define CART_MICROBENCH_RANGE_FILE (1024 * 1024) // Bytes in the copy range source
+#define CART_MICROBENCH_RANGE_COPIES 4 // Copies made by each copy range benchmark
+#define CART_MICROBENCH_LAYOUT_FILES 16 // Files overwritten by the layout benchmarks
+#define CART_MICROBENCH_LAYOUT_FILE (2 * 1024 * 1024) // Bytes in each of them (32 cartridges in all)
+#define CART_MICROBENCH_LAYOUT_CARTRIDGES 36 // Cartridge budget of the layout benchmarks, so the log cleaner runs within a few thousand writes
+#define CART_MICROBENCH_LAYOUT_IO 100 // Bytes per overwrite
+#define CART_MICROBENCH_INTERLEAVED_FILE (1024 * 1024) // Bytes in the file the interleaved readers share
+#define CART_MICROBENCH_INTERLEAVED_IO 4096 // Bytes per interleaved read
+#define CART_MICROBENCH_THREADED_READS 2000 // Most reads (of CART_MICROBENCH_INTERLEAVED_IO bytes) per threaded reader benchmark
+#define CART_MICROBENCH_BUS_LATENCY 20000 // Nanoseconds each request waits on the memory bus in the threaded reader benchmarks
+#define CART_MICROBENCH_GROW_FILES 16 // Files grown side by side by the preallocation benchmarks
+#define CART_MICROBENCH_GROW_FILE (256 * 1024) // Bytes each of them grows to
+#define CART_MICROBENCH_BLOCK_FILE (16 * 1024 * 1024) // Bytes in the file of the block size benchmarks
+#define CART_MICROBENCH_BLOCK_IO (64 * 1024) // Bytes per streaming read or write of it
+#define CART_MICROBENCH_DEFAULT_FILES 100000 // Files in the namespace scans
+#define CART_MICROBENCH_SCAN_OPS 1000 // Operations per scan pass (scans = ops / this)
+#define USAGE \
+	"USAGE: cart_microbench [-h] [-n <ops>] [-s <sizes>] [-S <seed>] [-f <files>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -n - operations per benchmark (default 50000)\n" \
+	"    -s - comma separated cache sizes in frames (default 16,64,256,1024,4096)\n" \
+	"    -S - seed for the random key streams (default 1)\n" \
+	"    -f - files in the namespace scans (default 100000)\n" \
+	"\n" \
+
+// These are the key distributions of the mixed streams
+typedef enum {
+	CART_MB_UNIFORM = 0, // Every key equally likely
+	CART_MB_ZIPF    = 1, // A few hot keys (zipf, s=0.99)
+	CART_MB_LOOP    = 2, // Sequential scan, looping over the key space
+	CART_MB_MAXVAL  = 3  // Maximum distribution value
+} CartMicrobenchDistribution;
+
+// This is the result of a benchmark
+typedef struct {
+	uint64_t ops;     // Operations timed
+	uint64_t ns;      // Elapsed time
+	uint64_t cycles;  // CPU cycles (if perf counters are available)
+	uint64_t misses;  // Cache misses (if perf counters are available)
+	uint64_t hits;    // Cache hits (mixed streams)
+} CartMicrobenchResult;
+
+// This is a file as the driver laid it out before the field arrays: one
+// arena-allocated struct per file, reached through a table of pointers
+typedef struct {
+	char    *fileName;
+	uint32_t nameHash;
+	int32_t  length;
+	int32_t  filePointer;
+	struct {
+		int  cartridges;
+		int *occupiedCartridges;
+		int  frames;
+		int *occupiedFrames;
+		int  capacity;
+	} location;
+	int16_t  fileHandle;
+} CartMicrobenchFile;
+
+// This is a scan summary (the fields of CartDriverScan the scans compute)
+typedef struct {
+	uint64_t openFiles;   // Files open
+	uint64_t bytes;       // Total length
+	uint64_t badPointers; // Positions outside their file
+} CartMicrobenchScan;
+
+// This is a thread of the threaded reader benchmark
+typedef struct {
+	pthread_t   thread;  // The thread
+	int16_t     fd;      // Its read-only handle
+	uint32_t    start;   // Where in the file it starts reading
+	uint64_t    reads;   // The reads it makes
+	const char *expect;  // The file's contents
+	int         failed;  // Non-zero if a read failed or returned the wrong bytes
+} CartMicrobenchReader;
+
+//
+// Global data
+
+static const char *distribution_names[CART_MB_MAXVAL] = { "uniform", "zipf", "loop" };
+static int perf_group = -1;   // perf_event_open group leader (cycles), -1 if unavailable
+static int perf_misses = -1;  // perf_event_open cache miss counter
+static uint64_t random_state; // xorshift64 state
+static char frame_buf[CART_FRAME_SIZE]; // Frame contents put in the cache
+static char *memory_bus = NULL; // Frames of every cartridge when the bus keeps data, NULL for the null bus
+static __thread int memory_cart = 0; // Cartridge loaded on this thread's connection to the memory bus
+static uint32_t memory_bus_latency = 0; // Nanoseconds each request waits on the memory bus, as on a network round trip (0 for none)
+static uint64_t memory_bus_frames = 0; // Frames read or written on the memory bus
+static uint64_t memory_bus_loads = 0;  // Cartridge loads on the memory bus
+static uint64_t memory_bus_batches = 0; // Runs of frames moved by one client_cart_bus_batch
+static const uint32_t copy_sizes[] = { 64, 1000, 1024, 4096 }; // Bytes per copy benchmark operation
+static const uint32_t read_sizes[] = { 1, 20, 100, 512 };      // Bytes per small read benchmark operation
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_cart_bus_request
+// Description  : The null bus: every request succeeds and moves no data,
+//                unless memory_bus is set, when frames are read and written
+//                (after memory_bus_latency).  As with the network, each
+//                thread has its own connection, with its own loaded cartridge.
+//
+// Inputs       : reg - the request register
+//                buf - the frame buffer
+// Outputs      : the response register
+
+CartXferRegister client_cart_bus_request(CartXferRegister reg, void *buf) {
+	CartRegisterValue regs;
+	struct timespec wait;
+	char *frame;
+
+	if(memory_bus != NULL) {
+		if(memory_bus_latency != 0) {
+			wait.tv_sec = 0;
+			wait.tv_nsec = memory_bus_latency;
+			nanosleep(&wait, NULL);
+		}
+		regs = cart_decode_registers(reg);
+		frame = &memory_bus[(((size_t)memory_cart * CART_CARTRIDGE_SIZE) + (regs.fm1 % CART_CARTRIDGE_SIZE)) * CART_FRAME_SIZE];
+		if(regs.ky1 == CART_OP_LDCART) {
+			memory_cart = regs.ct1 % CART_MAX_CARTRIDGES;
+			__atomic_fetch_add(&memory_bus_loads, 1, __ATOMIC_RELAXED);
+		} else if(regs.ky1 == CART_OP_RDFRME) {
+			memcpy(buf, frame, CART_FRAME_SIZE);
+			__atomic_fetch_add(&memory_bus_frames, 1, __ATOMIC_RELAXED);
+		} else if(regs.ky1 == CART_OP_WRFRME) {
+			memcpy(frame, buf, CART_FRAME_SIZE);
+			__atomic_fetch_add(&memory_bus_frames, 1, __ATOMIC_RELAXED);
+		}
+	}
+	return reg & ~(CART_RT_MASK << CART_RT1_SHIFT); // Clear RT1, success
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : client_cart_bus_batch
+// Description  : The null bus, a run of requests at a time
+//
+// Inputs       : regs - the request registers, replaced by the responses
+//                n - the number of requests
+//                buf - the frames, one after the other
+// Outputs      : 0 if successful
+
+int client_cart_bus_batch(CartXferRegister *regs, int n, void *buf) {
+	int i;
+
+	__atomic_fetch_add(&memory_bus_batches, 1, __ATOMIC_RELAXED);
+	for(i=0; i<n; i++) {
+		regs[i] = client_cart_bus_request(regs[i], (char *)buf + ((size_t)i * CART_FRAME_SIZE));
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : memory_bus_begin
+// Description  : Make the bus keep the frames of every cartridge, so reads
+//                return what was written (until memory_bus_end)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int memory_bus_begin(void) {
+	if((memory_bus = calloc(CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE, CART_FRAME_SIZE)) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure allocating the memory bus.");
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : memory_bus_end
+// Description  : Drop the frames kept by memory_bus_begin, back to the null bus
+//
+// Inputs       : none
+// Outputs      : none
+
+static void memory_bus_end(void) {
+	free(memory_bus);
+	memory_bus = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_random
+// Description  : Get the next value of the xorshift64 generator
+//
+// Inputs       : none
+// Outputs      : the random value
+
+static uint64_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fill_random
+// Description  : Fill a buffer with random bytes (NULs included)
+//
+// Inputs       : buf - the buffer
+//                len - its length
+// Outputs      : none
+
+static void fill_random(char *buf, size_t len) {
+	size_t i;
+
+	for(i=0; i<len; i++) {
+		buf[i] = next_random() & 0xff;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : perf_open
+// Description  : Open the cycle and cache miss counters for this thread
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if the counters are not available
+
+static int perf_open(void) {
+	struct perf_event_attr attr;
+
+	memset(&attr, 0x0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	if((perf_group = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0)) == -1) {
+		return -1;
+	}
+	attr.config = PERF_COUNT_HW_CACHE_MISSES;
+	attr.disabled = 0;
+	if((perf_misses = syscall(SYS_perf_event_open, &attr, 0, -1, perf_group, 0)) == -1) {
+		close(perf_group);
+		perf_group = -1;
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_start
+// Description  : Start timing (and counting) a benchmark
+//
+// Inputs       : start - where to place the start time
+// Outputs      : none
+
+static void bench_start(struct timespec *start) {
+	if(perf_group != -1) {
+		ioctl(perf_group, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(perf_group, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_stop
+// Description  : Stop timing a benchmark, adding the time and counts to result
+//
+// Inputs       : start - the start time
+//                ops - the operations done
+//                result - the result to add to
+// Outputs      : none
+
+static void bench_stop(struct timespec *start, uint64_t ops, CartMicrobenchResult *result) {
+	struct timespec now;
+	uint64_t counts[3]; // nr, cycles, misses
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	result->ns += ((uint64_t)(now.tv_sec - start->tv_sec) * 1000000000) + now.tv_nsec - start->tv_nsec;
+	result->ops += ops;
+	if(perf_group != -1) {
+		ioctl(perf_group, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		if(read(perf_group, counts, sizeof(counts)) == sizeof(counts)) {
+			result->cycles += counts[1];
+			result->misses += counts[2];
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : print_result
+// Description  : Print a line of the results table
+//
+// Inputs       : name - the benchmark
+//                size - the cache size (0 if not a cache benchmark)
+//                result - the result
+//                showHits - print the hit rate
+// Outputs      : none
+
+static void print_result(const char *name, uint32_t size, CartMicrobenchResult *result, int showHits) {
+	char cycles[32] = "-", misses[32] = "-", hits[32] = "-";
+
+	if((perf_group != -1) && (result->ops > 0)) {
+		snprintf(cycles, sizeof(cycles), "%.1f", (double)result->cycles / result->ops);
+		snprintf(misses, sizeof(misses), "%.3f", (double)result->misses / result->ops);
+	}
+	if(showHits && (result->ops > 0)) {
+		snprintf(hits, sizeof(hits), "%.1f%%", (result->hits * 100.0) / result->ops);
+	}
+	printf("%-22s %6u %9lu %10.1f %11s %11s %7s\n", name, size, (unsigned long)result->ops,
+		(result->ops == 0) ? 0.0 : (double)result->ns / result->ops, cycles, misses, hits);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fill_cache
+// Description  : Start a cache of the given size, filled with keys [0, size)
+//
+// Inputs       : size - the cache size in frames
+// Outputs      : 0 if successful, -1 if failure
+
+static int fill_cache(uint32_t size) {
+	uint32_t k;
+
+	set_cart_cache_size(size);
+	if(init_cart_cache() != 0) {
+		return -1;
+	}
+	for(k=0; k<size; k++) {
+		put_cart_cache(k / CART_CARTRIDGE_SIZE, k % CART_CARTRIDGE_SIZE, frame_buf);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : make_keys
+// Description  : Generate a stream of keys (generated before timing so the
+//                generator is not measured)
+//
+// Inputs       : keys - where to place the keys
+//                n - the number of keys
+//                space - the keys are in [base, base+space)
+//                base - the first key
+//                dist - the CartMicrobenchDistribution
+// Outputs      : none
+
+static void make_keys(uint32_t *keys, uint64_t n, uint32_t space, uint32_t base, int dist) {
+	double *cdf, sum = 0, u;
+	uint32_t k, lo, hi, mid;
+	uint64_t i;
+
+	if(dist == CART_MB_LOOP) {
+		for(i=0; i<n; i++) {
+			keys[i] = base + (i % space);
+		}
+		return;
+	}
+	if(dist == CART_MB_UNIFORM) {
+		for(i=0; i<n; i++) {
+			keys[i] = base + (next_random() % space);
+		}
+		return;
+	}
+
+	// Zipf, by inverting the CDF (hot keys are scattered over the space)
+	cdf = malloc(sizeof(double) * space);
+	for(k=0; k<space; k++) {
+		sum += 1.0 / pow(k + 1, CART_MICROBENCH_ZIPF);
+		cdf[k] = sum;
+	}
+	for(i=0; i<n; i++) {
+		u = ((next_random() >> 11) * (1.0 / 9007199254740992.0)) * sum;
+		for(lo=0, hi=space-1; lo<hi; ) {
+			mid = (lo + hi) / 2;
+			if(cdf[mid] < u) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		keys[i] = base + ((lo * 2654435761u) % space);
+	}
+	free(cdf);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_cache
+// Description  : Run the frame cache benchmarks for a cache size
+//
+// Inputs       : size - the cache size in frames
+//                ops - operations per benchmark
+//                keys - scratch space for ops keys
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_cache(uint32_t size, uint64_t ops, uint32_t *keys) {
+	CartMicrobenchResult result;
+	struct timespec start;
+	uint32_t k, space;
+	uint64_t i, fills;
+	int dist;
+	char name[64];
+
+	// Insert: filling an empty cache
+	memset(&result, 0x0, sizeof(result));
+	for(fills=0; fills*size<ops; fills++) {
+		set_cart_cache_size(size);
+		if(init_cart_cache() != 0) {
+			return -1;
+		}
+		bench_start(&start);
+		for(k=0; k<size; k++) {
+			put_cart_cache(k / CART_CARTRIDGE_SIZE, k % CART_CARTRIDGE_SIZE, frame_buf);
+		}
+		bench_stop(&start, size, &result);
+		close_cart_cache();
+	}
+	print_result("insert", size, &result, 0);
+
+	// Hit: lookups of resident frames
+	if(fill_cache(size) != 0) {
+		return -1;
+	}
+	make_keys(keys, ops, size, 0, CART_MB_UNIFORM);
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		result.hits += (get_cart_cache(keys[i] / CART_CARTRIDGE_SIZE, keys[i] % CART_CARTRIDGE_SIZE) != NULL);
+	}
+	bench_stop(&start, ops, &result);
+	print_result("hit", size, &result, 1);
+
+	// Miss: lookups of frames that are not resident
+	make_keys(keys, ops, size, size, CART_MB_UNIFORM);
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		result.hits += (get_cart_cache(keys[i] / CART_CARTRIDGE_SIZE, keys[i] % CART_CARTRIDGE_SIZE) != NULL);
+	}
+	bench_stop(&start, ops, &result);
+	print_result("miss", size, &result, 1);
+
+	// Promote: rewriting resident frames (moves them to most recently used)
+	make_keys(keys, ops, size, 0, CART_MB_UNIFORM);
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		put_cart_cache(keys[i] / CART_CARTRIDGE_SIZE, keys[i] % CART_CARTRIDGE_SIZE, frame_buf);
+	}
+	bench_stop(&start, ops, &result);
+	print_result("promote", size, &result, 0);
+
+	// Evict: inserting new frames into the full cache
+	make_keys(keys, ops, CART_MICROBENCH_KEYS - size, size, CART_MB_LOOP);
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		put_cart_cache(keys[i] / CART_CARTRIDGE_SIZE, keys[i] % CART_CARTRIDGE_SIZE, frame_buf);
+	}
+	bench_stop(&start, ops, &result);
+	print_result("evict", size, &result, 0);
+	close_cart_cache();
+
+	// Mixed streams: lookup, insert on a miss (as the driver does on writes)
+	space = (size * 4 < CART_MICROBENCH_KEYS) ? size * 4 : CART_MICROBENCH_KEYS;
+	for(dist=0; dist<CART_MB_MAXVAL; dist++) {
+		if(fill_cache(size) != 0) {
+			return -1;
+		}
+		make_keys(keys, ops, space, 0, dist);
+		memset(&result, 0x0, sizeof(result));
+		bench_start(&start);
+		for(i=0; i<ops; i++) {
+			if(get_cart_cache(keys[i] / CART_CARTRIDGE_SIZE, keys[i] % CART_CARTRIDGE_SIZE) != NULL) {
+				result.hits++;
+			} else {
+				put_cart_cache(keys[i] / CART_CARTRIDGE_SIZE, keys[i] % CART_CARTRIDGE_SIZE, frame_buf);
+			}
+		}
+		bench_stop(&start, ops, &result);
+		snprintf(name, sizeof(name), "mixed-%s", distribution_names[dist]);
+		print_result(name, size, &result, 1);
+		close_cart_cache();
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_mapping
+// Description  : Time the offset-to-frame mapping of cart_read and cart_write
+//                (seek to a random offset, then a small read or write) on a
+//                file of the given size, with the frame cache disabled
+//
+// Inputs       : name - the file name (also the benchmark prefix)
+//                length - the file size in bytes
+//                ops - operations per benchmark
+//                keys - scratch space for ops offsets
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_mapping(char *name, uint32_t length, uint64_t ops, uint32_t *keys) {
+	CartMicrobenchResult result;
+	struct timespec start;
+	char buf[CART_FRAME_SIZE], label[64];
+	int16_t fd;
+	uint32_t written, chunk;
+	uint64_t i;
+
+	// Create the file, a frame at a time
+	memset(buf, 'm', sizeof(buf));
+	if((fd = cart_open(name)) == -1) {
+		return -1;
+	}
+	for(written=0; written<length; written+=chunk) {
+		chunk = (length - written < CART_FRAME_SIZE) ? length - written : CART_FRAME_SIZE;
+		if(cart_write(fd, buf, chunk) != chunk) {
+			return -1;
+		}
+	}
+	make_keys(keys, ops, length - CART_MICROBENCH_IO, 0, CART_MB_UNIFORM);
+
+	// Reads
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		cart_seek(fd, keys[i]);
+		cart_read(fd, buf, CART_MICROBENCH_IO);
+	}
+	bench_stop(&start, ops, &result);
+	snprintf(label, sizeof(label), "map-read-%s", name);
+	print_result(label, 0, &result, 0);
+
+	// Writes (in place, so the file does not grow)
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		cart_seek(fd, keys[i]);
+		cart_write(fd, buf, CART_MICROBENCH_IO);
+	}
+	bench_stop(&start, ops, &result);
+	snprintf(label, sizeof(label), "map-write-%s", name);
+	print_result(label, 0, &result, 0);
+	return cart_close(fd);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_copy
+// Description  : Time sequential reads and in-place writes of a range of sizes
+//                through the driver (with the frame cache disabled), reporting
+//                the copy throughput.  The file holds random bytes, NULs
+//                included, and is checked after the writes.
+//
+// Inputs       : ops - operations per benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_copy(uint64_t ops) {
+	CartMicrobenchResult result;
+	struct timespec start;
+	char *buf = NULL, *check = NULL, label[64];
+	uint32_t written, chunk, pos, size;
+	uint64_t i;
+	int16_t fd = -1;
+	int s, err = -1;
+
+	// Keep the frames, so the reads return what was written
+	if((memory_bus_begin() != 0) || ((buf = malloc(CART_MICROBENCH_COPY_FILE)) == NULL) ||
+			((check = malloc(CART_MICROBENCH_COPY_FILE)) == NULL)) {
+		goto done;
+	}
+
+	// Create the file, a frame at a time
+	fill_random(buf, CART_MICROBENCH_COPY_FILE);
+	if((fd = cart_open("copy")) == -1) {
+		goto done;
+	}
+	for(written=0; written<CART_MICROBENCH_COPY_FILE; written+=chunk) {
+		chunk = (CART_MICROBENCH_COPY_FILE - written < CART_FRAME_SIZE) ? CART_MICROBENCH_COPY_FILE - written : CART_FRAME_SIZE;
+		if(cart_write(fd, &buf[written], chunk) != chunk) {
+			goto done;
+		}
+	}
+
+	for(s=0; s<sizeof(copy_sizes)/sizeof(copy_sizes[0]); s++) {
+		size = copy_sizes[s];
+
+		// Sequential reads, wrapping at the end of the file
+		memset(&result, 0x0, sizeof(result));
+		bench_start(&start);
+		for(i=0, pos=0; i<ops; i++, pos+=size) {
+			if(pos + size > CART_MICROBENCH_COPY_FILE) {
+				pos = 0;
+			}
+			cart_seek(fd, pos);
+			cart_read(fd, check, size);
+		}
+		bench_stop(&start, ops, &result);
+		snprintf(label, sizeof(label), "copy-read-%u", size);
+		print_result(label, 0, &result, 0);
+		printf("%-22s %6s %9s %10.1f MB/s\n", "", "", "", (double)size * result.ops * 1000.0 / result.ns);
+
+		// Sequential in-place writes of the same bytes, so the contents stay known
+		memset(&result, 0x0, sizeof(result));
+		bench_start(&start);
+		for(i=0, pos=0; i<ops; i++, pos+=size) {
+			if(pos + size > CART_MICROBENCH_COPY_FILE) {
+				pos = 0;
+			}
+			cart_seek(fd, pos);
+			cart_write(fd, &buf[pos], size);
+		}
+		bench_stop(&start, ops, &result);
+		snprintf(label, sizeof(label), "copy-write-%u", size);
+		print_result(label, 0, &result, 0);
+		printf("%-22s %6s %9s %10.1f MB/s\n", "", "", "", (double)size * result.ops * 1000.0 / result.ns);
+	}
+
+	// Every byte must have survived the copies
+	cart_seek(fd, 0);
+	if((cart_read(fd, check, CART_MICROBENCH_COPY_FILE) != CART_MICROBENCH_COPY_FILE) ||
+			(memcmp(buf, check, CART_MICROBENCH_COPY_FILE) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Copy benchmark file contents do not match what was written.");
+		goto done;
+	}
+	err = 0;
+
+done:
+	if((fd != -1) && (cart_close(fd) != 0)) {
+		err = -1;
+	}
+	free(buf);
+	free(check);
+	memory_bus_end();
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : check_range_copy
+// Description  : Check that a file holds the expected bytes
+//
+// Inputs       : fd - the file
+//                expect - the expected contents
+//                len - the expected length
+// Outputs      : 0 if the contents match, -1 if not
+
+static int check_range_copy(int16_t fd, char *expect, uint32_t len) {
+	char *check;
+	int ret;
+
+	if((check = malloc(len + 1)) == NULL) {
+		return -1;
+	}
+	ret = ((cart_seek(fd, 0) == 0) && (cart_read(fd, check, len + 1) == len) && (memcmp(check, expect, len) == 0)) ? 0 : -1;
+	free(check);
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_copy_range
+// Description  : Time copying a file with cart_copy_range, frame aligned (the
+//                frames are shared) and unaligned (bounced through the bus),
+//                against reading and writing it a frame at a time, reporting
+//                the frames moved over the bus per copy.  Then check the
+//                copies, and that writes to a copy and to the source after
+//                sharing do not show through to the other.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_copy_range(void) {
+	CartMicrobenchResult result;
+	struct timespec start;
+	char *buf = NULL, *copy = NULL, name[64], frame[CART_FRAME_SIZE];
+	const char *modes[] = { "copyrange-shared", "copyrange-unaligned", "copyrange-readwrite" };
+	int16_t src = -1, dst[3][CART_MICROBENCH_RANGE_COPIES];
+	uint32_t written, offset, length;
+	uint64_t frames;
+	int m, c, err = -1;
+
+	// Keep the frames, so the copies can be checked
+	memset(dst, 0xff, sizeof(dst)); // -1, none open
+	if((memory_bus_begin() != 0) || ((buf = malloc(CART_MICROBENCH_RANGE_FILE)) == NULL) ||
+			((copy = malloc(CART_MICROBENCH_RANGE_FILE)) == NULL)) {
+		goto done;
+	}
+	fill_random(buf, CART_MICROBENCH_RANGE_FILE);
+	if((src = cart_open("range-src")) == -1) {
+		goto done;
+	}
+	for(written=0; written<CART_MICROBENCH_RANGE_FILE; written+=CART_FRAME_SIZE) {
+		if(cart_write(src, &buf[written], CART_FRAME_SIZE) != CART_FRAME_SIZE) {
+			goto done;
+		}
+	}
+
+	for(m=0; m<3; m++) {
+		offset = (m == 1) ? 100 : 0;
+		length = CART_MICROBENCH_RANGE_FILE - offset;
+		memset(&result, 0x0, sizeof(result));
+		frames = memory_bus_frames;
+		bench_start(&start);
+		for(c=0; c<CART_MICROBENCH_RANGE_COPIES; c++) {
+			snprintf(name, sizeof(name), "range-%d-%d", m, c);
+			if((dst[m][c] = cart_open(name)) == -1) {
+				goto done;
+			}
+			if(m < 2) {
+				if(cart_copy_range(src, offset, dst[m][c], 0, length) != length) {
+					goto done;
+				}
+			} else {
+				for(written=0; written<length; written+=CART_FRAME_SIZE) {
+					if((cart_seek(src, written) != 0) || (cart_read(src, frame, CART_FRAME_SIZE) != CART_FRAME_SIZE) ||
+							(cart_write(dst[m][c], frame, CART_FRAME_SIZE) != CART_FRAME_SIZE)) {
+						goto done;
+					}
+				}
+			}
+		}
+		bench_stop(&start, CART_MICROBENCH_RANGE_COPIES, &result);
+		print_result(modes[m], 0, &result, 0);
+		printf("%-22s %6s %9s %10.1f MB/s %8lu frames moved/copy\n", "", "", "",
+			(double)length * result.ops * 1000.0 / result.ns,
+			(unsigned long)((memory_bus_frames - frames) / CART_MICROBENCH_RANGE_COPIES));
+
+		for(c=0; c<CART_MICROBENCH_RANGE_COPIES; c++) {
+			if(check_range_copy(dst[m][c], &buf[offset], length) != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Copy %d of %s does not match the source.", c, modes[m]);
+				goto done;
+			}
+		}
+	}
+
+	// Writes to shared frames must not show through: first to a copy, then to the source (across two frames)
+	memcpy(copy, buf, CART_MICROBENCH_RANGE_FILE);
+	memset(frame, 'x', sizeof(frame));
+	memcpy(&copy[10], frame, 100);
+	if((cart_seek(dst[0][0], 10) != 0) || (cart_write(dst[0][0], frame, 100) != 100) ||
+			(check_range_copy(dst[0][0], copy, CART_MICROBENCH_RANGE_FILE) != 0) ||
+			(check_range_copy(dst[0][1], buf, CART_MICROBENCH_RANGE_FILE) != 0) ||
+			(check_range_copy(src, buf, CART_MICROBENCH_RANGE_FILE) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Write to a shared copy showed through to the source or another copy.");
+		goto done;
+	}
+	memcpy(copy, buf, CART_MICROBENCH_RANGE_FILE);
+	memcpy(&copy[2 * CART_FRAME_SIZE - 50], frame, 100);
+	if((cart_seek(src, 2 * CART_FRAME_SIZE - 50) != 0) || (cart_write(src, frame, 100) != 100) ||
+			(check_range_copy(src, copy, CART_MICROBENCH_RANGE_FILE) != 0) ||
+			(check_range_copy(dst[0][1], buf, CART_MICROBENCH_RANGE_FILE) != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Write to a shared source showed through to a copy.");
+		goto done;
+	}
+	err = 0;
+
+done:
+	for(m=0; m<3; m++) {
+		for(c=0; c<CART_MICROBENCH_RANGE_COPIES; c++) {
+			if((dst[m][c] != -1) && (cart_close(dst[m][c]) != 0)) {
+				err = -1;
+			}
+		}
+	}
+	if((src != -1) && (cart_close(src) != 0)) {
+		err = -1;
+	}
+	free(copy);
+	free(buf);
+	memory_bus_end();
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_interleaved_readers
+// Description  : Time interleaved readers of one file taking turns on this
+//                thread (bench_threaded_readers runs them in threads), each reading the next
+//                block from its own read-only handle while a writer keeps the
+//                file open, against the same reads through one shared handle
+//                (seeking before each read, as the readers had to when a file
+//                could only be open once).  Every read is checked.
+//
+// Inputs       : cache - the frame cache size the driver was powered on with
+//                ops - operations per benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_interleaved_readers(uint32_t cache, uint64_t ops) {
+	static const int counts[] = { 1, 4, 16 };
+	CartMicrobenchResult result;
+	struct timespec start;
+	char *buf = NULL, check[CART_MICROBENCH_INTERLEAVED_IO], label[64];
+	uint32_t pos[16];
+	int16_t writer = -1, fd[16];
+	uint64_t i;
+	int c, n, r, shared, err = -1;
+
+	// Keep the frames, so the reads return what was written
+	for(r=0; r<16; r++) {
+		fd[r] = -1;
+	}
+	if((memory_bus_begin() != 0) || ((buf = malloc(CART_MICROBENCH_INTERLEAVED_FILE)) == NULL)) {
+		goto done;
+	}
+	fill_random(buf, CART_MICROBENCH_INTERLEAVED_FILE);
+	if((writer = cart_open("readers")) == -1) {
+		goto done;
+	}
+	for(i=0; i<CART_MICROBENCH_INTERLEAVED_FILE; i+=CART_FRAME_SIZE) {
+		if(cart_write(writer, &buf[i], CART_FRAME_SIZE) != CART_FRAME_SIZE) {
+			goto done;
+		}
+	}
+
+	for(c=0; c<sizeof(counts)/sizeof(counts[0]); c++) {
+		n = counts[c];
+		for(shared=0; shared<2; shared++) {
+			// Each reader starts at its own place in the file (a shared handle is only opened, and closed, once)
+			for(r=0; r<n; r++) {
+				pos[r] = (uint32_t)r * (CART_MICROBENCH_INTERLEAVED_FILE / n);
+				if((!shared || (r == 0)) && ((fd[r] = cart_open_mode("readers", CART_OPEN_READ)) == -1)) {
+					goto done;
+				}
+				if(!shared && (cart_seek(fd[r], pos[r]) != 0)) {
+					goto done;
+				}
+			}
+
+			memset(&result, 0x0, sizeof(result));
+			bench_start(&start);
+			for(i=0; i<ops; i++) {
+				r = i % n;
+				if(pos[r] + CART_MICROBENCH_INTERLEAVED_IO > CART_MICROBENCH_INTERLEAVED_FILE) {
+					pos[r] = 0;
+					cart_seek(fd[shared ? 0 : r], 0);
+				} else if(shared) {
+					cart_seek(fd[0], pos[r]);
+				}
+				if((cart_read(fd[shared ? 0 : r], check, CART_MICROBENCH_INTERLEAVED_IO) != CART_MICROBENCH_INTERLEAVED_IO) ||
+						(memcmp(check, &buf[pos[r]], CART_MICROBENCH_INTERLEAVED_IO) != 0)) {
+					logMessage(LOG_ERROR_LEVEL, "Reader %d of %d read the wrong bytes at %u.", r, n, pos[r]);
+					goto done;
+				}
+				pos[r] += CART_MICROBENCH_INTERLEAVED_IO;
+			}
+			bench_stop(&start, ops, &result);
+			snprintf(label, sizeof(label), "interleaved-%d%s", n, shared ? "-shared" : "");
+			print_result(label, cache, &result, 0);
+			printf("%-22s %6s %9s %10.1f MB/s\n", "", "", "", (double)CART_MICROBENCH_INTERLEAVED_IO * result.ops * 1000.0 / result.ns);
+
+			for(r=0; r<16; r++) {
+				if((fd[r] != -1) && (cart_close(fd[r]) != 0)) {
+					fd[r] = -1;
+					goto done;
+				}
+				fd[r] = -1;
+			}
+		}
+	}
+
+	// A read-only handle cannot write, and a missing file cannot be opened to read
+	if(((fd[0] = cart_open_mode("readers", CART_OPEN_READ)) == -1) || (cart_write(fd[0], buf, 1) != -1) ||
+			(cart_open_mode("missing", CART_OPEN_READ) != -1)) {
+		logMessage(LOG_ERROR_LEVEL, "Read-only handles are not enforced.");
+		goto done;
+	}
+	err = 0;
+
+done:
+	for(r=0; r<16; r++) {
+		if((fd[r] != -1) && (cart_close(fd[r]) != 0)) {
+			err = -1;
+		}
+	}
+	if((writer != -1) && (cart_close(writer) != 0)) {
+		err = -1;
+	}
+	free(buf);
+	memory_bus_end();
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_reader
+// Description  : Read a file through a read-only handle, checking every read
+//                (the thread function of bench_threaded_readers)
+//
+// Inputs       : arg - the CartMicrobenchReader
+// Outputs      : NULL
+
+static void * run_reader(void *arg) {
+	CartMicrobenchReader *reader = arg;
+	char check[CART_MICROBENCH_INTERLEAVED_IO];
+	uint32_t pos = reader->start;
+	uint64_t i;
+
+	for(i=0; i<reader->reads; i++, pos+=CART_MICROBENCH_INTERLEAVED_IO) {
+		if((pos + CART_MICROBENCH_INTERLEAVED_IO > CART_MICROBENCH_INTERLEAVED_FILE) && ((pos = 0), (cart_seek(reader->fd, 0) != 0))) {
+			reader->failed = 1;
+			break;
+		}
+		if((cart_read(reader->fd, check, CART_MICROBENCH_INTERLEAVED_IO) != CART_MICROBENCH_INTERLEAVED_IO) ||
+				(memcmp(check, &reader->expect[pos], CART_MICROBENCH_INTERLEAVED_IO) != 0)) {
+			reader->failed = 1;
+			break;
+		}
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_threaded_readers
+// Description  : Time readers of one file each in a thread of its own,
+//                reading the next block from its own read-only handle, with
+//                every bus request taking CART_MICROBENCH_BUS_LATENCY.  The
+//                readers that miss the cache wait on the bus together, so
+//                the throughput grows with the threads; those that hit it
+//                share the driver's lock.  Every read is checked.
+//
+// Inputs       : cache - the frame cache size the driver was powered on with
+//                ops - operations per benchmark (at most CART_MICROBENCH_THREADED_READS)
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_threaded_readers(uint32_t cache, uint64_t ops) {
+	static const int counts[] = { 1, 4, 16 };
+	CartMicrobenchReader readers[16];
+	CartMicrobenchResult result;
+	struct timespec start;
+	char *buf = NULL, label[64];
+	uint64_t reads = (ops < CART_MICROBENCH_THREADED_READS) ? ops : CART_MICROBENCH_THREADED_READS;
+	uint32_t pos;
+	int16_t writer = -1;
+	int c, n, r, started, err = -1;
+
+	// Keep the frames, so the reads return what was written
+	memset(readers, 0x0, sizeof(readers));
+	for(r=0; r<16; r++) {
+		readers[r].fd = -1;
+	}
+	if((memory_bus_begin() != 0) || ((buf = malloc(CART_MICROBENCH_INTERLEAVED_FILE)) == NULL)) {
+		goto done;
+	}
+	fill_random(buf, CART_MICROBENCH_INTERLEAVED_FILE);
+	if((writer = cart_open("threaded")) == -1) {
+		goto done;
+	}
+	for(pos=0; pos<CART_MICROBENCH_INTERLEAVED_FILE; pos+=CART_FRAME_SIZE) {
+		if(cart_write(writer, &buf[pos], CART_FRAME_SIZE) != CART_FRAME_SIZE) {
+			goto done;
+		}
+	}
+
+	// Only reads may run while the readers do, so the writer is closed first
+	if(cart_close(writer) != 0) {
+		writer = -1;
+		goto done;
+	}
+	writer = -1;
+	memory_bus_latency = CART_MICROBENCH_BUS_LATENCY;
+
+	for(c=0; c<sizeof(counts)/sizeof(counts[0]); c++) {
+		n = counts[c];
+
+		// Each reader starts at its own place in the file
+		for(r=0; r<n; r++) {
+			readers[r].start = (uint32_t)r * (CART_MICROBENCH_INTERLEAVED_FILE / n);
+			readers[r].reads = reads / n;
+			readers[r].expect = buf;
+			readers[r].failed = 0;
+			if(((readers[r].fd = cart_open_mode("threaded", CART_OPEN_READ)) == -1) || (cart_seek(readers[r].fd, readers[r].start) != 0)) {
+				goto done;
+			}
+		}
+
+		memset(&result, 0x0, sizeof(result));
+		bench_start(&start);
+		for(started=0; started<n; started++) {
+			if(pthread_create(&readers[started].thread, NULL, run_reader, &readers[started]) != 0) {
+				logMessage(LOG_ERROR_LEVEL, "Failure starting reader thread %d.", started);
+				break;
+			}
+		}
+		for(r=0; r<started; r++) {
+			pthread_join(readers[r].thread, NULL);
+		}
+		bench_stop(&start, (reads / n) * n, &result);
+		for(r=0; r<n; r++) {
+			if((r >= started) || readers[r].failed) {
+				logMessage(LOG_ERROR_LEVEL, "Reader thread %d of %d failed or read the wrong bytes.", r, n);
+				goto done;
+			}
+		}
+		snprintf(label, sizeof(label), "threaded-%d", n);
+		print_result(label, cache, &result, 0);
+		printf("%-22s %6s %9s %10.1f MB/s\n", "", "", "", (double)CART_MICROBENCH_INTERLEAVED_IO * result.ops * 1000.0 / result.ns);
+
+		for(r=0; r<n; r++) {
+			if(cart_close(readers[r].fd) != 0) {
+				readers[r].fd = -1;
+				goto done;
+			}
+			readers[r].fd = -1;
+		}
+	}
+	err = 0;
+
+done:
+	memory_bus_latency = 0;
+	for(r=0; r<16; r++) {
+		if((readers[r].fd != -1) && (cart_close(readers[r].fd) != 0)) {
+			err = -1;
+		}
+	}
+	if((writer != -1) && (cart_close(writer) != 0)) {
+		err = -1;
+	}
+	free(buf);
+	memory_bus_end();
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_fallocate
+// Description  : Time growing files side by side a frame at a time, with and
+//                without reserving their frames first with cart_fallocate,
+//                reporting the cartridge loads of the writes and of reading
+//                the files back one after the other (the driver must be
+//                powered on with no cache).  The files are checked, as is a
+//                reserved file never written, which must read as zero
+//                without touching the bus.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_fallocate(void) {
+	CartMicrobenchResult result;
+	struct timespec start;
+	char *buf = NULL, check[4 * CART_FRAME_SIZE], name[64];
+	int16_t fd[CART_MICROBENCH_GROW_FILES], reserved = -1;
+	uint64_t loads, readLoads, frames;
+	uint32_t pos;
+	int f, prealloc, err = -1;
+
+	// Keep the frames, so the files can be checked
+	for(f=0; f<CART_MICROBENCH_GROW_FILES; f++) {
+		fd[f] = -1;
+	}
+	if((memory_bus_begin() != 0) || ((buf = malloc((size_t)CART_MICROBENCH_GROW_FILES * CART_MICROBENCH_GROW_FILE)) == NULL)) {
+		goto done;
+	}
+	fill_random(buf, (size_t)CART_MICROBENCH_GROW_FILES * CART_MICROBENCH_GROW_FILE);
+
+	for(prealloc=0; prealloc<2; prealloc++) {
+		for(f=0; f<CART_MICROBENCH_GROW_FILES; f++) {
+			snprintf(name, sizeof(name), "grow%d-%02d", prealloc, f);
+			if(((fd[f] = cart_open(name)) == -1) || (prealloc && (cart_fallocate(fd[f], 0, CART_MICROBENCH_GROW_FILE) != 0))) {
+				goto done;
+			}
+		}
+
+		// Grow the files together, a frame each in turn
+		loads = memory_bus_loads;
+		memset(&result, 0x0, sizeof(result));
+		bench_start(&start);
+		for(pos=0; pos<CART_MICROBENCH_GROW_FILE; pos+=CART_FRAME_SIZE) {
+			for(f=0; f<CART_MICROBENCH_GROW_FILES; f++) {
+				if(cart_write(fd[f], &buf[((size_t)f * CART_MICROBENCH_GROW_FILE) + pos], CART_FRAME_SIZE) != CART_FRAME_SIZE) {
+					goto done;
+				}
+			}
+		}
+		bench_stop(&start, CART_MICROBENCH_GROW_FILES * (CART_MICROBENCH_GROW_FILE / CART_FRAME_SIZE), &result);
+		loads = memory_bus_loads - loads;
+
+		// Then read them back, one after the other
+		readLoads = memory_bus_loads;
+		for(f=0; f<CART_MICROBENCH_GROW_FILES; f++) {
+			for(pos=0; pos<CART_MICROBENCH_GROW_FILE; pos+=sizeof(check)) {
+				if((cart_seek(fd[f], pos) != 0) || (cart_read(fd[f], check, sizeof(check)) != sizeof(check)) ||
+						(memcmp(check, &buf[((size_t)f * CART_MICROBENCH_GROW_FILE) + pos], sizeof(check)) != 0)) {
+					logMessage(LOG_ERROR_LEVEL, "Grown file %d does not match at %u.", f, pos);
+					goto done;
+				}
+			}
+		}
+		readLoads = memory_bus_loads - readLoads;
+		print_result(prealloc ? "grow-fallocate" : "grow-append", 0, &result, 0);
+		printf("%-22s %6s %9s %7lu loads writing, %lu reading back\n", "", "", "", (unsigned long)loads, (unsigned long)readLoads);
+
+		for(f=0; f<CART_MICROBENCH_GROW_FILES; f++) {
+			if(cart_close(fd[f]) != 0) {
+				fd[f] = -1;
+				goto done;
+			}
+			fd[f] = -1;
+		}
+	}
+
+	// A reserved file reads as zero, without the bus
+	memset(buf, 0x0, sizeof(check));
+	frames = memory_bus_frames;
+	if(((reserved = cart_open("reserved")) == -1) || (cart_fallocate(reserved, 100, 16 * CART_FRAME_SIZE) != 0) ||
+			(cart_read(reserved, check, sizeof(check)) != sizeof(check)) || (memcmp(check, buf, sizeof(check)) != 0) ||
+			(memory_bus_frames != frames)) {
+		logMessage(LOG_ERROR_LEVEL, "Reserved frames do not read as zero without the bus.");
+		goto done;
+	}
+	err = 0;
+
+done:
+	for(f=0; f<CART_MICROBENCH_GROW_FILES; f++) {
+		if((fd[f] != -1) && (cart_close(fd[f]) != 0)) {
+			err = -1;
+		}
+	}
+	if((reserved != -1) && (cart_close(reserved) != 0)) {
+		err = -1;
+	}
+	free(buf);
+	memory_bus_end();
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_layout
+// Description  : Time small overwrites at random offsets of files filling
+//                all but four of the cartridges the driver may use (so the
+//                log layout is soon cleaning), with the given frame layout,
+//                reporting the cartridge loads and frames moved per write
+//                (and, for the log layout, the cleaner's work).  The files
+//                are checked against a shadow copy afterwards.
+//
+// Inputs       : layout - the frame layout
+//                ops - operations per benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_layout(CartDriverLayout layout, uint64_t ops) {
+	CartMicrobenchResult result;
+	CartDriverStats before, after;
+	struct timespec start;
+	char *shadow = NULL, *check = NULL, data[CART_MICROBENCH_LAYOUT_IO], name[64];
+	int16_t fd[CART_MICROBENCH_LAYOUT_FILES];
+	uint64_t loads, frames, i;
+	uint32_t pos, written;
+	int f, err = -1, powered = 0;
+
+	// Keep the frames, so the files can be checked
+	set_cart_cache_size(CART_MICROBENCH_READ_FRAMES * 16);
+	cart_set_layout(layout);
+	if((cart_set_cartridges(CART_MICROBENCH_LAYOUT_CARTRIDGES) != 0) || (memory_bus_begin() != 0) ||
+			((shadow = malloc((size_t)CART_MICROBENCH_LAYOUT_FILES * CART_MICROBENCH_LAYOUT_FILE)) == NULL) ||
+			((check = malloc(CART_MICROBENCH_LAYOUT_FILE)) == NULL) || (cart_poweron() != 0)) {
+		goto done;
+	}
+	powered = 1;
+	fill_random(shadow, (size_t)CART_MICROBENCH_LAYOUT_FILES * CART_MICROBENCH_LAYOUT_FILE);
+	for(f=0; f<CART_MICROBENCH_LAYOUT_FILES; f++) {
+		snprintf(name, sizeof(name), "layout%02d", f);
+		if((fd[f] = cart_open(name)) == -1) {
+			goto done;
+		}
+		for(written=0; written<CART_MICROBENCH_LAYOUT_FILE; written+=CART_FRAME_SIZE) {
+			if(cart_write(fd[f], &shadow[((size_t)f * CART_MICROBENCH_LAYOUT_FILE) + written], CART_FRAME_SIZE) != CART_FRAME_SIZE) {
+				goto done;
+			}
+		}
+	}
+
+	// Overwrite at random, keeping the shadow in step
+	cart_driver_stats(&before);
+	loads = memory_bus_loads;
+	frames = memory_bus_frames;
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(i=0; i<ops; i++) {
+		f = next_random() % CART_MICROBENCH_LAYOUT_FILES;
+		pos = next_random() % (CART_MICROBENCH_LAYOUT_FILE - CART_MICROBENCH_LAYOUT_IO);
+		memset(data, (int)(i & 0xff), sizeof(data));
+		memcpy(&shadow[((size_t)f * CART_MICROBENCH_LAYOUT_FILE) + pos], data, sizeof(data));
+		if((cart_seek(fd[f], pos) != 0) || (cart_write(fd[f], data, sizeof(data)) != sizeof(data))) {
+			logMessage(LOG_ERROR_LEVEL, "Overwrite %lu failed.", (unsigned long)i);
+			goto done;
+		}
+	}
+	bench_stop(&start, ops, &result);
+	cart_driver_stats(&after);
+	print_result((layout == CART_LAYOUT_LOG) ? "overwrite-log" : "overwrite-inplace", CART_MICROBENCH_READ_FRAMES * 16, &result, 0);
+	printf("%-22s %6s %9s %7.2f loads/write %5.2f frames/write, %lu segments (%lu frames) cleaned\n", "", "", "",
+		(double)(memory_bus_loads - loads) / ops, (double)(memory_bus_frames - frames) / ops,
+		(unsigned long)(after.cleanedSegments - before.cleanedSegments), (unsigned long)(after.cleanedFrames - before.cleanedFrames));
+
+	for(f=0; f<CART_MICROBENCH_LAYOUT_FILES; f++) {
+		if((cart_seek(fd[f], 0) != 0) || (cart_read(fd[f], check, CART_MICROBENCH_LAYOUT_FILE) != CART_MICROBENCH_LAYOUT_FILE) ||
+				(memcmp(check, &shadow[(size_t)f * CART_MICROBENCH_LAYOUT_FILE], CART_MICROBENCH_LAYOUT_FILE) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "Layout benchmark file %d does not match its shadow.", f);
+			goto done;
+		}
+	}
+	err = 0;
+
+done:
+	if(powered && (cart_poweroff() != 0)) { // Which closes the files
+		err = -1;
+	}
+	free(shadow);
+	free(check);
+	memory_bus_end();
+	cart_set_layout(CART_LAYOUT_INPLACE);
+	cart_set_cartridges(CART_MAX_CARTRIDGES);
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_block_size
+// Description  : Time writing a large file and reading it back, streaming,
+//                with the given file block size, reporting the throughput,
+//                the file metadata and the frames moved per bus transfer.
+//                The file is checked as it is read.
+//
+// Inputs       : block - the block size in bytes
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_block_size(uint32_t block) {
+	CartMicrobenchResult result[2];
+	CartDriverStats stats;
+	struct timespec start;
+	char *data = NULL, *check = NULL, name[64];
+	uint64_t frames, batches, metadata;
+	uint32_t pos;
+	int16_t fd;
+	int pass, err = -1, powered = 0;
+
+	// Keep the frames, so the file can be checked
+	set_cart_cache_size(CART_MICROBENCH_READ_FRAMES);
+	if((cart_set_block_size(block) != 0) || (memory_bus_begin() != 0) ||
+			((data = malloc(CART_MICROBENCH_BLOCK_FILE)) == NULL) || ((check = malloc(CART_MICROBENCH_BLOCK_IO)) == NULL) ||
+			(cart_poweron() != 0)) {
+		goto done;
+	}
+	powered = 1;
+	fill_random(data, CART_MICROBENCH_BLOCK_FILE);
+	snprintf(name, sizeof(name), "block%u", block);
+	if((fd = cart_open(name)) == -1) {
+		goto done;
+	}
+
+	// Write the file, then read it back
+	frames = memory_bus_frames;
+	batches = memory_bus_batches;
+	memset(result, 0x0, sizeof(result));
+	for(pass=0; pass<2; pass++) {
+		if(cart_seek(fd, 0) != 0) {
+			goto done;
+		}
+		bench_start(&start);
+		for(pos=0; pos<CART_MICROBENCH_BLOCK_FILE; pos+=CART_MICROBENCH_BLOCK_IO) {
+			if(pass == 0) {
+				if(cart_write(fd, &data[pos], CART_MICROBENCH_BLOCK_IO) != CART_MICROBENCH_BLOCK_IO) {
+					goto done;
+				}
+			}
+			else if((cart_read(fd, check, CART_MICROBENCH_BLOCK_IO) != CART_MICROBENCH_BLOCK_IO) ||
+					(memcmp(check, &data[pos], CART_MICROBENCH_BLOCK_IO) != 0)) {
+				logMessage(LOG_ERROR_LEVEL, "Block size %u file does not match at %u.", block, pos);
+				goto done;
+			}
+		}
+		bench_stop(&start, CART_MICROBENCH_BLOCK_FILE / CART_MICROBENCH_BLOCK_IO, &result[pass]);
+	}
+	cart_driver_stats(&stats);
+	metadata = stats.metadataBytes;
+	frames = memory_bus_frames - frames;
+	batches = memory_bus_batches - batches;
+
+	print_result("block-write", block, &result[0], 0);
+	print_result("block-read", block, &result[1], 0);
+	printf("%-22s %6s %9s %7.1f MB/s writing, %.1f MB/s reading, %lu metadata bytes, %.1f frames/transfer\n", "", "", "",
+		(CART_MICROBENCH_BLOCK_FILE / 1048576.0) / (result[0].ns / 1e9), (CART_MICROBENCH_BLOCK_FILE / 1048576.0) / (result[1].ns / 1e9),
+		(unsigned long)metadata, (batches == 0) ? 1.0 : (double)frames / batches);
+	err = 0;
+
+done:
+	if(powered && (cart_poweroff() != 0)) { // Which closes the file
+		err = -1;
+	}
+	free(data);
+	free(check);
+	memory_bus_end();
+	cart_set_block_size(CART_FRAME_SIZE);
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_small_read
+// Description  : Time small reads, each inside a single frame at a random
+//                offset, through the driver with the given frame cache (all
+//                hits if it holds the file, all misses if it is disabled).
+//                The bytes read are checked after the timed runs, and reads
+//                at the end of a file must not touch the bus.
+//
+// Inputs       : cache - the frame cache size the driver was powered on with
+//                ops - operations per benchmark
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_small_read(uint32_t cache, uint64_t ops) {
+	CartMicrobenchResult result;
+	struct timespec start;
+	char *buf = NULL, check[CART_FRAME_SIZE], label[64];
+	uint32_t pos, size;
+	uint64_t i, frames;
+	int16_t fd = -1, empty = -1;
+	int s, err = -1;
+
+	// Keep the frames, so the reads return what was written
+	if((memory_bus_begin() != 0) || ((buf = malloc(CART_MICROBENCH_READ_FRAMES * CART_FRAME_SIZE)) == NULL)) {
+		goto done;
+	}
+
+	// Create the file, a frame at a time (which also fills the cache)
+	fill_random(buf, CART_MICROBENCH_READ_FRAMES * CART_FRAME_SIZE);
+	if((fd = cart_open("smallread")) == -1) {
+		goto done;
+	}
+	for(i=0; i<CART_MICROBENCH_READ_FRAMES; i++) {
+		if(cart_write(fd, &buf[i * CART_FRAME_SIZE], CART_FRAME_SIZE) != CART_FRAME_SIZE) {
+			goto done;
+		}
+	}
+
+	for(s=0; s<sizeof(read_sizes)/sizeof(read_sizes[0]); s++) {
+		size = read_sizes[s];
+
+		memset(&result, 0x0, sizeof(result));
+		bench_start(&start);
+		for(i=0; i<ops; i++) {
+			pos = ((next_random() % CART_MICROBENCH_READ_FRAMES) * CART_FRAME_SIZE) + (next_random() % (CART_FRAME_SIZE - size + 1));
+			cart_seek(fd, pos);
+			cart_read(fd, check, size);
+		}
+		bench_stop(&start, ops, &result);
+		snprintf(label, sizeof(label), "read-%u", size);
+		print_result(label, cache, &result, 0);
+
+		// The same kind of reads again, checking the bytes
+		for(i=0; i<CART_MICROBENCH_READ_FRAMES * 16; i++) {
+			pos = ((next_random() % CART_MICROBENCH_READ_FRAMES) * CART_FRAME_SIZE) + (next_random() % (CART_FRAME_SIZE - size + 1));
+			if((cart_seek(fd, pos) != 0) || (cart_read(fd, check, size) != size) || (memcmp(check, &buf[pos], size) != 0)) {
+				logMessage(LOG_ERROR_LEVEL, "Small read of %u bytes at %u returned the wrong bytes.", size, pos);
+				goto done;
+			}
+		}
+	}
+
+	// Reads at the end of the file, and of an empty file, return nothing without the bus
+	frames = memory_bus_frames + memory_bus_loads;
+	if((cart_seek(fd, CART_MICROBENCH_READ_FRAMES * CART_FRAME_SIZE) != 0) || (cart_read(fd, check, 1) != 0) ||
+			((empty = cart_open("smallread-empty")) == -1) || (cart_read(empty, check, 1) != 0) ||
+			(memory_bus_frames + memory_bus_loads != frames)) {
+		logMessage(LOG_ERROR_LEVEL, "Small reads at the end of a file went to the bus.");
+		goto done;
+	}
+	err = 0;
+
+done:
+	if((fd != -1) && (cart_close(fd) != 0)) {
+		err = -1;
+	}
+	if((empty != -1) && (cart_close(empty) != 0)) {
+		err = -1;
+	}
+	free(buf);
+	memory_bus_end();
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_scan
+// Description  : Time a whole-namespace scan (open files, total bytes and a
+//                position check) over nfiles files laid out as an array of
+//                pointers to per-file structs and as field arrays, the old and
+//                new driver layouts.  The driver's own table is limited to
+//                the int16_t handle space, so the layouts are rebuilt here.
+//
+// Inputs       : nfiles - the number of files
+//                ops - operations per benchmark (sets the number of passes)
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_scan(uint32_t nfiles, uint64_t ops) {
+	CartMicrobenchResult result;
+	CartMicrobenchScan aos, soa;
+	CartMicrobenchFile **table, *file;
+	CartArena arena;
+	struct timespec start;
+	int16_t *handles;
+	int32_t *lengths, *pointers;
+	char name[64], label[64];
+	uint64_t passes, p;
+	uint32_t i;
+
+	// Build both layouts with the same contents (a third of the files open)
+	cart_arena_init(&arena, 0);
+	table = cart_arena_alloc(&arena, sizeof(CartMicrobenchFile *) * nfiles);
+	handles = cart_arena_alloc(&arena, sizeof(int16_t) * nfiles);
+	lengths = cart_arena_alloc(&arena, sizeof(int32_t) * nfiles);
+	pointers = cart_arena_alloc(&arena, sizeof(int32_t) * nfiles);
+	if((table == NULL) || (handles == NULL) || (lengths == NULL) || (pointers == NULL)) {
+		return -1;
+	}
+	for(i=0; i<nfiles; i++) {
+		snprintf(name, sizeof(name), "file%06u.txt", i);
+		if((file = table[i] = cart_arena_alloc(&arena, sizeof(CartMicrobenchFile))) == NULL) {
+			return -1;
+		}
+		file->fileName = cart_arena_strdup(&arena, name);
+		file->location.occupiedFrames = cart_arena_alloc(&arena, sizeof(int) * 4);
+		file->location.occupiedCartridges = cart_arena_alloc(&arena, sizeof(int) * 4);
+		file->length = lengths[i] = next_random() % (4 * CART_FRAME_SIZE);
+		file->filePointer = pointers[i] = (file->length == 0) ? 0 : next_random() % file->length;
+		file->fileHandle = handles[i] = (i % 3 == 0) ? (i % INT16_MAX) + 1 : 0;
+	}
+	passes = (ops < CART_MICROBENCH_SCAN_OPS) ? 1 : ops / CART_MICROBENCH_SCAN_OPS;
+
+	// Array of pointers to structs
+	memset(&result, 0x0, sizeof(result));
+	memset(&aos, 0x0, sizeof(aos));
+	bench_start(&start);
+	for(p=0; p<passes; p++) {
+		for(i=0; i<nfiles; i++) {
+			aos.openFiles += (table[i]->fileHandle > 0);
+			aos.bytes += table[i]->length;
+			aos.badPointers += (table[i]->filePointer > table[i]->length) || (table[i]->filePointer < 0);
+		}
+	}
+	bench_stop(&start, passes * nfiles, &result);
+	snprintf(label, sizeof(label), "scan-structs-%u", nfiles);
+	print_result(label, 0, &result, 0);
+
+	// Field arrays
+	memset(&result, 0x0, sizeof(result));
+	memset(&soa, 0x0, sizeof(soa));
+	bench_start(&start);
+	for(p=0; p<passes; p++) {
+		for(i=0; i<nfiles; i++) {
+			soa.openFiles += (handles[i] > 0);
+			soa.bytes += lengths[i];
+			soa.badPointers += (pointers[i] > lengths[i]) || (pointers[i] < 0);
+		}
+	}
+	bench_stop(&start, passes * nfiles, &result);
+	snprintf(label, sizeof(label), "scan-arrays-%u", nfiles);
+	print_result(label, 0, &result, 0);
+
+	cart_arena_release(&arena);
+	if(memcmp(&aos, &soa, sizeof(aos)) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Scan results of the two layouts differ.");
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_driver_scan
+// Description  : Time cart_driver_scan over nfiles files created through the
+//                driver
+//
+// Inputs       : nfiles - the number of files
+//                ops - operations per benchmark (sets the number of passes)
+// Outputs      : 0 if successful, -1 if failure
+
+static int bench_driver_scan(uint32_t nfiles, uint64_t ops) {
+	CartMicrobenchResult result;
+	CartDriverScan scan;
+	struct timespec start;
+	char name[64], label[64];
+	uint64_t passes, p;
+	uint32_t i, opened = 0;
+
+	// Create the (empty) files, leaving every third one open while there
+	// are handles (int16_t) for them, less the one the others are made with
+	for(i=0; i<nfiles; i++) {
+		snprintf(name, sizeof(name), "scan%06u.txt", i);
+		if(((i % 3) == 0) && (opened < INT16_MAX - 1)) {
+			if(cart_open(name) == -1) {
+				return -1;
+			}
+			opened++;
+		} else if(cart_close(cart_open(name)) != 0) {
+			return -1;
+		}
+	}
+	passes = (ops < CART_MICROBENCH_SCAN_OPS) ? 1 : ops / CART_MICROBENCH_SCAN_OPS;
+
+	memset(&result, 0x0, sizeof(result));
+	bench_start(&start);
+	for(p=0; p<passes; p++) {
+		cart_driver_scan(&scan);
+	}
+	bench_stop(&start, passes * scan.files, &result);
+	snprintf(label, sizeof(label), "scan-driver-%u", scan.files);
+	print_result(label, 0, &result, 0);
+	return (scan.badPointers == 0) ? 0 : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the microbenchmarks
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch;
+	uint64_t ops = CART_MICROBENCH_DEFAULT_OPS, seed = 1;
+	char *sizelist, *tok, *save;
+	uint32_t size, *keys, nfiles = CART_MICROBENCH_DEFAULT_FILES;
+
+	// Process the command line parameters
+	sizelist = strdup(CART_MICROBENCH_DEFAULT_SIZES);
+	while ((ch = getopt(argc, argv, CART_MICROBENCH_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'n': // Set the operations per benchmark
+			if ( (sscanf(optarg, "%lu", &ops) != 1) || (ops == 0) ) {
+				fprintf( stderr, "Bad operation count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 's': // Set the cache sizes
+			free(sizelist);
+			sizelist = strdup(optarg);
+			break;
+
+		case 'S': // Set the seed
+			if ( (sscanf(optarg, "%lu", &seed) != 1) || (seed == 0) ) {
+				fprintf( stderr, "Bad seed [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'f': // Set the files in the namespace scans
+			if ( (sscanf(optarg, "%u", &nfiles) != 1) || (nfiles == 0) ) {
+				fprintf( stderr, "Bad file count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	random_state = seed;
+	memset(frame_buf, 'c', sizeof(frame_buf));
+	if ((keys = malloc(sizeof(uint32_t) * ops)) == NULL) {
+		logMessage( LOG_ERROR_LEVEL, "Failure allocating the key stream." );
+		return( -1 );
+	}
+	if ( perf_open() == -1 ) {
+		logMessage( LOG_WARNING_LEVEL, "perf_event_open not available, cycles and misses not reported." );
+	}
+
+	// Frame cache benchmarks, for each size
+	printf("%-22s %6s %9s %10s %11s %11s %7s\n", "benchmark", "frames", "ops", "ns/op", "cycles/op", "misses/op", "hits");
+	for (tok=strtok_r(sizelist, ",", &save); tok!=NULL; tok=strtok_r(NULL, ",", &save)) {
+		if ( (sscanf(tok, "%u", &size) != 1) || (size == 0) || (size >= CART_MICROBENCH_KEYS) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad cache size [%s], skipping.", tok );
+			continue;
+		}
+		if ( bench_cache(size, ops, keys) != 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "Cache benchmarks failed for size %u.", size );
+			return( -1 );
+		}
+	}
+
+	// Mapping benchmarks, through the driver on the null bus with no cache
+	set_cart_cache_size(0);
+	if ( (cart_poweron() != 0) ||
+			(bench_mapping("small", CART_MICROBENCH_SMALL_FILE, ops, keys) != 0) ||
+			(bench_mapping("huge", CART_MICROBENCH_HUGE_FILE, ops, keys) != 0) ||
+			(bench_copy(ops) != 0) || (bench_copy_range() != 0) || (cart_poweroff() != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "Mapping benchmarks failed." );
+		return( -1 );
+	}
+
+	// Small read benchmarks, every read a cache miss and then every read a hit
+	for (size=0; size<=CART_MICROBENCH_READ_FRAMES; size+=CART_MICROBENCH_READ_FRAMES) {
+		set_cart_cache_size(size);
+		if ( (cart_poweron() != 0) || (bench_small_read(size, ops) != 0) || (cart_poweroff() != 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "Small read benchmarks failed." );
+			return( -1 );
+		}
+	}
+
+	// Preallocation benchmarks, on the null bus with no cache
+	set_cart_cache_size(0);
+	if ( (cart_poweron() != 0) || (bench_fallocate() != 0) || (cart_poweroff() != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "Preallocation benchmarks failed." );
+		return( -1 );
+	}
+
+	// Reader benchmarks, on one thread and in threads, with a cache smaller than the file and one holding it
+	for (size=CART_MICROBENCH_READ_FRAMES; size<=CART_MICROBENCH_INTERLEAVED_FILE/CART_FRAME_SIZE; size*=CART_MICROBENCH_INTERLEAVED_FILE/CART_FRAME_SIZE/CART_MICROBENCH_READ_FRAMES) {
+		set_cart_cache_size(size);
+		if ( (cart_poweron() != 0) || (bench_interleaved_readers(size, ops) != 0) || (bench_threaded_readers(size, ops) != 0) ||
+				(cart_poweroff() != 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "Reader benchmarks failed." );
+			return( -1 );
+		}
+	}
+
+	// Random overwrite benchmarks, of the frame layouts
+	if ( (bench_layout(CART_LAYOUT_INPLACE, ops) != 0) || (bench_layout(CART_LAYOUT_LOG, ops) != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "Layout benchmarks failed." );
+		return( -1 );
+	}
+
+	// Large file benchmarks, of the block sizes
+	for (size=CART_FRAME_SIZE; size<=CART_FRAME_SIZE*CART_NET_MAX_BATCH; size*=4) {
+		if ( bench_block_size(size) != 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "Block size benchmarks failed." );
+			return( -1 );
+		}
+	}
+
+	// Namespace scan benchmarks, of the two metadata layouts and of the driver
+	if ( (bench_scan(nfiles, ops) != 0) || (cart_poweron() != 0) ||
+			(bench_driver_scan(nfiles, ops) != 0) || (cart_poweroff() != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "Scan benchmarks failed." );
+		return( -1 );
+	}
+
+	free(keys);
+	free(sizelist);
+	return( 0 );
+}
@@ -20,6 +20,7 @@
 #define CART_NET_HEADER_SIZE sizeof(CartXferRegister)
 #define CART_DEFAULT_IP "127.0.0.1"
 #define CART_DEFAULT_PORT 21785
+#define CART_NET_MAX_BATCH 64 // Most requests client_cart_bus_batch sends at once
 
 // Global data
 extern int            cart_network_shutdown; // Flag indicating shutdown
@@ -32,6 +33,15 @@ extern unsigned short cart_network_port;     // Port of CART server
 CartXferRegister client_cart_bus_request(CartXferRegister reg, void *buf);
 	// This is the implementation of the client operation (cart_client.c)
 
+int client_cart_bus_batch(CartXferRegister *regs, int n, void *buf);
+	// Send a run of frame requests at once, then collect their responses (cart_client.c)
+
+int client_cart_bus_send(CartXferRegister *regs, int n, void *buf);
+	// Send a run of requests at once without waiting for the responses (cart_client.c)
+
+int client_cart_bus_receive(CartXferRegister *regs, int n, void *buf);
+	// Collect the responses to the oldest run of requests sent (cart_client.c)
+
 int cart_server( void );
 	// This is the implementation of the server application (cart_server.c)
 
@@ -0,0 +1,562 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_perfgate.c
+//  Description    : This is the performance regression gate for the CART
+//                   client.  It runs a fixed suite of workloads against a fresh
+//                   cart_server (several times each), collects the statistics
+//                   written by cart_client -s, and compares them against a
+//                   stored baseline.  Counted metrics (bus operations, cache
+//                   hits, allocations) are deterministic and compared exactly
+//                   (or within -t); any regression, or a baseline metric the
+//                   run no longer reports, makes the gate fail.  Timings are
+//                   compared by their median with a noise allowance taken
+//                   from the median absolute deviation of the runs, but are
+//                   only advisory unless -g is given, as the baseline holds
+//                   the wall clock times of the machine that recorded it.
+//                   To gate timings on another machine, record a baseline
+//                   there first (make; ./cart_perfgate -u -b <file>) and
+//                   compare against it with -g -b <file>.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Project Includes
+#include <cart_network.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_PERFGATE_ARGUMENTS "hugb:r:t:T:k:s:c:"
+#define CART_PERFGATE_BASELINE "perf_baseline.json" // Default baseline file
+#define CART_PERFGATE_STATS "/tmp/cart_perfgate.json" // Statistics of the current run
+#define CART_PERFGATE_MAX_METRICS 256  // Metrics kept per file
+#define CART_PERFGATE_MAX_RUNS 32      // Maximum runs per case
+#define CART_PERFGATE_NAME_LENGTH 128  // Maximum metric name length
+#define CART_PERFGATE_SERVER_WAIT 5000 // Time to wait for the server to listen (msec)
+#define USAGE \
+	"USAGE: cart_perfgate [-h] [-u] [-g] [-b <baseline>] [-r <runs>] [-t <pct>] [-T <pct>]\n" \
+	"                     [-k <mads>] [-s <server>] [-c <client>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -u - update the baseline with the results of this run instead of comparing\n" \
+	"    -g - fail on timing regressions too (only against a baseline recorded on\n" \
+	"         this machine, otherwise they are reported as slower)\n" \
+	"    -b - baseline file (default perf_baseline.json)\n" \
+	"    -r - runs of each case (default 3)\n" \
+	"    -t - tolerance for counted metrics in percent (default 0)\n" \
+	"    -T - tolerance for timings in percent (default 10)\n" \
+	"    -k - noise allowance for timings, in median absolute deviations (default 3)\n" \
+	"    -s - server binary (default ./cart_server)\n" \
+	"    -c - client binary (default ./cart_client)\n" \
+	"\n" \
+
+// This is a case in the benchmark suite
+typedef struct {
+	const char *name;     // Name of the case, the prefix of its metrics
+	const char *workload; // Workload replayed by the client
+	const char *args[8];  // Extra client arguments (NULL terminated)
+} CartPerfgateCase;
+
+// This is a named value read from (or written to) a statistics file
+typedef struct {
+	char   name[CART_PERFGATE_NAME_LENGTH]; // Metric name
+	double value;                           // Metric value
+} CartPerfgateMetric;
+
+// This is a set of metrics
+typedef struct {
+	CartPerfgateMetric metrics[CART_PERFGATE_MAX_METRICS]; // The metrics
+	int                count;                              // Number of metrics
+} CartPerfgateMetrics;
+
+//
+// Global data
+
+// The benchmark suite
+static const CartPerfgateCase suite[] = {
+	{ "assign4",       "workload/cmpsc311-f16-assign4-workload.txt", { NULL } },
+	{ "assign4-c1024", "workload/cmpsc311-f16-assign4-workload.txt", { "-c", "1024", NULL } },
+	{ "binary",        "workload/binary-workload.cwl",                { "-c", "64", NULL } },
+	{ "assign4-log",   "workload/cmpsc311-f16-assign4-workload.txt", { "-c", "1024", "-L", NULL } },
+	{ "assign4-clean", "workload/cmpsc311-f16-assign4-workload.txt", { "-c", "1024", "-L", "-K", "6", NULL } }, // Six cartridges, so the cleaner runs
+};
+#define CART_PERFGATE_CASES (sizeof(suite) / sizeof(suite[0]))
+
+// The metrics that describe the workload, not the client (must match exactly)
+static const char *workload_metrics[] = { "ops", "bytes_read", "bytes_written", NULL };
+
+char *server_binary = "./cart_server"; // Server started for each run
+char *client_binary = "./cart_client"; // Client being measured
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_metric
+// Description  : Look up a metric by name
+//
+// Inputs       : set - the metrics
+//                name - the metric name
+// Outputs      : pointer to the metric, NULL if not found
+
+static CartPerfgateMetric * find_metric(CartPerfgateMetrics *set, const char *name) {
+	int i;
+
+	for(i=0; i<set->count; i++) {
+		if(strcmp(set->metrics[i].name, name) == 0) {
+			return &set->metrics[i];
+		}
+	}
+	return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : set_metric
+// Description  : Set (adding if needed) a metric
+//
+// Inputs       : set - the metrics
+//                name - the metric name
+//                value - the value
+// Outputs      : 0 if successful, -1 if failure
+
+static int set_metric(CartPerfgateMetrics *set, const char *name, double value) {
+	CartPerfgateMetric *metric;
+
+	if((metric = find_metric(set, name)) == NULL) {
+		if(set->count == CART_PERFGATE_MAX_METRICS) {
+			logMessage(LOG_ERROR_LEVEL, "Too many metrics, dropping [%s].", name);
+			return -1;
+		}
+		metric = &set->metrics[set->count++];
+		strncpy(metric->name, name, CART_PERFGATE_NAME_LENGTH-1);
+		metric->name[CART_PERFGATE_NAME_LENGTH-1] = '\0';
+	}
+	metric->value = value;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_metrics
+// Description  : Read a flat JSON object of numbers (one "name": value per
+//                line, as written by cart_client -s and by this tool)
+//
+// Inputs       : path - the file to read
+//                set - where to place the metrics
+// Outputs      : 0 if successful, -1 if failure
+
+static int read_metrics(const char *path, CartPerfgateMetrics *set) {
+	char line[256], name[CART_PERFGATE_NAME_LENGTH];
+	double value;
+	FILE *fp;
+
+	set->count = 0;
+	if((fp = fopen(path, "r")) == NULL) {
+		return -1;
+	}
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		if(sscanf(line, " \"%127[^\"]\" : %lf", name, &value) == 2) {
+			set_metric(set, name, value);
+		}
+	}
+	fclose(fp);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_metrics
+// Description  : Write a set of metrics as a flat JSON object
+//
+// Inputs       : path - the file to write
+//                set - the metrics
+// Outputs      : 0 if successful, -1 if failure
+
+static int write_metrics(const char *path, CartPerfgateMetrics *set) {
+	FILE *fp;
+	int i;
+
+	if((fp = fopen(path, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing baseline [%s].", path);
+		return -1;
+	}
+	fprintf(fp, "{\n");
+	for(i=0; i<set->count; i++) {
+		fprintf(fp, "  \"%s\": %.0f%s\n", set->metrics[i].name, set->metrics[i].value,
+			(i == set->count-1) ? "" : ",");
+	}
+	fprintf(fp, "}\n");
+	fclose(fp);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : is_timing
+// Description  : Check if a metric is a timing (noisy) rather than a count
+//
+// Inputs       : name - the metric name
+// Outputs      : 1 if a timing, 0 if not
+
+static int is_timing(const char *name) {
+	size_t len = strlen(name);
+
+	return (len > 3) && (strcmp(&name[len-3], "_us") == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : is_workload_metric
+// Description  : Check if a metric describes the workload rather than the client
+//
+// Inputs       : name - the metric name
+// Outputs      : 1 if a workload metric, 0 if not
+
+static int is_workload_metric(const char *name) {
+	int i;
+
+	for(i=0; workload_metrics[i]!=NULL; i++) {
+		if(strcmp(workload_metrics[i], name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_doubles
+// Description  : qsort comparison of doubles
+//
+// Inputs       : a, b - the values
+// Outputs      : <0, 0, >0 as a is less than, equal to or greater than b
+
+static int compare_doubles(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : median
+// Description  : Find the median of a set of values (sorts them)
+//
+// Inputs       : vals - the values
+//                n - the number of values
+// Outputs      : the median
+
+static double median(double *vals, int n) {
+	qsort(vals, n, sizeof(double), compare_doubles);
+	return (n % 2) ? vals[n/2] : (vals[n/2-1] + vals[n/2]) / 2;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : server_listening
+// Description  : Check if something is listening on the CART port (read from
+//                /proc so that the check does not use up a server session)
+//
+// Inputs       : none
+// Outputs      : 1 if listening, 0 if not
+
+static int server_listening(void) {
+	char line[256];
+	unsigned int port, state;
+	int found = 0;
+	FILE *fp;
+
+	if((fp = fopen("/proc/net/tcp", "r")) == NULL) {
+		return 0;
+	}
+	while(fgets(line, sizeof(line), fp) != NULL) {
+		if((sscanf(line, " %*d: %*x:%x %*x:%*x %x", &port, &state) == 2) &&
+				(port == CART_DEFAULT_PORT) && (state == 0x0a)) {
+			found = 1;
+			break;
+		}
+	}
+	fclose(fp);
+	return found;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : spawn
+// Description  : Start a program with its output discarded
+//
+// Inputs       : argv - the program and its arguments
+// Outputs      : the process id, -1 if failure
+
+static pid_t spawn(char *argv[]) {
+	pid_t pid;
+	int fh;
+
+	if((pid = fork()) == 0) {
+		if((fh = open("/dev/null", O_WRONLY)) != -1) {
+			dup2(fh, STDOUT_FILENO);
+			dup2(fh, STDERR_FILENO);
+			close(fh);
+		}
+		execv(argv[0], argv);
+		_exit(127);
+	}
+	if(pid == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure starting [%s].", argv[0]);
+	}
+	return pid;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_case
+// Description  : Run a case of the suite once against a fresh server
+//
+// Inputs       : c - the case
+//                set - where to place the statistics of the run
+// Outputs      : 0 if successful, -1 if failure
+
+static int run_case(const CartPerfgateCase *c, CartPerfgateMetrics *set) {
+	char *sargv[2], *cargv[16];
+	struct timespec pause = { 0, 10000000 };
+	pid_t server, client;
+	int waited, status, argc = 0, i;
+
+	// Start a fresh server (it serves a single session) and wait for it
+	sargv[0] = server_binary;
+	sargv[1] = NULL;
+	if((server = spawn(sargv)) == -1) {
+		return -1;
+	}
+	for(waited=0; !server_listening() && (waited<CART_PERFGATE_SERVER_WAIT); waited+=10) {
+		nanosleep(&pause, NULL);
+	}
+
+	// Run the client
+	unlink(CART_PERFGATE_STATS);
+	cargv[argc++] = client_binary;
+	cargv[argc++] = "-s";
+	cargv[argc++] = CART_PERFGATE_STATS;
+	for(i=0; c->args[i]!=NULL; i++) {
+		cargv[argc++] = (char *)c->args[i];
+	}
+	cargv[argc++] = (char *)c->workload;
+	cargv[argc] = NULL;
+	status = -1;
+	if((client = spawn(cargv)) != -1) {
+		waitpid(client, &status, 0);
+	}
+
+	// Stop the server
+	kill(server, SIGTERM);
+	waitpid(server, NULL, 0);
+
+	// The client only writes statistics for a successful simulation
+	if((status != 0) || (read_metrics(CART_PERFGATE_STATS, set) == -1) || (set->count == 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Case [%s] failed (client status %d).", c->name, status);
+		return -1;
+	}
+	unlink(CART_PERFGATE_STATS);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the regression gate
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if no regressions, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, update = 0, gateTimings = 0, runs = 3, c, r, m, regressions = 0;
+	char *baseline = CART_PERFGATE_BASELINE, key[CART_PERFGATE_NAME_LENGTH*2], *verdict;
+	double tolerance = 0.0, timeTolerance = 10.0, mads = 3.0, vals[CART_PERFGATE_MAX_RUNS];
+	double current, mad, base, baseMad, delta, allowed;
+	static CartPerfgateMetrics results[CART_PERFGATE_MAX_RUNS], expected, measured;
+	CartPerfgateMetric *metric, *bm;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_PERFGATE_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'u': // Update the baseline
+			update = 1;
+			break;
+
+		case 'g': // Gate on the timings
+			gateTimings = 1;
+			break;
+
+		case 'b': // Set the baseline filename
+			baseline = optarg;
+			break;
+
+		case 'r': // Set the number of runs
+			if ( (sscanf(optarg, "%d", &runs) != 1) || (runs < 1) || (runs > CART_PERFGATE_MAX_RUNS) ) {
+				fprintf( stderr, "Bad run count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 't': // Set the counted metric tolerance
+			if ( sscanf(optarg, "%lf", &tolerance) != 1 ) {
+				fprintf( stderr, "Bad tolerance [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'T': // Set the timing tolerance
+			if ( sscanf(optarg, "%lf", &timeTolerance) != 1 ) {
+				fprintf( stderr, "Bad timing tolerance [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'k': // Set the noise allowance
+			if ( sscanf(optarg, "%lf", &mads) != 1 ) {
+				fprintf( stderr, "Bad noise allowance [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 's': // Set the server binary
+			server_binary = optarg;
+			break;
+
+		case 'c': // Set the client binary
+			client_binary = optarg;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+
+	// Load the baseline, unless it is being replaced
+	if ( !update && (read_metrics(baseline, &expected) == -1) ) {
+		logMessage( LOG_ERROR_LEVEL, "Missing baseline [%s], create it with -u.", baseline );
+		return( -1 );
+	}
+	measured.count = 0;
+
+	printf("%-16s %-16s %14s %14s %9s  %s\n", "case", "metric", "baseline", "current", "delta", "result");
+	for (c=0; c<CART_PERFGATE_CASES; c++) {
+
+		// Run the case
+		for (r=0; r<runs; r++) {
+			if ( run_case(&suite[c], &results[r]) == -1 ) {
+				return( -1 );
+			}
+		}
+
+		// Reduce the runs to one value per metric (plus the spread of timings)
+		for (m=0; m<results[0].count; m++) {
+			metric = &results[0].metrics[m];
+			for (r=0; r<runs; r++) {
+				bm = find_metric(&results[r], metric->name);
+				vals[r] = (bm == NULL) ? 0 : bm->value;
+				if ( !is_timing(metric->name) && (vals[r] != vals[0]) ) {
+					logMessage( LOG_WARNING_LEVEL, "Case [%s] metric [%s] differs between runs (%.0f, %.0f).",
+						suite[c].name, metric->name, vals[0], vals[r] );
+				}
+			}
+			current = is_timing(metric->name) ? median(vals, runs) : vals[0];
+			mad = 0;
+			if ( is_timing(metric->name) ) {
+				for (r=0; r<runs; r++) {
+					vals[r] = fabs(vals[r] - current);
+				}
+				mad = median(vals, runs);
+			}
+			snprintf(key, sizeof(key), "%s.%s", suite[c].name, metric->name);
+			set_metric(&measured, key, current);
+			if ( is_timing(metric->name) ) {
+				snprintf(key, sizeof(key), "%s.%s.mad", suite[c].name, metric->name);
+				set_metric(&measured, key, mad);
+				snprintf(key, sizeof(key), "%s.%s", suite[c].name, metric->name);
+			}
+
+			// Compare against the baseline
+			if ( update ) {
+				printf("%-16s %-16s %14s %14.0f %9s  %s\n", suite[c].name, metric->name, "-", current, "-", "recorded");
+				continue;
+			}
+			if ( (bm = find_metric(&expected, key)) == NULL ) {
+				printf("%-16s %-16s %14s %14.0f %9s  %s\n", suite[c].name, metric->name, "-", current, "-", "new");
+				continue;
+			}
+			base = bm->value;
+			delta = (base == 0) ? ((current == 0) ? 0 : 100.0) : ((current - base) * 100.0) / base;
+			if ( is_workload_metric(metric->name) ) {
+				allowed = 0;
+				verdict = (current == base) ? "ok" : "MISMATCH";
+			} else {
+				allowed = tolerance;
+				if ( is_timing(metric->name) ) {
+					snprintf(key, sizeof(key), "%s.%s.mad", suite[c].name, metric->name);
+					baseMad = ((bm = find_metric(&expected, key)) == NULL) ? 0 : bm->value;
+					allowed = (base == 0) ? timeTolerance : (mads * (baseMad + mad) * 100.0) / base;
+					if ( allowed < timeTolerance ) {
+						allowed = timeTolerance;
+					}
+				}
+				verdict = (delta > allowed) ? "REGRESSION" : ((delta < -allowed) ? "improved" : "ok");
+				if ( is_timing(metric->name) && !gateTimings && (verdict[0] == 'R') ) {
+					verdict = "slower"; // Advisory, see -g
+				}
+			}
+			if ( (verdict[0] == 'R') || (verdict[0] == 'M') ) {
+				regressions++;
+			}
+			printf("%-16s %-16s %14.0f %14.0f %+8.1f%%  %s\n", suite[c].name, metric->name, base, current, delta, verdict);
+		}
+	}
+
+	// Save the new baseline, or report the result
+	if ( update ) {
+		return( write_metrics(baseline, &measured) );
+	}
+
+	// A metric of the baseline the run did not report was renamed or dropped, which is a failure too
+	for (m=0; m<expected.count; m++) {
+		bm = &expected.metrics[m];
+		if ( (strlen(bm->name) > 4) && (strcmp(&bm->name[strlen(bm->name)-4], ".mad") == 0) ) {
+			continue;
+		}
+		if ( find_metric(&measured, bm->name) == NULL ) {
+			printf("%-33s %14.0f %14s %9s  %s\n", bm->name, bm->value, "-", "-", "MISSING");
+			regressions++;
+		}
+	}
+	if ( regressions ) {
+		printf("\nPerformance gate FAILED: %d regression(s) against [%s].\n", regressions, baseline);
+		return( -1 );
+	}
+	printf("\nPerformance gate passed against [%s].\n", baseline);
+	return( 0 );
+}
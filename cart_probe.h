@@ -0,0 +1,105 @@
+#ifndef CART_PROBE_INCLUDED
+#define CART_PROBE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_probe.h
+//  Description    : These are the USDT (SystemTap/DTrace style) static probe
+//                   points of the CART client, under the provider "cart".  A
+//                   probe is a single nop plus an ELF note describing where
+//                   its arguments live, so it costs nothing until a tracer
+//                   (bpftrace, perf, stap) attaches to it.  List them with
+//                   "readelf -n cart_client" or "bpftrace -l 'usdt:./cart_client:*'"
+//                   and see cart_probes.bt for an example.
+//
+//                   <sys/sdt.h> is used when it is installed; otherwise the
+//                   notes are emitted directly on x86-64 ELF, in the same
+//                   format, and the probes compile to nothing elsewhere.
+//                   Arguments must be integers (cast pointers to uintptr_t).
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+
+#if defined(CART_PROBES_DISABLED)
+
+#define CART_PROBE0(name)
+#define CART_PROBE1(name,a0)
+#define CART_PROBE2(name,a0,a1)
+#define CART_PROBE3(name,a0,a1,a2)
+#define CART_PROBE4(name,a0,a1,a2,a3)
+
+#elif defined(__has_include) && __has_include(<sys/sdt.h>)
+
+#include <sys/sdt.h>
+#define CART_PROBE0(name) DTRACE_PROBE(cart, name)
+#define CART_PROBE1(name,a0) DTRACE_PROBE1(cart, name, a0)
+#define CART_PROBE2(name,a0,a1) DTRACE_PROBE2(cart, name, a0, a1)
+#define CART_PROBE3(name,a0,a1,a2) DTRACE_PROBE3(cart, name, a0, a1, a2)
+#define CART_PROBE4(name,a0,a1,a2,a3) DTRACE_PROBE4(cart, name, a0, a1, a2, a3)
+
+#elif defined(__x86_64__) && defined(__ELF__)
+
+// The argument size, negative if signed (the "-4@%eax" form of the note)
+#define CART_PROBE_SIZE(x) ((((__typeof__(x))-1) < 0) ? -(int)sizeof(x) : (int)sizeof(x))
+
+// The note for a probe (see the SystemTap SDT note format), with the
+// .stapsdt.base symbol tools use to adjust the addresses for prelinking
+#define CART_PROBE_NOTE(name, args) \
+	"990: nop\n" \
+	".pushsection .note.stapsdt,\"\",\"note\"\n" \
+	".balign 4\n" \
+	".4byte 992f-991f, 994f-993f, 3\n" \
+	"991: .asciz \"stapsdt\"\n" \
+	"992: .balign 4\n" \
+	"993: .8byte 990b\n" \
+	".8byte _.stapsdt.base\n" \
+	".8byte 0\n" \
+	".asciz \"cart\"\n" \
+	".asciz \"" #name "\"\n" \
+	".asciz \"" args "\"\n" \
+	"994: .balign 4\n" \
+	".popsection\n" \
+	".ifndef _.stapsdt.base\n" \
+	".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+	".weak _.stapsdt.base\n" \
+	".hidden _.stapsdt.base\n" \
+	"_.stapsdt.base: .space 1\n" \
+	".size _.stapsdt.base, 1\n" \
+	".popsection\n" \
+	".endif\n"
+
+#define CART_PROBE_ARG(n) "%c[s" #n "]@%[a" #n "]"
+#define CART_PROBE_OP(n, x) [s##n] "n" (CART_PROBE_SIZE(x)), [a##n] "nor" (x)
+
+#define CART_PROBE0(name) \
+	__asm__ __volatile__ (CART_PROBE_NOTE(name, ""))
+#define CART_PROBE1(name,a0) \
+	__asm__ __volatile__ (CART_PROBE_NOTE(name, CART_PROBE_ARG(0)) \
+		:: CART_PROBE_OP(0, a0))
+#define CART_PROBE2(name,a0,a1) \
+	__asm__ __volatile__ (CART_PROBE_NOTE(name, CART_PROBE_ARG(0) " " CART_PROBE_ARG(1)) \
+		:: CART_PROBE_OP(0, a0), CART_PROBE_OP(1, a1))
+#define CART_PROBE3(name,a0,a1,a2) \
+	__asm__ __volatile__ (CART_PROBE_NOTE(name, CART_PROBE_ARG(0) " " CART_PROBE_ARG(1) " " \
+			CART_PROBE_ARG(2)) \
+		:: CART_PROBE_OP(0, a0), CART_PROBE_OP(1, a1), CART_PROBE_OP(2, a2))
+#define CART_PROBE4(name,a0,a1,a2,a3) \
+	__asm__ __volatile__ (CART_PROBE_NOTE(name, CART_PROBE_ARG(0) " " CART_PROBE_ARG(1) " " \
+			CART_PROBE_ARG(2) " " CART_PROBE_ARG(3)) \
+		:: CART_PROBE_OP(0, a0), CART_PROBE_OP(1, a1), CART_PROBE_OP(2, a2), CART_PROBE_OP(3, a3))
+
+#else
+
+#define CART_PROBE0(name)
+#define CART_PROBE1(name,a0)
+#define CART_PROBE2(name,a0,a1)
+#define CART_PROBE3(name,a0,a1,a2)
+#define CART_PROBE4(name,a0,a1,a2,a3)
+
+#endif
+
+#endif
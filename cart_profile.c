@@ -0,0 +1,356 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_profile.c
+//  Description    : This is the cartridge access profiler.  It reads a bus trace
+//                   recorded with cart_sim -t and reports how the accesses were
+//                   spread over the cartridges and frames: per-cartridge and
+//                   per-frame read/write counts (as a text or CSV heatmap), the
+//                   sequence of cartridge switches, frame reuse distances and
+//                   the cartridge loads that were wasted.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Project Includes
+#include <cart_controller.h>
+#include <cart_trace.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_PROFILE_ARGUMENTS "hcn:"
+#define CART_PROFILE_KEYS (CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE)
+#define CART_PROFILE_COLUMNS 64  // Heatmap columns (frames per column = CART_CARTRIDGE_SIZE/columns)
+#define CART_PROFILE_DISTANCE_BUCKETS 18 // Reuse distance buckets (powers of 2, last is open)
+#define CART_PROFILE_DEFAULT_SWITCHES 32 // Cartridge switches listed by default
+#define USAGE \
+	"USAGE: cart_profile [-h] [-c] [-n <switches>] <trace-file>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -c - print the per-frame counts as CSV instead of the text report\n" \
+	"    -n - number of cartridge switches to list (default 32)\n" \
+	"\n" \
+	"    <trace-file> - bus trace recorded with cart_sim -t\n" \
+	"\n" \
+
+// These are the access counts of a frame (or cartridge)
+typedef struct {
+	uint32_t reads;  // RDFRME bus operations
+	uint32_t writes; // WRFRME bus operations
+	uint32_t hits;   // Frame cache hits
+} CartProfileCounts;
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : heat_char
+// Description  : Pick the heatmap character for an access count, on a log scale
+//                relative to the hottest cell
+//
+// Inputs       : count - the access count of the cell
+//                max - the access count of the hottest cell
+// Outputs      : the character to print
+
+static char heat_char(uint64_t count, uint64_t max) {
+	static const char scale[] = " .:-=+*#%@";
+	int level = 0, maxlevel = 0;
+
+	if(count == 0) {
+		return scale[0];
+	}
+	while((count >> level) > 1) {
+		level++;
+	}
+	while((max >> maxlevel) > 1) {
+		maxlevel++;
+	}
+	return scale[1 + ((maxlevel == 0) ? 8 : (level * 8) / maxlevel)];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fenwick_add
+// Description  : Add to a position of a Fenwick (binary indexed) tree
+//
+// Inputs       : tree - the tree (1-based)
+//                n - the size of the tree
+//                pos - the position (0-based)
+//                val - the value to add
+// Outputs      : none
+
+static void fenwick_add(int32_t *tree, uint64_t n, uint64_t pos, int32_t val) {
+	for(pos++; pos<=n; pos+=(pos & -pos)) {
+		tree[pos] += val;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : fenwick_sum
+// Description  : Sum the positions [0, pos) of a Fenwick tree
+//
+// Inputs       : tree - the tree (1-based)
+//                pos - the end of the range (0-based, exclusive)
+// Outputs      : the sum
+
+static int64_t fenwick_sum(int32_t *tree, uint64_t pos) {
+	int64_t sum = 0;
+
+	for(; pos>0; pos-=(pos & -pos)) {
+		sum += tree[pos];
+	}
+	return sum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the profiler
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, csv = 0, listed = CART_PROFILE_DEFAULT_SWITCHES, cart, col, b;
+	CartTraceHeader *hdr;
+	CartTraceRecord *recs, *rec;
+	CartProfileCounts *frames, carts[CART_MAX_CARTRIDGES];
+	uint32_t loadsOf[CART_MAX_CARTRIDGES], touched[CART_MAX_CARTRIDGES];
+	uint64_t k, t, refs = 0, cold = 0, cell, maxcell = 0, distance;
+	uint64_t hist[CART_PROFILE_DISTANCE_BUCKETS];
+	uint64_t loads = 0, redundant = 0, pingpong = 0, single = 0, opsSinceLoad = 0, switches = 0;
+	int zeroed = 0;
+	int64_t *lastRef;
+	int32_t *tree, loaded = -1, previous = -1, key, lastKey = -1;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_PROFILE_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'c': // CSV output
+			csv = 1;
+			break;
+
+		case 'n': // Number of switches to list
+			if ( sscanf(optarg, "%d", &listed) != 1 ) {
+				fprintf( stderr, "Bad switch count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	if ( optind >= argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Map the trace, setup the counters
+	if ( (recs = cart_trace_load(argv[optind], &hdr)) == NULL ) {
+		return( -1 );
+	}
+	frames = calloc(CART_PROFILE_KEYS, sizeof(CartProfileCounts));
+	lastRef = malloc(sizeof(int64_t) * CART_PROFILE_KEYS);
+	tree = calloc(hdr->records + 1, sizeof(int32_t));
+	if ( (frames == NULL) || (lastRef == NULL) || (tree == NULL) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failed allocating profile counters." );
+		return( -1 );
+	}
+	memset(lastRef, 0xff, sizeof(int64_t) * CART_PROFILE_KEYS);
+	memset(carts, 0x0, sizeof(carts));
+	memset(loadsOf, 0x0, sizeof(loadsOf));
+	memset(touched, 0x0, sizeof(touched));
+	memset(hist, 0x0, sizeof(hist));
+
+	if ( ! csv ) {
+		printf("Trace [%s]: %lu records, recorded with a %u frame cache\n\n", argv[optind],
+			(unsigned long)hdr->records, hdr->cacheFrames);
+		printf("Cartridge switches (first %d):\n", listed);
+	}
+
+	// Walk the trace
+	for (k=0; k<hdr->records; k++) {
+		rec = &recs[k];
+		if ( (rec->cartridge >= CART_MAX_CARTRIDGES) || (rec->frame >= CART_CARTRIDGE_SIZE) ) {
+			continue;
+		}
+		key = (rec->cartridge * CART_CARTRIDGE_SIZE) + rec->frame;
+
+		// Bus operations: loads, switches and frame reads/writes
+		if (rec->event == CART_TRACE_BUS) {
+			if (rec->opcode == CART_OP_LDCART) {
+				loads++;
+				loadsOf[rec->cartridge]++;
+				if ((loaded != -1) && (opsSinceLoad <= 1) && (! zeroed)) {
+					single++;
+				}
+				if (rec->cartridge == loaded) {
+					redundant++;
+				} else {
+					if (rec->cartridge == previous) {
+						pingpong++;
+					}
+					if ( (! csv) && (switches < listed) ) {
+						printf("%s%d -> %d", (switches % 8 == 0) ? (switches ? "\n  " : "  ") : ", ",
+							loaded, rec->cartridge);
+					}
+					switches++;
+					previous = loaded;
+				}
+				loaded = rec->cartridge;
+				opsSinceLoad = 0;
+				zeroed = 0;
+				continue;
+			}
+			if (rec->opcode == CART_OP_BZERO) {
+				zeroed = 1; // Loaded to be zeroed (power on), not wasted
+				continue;
+			}
+			if (rec->opcode == CART_OP_RDFRME) {
+				frames[key].reads++;
+				carts[rec->cartridge].reads++;
+				opsSinceLoad++;
+			} else if (rec->opcode == CART_OP_WRFRME) {
+				frames[key].writes++;
+				carts[rec->cartridge].writes++;
+				opsSinceLoad++;
+			} else {
+				continue;
+			}
+			if (rec->opcode == CART_OP_RDFRME) {
+				continue; // The lookup that missed was already counted as a reference
+			}
+		} else if (rec->event == CART_TRACE_CACHE_GET) {
+			if (rec->hit) {
+				frames[key].hits++;
+				carts[rec->cartridge].hits++;
+			}
+		} else {
+			continue;
+		}
+
+		// Lookups and writes form the frame reference stream (repeats collapsed)
+		if (key == lastKey) {
+			continue;
+		}
+		lastKey = key;
+		t = refs++;
+		if (lastRef[key] == -1) {
+			cold++;
+			touched[rec->cartridge]++;
+		} else {
+			// Distinct frames referenced since the last reference to this one
+			distance = fenwick_sum(tree, t) - fenwick_sum(tree, lastRef[key] + 1);
+			for (b=0; (b < CART_PROFILE_DISTANCE_BUCKETS-1) && (distance >= (1ul << b)); b++);
+			hist[b]++;
+			fenwick_add(tree, hdr->records, lastRef[key], -1);
+		}
+		fenwick_add(tree, hdr->records, t, 1);
+		lastRef[key] = t;
+	}
+	if ((loaded != -1) && (opsSinceLoad <= 1) && (! zeroed)) {
+		single++;
+	}
+
+	// CSV output is just the per-frame counts
+	if (csv) {
+		printf("cartridge,frame,reads,writes,hits\n");
+		for (key=0; key<CART_PROFILE_KEYS; key++) {
+			if (frames[key].reads || frames[key].writes || frames[key].hits) {
+				printf("%d,%d,%u,%u,%u\n", key / CART_CARTRIDGE_SIZE, key % CART_CARTRIDGE_SIZE,
+					frames[key].reads, frames[key].writes, frames[key].hits);
+			}
+		}
+		cart_trace_unload(hdr);
+		return( 0 );
+	}
+
+	// Per-cartridge counts
+	printf("\n  (%lu switches in total)\n\n", (unsigned long)switches);
+	printf("Per-cartridge accesses (cartridges with no accesses omitted):\n");
+	printf("  %4s %10s %10s %10s %8s %8s\n", "cart", "reads", "writes", "hits", "loads", "frames");
+	for (cart=0; cart<CART_MAX_CARTRIDGES; cart++) {
+		if (carts[cart].reads || carts[cart].writes || carts[cart].hits || loadsOf[cart]) {
+			printf("  %4d %10u %10u %10u %8u %8u\n", cart, carts[cart].reads, carts[cart].writes,
+				carts[cart].hits, loadsOf[cart], touched[cart]);
+		}
+	}
+
+	// Heatmap, one row per cartridge, columns of frames
+	for (key=0; key<CART_PROFILE_KEYS; key+=CART_CARTRIDGE_SIZE/CART_PROFILE_COLUMNS) {
+		for (cell=0, k=0; k<CART_CARTRIDGE_SIZE/CART_PROFILE_COLUMNS; k++) {
+			cell += frames[key+k].reads + frames[key+k].writes + frames[key+k].hits;
+		}
+		if (cell > maxcell) {
+			maxcell = cell;
+		}
+	}
+	printf("\nHeatmap (reads+writes+hits, %d frames per column, log scale \" .:-=+*#%%@\", max %lu):\n",
+		CART_CARTRIDGE_SIZE/CART_PROFILE_COLUMNS, (unsigned long)maxcell);
+	for (cart=0; cart<CART_MAX_CARTRIDGES; cart++) {
+		if ( ! (carts[cart].reads || carts[cart].writes || carts[cart].hits) ) {
+			continue;
+		}
+		printf("  %4d |", cart);
+		for (col=0; col<CART_PROFILE_COLUMNS; col++) {
+			key = (cart * CART_CARTRIDGE_SIZE) + (col * (CART_CARTRIDGE_SIZE/CART_PROFILE_COLUMNS));
+			for (cell=0, k=0; k<CART_CARTRIDGE_SIZE/CART_PROFILE_COLUMNS; k++) {
+				cell += frames[key+k].reads + frames[key+k].writes + frames[key+k].hits;
+			}
+			putchar(heat_char(cell, maxcell));
+		}
+		printf("|\n");
+	}
+
+	// Reuse distances
+	printf("\nFrame reuse distance (distinct frames between references, %lu references, %lu cold):\n",
+		(unsigned long)refs, (unsigned long)cold);
+	for (b=0; b<CART_PROFILE_DISTANCE_BUCKETS; b++) {
+		if (hist[b] == 0) {
+			continue;
+		}
+		if (b == 0) {
+			printf("  %8s %-8s %10lu %6.2f%%\n", "0", "", (unsigned long)hist[b], 100.0 * hist[b] / (refs - cold));
+		} else if (b == CART_PROFILE_DISTANCE_BUCKETS-1) {
+			printf("  %8lu %-8s %10lu %6.2f%%\n", 1ul << (b-1), "+", (unsigned long)hist[b], 100.0 * hist[b] / (refs - cold));
+		} else {
+			printf("  %8lu-%-8lu %10lu %6.2f%%\n", 1ul << (b-1), (1ul << b) - 1, (unsigned long)hist[b], 100.0 * hist[b] / (refs - cold));
+		}
+	}
+
+	// Wasted loads
+	printf("\nCartridge loads: %lu\n", (unsigned long)loads);
+	printf("  redundant (cartridge already loaded)      : %lu\n", (unsigned long)redundant);
+	printf("  ping-pong (back to the previous cartridge): %lu\n", (unsigned long)pingpong);
+	printf("  served at most one frame operation        : %lu\n", (unsigned long)single);
+	for (k=0, cart=0; cart<CART_MAX_CARTRIDGES; cart++) {
+		k += carts[cart].reads + carts[cart].writes;
+	}
+	printf("  frame reads/writes per load               : %.2f\n", (loads > 0) ? (double)k / loads : 0.0);
+
+	free(frames);
+	free(lastRef);
+	free(tree);
+	cart_trace_unload(hdr);
+	return( 0 );
+}
@@ -0,0 +1,238 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_ring.c
+//  Description    : This is the implementation of the binary trace ring.  Each
+//                   thread's ring has a single writer (the thread itself), so
+//                   logging is a timestamp read and a 32-byte store.  Rings
+//                   are pushed onto a global list with a compare-and-swap the
+//                   first time a thread logs, which is the only shared write.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Project Includes
+#include <cart_ring.h>
+#include <cmpsc311_log.h>
+
+// This is a thread's ring
+typedef struct CartRing {
+	CartRingRecord  *records; // The records (index is head % size)
+	uint64_t         size;    // Records the ring holds (a power of 2)
+	uint64_t         head;    // Records ever written (only the owner writes it)
+	uint32_t         thread;  // Thread id of the owner
+	struct CartRing *next;    // Next ring in the global list
+} CartRing;
+
+//
+// Global data
+
+int cart_ring_enabled = 0; // Non-zero while the rings are recording
+
+// Event name then argument names, space separated (used by the decoder)
+const char *cart_ring_events[CART_RING_MAXVAL] = {
+	"sim_open file",
+	"sim_write file len",
+	"sim_writeat file len off",
+	"sim_seek file off",
+	"sim_read file len",
+	"cart_open fd mode",
+	"cart_close fd result",
+	"cart_read fd pos count result",
+	"cart_write fd pos count result",
+	"cart_seek fd pos result",
+	"bus op cart frame rt",
+	"cache_get cart frame hit",
+	"cache_put cart frame",
+	"cart_copy_range src dst result shared",
+	"cart_fallocate fd off len frames",
+};
+
+static CartRing *ringList = NULL;         // Every thread's ring
+static uint64_t ringRecords = CART_RING_RECORDS; // Records in each new ring
+static __thread CartRing *threadRing = NULL; // This thread's ring
+static uint64_t startTicks;               // Ticks when the rings were enabled
+static struct timespec startTime;         // Time when the rings were enabled
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : ring_ticks
+// Description  : Read the timestamp counter (the TSC on x86, else the clock)
+//
+// Inputs       : none
+// Outputs      : the tick count
+
+static inline uint64_t ring_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_ring_set_records
+// Description  : Set the records each thread's ring holds (the rings already
+//                created keep their size)
+//
+// Inputs       : records - the records, rounded up to a power of 2
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_ring_set_records(uint32_t records) {
+	if((records == 0) || (records > CART_RING_MAX_RECORDS)) {
+		return -1;
+	}
+	for(ringRecords=1; ringRecords<records; ringRecords<<=1);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_ring_enable
+// Description  : Start recording into the rings
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_ring_enable(void) {
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	startTicks = ring_ticks();
+	cart_ring_enabled = 1;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : new_ring
+// Description  : Create the calling thread's ring and add it to the list
+//
+// Inputs       : none
+// Outputs      : the ring, NULL if failure
+
+static CartRing * new_ring(void) {
+	CartRing *ring;
+
+	if((ring = calloc(1, sizeof(CartRing))) == NULL) {
+		return NULL;
+	}
+	ring->size = ringRecords;
+	if((ring->records = calloc(ring->size, sizeof(CartRingRecord))) == NULL) {
+		free(ring);
+		return NULL;
+	}
+	ring->thread = syscall(SYS_gettid);
+	ring->next = __atomic_load_n(&ringList, __ATOMIC_ACQUIRE);
+	while(!__atomic_compare_exchange_n(&ringList, &ring->next, ring, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+		// ring->next was reloaded by the failed exchange, try again
+	}
+	return ring;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_ring_log
+// Description  : Append a record to this thread's ring
+//
+// Inputs       : event - the CartRingEvent
+//                a0-a3 - the event arguments
+// Outputs      : none
+
+void cart_ring_log(uint16_t event, int32_t a0, int32_t a1, int32_t a2, int32_t a3) {
+	CartRingRecord *rec;
+	CartRing *ring;
+
+	if(((ring = threadRing) == NULL) && ((ring = threadRing = new_ring()) == NULL)) {
+		return;
+	}
+	rec = &ring->records[ring->head & (ring->size - 1)];
+	rec->timestamp = ring_ticks();
+	rec->event = event;
+	rec->args[0] = a0;
+	rec->args[1] = a1;
+	rec->args[2] = a2;
+	rec->args[3] = a3;
+	rec->sequence = ring->head;
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_ring_dump
+// Description  : Write every thread's ring to a file and stop recording.  Other
+//                threads should be idle; a record being written while it is
+//                copied may be torn.
+//
+// Inputs       : path - the file to create
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_ring_dump(char *path) {
+	CartRingHeader hdr;
+	CartRingThread section;
+	struct timespec now;
+	uint64_t ticks, head, first, i;
+	CartRing *ring;
+	int fh, ret = 0;
+
+	cart_ring_enabled = 0;
+	if((fh = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure creating ring dump [%s], error: %s.", path, strerror(errno));
+		return -1;
+	}
+
+	// Calibrate the ticks against the clock over the recording
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ticks = ring_ticks() - startTicks;
+	memset(&hdr, 0x0, sizeof(hdr));
+	hdr.magic = CART_RING_MAGIC;
+	hdr.version = CART_RING_VERSION;
+	hdr.nsPerTick = (ticks == 0) ? 1.0 :
+		(((now.tv_sec - startTime.tv_sec) * 1e9) + (now.tv_nsec - startTime.tv_nsec)) / ticks;
+	for(ring=__atomic_load_n(&ringList, __ATOMIC_ACQUIRE); ring!=NULL; ring=ring->next) {
+		hdr.threads++;
+	}
+	if(write(fh, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		ret = -1;
+	}
+
+	// Each ring, oldest record first
+	for(ring=__atomic_load_n(&ringList, __ATOMIC_ACQUIRE); (ring!=NULL) && (ret==0); ring=ring->next) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		first = (head > ring->size) ? head - ring->size : 0;
+		section.thread = ring->thread;
+		section.records = head - first;
+		section.dropped = first;
+		if(write(fh, &section, sizeof(section)) != sizeof(section)) {
+			ret = -1;
+		}
+		for(i=first; (i<head) && (ret==0); i++) {
+			if(write(fh, &ring->records[i & (ring->size - 1)], sizeof(CartRingRecord)) != sizeof(CartRingRecord)) {
+				ret = -1;
+			}
+		}
+	}
+	if(ret != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing ring dump [%s], error: %s.", path, strerror(errno));
+	}
+	close(fh);
+	return ret;
+}
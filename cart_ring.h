@@ -0,0 +1,114 @@
+#ifndef CART_RING_INCLUDED
+#define CART_RING_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_ring.h
+//  Description    : This is the interface for the binary trace ring.  Each
+//                   thread logs fixed-size records (timestamp, event and four
+//                   integer arguments) into its own ring buffer, with no locks
+//                   and no formatting, overwriting the oldest records when the
+//                   ring is full, so a dump holds the most recent records of
+//                   each thread (and counts the rest as dropped).  A whole
+//                   assign4 run logs about 690k records, so keep all of it
+//                   with cart_ring_set_records (cart_sim -R).  The rings are
+//                   written to a file on demand and decoded offline by
+//                   cart_ringdump.
+//
+//                   Events above CART_RING_LEVEL are compiled out entirely;
+//                   the rest cost a flag test when the ring is disabled.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CART_RING_MAGIC 0x474e5243    // "CRNG", first word of a ring dump
+#define CART_RING_VERSION 1           // Version of the dump format
+#define CART_RING_RECORDS 16384       // Default records per thread (a power of 2)
+#define CART_RING_MAX_RECORDS (1 << 24) // Most records per thread (512 MB)
+
+// These are the trace levels (an event is compiled in if its level <= CART_RING_LEVEL)
+#define CART_RING_LEVEL_OPS   1 // Workload and driver API operations
+#define CART_RING_LEVEL_BUS   2 // Bus requests
+#define CART_RING_LEVEL_CACHE 3 // Frame cache lookups and inserts
+#ifndef CART_RING_LEVEL
+#define CART_RING_LEVEL CART_RING_LEVEL_BUS // Default, override with -DCART_RING_LEVEL=n
+#endif
+
+// These are the events (the decoder names them from cart_ring_events)
+typedef enum {
+
+	CART_RING_SIM_OPEN    = 0,  // Workload open (file index)
+	CART_RING_SIM_WRITE   = 1,  // Workload write (file index, length)
+	CART_RING_SIM_WRITEAT = 2,  // Workload write at (file index, length, offset)
+	CART_RING_SIM_SEEK    = 3,  // Workload seek (file index, offset)
+	CART_RING_SIM_READ    = 4,  // Workload read (file index, length)
+	CART_RING_DRV_OPEN    = 5,  // cart_open (handle returned)
+	CART_RING_DRV_CLOSE   = 6,  // cart_close (handle, result)
+	CART_RING_DRV_READ    = 7,  // cart_read (handle, position, count, result)
+	CART_RING_DRV_WRITE   = 8,  // cart_write (handle, position, count, result)
+	CART_RING_DRV_SEEK    = 9,  // cart_seek (handle, position, result)
+	CART_RING_BUS         = 10, // Bus request (opcode, cartridge, frame, rt)
+	CART_RING_CACHE_GET   = 11, // Frame cache lookup (cartridge, frame, hit)
+	CART_RING_CACHE_PUT   = 12, // Frame cache insert (cartridge, frame)
+	CART_RING_DRV_COPY    = 13, // cart_copy_range (source handle, destination handle, result, frames shared)
+	CART_RING_DRV_FALLOCATE = 14, // cart_fallocate (handle, offset, length, frames reserved)
+	CART_RING_MAXVAL      = 15  // Maximum event value
+
+} CartRingEvent;
+
+// This is the header at the start of a ring dump
+typedef struct {
+	uint32_t magic;      // CART_RING_MAGIC
+	uint32_t version;    // CART_RING_VERSION
+	uint32_t threads;    // Number of thread sections that follow
+	uint32_t unused;
+	double   nsPerTick;  // Nanoseconds per timestamp tick
+} CartRingHeader;
+
+// This is the header of each thread's section of a dump
+typedef struct {
+	uint32_t thread;  // Thread id
+	uint32_t records; // Records that follow (oldest first)
+	uint64_t dropped; // Records overwritten before the dump
+} CartRingThread;
+
+// This is a single ring record (32 bytes)
+typedef struct {
+	uint64_t timestamp; // Ticks (see nsPerTick)
+	uint16_t event;     // CartRingEvent
+	uint16_t unused;
+	int32_t  args[4];   // Event arguments
+	uint32_t sequence;  // Position of the record in its thread's stream
+} CartRingRecord;
+
+//
+// Global data
+
+extern int cart_ring_enabled;              // Non-zero while the rings are recording
+extern const char *cart_ring_events[CART_RING_MAXVAL]; // Event name then argument names, space separated
+
+//
+// Functional Prototypes
+
+int cart_ring_set_records(uint32_t records);
+	// Set the records each thread's ring holds (rounded up to a power of 2), before the first is logged
+
+int cart_ring_enable(void);
+	// Start recording into the rings
+
+int cart_ring_dump(char *path);
+	// Write every thread's ring to a file (and stop recording)
+
+void cart_ring_log(uint16_t event, int32_t a0, int32_t a1, int32_t a2, int32_t a3);
+	// Append a record to this thread's ring (use CART_RING)
+
+// Record an event if its level is compiled in and the ring is enabled
+#define CART_RING(lvl,ev,a0,a1,a2,a3) \
+	do { if (((lvl) <= CART_RING_LEVEL) && cart_ring_enabled) cart_ring_log(ev, a0, a1, a2, a3); } while (0)
+
+#endif
@@ -0,0 +1,193 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_ringdump.c
+//  Description    : This is the offline decoder for the binary trace ring.  It
+//                   reads a ring dump written by cart_sim -r, merges the
+//                   threads' records by timestamp and prints them, one event
+//                   per line, with the argument names filled in.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Project Includes
+#include <cart_ring.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_RINGDUMP_ARGUMENTS "hc"
+#define CART_RINGDUMP_MAX_ARGS 4
+#define USAGE \
+	"USAGE: cart_ringdump [-h] [-c] <ring-file>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -c - print comma separated values (time_us,thread,event,arg0..arg3)\n" \
+	"\n" \
+	"    <ring-file> - trace ring dumped with cart_sim -r\n" \
+	"\n" \
+
+// This is a record tagged with the thread that logged it
+typedef struct {
+	CartRingRecord rec;    // The record
+	uint32_t       thread; // Thread id
+} CartRingEntry;
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_entries
+// Description  : Order entries by timestamp, then thread and sequence (qsort)
+//
+// Inputs       : a, b - the entries
+// Outputs      : <0, 0 or >0
+
+static int compare_entries(const void *a, const void *b) {
+	const CartRingEntry *x = a, *y = b;
+
+	if(x->rec.timestamp != y->rec.timestamp) {
+		return (x->rec.timestamp < y->rec.timestamp) ? -1 : 1;
+	}
+	if(x->thread != y->thread) {
+		return (x->thread < y->thread) ? -1 : 1;
+	}
+	return (x->rec.sequence < y->rec.sequence) ? -1 : (x->rec.sequence > y->rec.sequence);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : print_entry
+// Description  : Print one record
+//
+// Inputs       : ent - the entry
+//                us - microseconds since the first record
+//                csv - non-zero for comma separated output
+// Outputs      : none
+
+static void print_entry(CartRingEntry *ent, double us, int csv) {
+	char names[128], *name, *arg, *save;
+	int i;
+
+	if(ent->rec.event >= CART_RING_MAXVAL) {
+		snprintf(names, sizeof(names), "event%u", ent->rec.event);
+	} else {
+		snprintf(names, sizeof(names), "%s", cart_ring_events[ent->rec.event]);
+	}
+	name = strtok_r(names, " ", &save);
+
+	if(csv) {
+		printf("%.3f,%u,%s", us, ent->thread, name);
+		for(i=0; i<CART_RINGDUMP_MAX_ARGS; i++) {
+			printf(",%d", ent->rec.args[i]);
+		}
+	} else {
+		printf("%12.3f %7u %-10s", us, ent->thread, name);
+		for(i=0; (i<CART_RINGDUMP_MAX_ARGS) && ((arg = strtok_r(NULL, " ", &save)) != NULL); i++) {
+			printf(" %s=%d", arg, ent->rec.args[i]);
+		}
+	}
+	printf("\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the trace ring decoder
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	CartRingHeader hdr;
+	CartRingThread section;
+	CartRingEntry *entries = NULL, *grown;
+	uint64_t count = 0, dropped = 0, i;
+	uint32_t t, r;
+	int ch, csv = 0;
+	FILE *fp;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_RINGDUMP_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'c': // Comma separated output
+			csv = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	if ( optind >= argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Read the header
+	if ( (fp = fopen(argv[optind], "r")) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Unable to open ring dump [%s]", argv[optind] );
+		return( -1 );
+	}
+	if ( (fread(&hdr, sizeof(hdr), 1, fp) != 1) || (hdr.magic != CART_RING_MAGIC) ||
+			(hdr.version != CART_RING_VERSION) ) {
+		logMessage( LOG_ERROR_LEVEL, "Bad ring dump header [%s]", argv[optind] );
+		fclose( fp );
+		return( -1 );
+	}
+
+	// Read every thread's records, tagging each with its thread
+	for (t=0; t<hdr.threads; t++) {
+		if ( (fread(&section, sizeof(section), 1, fp) != 1) ||
+				((grown = realloc(entries, (count + section.records) * sizeof(CartRingEntry))) == NULL) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad ring dump section %u [%s]", t, argv[optind] );
+			free( entries );
+			fclose( fp );
+			return( -1 );
+		}
+		entries = grown;
+		for (r=0; r<section.records; r++, count++) {
+			if ( fread(&entries[count].rec, sizeof(CartRingRecord), 1, fp) != 1 ) {
+				logMessage( LOG_ERROR_LEVEL, "Truncated ring dump section %u [%s]", t, argv[optind] );
+				free( entries );
+				fclose( fp );
+				return( -1 );
+			}
+			entries[count].thread = section.thread;
+		}
+		dropped += section.dropped;
+	}
+	fclose( fp );
+
+	// Merge the threads by time and print
+	qsort( entries, count, sizeof(CartRingEntry), compare_entries );
+	if ( csv ) {
+		printf( "time_us,thread,event,arg0,arg1,arg2,arg3\n" );
+	}
+	for (i=0; i<count; i++) {
+		print_entry( &entries[i], (entries[i].rec.timestamp - entries[0].rec.timestamp) * hdr.nsPerTick / 1000.0, csv );
+	}
+	if ( dropped > 0 ) {
+		logMessage( LOG_WARNING_LEVEL, "%llu records were overwritten before the dump", (unsigned long long)dropped );
+	}
+
+	// Return successfully
+	free( entries );
+	return( 0 );
+}
@@ -0,0 +1,541 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_scale.c
+//  Description    : This is the scale test suite for the CART driver.  The
+//                   shipped workloads touch about 50 files and a few percent
+//                   of the device, so it drives the stack (driver, client and
+//                   cart_server) out to the limits instead:
+//
+//                     files    - create CART_MAX_TOTAL_FILES files, all open
+//                     reopen   - close them all and open them all again
+//                     filesize - grow one file across several cartridges
+//                     capacity - fill every frame of all 64 cartridges
+//
+//                   For each dimension it reports the per-operation latency
+//                   at each step (e.g. after 16, 32, ... 1024 files) and fits
+//                   the growth exponent b of latency ~ n^b.  Per-operation
+//                   latency should not grow with n, so a dimension with b
+//                   above the limit (-g) is flagged as superlinear.  Every
+//                   byte written is checked when the device is full.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+// Project Includes
+#include <cart_controller.h>
+#include <cart_driver.h>
+#include <cart_cache.h>
+#include <cart_network.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_SCALE_ARGUMENTS "hvg:s:m:C:i:p:"
+#define CART_SCALE_DEVICE_FRAMES (CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE)
+#define CART_SCALE_DEFAULT_GROWTH 0.3  // Largest growth exponent that is not flagged
+#define CART_SCALE_DEFAULT_BIG_FILE 8  // Cartridges spanned by the filesize file
+#define CART_SCALE_DEFAULT_SAMPLES 256 // Random reads timed after each step
+#define CART_SCALE_FILL_FILE 1000      // Frames per file in the capacity phase (not cartridge aligned)
+#define CART_SCALE_MAX_STEPS 32        // Steps per dimension
+#define CART_SCALE_IO 64               // Bytes per sampled read
+#define USAGE \
+	"USAGE: cart_scale [-h] [-v] [-g <exp>] [-s <samples>] [-m <carts>] [-C <sz>]\n" \
+	"                  [-i <ip>] [-p <port>]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - print every step, not just the summary of each dimension\n" \
+	"    -g - largest per-op growth exponent accepted (default 0.3)\n" \
+	"    -s - random reads timed after each step (default 256)\n" \
+	"    -m - cartridges spanned by the big file (default 8)\n" \
+	"    -C - set the cart frame cache to size <sz>\n" \
+	"    -i - IP address of server to connect to.\n" \
+	"    -p - port number of server to connect to.\n" \
+	"\n" \
+
+// This is a step of a dimension: the operations done to get to size n
+typedef struct {
+	uint64_t n;   // Size of the dimension after the step
+	uint64_t ops; // Operations timed
+	uint64_t ns;  // Total time of the operations
+	uint64_t max; // Slowest operation
+} CartScaleStep;
+
+// This is a dimension being scaled (one series of steps)
+typedef struct {
+	const char   *name;   // Name of the series
+	CartScaleStep steps[CART_SCALE_MAX_STEPS]; // The steps
+	int           nsteps; // Number of steps
+} CartScaleSeries;
+
+//
+// Global data
+
+static int verbose = 0;         // Print every step
+static int samples = CART_SCALE_DEFAULT_SAMPLES; // Random reads per step
+static uint64_t random_state = 1; // xorshift64 state
+static int16_t fds[CART_MAX_TOTAL_FILES]; // Handles of the scale files
+static uint32_t sizes[CART_MAX_TOTAL_FILES]; // Bytes written to each file
+static int nfiles = 0;          // Files created
+static uint64_t framesUsed = 0; // Device frames allocated so far
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_random
+// Description  : Get the next value of the xorshift64 generator
+//
+// Inputs       : none
+// Outputs      : the random value
+
+static uint64_t next_random(void) {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 7;
+	random_state ^= random_state << 17;
+	return random_state;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_ns
+// Description  : Get the monotonic time
+//
+// Inputs       : none
+// Outputs      : the time in ns
+
+static uint64_t now_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000000) + now.tv_nsec;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pattern
+// Description  : Fill a buffer with the contents of a file at an offset (a
+//                function of the file and offset, never NUL)
+//
+// Inputs       : buf - the buffer
+//                file - the file index
+//                off - the offset of the first byte
+//                len - the number of bytes
+// Outputs      : none
+
+static void pattern(char *buf, int file, uint32_t off, uint32_t len) {
+	uint32_t i;
+
+	for(i=0; i<len; i++) {
+		buf[i] = 'A' + (((off + i) / 7 + file) % 26);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : step_begin
+// Description  : Start a new step of a series
+//
+// Inputs       : series - the series
+//                n - the size of the dimension after the step
+// Outputs      : the step
+
+static CartScaleStep * step_begin(CartScaleSeries *series, uint64_t n) {
+	CartScaleStep *step = &series->steps[series->nsteps++];
+
+	memset(step, 0x0, sizeof(CartScaleStep));
+	step->n = n;
+	return step;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : step_time
+// Description  : Add a timed operation to a step
+//
+// Inputs       : step - the step
+//                start - the time the operation started
+// Outputs      : none
+
+static void step_time(CartScaleStep *step, uint64_t start) {
+	uint64_t ns = now_ns() - start;
+
+	step->ops++;
+	step->ns += ns;
+	if(ns > step->max) {
+		step->max = ns;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : append_frame
+// Description  : Append a frame (or less) of the file's pattern to a file
+//
+// Inputs       : file - the file index
+//                len - the bytes to append (at most a frame)
+// Outputs      : 0 if successful, -1 if failure
+
+static int append_frame(int file, uint32_t len) {
+	char buf[CART_FRAME_SIZE];
+
+	pattern(buf, file, sizes[file], len);
+	if((cart_seek(fds[file], sizes[file]) != 0) || (cart_write(fds[file], buf, len) != len)) {
+		logMessage(LOG_ERROR_LEVEL, "Write of %u bytes at %u to file %d failed.", len, sizes[file], file);
+		return -1;
+	}
+	if((sizes[file] % CART_FRAME_SIZE) == 0) {
+		framesUsed++;
+	}
+	sizes[file] += len;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : sample_reads
+// Description  : Time random small reads over files [first, last)
+//
+// Inputs       : series - the series to add a step to
+//                n - the size of the dimension
+//                first - the first file
+//                last - one past the last file
+// Outputs      : 0 if successful, -1 if failure
+
+static int sample_reads(CartScaleSeries *series, uint64_t n, int first, int last) {
+	CartScaleStep *step = step_begin(series, n);
+	char buf[CART_SCALE_IO], expect[CART_SCALE_IO];
+	uint64_t start;
+	uint32_t off, len;
+	int s, file;
+
+	for(s=0; s<samples; s++) {
+		file = first + (next_random() % (last - first));
+		len = (sizes[file] < CART_SCALE_IO) ? sizes[file] : CART_SCALE_IO;
+		off = next_random() % (sizes[file] - len + 1);
+		start = now_ns();
+		if((cart_seek(fds[file], off) != 0) || (cart_read(fds[file], buf, len) != len)) {
+			logMessage(LOG_ERROR_LEVEL, "Read of %u bytes at %u from file %d failed.", len, off, file);
+			return -1;
+		}
+		step_time(step, start);
+		pattern(expect, file, off, len);
+		if(memcmp(buf, expect, len) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "Read of %u bytes at %u from file %d returned bad data.", len, off, file);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : open_file
+// Description  : Open (creating) scale file i
+//
+// Inputs       : i - the file index
+// Outputs      : 0 if successful, -1 if failure
+
+static int open_file(int i) {
+	char name[CART_MAX_PATH_LENGTH];
+
+	snprintf(name, sizeof(name), "scale%04d", i);
+	if((fds[i] = cart_open(name)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Open of [%s] failed.", name);
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : growth_exponent
+// Description  : Fit latency ~ n^b to a series (least squares on log-log)
+//
+// Inputs       : series - the series
+// Outputs      : the exponent b
+
+static double growth_exponent(CartScaleSeries *series) {
+	double x, y, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	int i, k = 0;
+
+	for(i=0; i<series->nsteps; i++) {
+		if((series->steps[i].ops == 0) || (series->steps[i].n == 0)) {
+			continue;
+		}
+		x = log((double)series->steps[i].n);
+		y = log((double)series->steps[i].ns / series->steps[i].ops);
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+		k++;
+	}
+	if((k < 2) || ((k * sxx - sx * sx) == 0)) {
+		return 0;
+	}
+	return (k * sxy - sx * sy) / (k * sxx - sx * sx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : report_series
+// Description  : Print a series and check its growth
+//
+// Inputs       : series - the series
+//                unit - what n counts
+//                limit - the largest growth exponent accepted
+// Outputs      : 1 if the series grew superlinearly, 0 if not
+
+static int report_series(CartScaleSeries *series, const char *unit, double limit) {
+	CartScaleStep *first = &series->steps[0], *last = &series->steps[series->nsteps-1];
+	double b = growth_exponent(series);
+	int i;
+
+	if(verbose) {
+		for(i=0; i<series->nsteps; i++) {
+			printf("  %-16s %10lu %-10s %8lu ops %10.1f us/op %10.1f max us\n", series->name,
+				(unsigned long)series->steps[i].n, unit, (unsigned long)series->steps[i].ops,
+				series->steps[i].ops ? (series->steps[i].ns / 1e3) / series->steps[i].ops : 0.0,
+				series->steps[i].max / 1e3);
+		}
+	}
+	printf("%-16s %7lu -> %-7lu %-10s %10.1f -> %-10.1f %7.2f  %s\n", series->name,
+		(unsigned long)first->n, (unsigned long)last->n, unit,
+		first->ops ? (first->ns / 1e3) / first->ops : 0.0,
+		last->ops ? (last->ns / 1e3) / last->ops : 0.0, b, (b > limit) ? "SUPERLINEAR" : "ok");
+	return (b > limit);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : verify_files
+// Description  : Read every scale file back in full and check its contents
+//
+// Inputs       : none
+// Outputs      : number of files that failed
+
+static int verify_files(void) {
+	char *buf, *expect;
+	uint32_t max = 0;
+	int i, failed = 0;
+
+	for(i=0; i<nfiles; i++) {
+		max = (sizes[i] > max) ? sizes[i] : max;
+	}
+	buf = malloc(max);
+	expect = malloc(max);
+	for(i=0; i<nfiles; i++) {
+		pattern(expect, i, 0, sizes[i]);
+		if((cart_seek(fds[i], 0) != 0) || (cart_read(fds[i], buf, sizes[i]) != sizes[i]) ||
+				(memcmp(buf, expect, sizes[i]) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "File %d (%u bytes) failed validation.", i, sizes[i]);
+			failed++;
+		}
+	}
+	free(buf);
+	free(expect);
+	return failed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the scale suite
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	static CartScaleSeries opens = { "open" }, opened = { "read-by-files" }, reopens = { "reopen" },
+		appends = { "append" }, bigreads = { "read-by-size" }, fills = { "fill" }, fillreads = { "read-by-fill" };
+	int ch, i, big, superlinear = 0, failed;
+	uint32_t cache_size = 0, bigCarts = CART_SCALE_DEFAULT_BIG_FILE, frames;
+	uint64_t next, start, f;
+	double limit = CART_SCALE_DEFAULT_GROWTH;
+	CartScaleStep *step = NULL;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_SCALE_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			verbose = 1;
+			break;
+
+		case 'g': // Set the growth limit
+			if ( sscanf(optarg, "%lf", &limit) != 1 ) {
+				fprintf( stderr, "Bad growth exponent [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 's': // Set the samples per step
+			if ( (sscanf(optarg, "%d", &samples) != 1) || (samples < 1) ) {
+				fprintf( stderr, "Bad sample count [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'm': // Set the cartridges in the big file
+			if ( (sscanf(optarg, "%u", &bigCarts) != 1) || (bigCarts < 1) || (bigCarts > CART_MAX_CARTRIDGES / 2) ) {
+				fprintf( stderr, "Bad big file size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'C': // Set the cache size
+			if ( sscanf(optarg, "%u", &cache_size) != 1 ) {
+				fprintf( stderr, "Bad cache size [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'i': // Get the IP address
+			if (inet_addr(optarg) == INADDR_NONE) {
+				fprintf( stderr, "Bad IP address [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			cart_network_address = (unsigned char *)strdup(optarg);
+			break;
+
+		case 'p': // Set the network port number
+			if ( sscanf(optarg, "%hu", &cart_network_port) != 1 ) {
+				fprintf( stderr, "Bad port number [%s], aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	if ( cache_size != 0 ) {
+		set_cart_cache_size(cache_size);
+	}
+	if ( cart_poweron() != 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "CART power on failed, is cart_server running?" );
+		return( -1 );
+	}
+
+	// Files: create all of them (a frame each), keeping them all open
+	for (next=16; nfiles<CART_MAX_TOTAL_FILES-1; next*=2) {
+		if ( next > CART_MAX_TOTAL_FILES-1 ) {
+			next = CART_MAX_TOTAL_FILES-1;
+		}
+		step = step_begin(&opens, next);
+		for (; nfiles<next; nfiles++) {
+			start = now_ns();
+			if ( open_file(nfiles) != 0 ) {
+				return( -1 );
+			}
+			step_time(step, start);
+			if ( append_frame(nfiles, CART_FRAME_SIZE) != 0 ) {
+				return( -1 );
+			}
+		}
+		if ( sample_reads(&opened, nfiles, 0, nfiles) != 0 ) {
+			return( -1 );
+		}
+	}
+
+	// Reopen: close everything, then open it all again
+	for (i=0; i<nfiles; i++) {
+		if ( cart_close(fds[i]) != 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "Close of file %d failed.", i );
+			return( -1 );
+		}
+	}
+	for (i=0, next=16; i<nfiles; next*=2) {
+		step = step_begin(&reopens, (next < nfiles) ? next : nfiles);
+		for (; i<step->n; i++) {
+			start = now_ns();
+			if ( open_file(i) != 0 ) {
+				return( -1 );
+			}
+			step_time(step, start);
+		}
+	}
+	if ( sample_reads(&opened, nfiles, 0, nfiles) != 0 ) {
+		return( -1 );
+	}
+
+	// File size: one file (the last handle) spanning several cartridges
+	big = nfiles++;
+	if ( open_file(big) != 0 ) {
+		return( -1 );
+	}
+	for (next=64; sizes[big]<bigCarts*CART_CARTRIDGE_SIZE*CART_FRAME_SIZE; next*=2) {
+		step = step_begin(&appends, next);
+		while ( sizes[big] < next * CART_FRAME_SIZE ) {
+			start = now_ns();
+			if ( append_frame(big, CART_FRAME_SIZE) != 0 ) {
+				return( -1 );
+			}
+			step_time(step, start);
+		}
+		if ( sample_reads(&bigreads, next, big, big+1) != 0 ) {
+			return( -1 );
+		}
+	}
+
+	// Capacity: keep appending to the existing files until every frame is used
+	for (next=(framesUsed / CART_CARTRIDGE_SIZE) + 1; framesUsed<CART_SCALE_DEVICE_FRAMES; next*=2) {
+		if ( next > CART_MAX_CARTRIDGES ) {
+			next = CART_MAX_CARTRIDGES;
+		}
+		step = step_begin(&fills, next);
+		while ( (framesUsed < next * CART_CARTRIDGE_SIZE) && (framesUsed < CART_SCALE_DEVICE_FRAMES) ) {
+			f = framesUsed % (CART_MAX_TOTAL_FILES-1);
+			frames = (CART_SCALE_FILL_FILE < next * CART_CARTRIDGE_SIZE - framesUsed) ?
+				CART_SCALE_FILL_FILE : next * CART_CARTRIDGE_SIZE - framesUsed;
+			while ( frames-- > 0 ) {
+				start = now_ns();
+				if ( append_frame(f, CART_FRAME_SIZE) != 0 ) {
+					return( -1 );
+				}
+				step_time(step, start);
+			}
+		}
+		if ( sample_reads(&fillreads, next, 0, nfiles) != 0 ) {
+			return( -1 );
+		}
+	}
+
+	// Check everything that was written, then report
+	failed = verify_files();
+	printf("%-16s %-18s %-10s %-24s %7s  %s\n", "dimension", "range", "unit", "us/op first -> last", "exp", "result");
+	superlinear += report_series(&opens, "files", limit);
+	superlinear += report_series(&opened, "files", limit);
+	superlinear += report_series(&reopens, "files", limit);
+	superlinear += report_series(&appends, "frames", limit);
+	superlinear += report_series(&bigreads, "frames", limit);
+	superlinear += report_series(&fills, "carts", limit);
+	superlinear += report_series(&fillreads, "carts", limit);
+	printf("\n%d files, %lu of %d frames used, %d files failed validation, %d dimension(s) superlinear.\n",
+		nfiles, (unsigned long)framesUsed, CART_SCALE_DEVICE_FRAMES, failed, superlinear);
+
+	if ( cart_poweroff() != 0 ) {
+		return( -1 );
+	}
+	return( (failed || superlinear) ? -1 : 0 );
+}
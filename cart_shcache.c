@@ -0,0 +1,697 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_shcache.c
+//  Description    : This is the implementation of the shared frame cache.
+//                   The segment holds a header, a generation for every block
+//                   of the device, and a set associative table of entries
+//                   with their blocks.  A generation counts the writes of
+//                   its block started (high half) and in flight (low half);
+//                   a copy is tagged with the generation and the cache epoch
+//                   it was read under (its token), and is served only while
+//                   they are current and no write is in flight.  A reader
+//                   takes the token before reading CART, so a write racing
+//                   the read leaves the fill stale rather than caching the
+//                   old data.  Entries are claimed with a compare and swap
+//                   of their sequence number, which is odd while the entry
+//                   is being filled; readers copy a block out and keep it
+//                   only if the sequence did not move.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Project Includes
+#include <cart_shcache.h>
+#include <cart_controller.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_SHCACHE_MAGIC 0x4341525453484331ULL // "CARTSHC1", set once the segment is ready
+#define CART_SHCACHE_BLOCKS (CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE) // Generations (one per frame, a block uses its first frame's)
+#define CART_SHCACHE_KEY(c, f) (((c) * CART_CARTRIDGE_SIZE) + (f)) // Index of a block's generation
+#define CART_SHCACHE_WRITE ((1ULL << 32) + 1) // Added to a generation when a write starts (one started, one in flight)
+#define CART_SHCACHE_ATTACH_WAIT 1000 // Milliseconds to wait for another process to set the segment up
+#define CART_SHCACHE_TEST_KEYS 64     // Blocks the unit test uses
+#define CART_SHCACHE_TEST_PROCS 4     // Processes the unit test runs at once
+#define CART_SHCACHE_TEST_OPS 20000   // Operations each of them does
+#define CART_SHCACHE_TEST_LATENCY 200 // Spins a device access takes (so the processes' accesses overlap)
+
+// This is the start of the segment
+typedef struct {
+	uint64_t magic;       // CART_SHCACHE_MAGIC once the creator has set the segment up
+	uint32_t frames;      // Frames the cache holds
+	uint32_t blockFrames; // Frames in a block
+	uint32_t ways;        // Entries in a set
+	uint32_t setBits;     // log2 of the number of sets
+	uint32_t epoch;       // Moved on by cart_shcache_reset
+	uint32_t clock;       // Ticks of the use stamps
+	CartShcacheStats stats; // The counters
+} CartShcacheHeader;
+
+// This is an entry of the table (its block is in the data area)
+typedef struct {
+	uint32_t seq;   // Even when the entry is stable, odd while it is filled
+	uint32_t key;   // The block's key + 1, 0 if the entry was never filled
+	uint32_t stamp; // Clock tick of the last use, the least recent is replaced
+	uint32_t pad;   // Keeps the token aligned
+	uint64_t token; // Token the block was filled under
+} CartShcacheEntry;
+
+//
+// Global data
+static CartShcacheHeader *shHeader = NULL;  // The segment, NULL if none is attached
+static uint64_t *shGens = NULL;             // Generation of each block
+static CartShcacheEntry *shEntries = NULL;  // The table
+static char *shData = NULL;                 // The blocks of the entries
+static size_t shSize = 0;                   // Bytes in the segment
+static size_t shBlockBytes = 0;             // Bytes in a block
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : current_token
+// Description  : Get the token a copy of a block must have to be served
+//
+// Inputs       : key - the block
+// Outputs      : the token, CART_SHCACHE_NO_TOKEN if a write is in flight
+
+static uint64_t current_token(uint32_t key) {
+	uint32_t epoch = __atomic_load_n(&shHeader->epoch, __ATOMIC_ACQUIRE);
+	uint64_t gen = __atomic_load_n(&shGens[key], __ATOMIC_ACQUIRE);
+
+	if((gen & 0xffffffffULL) != 0) {
+		return CART_SHCACHE_NO_TOKEN;
+	}
+	return ((uint64_t)epoch << 32) | (gen >> 32);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : first_entry
+// Description  : Get the first entry of the set a block is placed in
+//
+// Inputs       : key - the block
+// Outputs      : index of the entry
+
+static uint32_t first_entry(uint32_t key) {
+	uint32_t set = (shHeader->setBits == 0) ? 0 : ((key * 2654435761U) >> (32 - shHeader->setBits));
+
+	return set * shHeader->ways;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : place_block
+// Description  : Put a block in its set, replacing its old copy, an entry
+//                that is empty or stale, or else the least recently used.
+//                An entry another process is filling is left alone (the
+//                block is then not cached, which is always safe).
+//
+// Inputs       : key - the block
+//                token - the token it was read or written under
+//                block - the data
+// Outputs      : 1 if it was placed, 0 if not
+
+static int place_block(uint32_t key, uint64_t token, const void *block) {
+	uint32_t first = first_entry(key), victim = first, i, k, seq;
+	CartShcacheEntry *entry;
+	int empty = 0;
+
+	for(i=first; i<first + shHeader->ways; i++) {
+		k = __atomic_load_n(&shEntries[i].key, __ATOMIC_RELAXED);
+		if(k == key + 1) {
+			victim = i;
+			break;
+		}
+		if(!empty && ((k == 0) || (__atomic_load_n(&shEntries[i].token, __ATOMIC_RELAXED) != current_token(k - 1)))) {
+			victim = i;
+			empty = 1;
+		}
+		else if(!empty && ((int32_t)(shEntries[i].stamp - shEntries[victim].stamp) < 0)) {
+			victim = i;
+		}
+	}
+
+	// Claim the entry, fill it, and publish it
+	entry = &shEntries[victim];
+	seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+	if((seq & 1) || !__atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	__atomic_store_n(&entry->key, key + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->token, token, __ATOMIC_RELAXED);
+	memcpy(&shData[victim * shBlockBytes], block, shBlockBytes);
+	__atomic_store_n(&entry->stamp, __atomic_fetch_add(&shHeader->clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&shHeader->stats.fills, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_open
+// Description  : Attach the named segment.  The first process creates it
+//                (exclusively) and sets it up; the others wait for it to be
+//                ready and check it holds the same cache.
+//
+// Inputs       : name - the name of the segment (as for shm_open)
+//                frames - frames the cache holds
+//                blockFrames - frames in a block
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_shcache_open(const char *name, uint32_t frames, uint32_t blockFrames) {
+	uint32_t entries = (blockFrames == 0) ? 0 : frames / blockFrames, ways, setBits = 0;
+	struct stat stats;
+	int fd, creator = 1, i;
+
+	if((shHeader != NULL) || (entries == 0)) {
+		return -1;
+	}
+	ways = (entries < CART_SHCACHE_WAYS) ? entries : CART_SHCACHE_WAYS;
+	while((2U << setBits) * ways <= entries) {
+		setBits++;
+	}
+	shBlockBytes = (size_t)CART_FRAME_SIZE * blockFrames;
+	shSize = sizeof(CartShcacheHeader) + (sizeof(uint64_t) * CART_SHCACHE_BLOCKS) +
+		(((size_t)ways << setBits) * (sizeof(CartShcacheEntry) + shBlockBytes));
+
+	// Create the segment, or find the one another process made
+	if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) != -1) {
+		if(ftruncate(fd, shSize) != 0) {
+			logMessage(LOG_ERROR_LEVEL, "CART shared cache failed to size [%s].", name);
+			close(fd);
+			shm_unlink(name);
+			return -1;
+		}
+	}
+	else if((errno != EEXIST) || ((fd = shm_open(name, O_RDWR, 0600)) == -1)) {
+		logMessage(LOG_ERROR_LEVEL, "CART shared cache failed to open [%s].", name);
+		return -1;
+	}
+	else {
+		creator = 0;
+		for(i=0; (fstat(fd, &stats) == 0) && (stats.st_size == 0) && (i < CART_SHCACHE_ATTACH_WAIT); i++) {
+			usleep(1000);
+		}
+		if(stats.st_size != shSize) {
+			logMessage(LOG_ERROR_LEVEL, "CART shared cache [%s] holds a different cache.", name);
+			close(fd);
+			return -1;
+		}
+	}
+	shHeader = mmap(NULL, shSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(shHeader == MAP_FAILED) {
+		logMessage(LOG_ERROR_LEVEL, "CART shared cache failed to map [%s].", name);
+		shHeader = NULL;
+		return -1;
+	}
+	shGens = (uint64_t *)&shHeader[1];
+	shEntries = (CartShcacheEntry *)&shGens[CART_SHCACHE_BLOCKS];
+	shData = (char *)&shEntries[ways << setBits];
+
+	// The new segment is all zeros, so it only needs its shape (published last)
+	if(creator) {
+		shHeader->frames = frames;
+		shHeader->blockFrames = blockFrames;
+		shHeader->ways = ways;
+		shHeader->setBits = setBits;
+		__atomic_store_n(&shHeader->magic, CART_SHCACHE_MAGIC, __ATOMIC_RELEASE);
+		return 0;
+	}
+	for(i=0; (__atomic_load_n(&shHeader->magic, __ATOMIC_ACQUIRE) != CART_SHCACHE_MAGIC) && (i < CART_SHCACHE_ATTACH_WAIT); i++) {
+		usleep(1000);
+	}
+	if((shHeader->magic != CART_SHCACHE_MAGIC) || (shHeader->frames != frames) || (shHeader->blockFrames != blockFrames)) {
+		logMessage(LOG_ERROR_LEVEL, "CART shared cache [%s] holds a different cache.", name);
+		cart_shcache_close();
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_close
+// Description  : Detach the segment (it stays for the other processes)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_shcache_close(void) {
+	if(shHeader != NULL) {
+		munmap(shHeader, shSize);
+		shHeader = NULL;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_unlink
+// Description  : Remove the named segment (processes attached keep it until
+//                they detach)
+//
+// Inputs       : name - the name of the segment
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_shcache_unlink(const char *name) {
+	return (shm_unlink(name) == 0) ? 0 : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_enabled
+// Description  : Is a segment attached?
+//
+// Inputs       : none
+// Outputs      : non-zero if it is
+
+int cart_shcache_enabled(void) {
+	return shHeader != NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_get
+// Description  : Copy a block out of the cache.  The copy is kept only if
+//                its entry was stable (the same even sequence) throughout.
+//
+// Inputs       : cartridge, first - the block
+//                block - where to copy it
+//                token - where to place the token the copy is valid for (may be NULL)
+// Outputs      : 1 if the block was found, 0 if not
+
+int cart_shcache_get(int cartridge, int first, void *block, uint64_t *token) {
+	uint32_t key = CART_SHCACHE_KEY(cartridge, first), i, seq;
+	CartShcacheEntry *entry;
+	uint64_t current;
+
+	if(shHeader == NULL) {
+		return 0;
+	}
+	if((current = current_token(key)) != CART_SHCACHE_NO_TOKEN) {
+		for(i=first_entry(key); i<first_entry(key) + shHeader->ways; i++) {
+			entry = &shEntries[i];
+			seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+			if((seq & 1) || (__atomic_load_n(&entry->key, __ATOMIC_RELAXED) != key + 1) ||
+					(__atomic_load_n(&entry->token, __ATOMIC_RELAXED) != current)) {
+				continue;
+			}
+			memcpy(block, &shData[i * shBlockBytes], shBlockBytes);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if(__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq) {
+				continue;
+			}
+			__atomic_store_n(&entry->stamp, __atomic_fetch_add(&shHeader->clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+			__atomic_fetch_add(&shHeader->stats.hits, 1, __ATOMIC_RELAXED);
+			if(token != NULL) {
+				*token = current;
+			}
+			return 1;
+		}
+	}
+	__atomic_fetch_add(&shHeader->stats.misses, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_valid
+// Description  : Is a copy made under a token still current?
+//
+// Inputs       : cartridge, first - the block
+//                token - the token of the copy
+// Outputs      : non-zero if it is
+
+int cart_shcache_valid(int cartridge, int first, uint64_t token) {
+	return (shHeader != NULL) && (token != CART_SHCACHE_NO_TOKEN) && (current_token(CART_SHCACHE_KEY(cartridge, first)) == token);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_fill_begin
+// Description  : Get the token a block about to be read from CART will be
+//                filled under (taken before the read, so a write that races
+//                it moves the generation on)
+//
+// Inputs       : cartridge, first - the block
+// Outputs      : the token, CART_SHCACHE_NO_TOKEN if it cannot be cached
+
+uint64_t cart_shcache_fill_begin(int cartridge, int first) {
+	return (shHeader == NULL) ? CART_SHCACHE_NO_TOKEN : current_token(CART_SHCACHE_KEY(cartridge, first));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_fill
+// Description  : Place a block read from CART in the cache, unless it was
+//                written since its token was taken.  (A write starting just
+//                after the check leaves the copy stale, so it is never served.)
+//
+// Inputs       : cartridge, first - the block
+//                token - from cart_shcache_fill_begin
+//                block - the data read
+// Outputs      : 1 if it was placed, 0 if not
+
+int cart_shcache_fill(int cartridge, int first, uint64_t token, const void *block) {
+	uint32_t key = CART_SHCACHE_KEY(cartridge, first);
+
+	if((shHeader == NULL) || (token == CART_SHCACHE_NO_TOKEN)) {
+		return 0;
+	}
+	if(current_token(key) != token) {
+		__atomic_fetch_add(&shHeader->stats.stale, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return place_block(key, token, block);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_write_begin
+// Description  : Start a write of a block.  Its generation moves on (with a
+//                write in flight), so no process serves or fills a copy of
+//                it until the write ends.
+//
+// Inputs       : cartridge, first - the block
+// Outputs      : the write's ticket (the generation before it)
+
+uint64_t cart_shcache_write_begin(int cartridge, int first) {
+	if(shHeader == NULL) {
+		return CART_SHCACHE_NO_TOKEN;
+	}
+	return __atomic_fetch_add(&shGens[CART_SHCACHE_KEY(cartridge, first)], CART_SHCACHE_WRITE, __ATOMIC_ACQ_REL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_write_end
+// Description  : Finish a write of a block once it is on CART.  If no other
+//                write of it overlapped this one (none in flight when it
+//                started, none started since), this one reached CART last,
+//                and the new block is cached under its new token.
+//
+// Inputs       : cartridge, first - the block
+//                ticket - from cart_shcache_write_begin
+//                block - the whole block as written, NULL if only part of it was
+// Outputs      : the token the block is now valid under, CART_SHCACHE_NO_TOKEN
+//                if another write overlapped
+
+uint64_t cart_shcache_write_end(int cartridge, int first, uint64_t ticket, const void *block) {
+	uint32_t key = CART_SHCACHE_KEY(cartridge, first);
+	uint64_t gen, token;
+
+	if((shHeader == NULL) || (ticket == CART_SHCACHE_NO_TOKEN)) {
+		return CART_SHCACHE_NO_TOKEN;
+	}
+	gen = __atomic_sub_fetch(&shGens[key], 1, __ATOMIC_ACQ_REL);
+	if(((ticket & 0xffffffffULL) != 0) || (gen != ticket + (1ULL << 32))) {
+		return CART_SHCACHE_NO_TOKEN;
+	}
+	token = ((uint64_t)__atomic_load_n(&shHeader->epoch, __ATOMIC_ACQUIRE) << 32) | (gen >> 32);
+	if(block != NULL) {
+		place_block(key, token, block);
+	}
+	return token;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_reset
+// Description  : Stop serving everything cached, by moving the epoch on
+//                (poweron zeroes CART)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_shcache_reset(void) {
+	if(shHeader == NULL) {
+		return -1;
+	}
+	__atomic_add_fetch(&shHeader->epoch, 1, __ATOMIC_ACQ_REL);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_shcache_stats
+// Description  : Get the counters the cache keeps
+//
+// Inputs       : stats - where to place them
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_shcache_stats(CartShcacheStats *stats) {
+	if(shHeader == NULL) {
+		memset(stats, 0x0, sizeof(CartShcacheStats));
+		return -1;
+	}
+	stats->hits = __atomic_load_n(&shHeader->stats.hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&shHeader->stats.misses, __ATOMIC_RELAXED);
+	stats->fills = __atomic_load_n(&shHeader->stats.fills, __ATOMIC_RELAXED);
+	stats->stale = __atomic_load_n(&shHeader->stats.stale, __ATOMIC_RELAXED);
+	return 0;
+}
+
+//
+// Unit test
+
+// This is the device the unit test's processes share: a version per block,
+// written atomically, which is what a block read from it holds
+typedef struct {
+	uint64_t version[CART_SHCACHE_TEST_KEYS]; // The block on the device
+	uint64_t done[CART_SHCACHE_TEST_KEYS];    // Highest version whose write has finished
+	uint64_t reads;      // Blocks read from the device
+	uint64_t violations; // Blocks served older than a finished write, or torn
+} CartShcacheTestDevice;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_latency
+// Description  : Take the time of a device access, for the unit test
+//
+// Inputs       : none
+// Outputs      : none
+
+static void unit_latency(void) {
+	volatile int i;
+
+	for(i=0; i<CART_SHCACHE_TEST_LATENCY; i++);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_read
+// Description  : Read a block for the unit test, from the cache or else the
+//                device (filling the cache), checking it is whole and no
+//                older than the last write finished before the read began
+//
+// Inputs       : dev - the device
+//                key - the block
+// Outputs      : none
+
+static void unit_read(CartShcacheTestDevice *dev, int key) {
+	uint64_t block[CART_FRAME_SIZE / sizeof(uint64_t)], floor, token;
+	int i;
+
+	floor = __atomic_load_n(&dev->done[key], __ATOMIC_ACQUIRE);
+	if(!cart_shcache_get(0, key, block, NULL)) {
+		token = cart_shcache_fill_begin(0, key);
+		unit_latency();
+		block[0] = __atomic_load_n(&dev->version[key], __ATOMIC_ACQUIRE);
+		__atomic_fetch_add(&dev->reads, 1, __ATOMIC_RELAXED);
+		unit_latency();
+		for(i=1; i<CART_FRAME_SIZE / sizeof(uint64_t); i++) {
+			block[i] = block[0];
+		}
+		cart_shcache_fill(0, key, token, block);
+	}
+	for(i=1; (i<CART_FRAME_SIZE / sizeof(uint64_t)) && (block[i] == block[0]); i++);
+	if((block[0] < floor) || (i < CART_FRAME_SIZE / sizeof(uint64_t))) {
+		__atomic_fetch_add(&dev->violations, 1, __ATOMIC_RELAXED);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_write
+// Description  : Write a block for the unit test (a new version of it)
+//
+// Inputs       : dev - the device
+//                key - the block
+// Outputs      : none
+
+static void unit_write(CartShcacheTestDevice *dev, int key) {
+	uint64_t block[CART_FRAME_SIZE / sizeof(uint64_t)], ticket, done;
+	int i;
+
+	ticket = cart_shcache_write_begin(0, key);
+	unit_latency();
+	block[0] = __atomic_add_fetch(&dev->version[key], 1, __ATOMIC_ACQ_REL);
+	for(i=1; i<CART_FRAME_SIZE / sizeof(uint64_t); i++) {
+		block[i] = block[0];
+	}
+	done = __atomic_load_n(&dev->done[key], __ATOMIC_ACQUIRE);
+	while((done < block[0]) && !__atomic_compare_exchange_n(&dev->done[key], &done, block[0], 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+	cart_shcache_write_end(0, key, ticket, block);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_processes
+// Description  : Run the unit test's processes, each attaching the segment
+//                by name and reading (and writing, if asked) random blocks
+//
+// Inputs       : name - the segment
+//                dev - the device
+//                writes - non-zero to write one operation in eight
+// Outputs      : 0 if successful, -1 if failure
+
+static int unit_processes(const char *name, CartShcacheTestDevice *dev, int writes) {
+	unsigned int seed;
+	int p, i, status, failed = 0;
+	pid_t pids[CART_SHCACHE_TEST_PROCS];
+
+	for(p=0; p<CART_SHCACHE_TEST_PROCS; p++) {
+		if((pids[p] = fork()) == 0) {
+			cart_shcache_close();
+			if(cart_shcache_open(name, CART_SHCACHE_TEST_KEYS * 4, 1) != 0) {
+				_exit(1);
+			}
+			seed = p + 1;
+			for(i=0; i<CART_SHCACHE_TEST_OPS; i++) {
+				if(writes && ((rand_r(&seed) % 8) == 0)) {
+					unit_write(dev, rand_r(&seed) % CART_SHCACHE_TEST_KEYS);
+				} else {
+					unit_read(dev, writes ? rand_r(&seed) % CART_SHCACHE_TEST_KEYS : i % CART_SHCACHE_TEST_KEYS);
+				}
+			}
+			_exit(0);
+		}
+		if(pids[p] == -1) {
+			return -1;
+		}
+	}
+	for(p=0; p<CART_SHCACHE_TEST_PROCS; p++) {
+		if((waitpid(pids[p], &status, 0) != pids[p]) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+			failed = 1;
+		}
+	}
+	return failed ? -1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_checks
+// Description  : Run the checks of the unit test on an attached segment
+//
+// Inputs       : name - the segment
+//                dev - the device
+// Outputs      : 0 if successful, -1 if failure
+
+static int unit_checks(const char *name, CartShcacheTestDevice *dev) {
+	char block[CART_FRAME_SIZE], check[CART_FRAME_SIZE];
+	uint64_t token, ticket;
+
+	// A fill is served until the block is written, a write in flight is never served
+	memset(block, 'a', sizeof(block));
+	token = cart_shcache_fill_begin(3, 7);
+	if(cart_shcache_get(3, 7, check, NULL) || !cart_shcache_fill(3, 7, token, block) ||
+			!cart_shcache_get(3, 7, check, &token) || (memcmp(block, check, sizeof(block)) != 0) || !cart_shcache_valid(3, 7, token)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: bad fill.");
+		return(-1);
+	}
+	ticket = cart_shcache_write_begin(3, 7);
+	if(cart_shcache_get(3, 7, check, NULL) || cart_shcache_valid(3, 7, token) ||
+			(cart_shcache_fill_begin(3, 7) != CART_SHCACHE_NO_TOKEN)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: served a block being written.");
+		return(-1);
+	}
+	memset(block, 'b', sizeof(block));
+	token = cart_shcache_write_end(3, 7, ticket, block);
+	if(!cart_shcache_get(3, 7, check, NULL) || (memcmp(block, check, sizeof(block)) != 0) || !cart_shcache_valid(3, 7, token)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: bad write.");
+		return(-1);
+	}
+
+	// A fill racing a write is dropped, and a reset drops everything
+	token = cart_shcache_fill_begin(3, 8);
+	cart_shcache_write_end(3, 8, cart_shcache_write_begin(3, 8), NULL);
+	if(cart_shcache_fill(3, 8, token, block) || cart_shcache_get(3, 8, check, NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: cached a block read before a write.");
+		return(-1);
+	}
+	cart_shcache_reset();
+	if(cart_shcache_get(3, 7, check, NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: served a block after a reset.");
+		return(-1);
+	}
+
+	// Processes writing and reading at once never see a block older than a finished write
+	if((unit_processes(name, dev, 1) != 0) || (dev->violations != 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: %lu stale or torn blocks served.", (unsigned long)dev->violations);
+		return(-1);
+	}
+
+	// Processes reading the same blocks share them, rather than each reading all of them
+	cart_shcache_reset();
+	dev->reads = 0;
+	if((unit_processes(name, dev, 0) != 0) || (dev->violations != 0) || (dev->reads >= CART_SHCACHE_TEST_KEYS * CART_SHCACHE_TEST_PROCS)) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: %lu device reads for %d blocks.", (unsigned long)dev->reads, CART_SHCACHE_TEST_KEYS);
+		return(-1);
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "Shared cache: %d processes read %d blocks from the device %lu times.",
+		CART_SHCACHE_TEST_PROCS, CART_SHCACHE_TEST_KEYS, (unsigned long)dev->reads);
+	return(0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cartShcacheUnitTest
+// Description  : Run a UNIT test checking the shared cache: fills, writes
+//                and resets in one process, then processes writing and
+//                reading the same blocks at once (nothing older than a
+//                finished write may be served), then processes reading the
+//                same blocks (which should share what the others read)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cartShcacheUnitTest(void) {
+	CartShcacheTestDevice *dev;
+	char name[64];
+	int ret;
+
+	snprintf(name, sizeof(name), "/cart_shcache_unit.%d", (int)getpid());
+	if(cart_shcache_open(name, CART_SHCACHE_TEST_KEYS * 4, 1) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Shared cache unit test failed: cannot create the segment.");
+		return(-1);
+	}
+	dev = mmap(NULL, sizeof(CartShcacheTestDevice), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(dev == MAP_FAILED) {
+		cart_shcache_close();
+		cart_shcache_unlink(name);
+		return(-1);
+	}
+	ret = unit_checks(name, dev);
+	munmap(dev, sizeof(CartShcacheTestDevice));
+	cart_shcache_close();
+	cart_shcache_unlink(name);
+	if(ret == 0) {
+		logMessage(LOG_OUTPUT_LEVEL, "Shared cache unit test completed successfully.");
+	}
+	return(ret);
+}
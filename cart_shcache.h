@@ -0,0 +1,79 @@
+#ifndef CART_SHCACHE_INCLUDED
+#define CART_SHCACHE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_shcache.h
+//  Description    : This is the interface for the shared frame cache of the
+//                   CART driver.  The processes of a host that attach the
+//                   same named shared memory segment share one cache of
+//                   blocks, so a block is read from the server and held once
+//                   however many of them use it.  The index takes no locks
+//                   (each entry is a seqlock).  Writes are kept coherent by
+//                   a generation per block: a write moves it on, and a copy
+//                   is only served while the generation it was read under is
+//                   current, so a write stops every process serving the old
+//                   data without finding the copies.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CART_SHCACHE_WAYS 8              // Entries a block may be placed in (its set)
+#define CART_SHCACHE_NO_TOKEN UINT64_MAX // Token of a block that cannot be cached now (a write of it is in flight)
+
+// These are the counters the cache keeps (over all of the processes)
+typedef struct {
+	uint64_t hits;   // Blocks found
+	uint64_t misses; // Blocks not found
+	uint64_t fills;  // Blocks placed in the cache
+	uint64_t stale;  // Fills dropped because the block was written while it was read
+} CartShcacheStats;
+
+//
+// Functional Prototypes
+
+int cart_shcache_open(const char *name, uint32_t frames, uint32_t blockFrames);
+	// Attach the named segment (creating it if there is none), holding frames frames in blocks of blockFrames
+
+int cart_shcache_close(void);
+	// Detach the segment (it stays for the other processes)
+
+int cart_shcache_unlink(const char *name);
+	// Remove the named segment
+
+int cart_shcache_enabled(void);
+	// Non-zero if a segment is attached
+
+int cart_shcache_get(int cartridge, int first, void *block, uint64_t *token);
+	// Copy a block out of the cache, 1 if it was there (token is the generation the copy is valid for)
+
+int cart_shcache_valid(int cartridge, int first, uint64_t token);
+	// Non-zero if a copy made under token is still current
+
+uint64_t cart_shcache_fill_begin(int cartridge, int first);
+	// Get the token a block about to be read from CART is filled under
+
+int cart_shcache_fill(int cartridge, int first, uint64_t token, const void *block);
+	// Place a block read from CART in the cache (dropped if it was written since cart_shcache_fill_begin)
+
+uint64_t cart_shcache_write_begin(int cartridge, int first);
+	// Start a write of a block, its cached copies stop being served (returns the write's ticket)
+
+uint64_t cart_shcache_write_end(int cartridge, int first, uint64_t ticket, const void *block);
+	// Finish a write once it is on CART, caching the new block (NULL if only part was written), returns its token
+
+int cart_shcache_reset(void);
+	// Stop serving everything cached (CART was zeroed)
+
+int cart_shcache_stats(CartShcacheStats *stats);
+	// Get the counters the cache keeps
+
+int cartShcacheUnitTest(void);
+	// Run a UNIT test checking the shared cache (with several processes)
+
+#endif
@@ -11,6 +11,7 @@
 // Include Files
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -20,30 +21,57 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <time.h>
 
 // Project Includes
 #include <cart_driver.h>
 #include <cart_cache.h>
+#include <cart_codec.h>
+#include <cart_arena.h>
+#include <cart_tier.h>
+#include <cart_shcache.h>
 #include <cart_network.h>
+#include <cart_workload.h>
+#include <cart_trace.h>
+#include <cart_ring.h>
 #include <cmpsc311_log.h>
 #include <cmpsc311_util.h>
 
 // Defines
 #define CART_WORKLOAD_DIR "workload"
 #define CART_SIM_MAX_OPEN_FILES 128
-#define CART_ARGUMENTS "huvl:c:i:p:"
+#define CART_SIM_MAX_VALIDATE_THREADS 64
+#define CART_ARGUMENTS "huvbLl:c:B:K:T:M:i:p:j:t:s:r:R:"
 #define USAGE \
-	"USAGE: cart_sim [-h] [-v] [-l <logfile>] [-c <sz>] <workload-file>\n" \
+	"USAGE: cart_sim [-h] [-v] [-b] [-L] [-l <logfile>] [-c <sz>] [-B <bytes>]\n" \
+	"                [-K <carts>] [-T <tierfile>] [-M <segment>] [-j <threads>] [-t <tracefile>]\n" \
+	"                [-s <statsfile>] [-r <ringfile>] [-R <records>] <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -v - verbose output\n" \
+	"    -b - write .cmm backups of the CART files when validating\n" \
+	"    -L - use the log-structured layout (every write goes to the head of a log)\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
 	"    -c - set the cart block cache to size <sz> (disabled for assign #2)\n" \
+	"    -B - set the file block size to <bytes> (1024, 4096, 16384 or 65536)\n" \
+	"    -K - only use the first <carts> cartridges for files (with -L, makes the cleaner run)\n" \
+	"    -T - keep the hot extents in the local store <tierfile> (a local disk)\n" \
+	"    -M - cache in the shared memory <segment> (e.g. /cart), shared by the\n" \
+	"         processes naming it, of the size set with -c\n" \
 	"    -i - IP address of server to connect to.\n" \
 	"    -p - port number of server to connect to.\n" \
+	"    -j - validate files with <threads> threads (default one per CPU)\n" \
+	"    -t - record a bus trace to <tracefile> (replay it with cart_tracesim)\n" \
+	"    -s - write the run statistics to <statsfile> as JSON (see cart_perfgate)\n" \
+	"    -r - record the trace ring and dump it to <ringfile> (see cart_ringdump)\n" \
+	"    -R - keep the last <records> records of each thread in the trace ring\n" \
+	"         (default 16384, older ones are counted as dropped)\n" \
 	"\n" \
-	"    <workload-file> - file contain the workload to simulate\n" \
+	"    <workload-file> - file contain the workload to simulate (text, or\n" \
+	"                      compiled with cart_wlcompile)\n" \
 	"\n" \
 
 // This is the file table
@@ -52,15 +80,40 @@ typedef struct {
 	int16_t   fhandle;   // This is a file handle for the opened file
 } CartSimulationTable;
 
+// This is a file waiting to be validated
+typedef struct {
+	char     *fname;     // This is the filename for the test file
+	char     *membuf;    // Contents read back from the CART file
+	off_t     size;      // Size of the source file
+	int       result;    // 0 if the file validated, -1 if not
+	char      error[512]; // Failure message, logged by the main thread
+} CartValidationJob;
+
+// This is the pool of validation jobs shared with the worker threads
+typedef struct {
+	pthread_mutex_t    lock;   // Protects the queue
+	pthread_cond_t     ready;  // Signaled when a job is queued or the queue closes
+	CartValidationJob *jobs;   // The jobs, in file table order
+	int                queued; // Number of jobs queued
+	int                next;   // Next job for a worker to take
+	int                closed; // No more jobs will be queued
+} CartValidationPool;
+
 //
 // Global Data
 int verbose;
+int write_backups = 0;    // Write .cmm backups of the CART files when validating
+int validate_threads = 0; // Number of validation threads (0 means one per CPU)
+uint64_t sim_ops = 0;         // Number of workload commands replayed
+uint64_t sim_replay_us = 0;   // Time spent replaying the workload (usec)
+uint64_t sim_validate_us = 0; // Time spent validating the files (usec)
 
 //
 // Functional Prototypes
 
 int simulate_CART( char *wload );             // control loop of the CART simulation
-int validate_file(char *fname, int16_t mfh);  // Validate a file in the filesystem
+int validate_files(CartSimulationTable *ftable, int nfiles); // Validate the files in the filesystem
+int write_sim_stats( char *path );            // Write the run statistics as JSON
 
 //
 // Functions
@@ -77,8 +130,9 @@ int validate_file(char *fname, int16_t mfh);  // Validate a file in the filesyst
 int main( int argc, char *argv[] ) {
 
 	// Local variables
-	int ch, verbose = 0, log_initialized = 0, unit_tests = 0;
-	uint32_t cache_size = 0;
+	int ch, verbose = 0, log_initialized = 0, unit_tests = 0, ret = 0, cartridges;
+	uint32_t cache_size = 0, block_size, ring_records;
+	char *trace_file = NULL, *stats_file = NULL, *ring_file = NULL;
 
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, CART_ARGUMENTS)) != -1) {
@@ -92,6 +146,14 @@ int main( int argc, char *argv[] ) {
 			verbose = 1;
 			break;
 
+		case 'b': // Backup Flag
+			write_backups = 1;
+			break;
+
+		case 'L': // Log-structured layout
+			cart_set_layout(CART_LAYOUT_LOG);
+			break;
+
 		case 'u': // Unit test Flag
 			unit_tests = 1;
 			break;
@@ -107,6 +169,34 @@ int main( int argc, char *argv[] ) {
 			}
 			break;
 
+		case 'B': // Set the file block size
+			if ( (sscanf( optarg, "%u", &block_size ) != 1) || (cart_set_block_size(block_size) != 0) ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad block size [%s]", optarg );
+			    return( -1 );
+			}
+			break;
+
+		case 'K': // Set the cartridge budget
+			if ( (sscanf( optarg, "%d", &cartridges ) != 1) || (cart_set_cartridges(cartridges) != 0) ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad cartridge count [%s]", optarg );
+			    return( -1 );
+			}
+			break;
+
+		case 'T': // Keep the hot extents in a local store
+			if ( cart_set_tier(optarg, 0) != 0 ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad local tier [%s]", optarg );
+			    return( -1 );
+			}
+			break;
+
+		case 'M': // Cache in a shared memory segment
+			if ( cart_set_shared_cache(optarg) != 0 ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad shared cache [%s]", optarg );
+			    return( -1 );
+			}
+			break;
+
         case 'i': // Get the IP address
             if (inet_addr(optarg) == INADDR_NONE) {
 			    logMessage( LOG_ERROR_LEVEL, "Bad IP address [%s]", argv[optind] );
@@ -122,6 +212,32 @@ int main( int argc, char *argv[] ) {
 			}
             break;			
 
+		case 'j': // Set the number of validation threads
+			if ( (sscanf(optarg, "%d", &validate_threads) != 1) || (validate_threads < 1) ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad validation thread count [%s]", optarg );
+                return(-1);
+			}
+			break;
+
+		case 't': // Set the bus trace filename
+			trace_file = optarg;
+			break;
+
+		case 's': // Set the statistics filename
+			stats_file = optarg;
+			break;
+
+		case 'r': // Set the trace ring filename
+			ring_file = optarg;
+			break;
+
+		case 'R': // Set the trace ring size
+			if ( (sscanf(optarg, "%u", &ring_records) != 1) || (cart_ring_set_records(ring_records) != 0) ) {
+			    logMessage( LOG_ERROR_LEVEL, "Bad ring size [%s]", optarg );
+			    return( -1 );
+			}
+			break;
+
 		default:  // Default (unknown)
 			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
 			return( -1 );
@@ -147,10 +263,12 @@ int main( int argc, char *argv[] ) {
 		// Run the unit tests
 		enableLogLevels( LOG_INFO_LEVEL );
 		logMessage(LOG_INFO_LEVEL, "Running unit tests ....\n\n");
-		if ( (cartCacheUnitTest() == 0) && (cartCacheUnitTest() == 0) ) {
+		if ( (cartCacheUnitTest() == 0) && (cartCacheUnitTest() == 0) && (cartCodecUnitTest() == 0) &&
+				(cartArenaUnitTest() == 0) && (cartTierUnitTest() == 0) && (cartShcacheUnitTest() == 0) ) {
 			logMessage(LOG_INFO_LEVEL, "Unit tests completed successfully.\n\n");
 		} else {
 			logMessage(LOG_ERROR_LEVEL, "Unit tests failed, aborting.\n\n");
+			ret = -1;
 		}
 
 	} else {
@@ -164,16 +282,34 @@ int main( int argc, char *argv[] ) {
 
 		}
 
+		// Start the bus trace as needed
+		if ( (trace_file != NULL) && (cart_trace_open(trace_file, get_cart_cache_size()) != 0) ) {
+			return( -1 );
+		}
+
+		// Start the trace ring as needed
+		if ( ring_file != NULL ) {
+			cart_ring_enable();
+		}
+
 		// Run the simulation
 		if ( simulate_CART(argv[optind]) == 0 ) {
 			logMessage( LOG_INFO_LEVEL, "CART simulation completed successfully.\n\n" );
+			if ( (stats_file != NULL) && (write_sim_stats(stats_file) != 0) ) {
+				ret = -1;
+			}
 		} else {
-			logMessage( LOG_INFO_LEVEL, "CART simulation failed.\n\n" );
+			logMessage( LOG_ERROR_LEVEL, "CART simulation failed.\n\n" );
+			ret = -1;
+		}
+		cart_trace_close();
+		if ( (ring_file != NULL) && (cart_ring_dump(ring_file) != 0) ) {
+			ret = -1;
 		}
 	}
 
-	// Return successfully
-	return( 0 );
+	// Return the result (non-zero if the unit tests, the simulation or its validation failed)
+	return( ret );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -188,287 +324,429 @@ int main( int argc, char *argv[] ) {
 int simulate_CART( char *wload ) {
 
 	// Local variables
-	char line[1024], fname[128], command[128], text[1025], *sep, *rbuf;
-	FILE *fhandle = NULL;
-	int32_t err=0, len, off, fields, linecount;
+	char *fname, *rbuf = NULL;
+	CartWorkload workload;
+	CartWorkloadCommand cmd;
+	int32_t err=0, rbufsz = 0;
 	CartSimulationTable ftable[CART_SIM_MAX_OPEN_FILES];
-	int idx, i;
+	struct timespec start, replayed, validated;
+	int idx;
 
 	// Setup the file table
 	memset(ftable, 0x0, sizeof(CartSimulationTable)*CART_SIM_MAX_OPEN_FILES);
 
-	// Open the workload file
-	linecount = 0;
-	if ( (fhandle=fopen(wload, "r")) == NULL ) {
-		logMessage( LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.\n",
-			wload, strerror(errno) );
+	// Open (map) the workload file
+	if ( open_cart_workload(wload, &workload) == -1 ) {
 		return( -1 );
 	}
 
 	// Startup the interface
 	if (cart_poweron() == -1) {
 		logMessage( LOG_ERROR_LEVEL, "CART simulator failed initialization.");
-		fclose( fhandle );
+		close_cart_workload( &workload );
 		return( -1 );
 	}
 	logMessage(CartSimulatorLLevel, "CART simulator initialization complete.");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	// While file not done, get the next command and bail out on fail
+	while ((err = next_cart_workload(&workload, &cmd)) == 1) {
+
+		// The parser interns the filenames, so the index is the table slot
+		sim_ops++;
+		idx = cmd.file;
+		CMPSC_ASSERT1(idx<CART_SIM_MAX_OPEN_FILES, "Too many open files on CART sim [%d]", idx);
+		fname = cart_workload_filename(&workload, idx);
+
+		// File is not found, open the file
+		if (ftable[idx].filename == NULL) {
+
+			// Record the open, save filename for later use
+			CART_RING(CART_RING_LEVEL_OPS, CART_RING_SIM_OPEN, idx, 0, 0, 0);
+			ftable[idx].filename = fname;
+
+			// Now perform the open
+			ftable[idx].fhandle = cart_open(ftable[idx].filename);
+			if (ftable[idx].fhandle == -1) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "Open of new file [%s] failed, aborting simulation.", fname);
+				return(-1);
+			}
+
+		}
+
+		// Now execute the specific command
+		if (cmd.op == CART_WL_WRITEAT) {
+
+			// Record the command executed
+			CART_RING(CART_RING_LEVEL_OPS, CART_RING_SIM_WRITEAT, idx, cmd.len, cmd.off, 0);
 
-	// While file not done
-	while (!feof(fhandle)) {
-
-		// Get the line and bail out on fail
-		if (fgets(line, 1024, fhandle) != NULL) {
-
-			// Parse out the string
-			linecount ++;
-			fields = sscanf(line, "%s %s %d %d", fname, command, &len, &off);
-			sep = strchr(line, ':');
-			if ( (fields != 4) || (sep == NULL) ) {
-				logMessage( LOG_ERROR_LEVEL, "CART un-parsable workload string, aborting [%s], line %d",
-						line, linecount );
-				fclose( fhandle );
-				return( -1 );
+			// First perform the seek
+			if (cart_seek(ftable[idx].fhandle, cmd.off)) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", fname, cmd.off);
+				return(-1);
+			}
+
+			// Now perform the write, straight out of the (translated) workload mapping
+			if (cart_write(ftable[idx].fhandle, cmd.data, cmd.len) != cmd.len) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d failed, aborting simulation.", fname, cmd.len);
+				return(-1);
 			}
 
-			// Just log the contents
-			logMessage(CartSimulatorLLevel, "File [%s], command [%s], len=%d, offset=%d",
-					fname, command, len, off);
-
-			// Now walk the the table looking for the file
-			idx = -1;
-			i = 0;
-			while ( (i < CART_SIM_MAX_OPEN_FILES) && (idx == -1) ) {
-				if ( (ftable[i].filename != NULL) && (strcmp(ftable[i].filename,fname) == 0) ) {
-					idx = i;
-				}
-				i++;
+
+		} else if (cmd.op == CART_WL_WRITE) {
+
+			// Record the command executed
+			CART_RING(CART_RING_LEVEL_OPS, CART_RING_SIM_WRITE, idx, cmd.len, 0, 0);
+
+			// Now perform the write
+			if (cart_write(ftable[idx].fhandle, cmd.data, cmd.len) != cmd.len) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "Write of file [%s], length %d failed, aborting simulation.", fname, cmd.len);
+				return(-1);
 			}
 
-			// File is not found, open the file
-			if (idx == -1) {
-
-				// Log message, find unused index and save filename for later use
-				logMessage(CartSimulatorLLevel, "CART_SIM : Opening file [%s]", fname);
-				idx = 0;
-				while ((ftable[idx].filename != NULL) && (idx < CART_SIM_MAX_OPEN_FILES)) {
-					idx++;
-				}
-				CMPSC_ASSERT1(idx<CART_SIM_MAX_OPEN_FILES, "Too many open files on CART sim [%d]", idx);
-				ftable[idx].filename = strdup(fname);
-
-				// Now perform the open
-				ftable[idx].fhandle = cart_open(ftable[idx].filename);
-				if (ftable[idx].fhandle == -1) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Open of new file [%s] failed, aborting simulation.", fname);
-					return(-1);
-				}
 
+		} else if (cmd.op == CART_WL_SEEK) {
+
+			// Record the command executed
+			CART_RING(CART_RING_LEVEL_OPS, CART_RING_SIM_SEEK, idx, cmd.off, 0, 0);
+
+			// Now perform the seek
+			if (cart_seek(ftable[idx].fhandle, cmd.off) != cmd.len) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "Seek in file [%s] to position %d failed, aborting simulation.", fname, cmd.off);
+				return(-1);
 			}
 
-			// Now execute the specific command
-			if (strncmp(command, "WRITEAT", 7) == 0) {
-
-				// Log the command executed
-				logMessage(CartSimulatorLLevel, "CART_SIM : Writing %d bytes at position %d from file [%s]", len, off, fname);
-
-				// First perform the seek
-				if (cart_seek(ftable[idx].fhandle, off)) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Seek/WriteAt file [%s] to position %d failed, aborting simulation.", fname, off);
-					return(-1);
-				}
-
-				// Now see if we need more data to fill, terminate the lines
-				CMPSC_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
-				CMPSC_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
-				strncpy(text, sep+1, len);
-				text[len] = 0x0;
-				for (i=0; i<strlen(text); i++) {
-					if (text[i] == '^') {
-						text[i] = '\n';
-					}
-				}
-
-				// Now perform the write
-				if (cart_write(ftable[idx].fhandle, text, len) != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "WriteAt of file [%s], length %d failed, aborting simulation.", fname, len);
-					return(-1);
-				}
-
-
-			} else if (strncmp(command, "WRITE", 5) == 0) {
-
-				// Now see if we need more data to fill, terminate the lines
-				CMPSC_ASSERT1(len<1024, "Simulated workload command text too large [%d]", len);
-				CMPSC_ASSERT2((strlen(sep+1)>=len), "Workload str [%d<%d]", strlen(sep+1), len);
-				strncpy(text, sep+1, len);
-				text[len] = 0x0;
-				for (i=0; i<strlen(text); i++) {
-					if (text[i] == '^') {
-						text[i] = '\n';
-					}
-				}
-
-				// Log the command executed
-				logMessage(CartSimulatorLLevel, "CART_SIM : Writing %d bytes to file [%s]", len, fname);
-
-				// Now perform the write
-				if (cart_write(ftable[idx].fhandle, text, len) != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Write of file [%s], length %d failed, aborting simulation.", fname, len);
-					return(-1);
-				}
-
-
-			} else if (strncmp(command, "SEEK", 4) == 0) {
-
-				// Log the command executed
-				logMessage(CartSimulatorLLevel, "CART_SIM : Seeking to position %d in file [%s]", off, fname);
-
-				// Now perform the seek
-				if (cart_seek(ftable[idx].fhandle, off) != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Seek in file [%s] to position %d failed, aborting simulation.", fname, off);
-					return(-1);
-				}
-
-			} else if (strncmp(command, "READ", 4) == 0) {
-
-				// Log the command executed
-				logMessage(CartSimulatorLLevel, "CART_SIM : Reading %d bytes from file [%s]", len, fname);
-
-				// Now perform the read
-				rbuf = malloc(len);
-				if (cart_read(ftable[idx].fhandle, rbuf, len) != len) {
-					// Failed, error out
-					logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", fname, off);
-					return(-1);
-				}
-				free(rbuf);
-				rbuf = NULL;
+		} else if (cmd.op == CART_WL_READ) {
 
-			} else {
+			// Record the command executed
+			CART_RING(CART_RING_LEVEL_OPS, CART_RING_SIM_READ, idx, cmd.len, 0, 0);
 
-				// Bomb out, don't understand the command
-				CMPSC_ASSERT1(0, "CART_SIM : Failed, unknown command [%s]", command);
+			// Grow the read buffer as needed (it is reused across reads)
+			if (cmd.len > rbufsz) {
+				free(rbuf);
+				rbufsz = cmd.len;
+				rbuf = malloc(rbufsz);
+			}
 
+			// Now perform the read
+			if (cart_read(ftable[idx].fhandle, rbuf, cmd.len) != cmd.len) {
+				// Failed, error out
+				logMessage(LOG_ERROR_LEVEL, "Read file [%s] of length %d failed, aborting simulation.", fname, cmd.off);
+				return(-1);
 			}
-		}
 
-		// Check for the virtual level failing
-		if ( err ) {
-			logMessage( LOG_ERROR_LEVEL, "CRUS system failed, aborting [%d]", err );
-			fclose( fhandle );
-			return( -1 );
 		}
 	}
+	free(rbuf);
+	rbuf = NULL;
+	clock_gettime(CLOCK_MONOTONIC, &replayed);
+
+	// Check for the parse failing
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "CART workload parse failed, aborting [%d]", err );
+		close_cart_workload( &workload );
+		return( -1 );
+	}
 
-	// Now walk the the table of files to validate
-	for (i=0; i<CART_SIM_MAX_OPEN_FILES; i++) {
-		if (ftable[i].filename != NULL) {
-			if (validate_file(ftable[i].filename, ftable[i].fhandle) != 0) {
-				logMessage(LOG_ERROR_LEVEL, "CART Validation failed on file [%s].", ftable[i].filename,fname);
-				fclose( fhandle );
-				return(-1);
-			}
-		}		
+	// Now validate the table of files
+	if (validate_files(ftable, CART_SIM_MAX_OPEN_FILES) != 0) {
+		close_cart_workload( &workload );
+		return(-1);
 	}
+	clock_gettime(CLOCK_MONOTONIC, &validated);
+	sim_replay_us = ((replayed.tv_sec - start.tv_sec) * 1000000) + ((replayed.tv_nsec - start.tv_nsec) / 1000);
+	sim_validate_us = ((validated.tv_sec - replayed.tv_sec) * 1000000) + ((validated.tv_nsec - replayed.tv_nsec) / 1000);
 
 	// Shut down the interface
 	if (cart_poweroff() == -1) {
 		logMessage( LOG_ERROR_LEVEL, "CART simulator failed shutdown.");
-		fclose( fhandle );
+		close_cart_workload( &workload );
 		return( -1 );
 	}
 	logMessage(CartSimulatorLLevel, "CART simulator shutdown complete.");
 	logMessage(LOG_OUTPUT_LEVEL, "CART simulation: all tests successful!!!.");
 
 	// Close the workload file, successfully
-	fclose( fhandle );
+	close_cart_workload( &workload );
 	return( 0 );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : validate_file
-// Description  : Vadliate a file in the filesystem
+// Function     : check_validation_job
+// Description  : Compare the contents read back from a CART file against the
+//                source file (mapped, compared with memcmp), and write the .cmm
+//                backup if asked to.  Runs on the validation worker threads, so
+//                results are left in the job for the main thread to log.
 //
-// Inputs       : fname - the name of the file to validate
-//                mfh - the memory file handle
+// Inputs       : job - the validation job
 // Outputs      : 0 if successful test, -1 if failure
 
-int validate_file(char *fname, int16_t mfh) {
+int check_validation_job(CartValidationJob *job) {
 
 	// Local variables
-	char filename[256], bkfile[256], *filbuf, *membuf;
-	struct stat stats;
-	int idx, fh;
-
-	// First figure out how big the file is, setup buffer
-	snprintf(filename, 256, "%s/%s", CART_WORKLOAD_DIR, fname);
-	logMessage(LOG_OUTPUT_LEVEL, "Validating [%s] file ....", fname);
-	if ((stat(filename, &stats) != 0) || (stats.st_size == 0)) {
-		logMessage(LOG_ERROR_LEVEL, "Failure validating file [%s], missing or "
-			"unknown source.", filename);
-		return(-1);		
-	}
-	if ( ((filbuf = malloc(stats.st_size)) == NULL) || ((membuf = malloc(stats.st_size)) == NULL) ) {
-		logMessage(LOG_ERROR_LEVEL, "Failure validating file [%s], failed "
-			"buffer allocation.", filename);
-		return(-1);		
-	}
+	char filename[256], bkfile[256], *filbuf;
+	int fh;
+	off_t idx;
 
-	// Now open the file and read the contents
+	// Map the source file
+	snprintf(filename, 256, "%s/%s", CART_WORKLOAD_DIR, job->fname);
 	if ((fh=open(filename, O_RDONLY)) == -1) {
-		logMessage(LOG_ERROR_LEVEL, "Failure validating file [%s], open failed ", filename);
-		return(-1);		
-	}
-	if ((read(fh, filbuf, stats.st_size)) == -1) {
-		logMessage(LOG_ERROR_LEVEL, "Failure validating file [%s], read failed ", filename);
+		snprintf(job->error, sizeof(job->error), "Failure validating file [%s], open failed ", filename);
 		return(-1);
 	}
+	filbuf = mmap(NULL, job->size, PROT_READ, MAP_PRIVATE, fh, 0);
 	close(fh);
-
-	// Seek to the beginning of the memory file, read the contents
-	if (cart_seek(mfh, 0) == -1) {
-		// Failed, error out
-		logMessage(LOG_ERROR_LEVEL, "Read cart file [%s] see to zero failed.", fname);
+	if (filbuf == MAP_FAILED) {
+		snprintf(job->error, sizeof(job->error), "Failure validating file [%s], read failed ", filename);
 		return(-1);
 	}
-	if (cart_read(mfh, membuf, stats.st_size) != stats.st_size) {
-		// Failed, error out
-		logMessage(LOG_ERROR_LEVEL, "Read cart file [%s] of length %d failed.", fname, stats.st_size);
+
+	// Now create a backup of the memory file so people can debug
+	if (write_backups) {
+		snprintf(bkfile, 256, "%s/%s.cmm", CART_WORKLOAD_DIR, job->fname);
+		if ((fh=open(bkfile, O_RDWR|O_CREAT|O_TRUNC, S_IRWXU)) == -1) {
+			snprintf(job->error, sizeof(job->error), "Failure creating backup file [%s], open failed (%s) ",
+				bkfile, strerror(errno));
+			munmap(filbuf, job->size);
+			return(-1);
+		}
+		if ((write(fh, job->membuf, job->size)) != job->size) {
+			snprintf(job->error, sizeof(job->error), "Failure writing backup file [%s].", bkfile);
+			close(fh);
+			munmap(filbuf, job->size);
+			return(-1);
+		}
+		close(fh);
+	}
+
+	// Compare the buffers, and only walk them byte for byte to report a mismatch
+	if (memcmp(job->membuf, filbuf, job->size) != 0) {
+		for (idx=0; job->membuf[idx] == filbuf[idx]; idx++);
+		snprintf(job->error, sizeof(job->error), "Validation of [%s] failed at offset %ld (mem %x/'%c' "
+			"!= fil %x/'%c'", job->fname, (long)idx, job->membuf[idx], job->membuf[idx], filbuf[idx], filbuf[idx]);
+		munmap(filbuf, job->size);
 		return(-1);
 	}
 
-	// Now create a backup of the memory file so people can debug
-	snprintf(bkfile, 256, "%s/%s.cmm", CART_WORKLOAD_DIR, fname);
-	if ((fh=open(bkfile, O_RDWR|O_CREAT|O_TRUNC, S_IRWXU)) == -1) {
-		logMessage(LOG_ERROR_LEVEL, "Failure creating backup file [%s], open failed (%s) ", 
-			bkfile, strerror(errno));
-		return(-1);		
+	munmap(filbuf, job->size);
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : validation_worker
+// Description  : Validation thread, checks jobs as the main thread queues them
+//
+// Inputs       : arg - the validation pool
+// Outputs      : NULL
+
+void * validation_worker(void *arg) {
+
+	// Local variables
+	CartValidationPool *pool = arg;
+	CartValidationJob *job;
+
+	while (1) {
+
+		// Wait for a job, or for the queue to be closed
+		pthread_mutex_lock(&pool->lock);
+		while ((pool->next == pool->queued) && (! pool->closed)) {
+			pthread_cond_wait(&pool->ready, &pool->lock);
+		}
+		if (pool->next == pool->queued) {
+			pthread_mutex_unlock(&pool->lock);
+			return(NULL);
+		}
+		job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		// Check the file, the buffer is no longer needed after
+		job->result = check_validation_job(job);
+		free(job->membuf);
+		job->membuf = NULL;
 	}
-	if ((write(fh, membuf, stats.st_size)) == -1) {
-		logMessage(LOG_ERROR_LEVEL, "Failure writing backup file [%s].", bkfile);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : validate_files
+// Description  : Vadliate all of the files in the filesystem.  The CART files
+//                are read back on this thread (the driver is single threaded),
+//                while the comparisons against the sources and the backups run
+//                on a pool of worker threads.
+//
+// Inputs       : ftable - the simulation file table
+//                nfiles - the number of entries in the table
+// Outputs      : 0 if successful test, -1 if failure
+
+int validate_files(CartSimulationTable *ftable, int nfiles) {
+
+	// Local variables
+	char filename[256];
+	struct stat stats;
+	CartValidationPool pool;
+	CartValidationJob *job;
+	pthread_t threads[CART_SIM_MAX_VALIDATE_THREADS];
+	int i, nthreads, failed = 0;
+
+	// Setup the pool, one job per file
+	memset(&pool, 0x0, sizeof(pool));
+	if ((pool.jobs = calloc(nfiles, sizeof(CartValidationJob))) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure validating files, failed job allocation.");
 		return(-1);
 	}
-	close(fh);
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.ready, NULL);
+	nthreads = (validate_threads > 0) ? validate_threads : sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1) {
+		nthreads = 1;
+	} else if (nthreads > CART_SIM_MAX_VALIDATE_THREADS) {
+		nthreads = CART_SIM_MAX_VALIDATE_THREADS;
+	}
+	for (i=0; i<nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, validation_worker, &pool) != 0) {
+			break;
+		}
+	}
+	nthreads = i;
+
+	// Read each CART file back and hand it to the workers
+	for (i=0; i<nfiles; i++) {
+		if (ftable[i].filename == NULL) {
+			continue;
+		}
+		job = &pool.jobs[pool.queued];
+		job->fname = ftable[i].filename;
+		job->result = -1;
+		logMessage(LOG_OUTPUT_LEVEL, "Validating [%s] file ....", job->fname);
+
+		// First figure out how big the file is, setup buffer
+		snprintf(filename, 256, "%s/%s", CART_WORKLOAD_DIR, job->fname);
+		if ((stat(filename, &stats) != 0) || (stats.st_size == 0)) {
+			logMessage(LOG_ERROR_LEVEL, "Failure validating file [%s], missing or "
+				"unknown source.", filename);
+			failed = 1;
+			break;
+		}
+		job->size = stats.st_size;
+		if ((job->membuf = malloc(job->size)) == NULL) {
+			logMessage(LOG_ERROR_LEVEL, "Failure validating file [%s], failed "
+				"buffer allocation.", filename);
+			failed = 1;
+			break;
+		}
 
+		// Seek to the beginning of the memory file, read the contents
+		if (cart_seek(ftable[i].fhandle, 0) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "Read cart file [%s] see to zero failed.", job->fname);
+			free(job->membuf);
+			failed = 1;
+			break;
+		}
+		if (cart_read(ftable[i].fhandle, job->membuf, job->size) != job->size) {
+			logMessage(LOG_ERROR_LEVEL, "Read cart file [%s] of length %ld failed.", job->fname, (long)job->size);
+			free(job->membuf);
+			failed = 1;
+			break;
+		}
 
-	// Now walk the buffers and compare byte for byte
-	for (idx=0; idx<stats.st_size; idx++) {
-		if (membuf[idx] != filbuf[idx]) {
-			logMessage(LOG_ERROR_LEVEL, "Validation of [%s] failed at offset %d (mem %x/'%c' "
-				"!= fil %x/'%c'", fname, idx, membuf[idx], membuf[idx], filbuf[idx], filbuf[idx]);
-			return(-1);
+		// Queue the job, or check it here if there are no workers
+		if (nthreads == 0) {
+			job->result = check_validation_job(job);
+			free(job->membuf);
+			job->membuf = NULL;
+			pool.queued++;
+			continue;
 		}
+		pthread_mutex_lock(&pool.lock);
+		pool.queued++;
+		pthread_cond_signal(&pool.ready);
+		pthread_mutex_unlock(&pool.lock);
 	}
 
-	// Free the buffers, log success, and return successfully
-	free(filbuf);
-	free(membuf);
-	logMessage(LOG_OUTPUT_LEVEL, "Validation of [%s], length %d sucessful.", fname, stats.st_size);
-	return( 0 );
+	// Close the queue and wait for the workers to drain it
+	pthread_mutex_lock(&pool.lock);
+	pool.closed = 1;
+	pthread_cond_broadcast(&pool.ready);
+	pthread_mutex_unlock(&pool.lock);
+	for (i=0; i<nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	// Log the results in file order
+	for (i=0; i<pool.queued; i++) {
+		job = &pool.jobs[i];
+		if (job->result != 0) {
+			logMessage(LOG_ERROR_LEVEL, "%s", job->error);
+			logMessage(LOG_ERROR_LEVEL, "CART Validation failed on file [%s].", job->fname);
+			failed = 1;
+		} else {
+			logMessage(LOG_OUTPUT_LEVEL, "Validation of [%s], length %ld sucessful.", job->fname, (long)job->size);
+		}
+	}
+
+	// Cleanup, return the result
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.ready);
+	free(pool.jobs);
+	return( failed ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_sim_stats
+// Description  : Write the statistics of the last simulation to a file as a
+//                flat JSON object (one "name": value per line), the format
+//                read by cart_perfgate.
+//
+// Inputs       : path - the file to write
+// Outputs      : 0 if successful, -1 if failure
+
+int write_sim_stats( char *path ) {
+
+	// Local variables
+	CartDriverStats stats;
+	uint64_t busops = 0;
+	FILE *fp;
+	int i;
+
+	// Get the driver counters
+	cart_driver_stats(&stats);
+	for (i=0; i<CART_OP_MAXVAL; i++) {
+		busops += stats.busOps[i];
+	}
+
+	// Write them out with the timings
+	if ((fp = fopen(path, "w")) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing statistics [%s], error: %s.", path, strerror(errno));
+		return(-1);
+	}
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"ops\": %lu,\n", (unsigned long)sim_ops);
+	fprintf(fp, "  \"replay_us\": %lu,\n", (unsigned long)sim_replay_us);
+	fprintf(fp, "  \"validate_us\": %lu,\n", (unsigned long)sim_validate_us);
+	fprintf(fp, "  \"bus_ops\": %lu,\n", (unsigned long)busops);
+	fprintf(fp, "  \"bus_initms\": %lu,\n", (unsigned long)stats.busOps[CART_OP_INITMS]);
+	fprintf(fp, "  \"bus_bzero\": %lu,\n", (unsigned long)stats.busOps[CART_OP_BZERO]);
+	fprintf(fp, "  \"bus_ldcart\": %lu,\n", (unsigned long)stats.busOps[CART_OP_LDCART]);
+	fprintf(fp, "  \"bus_rdfrme\": %lu,\n", (unsigned long)stats.busOps[CART_OP_RDFRME]);
+	fprintf(fp, "  \"bus_wrfrme\": %lu,\n", (unsigned long)stats.busOps[CART_OP_WRFRME]);
+	fprintf(fp, "  \"bus_powoff\": %lu,\n", (unsigned long)stats.busOps[CART_OP_POWOFF]);
+	fprintf(fp, "  \"cache_hits\": %lu,\n", (unsigned long)stats.cacheHits);
+	fprintf(fp, "  \"cache_misses\": %lu,\n", (unsigned long)stats.cacheMisses);
+	fprintf(fp, "  \"allocations\": %lu,\n", (unsigned long)stats.allocations);
+	fprintf(fp, "  \"bytes_read\": %lu,\n", (unsigned long)stats.bytesRead);
+	fprintf(fp, "  \"bytes_written\": %lu,\n", (unsigned long)stats.bytesWritten);
+	fprintf(fp, "  \"cleaned_segments\": %lu,\n", (unsigned long)stats.cleanedSegments);
+	fprintf(fp, "  \"cleaned_frames\": %lu,\n", (unsigned long)stats.cleanedFrames);
+	fprintf(fp, "  \"metadata_bytes\": %lu\n", (unsigned long)stats.metadataBytes);
+	fprintf(fp, "}\n");
+	fclose(fp);
+	return(0);
 }
@@ -0,0 +1,491 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_tier.c
+//  Description    : This is the implementation of the local storage tier.
+//                   Each extent has a heat (its accesses, halved every
+//                   CART_TIER_DECAY_ACCESSES accesses) and, while it is
+//                   local, a slot of the store file.  An extent is promoted
+//                   once its heat reaches CART_TIER_PROMOTE_HEAT, taking a
+//                   free slot or the slot of a colder extent, and demoted
+//                   (written back if dirty) when it loses its slot or its
+//                   heat decays to zero.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Project Includes
+#include <cart_tier.h>
+#include <cart_controller.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_TIER_PER_CARTRIDGE (CART_CARTRIDGE_SIZE / CART_TIER_EXTENT_FRAMES) // Extents on a cartridge
+#define CART_TIER_EXTENTS (CART_MAX_CARTRIDGES * CART_TIER_PER_CARTRIDGE) // Extents on the device
+#define CART_TIER_EXTENT(c, f) (((c) * CART_TIER_PER_CARTRIDGE) + ((f) / CART_TIER_EXTENT_FRAMES)) // Extent holding a frame
+#define CART_TIER_EXTENT_BYTES (CART_TIER_EXTENT_FRAMES * CART_FRAME_SIZE) // Bytes in an extent (and a slot)
+#define CART_TIER_HEAT_MAX UINT16_MAX // Heat saturates here
+
+// This is a slot of the local store
+typedef struct {
+	int32_t  extent; // The extent it holds, -1 if free
+	uint64_t dirty;  // The frames written since it was stored, one bit each
+} CartTierSlot;
+
+//
+// Global data
+static int tierFile = -1;                      // The local store, -1 if it is not open
+static char *tierPath = NULL;                  // The path of the local store
+static CartTierSlot *tierSlots = NULL;         // The slots of the local store
+static uint32_t tierSlotCount = 0;             // Number of slots
+static uint32_t tierCursor = 0;                // Next slot cart_tier_step looks at
+static uint16_t extentHeat[CART_TIER_EXTENTS]; // Heat of each extent
+static int32_t extentSlot[CART_TIER_EXTENTS];  // Slot holding each extent, -1 if it is only on CART
+static uint32_t *fileHeat = NULL;              // Heat of each file (by the driver's file index)
+static int fileHeatSize = 0;                   // Entries in fileHeat
+static uint32_t tierAccesses = 0;              // Accesses since the heat was last halved
+static CartTierStats tierStats;                // Counters reported by cart_tier_stats
+static char tierBuf[CART_TIER_EXTENT_BYTES];   // Dirty frames on their way back to CART
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : demote_slot
+// Description  : Write back the dirty frames of a slot, a run of consecutive
+//                frames at a time, and free it
+//
+// Inputs       : slot - the slot
+//                writeback - writes a run of frames to CART
+// Outputs      : 0 if successful, -1 if failure
+
+static int demote_slot(uint32_t slot, CartTierWriteback writeback) {
+	int32_t extent = tierSlots[slot].extent;
+	int cartridge = extent / CART_TIER_PER_CARTRIDGE, first = (extent % CART_TIER_PER_CARTRIDGE) * CART_TIER_EXTENT_FRAMES;
+	int i, n;
+
+	for(i=0; i<CART_TIER_EXTENT_FRAMES; i+=n) {
+		for(n=0; (i + n < CART_TIER_EXTENT_FRAMES) && (tierSlots[slot].dirty & (1ULL << (i + n))); n++);
+		if(n == 0) {
+			n = 1;
+			continue;
+		}
+		if((pread(tierFile, tierBuf, (size_t)n * CART_FRAME_SIZE, ((off_t)slot * CART_TIER_EXTENT_BYTES) + ((off_t)i * CART_FRAME_SIZE)) != (ssize_t)n * CART_FRAME_SIZE) ||
+				(writeback(cartridge, first + i, n, tierBuf) != 0)) {
+			logMessage(LOG_ERROR_LEVEL, "CART tier failed writing back cartridge %d frames %d-%d.", cartridge, first + i, first + i + n - 1);
+			return -1;
+		}
+		tierStats.writebacks += n;
+	}
+	extentSlot[extent] = -1;
+	tierSlots[slot].extent = -1;
+	tierSlots[slot].dirty = 0;
+	tierStats.demotions++;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : pick_slot
+// Description  : Pick the slot an extent would be promoted into: a free one,
+//                else the coldest, if it is colder than the extent
+//
+// Inputs       : extent - the extent
+// Outputs      : the slot, -1 if the extent is not hot enough to take one
+
+static int32_t pick_slot(int32_t extent) {
+	int32_t victim = -1;
+	uint32_t i;
+
+	for(i=0; i<tierSlotCount; i++) {
+		if(tierSlots[i].extent == -1) {
+			return i;
+		}
+		if((victim == -1) || (extentHeat[tierSlots[i].extent] < extentHeat[tierSlots[victim].extent])) {
+			victim = i;
+		}
+	}
+	if((victim != -1) && (extentHeat[tierSlots[victim].extent] >= extentHeat[extent])) {
+		return -1;
+	}
+	return victim;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_open
+// Description  : Create the local store, holding up to extents extents
+//
+// Inputs       : path - the store file (created, or truncated)
+//                extents - the extents it holds
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_tier_open(const char *path, uint32_t extents) {
+	uint32_t i;
+
+	if((tierFile != -1) || (extents == 0)) {
+		return -1;
+	}
+	if((tierFile = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "CART tier failed to create its store [%s].", path);
+		return -1;
+	}
+	if(((tierSlots = malloc(sizeof(CartTierSlot) * extents)) == NULL) || ((tierPath = strdup(path)) == NULL)) {
+		cart_tier_close();
+		return -1;
+	}
+	for(i=0; i<extents; i++) {
+		tierSlots[i].extent = -1;
+		tierSlots[i].dirty = 0;
+	}
+	tierSlotCount = extents;
+	tierCursor = tierAccesses = 0;
+	memset(extentHeat, 0x0, sizeof(extentHeat));
+	memset(extentSlot, 0xff, sizeof(extentSlot)); // All -1, nothing local
+	memset(&tierStats, 0x0, sizeof(tierStats));
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_close
+// Description  : Remove the local store.  Nothing is written back, as CART
+//                is zeroed at the next poweron anyway.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_tier_close(void) {
+	if(tierFile != -1) {
+		close(tierFile);
+		tierFile = -1;
+	}
+	if(tierPath != NULL) {
+		unlink(tierPath);
+		free(tierPath);
+		tierPath = NULL;
+	}
+	free(tierSlots);
+	tierSlots = NULL;
+	tierSlotCount = 0;
+	free(fileHeat);
+	fileHeat = NULL;
+	fileHeatSize = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_enabled
+// Description  : Is the local store open?
+//
+// Inputs       : none
+// Outputs      : non-zero if it is
+
+int cart_tier_enabled(void) {
+	return (tierFile != -1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_touch
+// Description  : Count an access to a frame of a file, halving all of the
+//                heat every CART_TIER_DECAY_ACCESSES accesses
+//
+// Inputs       : cartridge, frame - the frame
+//                file - the file (the driver's index of it)
+// Outputs      : non-zero if the frame's extent should be promoted (it is hot
+//                and there is a slot for it)
+
+int cart_tier_touch(int cartridge, int frame, int file) {
+	int32_t extent = CART_TIER_EXTENT(cartridge, frame);
+	uint32_t *heat;
+	int i, size;
+
+	if(tierFile == -1) {
+		return 0;
+	}
+	if(extentHeat[extent] < CART_TIER_HEAT_MAX) {
+		extentHeat[extent]++;
+	}
+	if(file >= fileHeatSize) {
+		for(size=(fileHeatSize == 0) ? 64 : fileHeatSize; size<=file; size*=2);
+		if((heat = realloc(fileHeat, sizeof(uint32_t) * size)) != NULL) {
+			memset(&heat[fileHeatSize], 0x0, sizeof(uint32_t) * (size - fileHeatSize));
+			fileHeat = heat;
+			fileHeatSize = size;
+		}
+	}
+	if(file < fileHeatSize) {
+		fileHeat[file]++;
+	}
+
+	// Age everything, so heat reflects recent accesses
+	if(++tierAccesses >= CART_TIER_DECAY_ACCESSES) {
+		for(i=0; i<CART_TIER_EXTENTS; i++) {
+			extentHeat[i] >>= 1;
+		}
+		for(i=0; i<fileHeatSize; i++) {
+			fileHeat[i] >>= 1;
+		}
+		tierAccesses = 0;
+	}
+	return ((extentSlot[extent] == -1) && (extentHeat[extent] >= CART_TIER_PROMOTE_HEAT) && (pick_slot(extent) != -1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_resident
+// Description  : Is the frame's extent in the local store?
+//
+// Inputs       : cartridge, frame - the frame
+// Outputs      : non-zero if it is
+
+int cart_tier_resident(int cartridge, int frame) {
+	return ((tierFile != -1) && (extentSlot[CART_TIER_EXTENT(cartridge, frame)] != -1));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_read
+// Description  : Read frames of a resident extent from the local store
+//
+// Inputs       : cartridge, frame - the first frame
+//                n - the number of frames (in the same extent)
+//                buf - where to place them
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_tier_read(int cartridge, int frame, int n, void *buf) {
+	int32_t slot = extentSlot[CART_TIER_EXTENT(cartridge, frame)];
+
+	if(pread(tierFile, buf, (size_t)n * CART_FRAME_SIZE, ((off_t)slot * CART_TIER_EXTENT_BYTES) +
+			((off_t)(frame % CART_TIER_EXTENT_FRAMES) * CART_FRAME_SIZE)) != (ssize_t)n * CART_FRAME_SIZE) {
+		logMessage(LOG_ERROR_LEVEL, "CART tier failed reading cartridge %d frame %d.", cartridge, frame);
+		return -1;
+	}
+	tierStats.reads += n;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_write
+// Description  : Write frames of a resident extent to the local store, to be
+//                written back to CART when the extent is demoted
+//
+// Inputs       : cartridge, frame - the first frame
+//                n - the number of frames (in the same extent)
+//                buf - the frames
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_tier_write(int cartridge, int frame, int n, const void *buf) {
+	int32_t slot = extentSlot[CART_TIER_EXTENT(cartridge, frame)];
+	int i;
+
+	if(pwrite(tierFile, buf, (size_t)n * CART_FRAME_SIZE, ((off_t)slot * CART_TIER_EXTENT_BYTES) +
+			((off_t)(frame % CART_TIER_EXTENT_FRAMES) * CART_FRAME_SIZE)) != (ssize_t)n * CART_FRAME_SIZE) {
+		logMessage(LOG_ERROR_LEVEL, "CART tier failed writing cartridge %d frame %d.", cartridge, frame);
+		return -1;
+	}
+	for(i=0; i<n; i++) {
+		tierSlots[slot].dirty |= 1ULL << ((frame % CART_TIER_EXTENT_FRAMES) + i);
+	}
+	tierStats.writes += n;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_admit
+// Description  : Store an extent just read from CART.  If the store is full,
+//                the coldest resident extent is demoted to make room, but
+//                only if it is colder than this one.
+//
+// Inputs       : cartridge, first - the extent's cartridge and first frame
+//                data - its frames
+//                writeback - writes a run of frames to CART
+// Outputs      : 0 if admitted, 1 if not (the store is full of hotter extents), -1 if failure
+
+int cart_tier_admit(int cartridge, int first, const void *data, CartTierWriteback writeback) {
+	int32_t extent = CART_TIER_EXTENT(cartridge, first), victim;
+
+	if(extentSlot[extent] != -1) {
+		return 0;
+	}
+	if((victim = pick_slot(extent)) == -1) {
+		return 1;
+	}
+	if((tierSlots[victim].extent != -1) && (demote_slot(victim, writeback) != 0)) {
+		return -1;
+	}
+	if(pwrite(tierFile, data, CART_TIER_EXTENT_BYTES, (off_t)victim * CART_TIER_EXTENT_BYTES) != CART_TIER_EXTENT_BYTES) {
+		logMessage(LOG_ERROR_LEVEL, "CART tier failed storing cartridge %d frames %d-%d.", cartridge, first, first + CART_TIER_EXTENT_FRAMES - 1);
+		return -1;
+	}
+	tierSlots[victim].extent = extent;
+	tierSlots[victim].dirty = 0;
+	extentSlot[extent] = victim;
+	tierStats.promotions++;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_step
+// Description  : Do a step of the background migration: look at the next
+//                slot, and demote its extent if it has gone cold.  The
+//                driver runs a step after each operation, so migration is
+//                spread over them rather than stalling one.
+//
+// Inputs       : writeback - writes a run of frames to CART
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_tier_step(CartTierWriteback writeback) {
+	uint32_t slot;
+
+	if(tierSlotCount == 0) {
+		return 0;
+	}
+	slot = tierCursor++ % tierSlotCount;
+	if((tierSlots[slot].extent != -1) && (extentHeat[tierSlots[slot].extent] == 0)) {
+		return demote_slot(slot, writeback);
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_file_heat
+// Description  : Get the heat of a file
+//
+// Inputs       : file - the file (the driver's index of it)
+// Outputs      : its heat
+
+uint32_t cart_tier_file_heat(int file) {
+	return ((file >= 0) && (file < fileHeatSize)) ? fileHeat[file] : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_tier_stats
+// Description  : Get the counters the tier keeps
+//
+// Inputs       : stats - where to place them
+// Outputs      : 0 if successful
+
+int cart_tier_stats(CartTierStats *stats) {
+	memcpy(stats, &tierStats, sizeof(CartTierStats));
+	return 0;
+}
+
+//
+// Unit test
+
+static char unitCart[4][CART_TIER_EXTENT_BYTES]; // CART, as the unit test's writeback sees it
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unit_writeback
+// Description  : The unit test's writeback, into unitCart (cartridges 0-3,
+//                first extent only)
+//
+// Inputs       : cartridge, frame - the first frame
+//                n - the number of frames
+//                data - the frames
+// Outputs      : 0 if successful
+
+static int unit_writeback(int cartridge, int frame, int n, void *data) {
+	memcpy(&unitCart[cartridge][frame * CART_FRAME_SIZE], data, (size_t)n * CART_FRAME_SIZE);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cartTierUnitTest
+// Description  : Run a UNIT test checking that extents are promoted when hot,
+//                that local writes only reach CART when their extent is
+//                demoted (by a hotter extent, or by cooling), and that the
+//                frames read back are the ones written
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cartTierUnitTest(void) {
+	char path[64], frame[2 * CART_FRAME_SIZE], check[2 * CART_FRAME_SIZE];
+	int c, i;
+
+	snprintf(path, sizeof(path), "/tmp/cart_tier_unit.%d", (int)getpid());
+	if(cart_tier_open(path, 2) != 0) {
+		logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: cannot create the store.");
+		return(-1);
+	}
+	for(c=0; c<4; c++) {
+		memset(unitCart[c], 'a' + c, CART_TIER_EXTENT_BYTES);
+	}
+
+	// Cartridges 0 and 1 become hot and are promoted, 2 is warm and does not displace them (so is not worth reading)
+	for(c=0; c<3; c++) {
+		for(i=0; i<CART_TIER_PROMOTE_HEAT * (3 - c) - 1; i++) {
+			if((cart_tier_touch(c, i % CART_TIER_EXTENT_FRAMES, c) != 0) && (i < CART_TIER_PROMOTE_HEAT - 1)) {
+				logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: promoted too soon.");
+				return(-1);
+			}
+		}
+		if(((cart_tier_touch(c, 0, c) != 0) != (c < 2)) || (cart_tier_admit(c, 0, unitCart[c], unit_writeback) != ((c < 2) ? 0 : 1))) {
+			logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: bad promotion of cartridge %d.", c);
+			return(-1);
+		}
+	}
+	if(!cart_tier_resident(0, 5) || !cart_tier_resident(1, 63) || cart_tier_resident(2, 0) || cart_tier_resident(0, 64) ||
+			(cart_tier_file_heat(0) <= cart_tier_file_heat(1))) {
+		logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: bad residency.");
+		return(-1);
+	}
+
+	// Local writes stay local until the extent is demoted
+	memset(frame, 'X', sizeof(frame));
+	if((cart_tier_write(1, 10, 2, frame) != 0) || (cart_tier_read(1, 10, 2, check) != 0) ||
+			(memcmp(frame, check, sizeof(frame)) != 0) || (unitCart[1][10 * CART_FRAME_SIZE] != 'b')) {
+		logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: bad local write.");
+		return(-1);
+	}
+
+	// A hotter extent displaces the colder one, which writes its dirty frames back
+	for(i=0; i<CART_TIER_PROMOTE_HEAT * 4; i++) {
+		cart_tier_touch(3, 0, 3);
+	}
+	if((cart_tier_admit(3, 0, unitCart[3], unit_writeback) != 0) || cart_tier_resident(1, 0) || !cart_tier_resident(3, 0) ||
+			(memcmp(&unitCart[1][10 * CART_FRAME_SIZE], frame, sizeof(frame)) != 0) || (unitCart[1][12 * CART_FRAME_SIZE] != 'b')) {
+		logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: bad demotion.");
+		return(-1);
+	}
+
+	// Once everything has cooled, the background steps demote it all
+	for(i=0; i<CART_TIER_DECAY_ACCESSES * 16; i++) {
+		cart_tier_touch(2, CART_TIER_EXTENT_FRAMES, 2);
+	}
+	for(i=0; i<2; i++) {
+		cart_tier_step(unit_writeback);
+	}
+	if(cart_tier_resident(0, 0) || cart_tier_resident(3, 0)) {
+		logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: cold extents not demoted.");
+		return(-1);
+	}
+	cart_tier_close();
+	if(access(path, F_OK) == 0) {
+		logMessage(LOG_ERROR_LEVEL, "Tier unit test failed: store not removed.");
+		return(-1);
+	}
+
+	// Return successfully
+	logMessage(LOG_OUTPUT_LEVEL, "Tier unit test completed successfully.");
+	return(0);
+}
@@ -0,0 +1,81 @@
+#ifndef CART_TIER_INCLUDED
+#define CART_TIER_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_tier.h
+//  Description    : This is the interface for the local storage tier of the
+//                   CART driver.  The device is split into extents of
+//                   consecutive frames on a cartridge; the tier counts the
+//                   accesses to each (and to each file), decayed over time,
+//                   and keeps the hot extents in a file on a local disk.
+//                   Frames written while their extent is local are only
+//                   written there, and go back to CART when the extent
+//                   cools and is demoted.  The tier never touches the bus,
+//                   the driver passes it the function that writes back.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CART_TIER_EXTENT_FRAMES 64      // Frames in an extent (a whole number of blocks, at most CART_NET_MAX_BATCH)
+#define CART_TIER_DEFAULT_EXTENTS 64    // Extents the local store holds by default (4 MB)
+#define CART_TIER_PROMOTE_HEAT 4        // Heat at which an extent is copied to the local store
+#define CART_TIER_DECAY_ACCESSES 4096   // Accesses between halvings of the heat
+
+// These are the counters the tier keeps
+typedef struct {
+	uint64_t promotions; // Extents copied to the local store
+	uint64_t demotions;  // Extents dropped from the local store
+	uint64_t reads;      // Frames read from the local store
+	uint64_t writes;     // Frames written to the local store
+	uint64_t writebacks; // Dirty frames written back to CART by demotions
+} CartTierStats;
+
+// This writes a run of frames of one cartridge back to CART
+typedef int (*CartTierWriteback)(int cartridge, int frame, int n, void *data);
+
+//
+// Functional Prototypes
+
+int cart_tier_open(const char *path, uint32_t extents);
+	// Create the local store, holding up to extents extents
+
+int cart_tier_close(void);
+	// Remove the local store (anything not written back is dropped)
+
+int cart_tier_enabled(void);
+	// Non-zero if the local store is open
+
+int cart_tier_touch(int cartridge, int frame, int file);
+	// Count an access to a frame of a file, non-zero if its extent should be promoted
+
+int cart_tier_resident(int cartridge, int frame);
+	// Non-zero if the frame's extent is in the local store
+
+int cart_tier_read(int cartridge, int frame, int n, void *buf);
+	// Read frames of a resident extent from the local store
+
+int cart_tier_write(int cartridge, int frame, int n, const void *buf);
+	// Write frames of a resident extent to the local store (they are written back on demotion)
+
+int cart_tier_admit(int cartridge, int first, const void *data, CartTierWriteback writeback);
+	// Store an extent read from CART, demoting a colder one if the store is full (1 if not admitted)
+
+int cart_tier_step(CartTierWriteback writeback);
+	// Do a step of the background migration, demoting an extent that has gone cold
+
+uint32_t cart_tier_file_heat(int file);
+	// Get the heat of a file
+
+int cart_tier_stats(CartTierStats *stats);
+	// Get the counters the tier keeps
+
+int cartTierUnitTest(void);
+	// Run a UNIT test checking the tier
+
+#endif
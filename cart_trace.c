@@ -0,0 +1,210 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_trace.c
+//  Description    : This is the implementation of the bus trace recorder.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Project Includes
+#include <cart_trace.h>
+#include <cmpsc311_log.h>
+
+//
+// Global data
+
+int cart_trace_enabled = 0; // Non-zero while a trace is being recorded
+
+static int traceHandle = -1; // File handle of the trace file
+static CartTraceHeader traceHeader; // Header, rewritten when the trace is closed
+static CartTraceRecord traceBuffer[CART_TRACE_BUFFER_RECORDS]; // Records waiting to be written
+static int traceBuffered = 0; // Number of records in traceBuffer
+static struct timespec traceStart; // Time the trace was opened
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flush_cart_trace
+// Description  : Write the buffered records out to the trace file
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+static int flush_cart_trace(void) {
+	char *buf = (char *)traceBuffer;
+	size_t len = traceBuffered * sizeof(CartTraceRecord);
+	ssize_t ret;
+
+	while(len > 0) {
+		if((ret = write(traceHandle, buf, len)) <= 0) {
+			logMessage(LOG_ERROR_LEVEL, "Failure writing bus trace, error: %s.", strerror(errno));
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	traceBuffered = 0;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_trace_open
+// Description  : Start recording a trace to the file at path
+//
+// Inputs       : path - the trace file to create
+//                cacheFrames - the size of the frame cache being traced
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_trace_open(char *path, uint32_t cacheFrames) {
+	if((traceHandle = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure creating bus trace [%s], error: %s.", path, strerror(errno));
+		return -1;
+	}
+
+	// The record count is filled in when the trace is closed
+	memset(&traceHeader, 0x0, sizeof(traceHeader));
+	traceHeader.magic = CART_TRACE_MAGIC;
+	traceHeader.version = CART_TRACE_VERSION;
+	traceHeader.cacheFrames = cacheFrames;
+	if(write(traceHandle, &traceHeader, sizeof(traceHeader)) != sizeof(traceHeader)) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing bus trace [%s], error: %s.", path, strerror(errno));
+		close(traceHandle);
+		traceHandle = -1;
+		return -1;
+	}
+
+	traceBuffered = 0;
+	clock_gettime(CLOCK_MONOTONIC, &traceStart);
+	cart_trace_enabled = 1;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_trace_log
+// Description  : Append a record to the trace
+//
+// Inputs       : event - the CartTraceEvent
+//                opcode - the bus opcode (bus events)
+//                cart - the cartridge index
+//                frame - the frame index
+//                hit - 1 if a cache lookup hit
+//                rt - the return code of a bus request
+// Outputs      : none
+
+void cart_trace_log(uint8_t event, uint8_t opcode, uint16_t cart, uint16_t frame, uint8_t hit, uint8_t rt) {
+	CartTraceRecord *rec;
+	struct timespec now;
+
+	if(traceHandle == -1) {
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	rec = &traceBuffer[traceBuffered++];
+	rec->timestamp = ((uint64_t)(now.tv_sec - traceStart.tv_sec) * 1000000000) + now.tv_nsec - traceStart.tv_nsec;
+	rec->event = event;
+	rec->opcode = opcode;
+	rec->hit = hit;
+	rec->rt = rt;
+	rec->cartridge = cart;
+	rec->frame = frame;
+	traceHeader.records++;
+
+	// Stop tracing (rather than failing the I/O) if the trace cannot be written
+	if((traceBuffered == CART_TRACE_BUFFER_RECORDS) && (flush_cart_trace() == -1)) {
+		cart_trace_enabled = 0;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_trace_close
+// Description  : Flush the trace, finish the header and stop recording
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_trace_close(void) {
+	int ret = 0;
+
+	if(traceHandle == -1) {
+		return 0;
+	}
+	cart_trace_enabled = 0;
+	if(flush_cart_trace() == -1) {
+		ret = -1;
+	}
+	traceHeader.records -= traceBuffered; // Anything left over was not written
+	if(pwrite(traceHandle, &traceHeader, sizeof(traceHeader), 0) != sizeof(traceHeader)) {
+		logMessage(LOG_ERROR_LEVEL, "Failure finishing bus trace, error: %s.", strerror(errno));
+		ret = -1;
+	}
+	close(traceHandle);
+	traceHandle = -1;
+	traceBuffered = 0;
+	return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_trace_load
+// Description  : Map a recorded trace for reading, checking the header
+//
+// Inputs       : path - the trace file
+//                hdr - where to place the pointer to the header
+// Outputs      : pointer to the first record if successful, NULL if failure
+
+CartTraceRecord * cart_trace_load(char *path, CartTraceHeader **hdr) {
+	struct stat stats;
+	char *map;
+	int fh;
+
+	if((fh = open(path, O_RDONLY)) == -1 || fstat(fh, &stats) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening trace [%s], error: %s.", path, strerror(errno));
+		if(fh != -1) {
+			close(fh);
+		}
+		return NULL;
+	}
+	if((stats.st_size < sizeof(CartTraceHeader)) ||
+			((map = mmap(NULL, stats.st_size, PROT_READ, MAP_PRIVATE, fh, 0)) == MAP_FAILED)) {
+		logMessage(LOG_ERROR_LEVEL, "Failure reading trace [%s].", path);
+		close(fh);
+		return NULL;
+	}
+	close(fh);
+
+	*hdr = (CartTraceHeader *)map;
+	if(((*hdr)->magic != CART_TRACE_MAGIC) || ((*hdr)->version != CART_TRACE_VERSION) ||
+			(sizeof(CartTraceHeader) + ((*hdr)->records * sizeof(CartTraceRecord)) > stats.st_size)) {
+		logMessage(LOG_ERROR_LEVEL, "Bad or truncated trace [%s].", path);
+		munmap(map, stats.st_size);
+		return NULL;
+	}
+	return (CartTraceRecord *)(map + sizeof(CartTraceHeader));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_trace_unload
+// Description  : Unmap a trace mapped by cart_trace_load
+//
+// Inputs       : hdr - the trace header
+// Outputs      : 0 if successful, -1 if failure
+
+int cart_trace_unload(CartTraceHeader *hdr) {
+	return munmap(hdr, sizeof(CartTraceHeader) + (hdr->records * sizeof(CartTraceRecord)));
+}
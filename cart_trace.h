@@ -0,0 +1,81 @@
+#ifndef CART_TRACE_INCLUDED
+#define CART_TRACE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_trace.h
+//  Description    : This is the interface for the bus trace recorder.  When
+//                   enabled, the driver logs every frame cache lookup/insert
+//                   and every bus request to a compact binary trace file that
+//                   can be replayed offline by cart_tracesim.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+
+// Defines
+#define CART_TRACE_MAGIC 0x52544743   // "CGTR", first word of a trace file
+#define CART_TRACE_VERSION 1          // Version of the trace format
+#define CART_TRACE_BUFFER_RECORDS 4096 // Records buffered before a write
+
+// These are the events that are traced
+typedef enum {
+
+	CART_TRACE_CACHE_GET = 0, // Frame cache lookup (hit says whether it was found)
+	CART_TRACE_CACHE_PUT = 1, // Frame cache insert/update
+	CART_TRACE_BUS       = 2, // Bus request (opcode is the CART_OP_* sent)
+	CART_TRACE_MAXVAL    = 3  // Maximum event value
+
+} CartTraceEvent;
+
+// This is the header at the start of a trace file
+typedef struct {
+	uint32_t magic;       // CART_TRACE_MAGIC
+	uint32_t version;     // CART_TRACE_VERSION
+	uint32_t cacheFrames; // Size of the frame cache when the trace was recorded
+	uint32_t unused;
+	uint64_t records;     // Number of records that follow
+} CartTraceHeader;
+
+// This is a single trace record (16 bytes)
+typedef struct {
+	uint64_t timestamp; // Nanoseconds since the trace was opened
+	uint8_t  event;     // CartTraceEvent
+	uint8_t  opcode;    // CART_OP_* for bus events
+	uint8_t  hit;       // 1 if a cache lookup hit
+	uint8_t  rt;        // Return code of a bus request
+	uint16_t cartridge; // Cartridge index
+	uint16_t frame;     // Frame index
+} CartTraceRecord;
+
+//
+// Global data
+
+extern int cart_trace_enabled; // Non-zero while a trace is being recorded
+
+//
+// Functional Prototypes
+
+int cart_trace_open(char *path, uint32_t cacheFrames);
+	// Start recording a trace to the file at path
+
+void cart_trace_log(uint8_t event, uint8_t opcode, uint16_t cart, uint16_t frame, uint8_t hit, uint8_t rt);
+	// Append a record to the trace (use CART_TRACE so disabled tracing is free)
+
+int cart_trace_close(void);
+	// Flush the trace, finish the header and stop recording
+
+CartTraceRecord * cart_trace_load(char *path, CartTraceHeader **hdr);
+	// Map a recorded trace for reading (returns the records, NULL on failure)
+
+int cart_trace_unload(CartTraceHeader *hdr);
+	// Unmap a trace mapped by cart_trace_load
+
+// Record an event if tracing is enabled
+#define CART_TRACE(ev,op,ct,fm,hit,rt) \
+	do { if (cart_trace_enabled) cart_trace_log(ev, op, ct, fm, hit, rt); } while (0)
+
+#endif
@@ -0,0 +1,427 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_tracesim.c
+//  Description    : This is the offline bus trace simulator.  It replays the
+//                   frame cache accesses of a trace recorded with cart_sim -t
+//                   against other cache sizes and replacement policies, and
+//                   estimates the bus operations each configuration would
+//                   have needed.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Project Includes
+#include <cart_controller.h>
+#include <cart_trace.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_TRACESIM_ARGUMENTS "has:p:"
+#define CART_TRACESIM_MAX_SIZES 32
+#define CART_TRACESIM_KEYS (CART_MAX_CARTRIDGES * CART_CARTRIDGE_SIZE)
+#define CART_TRACESIM_DEFAULT_SIZES "0,16,64,256,1024,4096,16384"
+#define CART_TRACESIM_DEFAULT_POLICIES "lru,fifo,clock,random"
+#define USAGE \
+	"USAGE: cart_tracesim [-h] [-a] [-s <sizes>] [-p <policies>] <trace-file>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -a - also insert frames into the cache on read misses\n" \
+	"    -s - comma separated cache sizes in frames (default " CART_TRACESIM_DEFAULT_SIZES ")\n" \
+	"    -p - comma separated policies, from lru, fifo, clock and random\n" \
+	"         (default " CART_TRACESIM_DEFAULT_POLICIES ")\n" \
+	"\n" \
+	"    <trace-file> - bus trace recorded with cart_sim -t\n" \
+	"\n" \
+
+// These are the replacement policies that can be simulated
+typedef enum {
+
+	CART_POLICY_LRU    = 0, // Evict the least recently used frame (the driver's policy)
+	CART_POLICY_FIFO   = 1, // Evict the oldest inserted frame
+	CART_POLICY_CLOCK  = 2, // Second chance approximation of LRU
+	CART_POLICY_RANDOM = 3, // Evict a random frame
+	CART_POLICY_MAXVAL = 4  // Maximum policy value
+
+} CartCachePolicy;
+
+static const char *policyNames[CART_POLICY_MAXVAL] = { "lru", "fifo", "clock", "random" };
+
+// This is a simulated frame cache
+typedef struct {
+	CartCachePolicy policy; // Replacement policy
+	uint32_t  size;   // Number of frames the cache holds
+	uint32_t  used;   // Number of frames in use
+	int32_t  *slotOf; // Frame key -> slot (-1 if not cached)
+	int32_t  *keyOf;  // Slot -> frame key
+	int32_t  *prev;   // Recency/insertion list, towards the head
+	int32_t  *next;   // Recency/insertion list, towards the tail
+	uint8_t  *ref;    // Reference bits (clock)
+	int32_t   head;   // Most recently used/inserted slot
+	int32_t   tail;   // Least recently used/inserted slot
+	uint32_t  hand;   // Clock hand
+	uint32_t  seed;   // Random policy state
+} CartSimCache;
+
+// These are the results of a replay
+typedef struct {
+	uint64_t lookups; // Cache lookups
+	uint64_t hits;    // Cache lookups that hit
+	uint64_t reads;   // Frame reads from the bus (lookup misses)
+	uint64_t writes;  // Frame writes to the bus
+	uint64_t loads;   // Cartridge loads
+	uint64_t other;   // Other bus operations (init, zero, power off)
+} CartSimResults;
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unlink_slot
+// Description  : Remove a slot from the recency/insertion list
+//
+// Inputs       : c - the simulated cache
+//                s - the slot
+// Outputs      : none
+
+static void unlink_slot(CartSimCache *c, int32_t s) {
+	if(c->prev[s] != -1) {
+		c->next[c->prev[s]] = c->next[s];
+	} else {
+		c->head = c->next[s];
+	}
+	if(c->next[s] != -1) {
+		c->prev[c->next[s]] = c->prev[s];
+	} else {
+		c->tail = c->prev[s];
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : push_slot
+// Description  : Put a slot at the head of the recency/insertion list
+//
+// Inputs       : c - the simulated cache
+//                s - the slot
+// Outputs      : none
+
+static void push_slot(CartSimCache *c, int32_t s) {
+	c->prev[s] = -1;
+	c->next[s] = c->head;
+	if(c->head != -1) {
+		c->prev[c->head] = s;
+	}
+	c->head = s;
+	if(c->tail == -1) {
+		c->tail = s;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : touch_slot
+// Description  : Note a use of a cached frame
+//
+// Inputs       : c - the simulated cache
+//                s - the slot
+// Outputs      : none
+
+static void touch_slot(CartSimCache *c, int32_t s) {
+	if(c->policy == CART_POLICY_LRU) {
+		unlink_slot(c, s);
+		push_slot(c, s);
+	} else if(c->policy == CART_POLICY_CLOCK) {
+		c->ref[s] = 1;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : victim_slot
+// Description  : Pick the slot to evict according to the policy
+//
+// Inputs       : c - the simulated cache (full)
+// Outputs      : the slot to reuse
+
+static int32_t victim_slot(CartSimCache *c) {
+	int32_t s;
+
+	switch(c->policy) {
+	case CART_POLICY_CLOCK:
+		while(c->ref[c->hand]) {
+			c->ref[c->hand] = 0;
+			c->hand = (c->hand + 1) % c->size;
+		}
+		s = c->hand;
+		c->hand = (c->hand + 1) % c->size;
+		return s;
+
+	case CART_POLICY_RANDOM:
+		c->seed = (c->seed * 1103515245) + 12345;
+		return (c->seed >> 8) % c->size;
+
+	default: // LRU and FIFO both evict the tail of the list
+		return c->tail;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : insert_frame
+// Description  : Insert (or update) a frame in the simulated cache
+//
+// Inputs       : c - the simulated cache
+//                key - the frame key
+// Outputs      : none
+
+static void insert_frame(CartSimCache *c, int32_t key) {
+	int32_t s;
+
+	if(c->size == 0) {
+		return;
+	}
+	if((s = c->slotOf[key]) != -1) {
+		touch_slot(c, s);
+		return;
+	}
+
+	// Use a free slot, or evict one
+	if(c->used < c->size) {
+		s = c->used++;
+	} else {
+		s = victim_slot(c);
+		c->slotOf[c->keyOf[s]] = -1;
+		unlink_slot(c, s);
+	}
+	c->keyOf[s] = key;
+	c->slotOf[key] = s;
+	c->ref[s] = 1;
+	push_slot(c, s);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_trace
+// Description  : Replay the cache accesses of a trace against a simulated
+//                cache, deriving the bus operations it would have needed
+//
+// Inputs       : recs - the trace records
+//                nrecs - the number of records
+//                policy - the replacement policy
+//                size - the cache size in frames
+//                allocate - insert frames on read misses too
+//                res - the results to fill in
+// Outputs      : 0 if successful, -1 if failure
+
+static int replay_trace(CartTraceRecord *recs, uint64_t nrecs, CartCachePolicy policy,
+		uint32_t size, int allocate, CartSimResults *res) {
+	CartSimCache c;
+	CartTraceRecord *rec;
+	int32_t key, loaded = -1;
+	uint64_t i;
+
+	// Setup the cache
+	memset(&c, 0x0, sizeof(c));
+	memset(res, 0x0, sizeof(CartSimResults));
+	c.policy = policy;
+	c.size = (size > CART_TRACESIM_KEYS) ? CART_TRACESIM_KEYS : size;
+	c.head = c.tail = -1;
+	c.seed = 311;
+	c.slotOf = malloc(sizeof(int32_t) * CART_TRACESIM_KEYS);
+	c.keyOf = malloc(sizeof(int32_t) * (c.size + 1));
+	c.prev = malloc(sizeof(int32_t) * (c.size + 1));
+	c.next = malloc(sizeof(int32_t) * (c.size + 1));
+	c.ref = malloc(c.size + 1);
+	if((c.slotOf == NULL) || (c.keyOf == NULL) || (c.prev == NULL) || (c.next == NULL) || (c.ref == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Failed allocating simulated cache of %u frames.", size);
+		return -1;
+	}
+	memset(c.slotOf, 0xff, sizeof(int32_t) * CART_TRACESIM_KEYS);
+
+	// Walk the trace
+	for(i=0; i<nrecs; i++) {
+		rec = &recs[i];
+		if((rec->cartridge >= CART_MAX_CARTRIDGES) || (rec->frame >= CART_CARTRIDGE_SIZE)) {
+			continue;
+		}
+		key = (rec->cartridge * CART_CARTRIDGE_SIZE) + rec->frame;
+
+		switch(rec->event) {
+		case CART_TRACE_CACHE_GET: // Lookup, a miss reads the frame from the bus
+			res->lookups++;
+			if(c.slotOf[key] != -1) {
+				res->hits++;
+				touch_slot(&c, c.slotOf[key]);
+				break;
+			}
+			if(loaded != rec->cartridge) {
+				res->loads++;
+				loaded = rec->cartridge;
+			}
+			res->reads++;
+			if(allocate) {
+				insert_frame(&c, key);
+			}
+			break;
+
+		case CART_TRACE_CACHE_PUT: // Insert
+			insert_frame(&c, key);
+			break;
+
+		case CART_TRACE_BUS: // Writes always go to the bus, reads and loads are derived above
+			if(rec->opcode == CART_OP_WRFRME) {
+				if(loaded != rec->cartridge) {
+					res->loads++;
+					loaded = rec->cartridge;
+				}
+				res->writes++;
+			} else if(rec->opcode == CART_OP_BZERO) {
+				loaded = rec->cartridge;
+				res->loads++;
+				res->other++;
+			} else if((rec->opcode != CART_OP_LDCART) && (rec->opcode != CART_OP_RDFRME)) {
+				res->other++;
+			}
+			break;
+		}
+	}
+
+	free(c.slotOf);
+	free(c.keyOf);
+	free(c.prev);
+	free(c.next);
+	free(c.ref);
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the trace simulator
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	char *sizelist = CART_TRACESIM_DEFAULT_SIZES, *policylist = CART_TRACESIM_DEFAULT_POLICIES;
+	char *tok, *save;
+	int ch, allocate = 0, nsizes = 0, npolicies = 0, i, j;
+	uint32_t sizes[CART_TRACESIM_MAX_SIZES];
+	CartCachePolicy policies[CART_POLICY_MAXVAL];
+	CartTraceHeader *hdr;
+	CartTraceRecord *recs;
+	CartSimResults rec, res;
+	uint64_t k, duration;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_TRACESIM_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'a': // Allocate on read miss
+			allocate = 1;
+			break;
+
+		case 's': // Cache sizes
+			sizelist = optarg;
+			break;
+
+		case 'p': // Policies
+			policylist = optarg;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	if ( optind >= argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Parse the sizes and policies (copied, as strtok_r writes into them)
+	sizelist = strdup(sizelist);
+	policylist = strdup(policylist);
+	for (tok = strtok_r(sizelist, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		if ( (nsizes == CART_TRACESIM_MAX_SIZES) || (sscanf(tok, "%u", &sizes[nsizes]) != 1) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad cache size [%s]", tok );
+			return( -1 );
+		}
+		nsizes++;
+	}
+	for (tok = strtok_r(policylist, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		for (i=0; (i<CART_POLICY_MAXVAL) && (strcmp(tok, policyNames[i]) != 0); i++);
+		if ( (i == CART_POLICY_MAXVAL) || (npolicies == CART_POLICY_MAXVAL) ) {
+			logMessage( LOG_ERROR_LEVEL, "Bad cache policy [%s]", tok );
+			return( -1 );
+		}
+		policies[npolicies++] = i;
+	}
+
+	// Map the trace
+	if ( (recs = cart_trace_load(argv[optind], &hdr)) == NULL ) {
+		return( -1 );
+	}
+
+	// Summarize what was recorded
+	memset(&rec, 0x0, sizeof(rec));
+	for (k=0; k<hdr->records; k++) {
+		if (recs[k].event == CART_TRACE_CACHE_GET) {
+			rec.lookups++;
+			rec.hits += recs[k].hit;
+		} else if (recs[k].event == CART_TRACE_BUS) {
+			switch (recs[k].opcode) {
+			case CART_OP_RDFRME: rec.reads++; break;
+			case CART_OP_WRFRME: rec.writes++; break;
+			case CART_OP_LDCART: rec.loads++; break;
+			default: rec.other++; break;
+			}
+		}
+	}
+	duration = (hdr->records > 0) ? recs[hdr->records-1].timestamp : 0;
+	printf("Trace [%s]: %lu records over %.3f s, recorded with a %u frame cache\n", argv[optind],
+		(unsigned long)hdr->records, duration / 1e9, hdr->cacheFrames);
+	printf("%-8s %8s %10s %10s %7s %10s %10s %10s %10s\n", "policy", "frames", "lookups",
+		"hits", "hit%", "RDFRME", "WRFRME", "LDCART", "bus ops");
+	printf("%-8s %8u %10lu %10lu %6.2f%% %10lu %10lu %10lu %10lu\n", "recorded", hdr->cacheFrames,
+		(unsigned long)rec.lookups, (unsigned long)rec.hits,
+		(rec.lookups > 0) ? (100.0 * rec.hits / rec.lookups) : 0.0,
+		(unsigned long)rec.reads, (unsigned long)rec.writes, (unsigned long)rec.loads,
+		(unsigned long)(rec.reads + rec.writes + rec.loads + rec.other));
+
+	// Now replay it against each configuration
+	for (i=0; i<npolicies; i++) {
+		for (j=0; j<nsizes; j++) {
+			if ( replay_trace(recs, hdr->records, policies[i], sizes[j], allocate, &res) != 0 ) {
+				return( -1 );
+			}
+			printf("%-8s %8u %10lu %10lu %6.2f%% %10lu %10lu %10lu %10lu\n", policyNames[policies[i]], sizes[j],
+				(unsigned long)res.lookups, (unsigned long)res.hits,
+				(res.lookups > 0) ? (100.0 * res.hits / res.lookups) : 0.0,
+				(unsigned long)res.reads, (unsigned long)res.writes, (unsigned long)res.loads,
+				(unsigned long)(res.reads + res.writes + res.loads + res.other));
+		}
+	}
+
+	cart_trace_unload(hdr);
+	free(sizelist);
+	free(policylist);
+	return( 0 );
+}
@@ -0,0 +1,126 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_wlcompile.c
+//  Description    : This is the workload compiler for the CART simulator.  It
+//                   turns a text workload into the binary workload format so
+//                   that benchmark runs do not pay for parsing the text.  It
+//                   can also generate a compiled workload over binary data
+//                   (files full of NULs), which text workloads cannot carry.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Project Includes
+#include <cart_workload.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define CART_WLCOMPILE_ARGUMENTS "hl:g:b:r:"
+#define CART_WLCOMPILE_BINARY_SIZE 32768 // Default largest generated file
+#define CART_WLCOMPILE_BINARY_SEED 311   // Default generator seed
+#define USAGE \
+	"USAGE: cart_wlcompile [-h] [-l <logfile>] <workload-file> <output-file>\n" \
+	"       cart_wlcompile [-h] [-l <logfile>] -g <files> [-b <bytes>] [-r <seed>] <output-file>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -l - write log messages to the filename <logfile>\n" \
+	"    -g - generate a binary workload over <files> random files instead, written\n" \
+	"         next to the output as binaryNN.bin (the simulator validates against them)\n" \
+	"    -b - largest generated file in bytes (default 32768)\n" \
+	"    -r - generator seed (default 311)\n" \
+	"\n" \
+	"    <workload-file> - text workload to compile\n" \
+	"    <output-file> - compiled workload to create (replay it with cart_client)\n" \
+	"\n" \
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the workload compiler
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] ) {
+
+	// Local variables
+	int ch, log_initialized = 0, files = 0;
+	uint32_t size = CART_WLCOMPILE_BINARY_SIZE;
+	unsigned int seed = CART_WLCOMPILE_BINARY_SEED;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, CART_WLCOMPILE_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'l': // Set the log filename
+			initializeLogWithFilename( optarg );
+			log_initialized = 1;
+			break;
+
+		case 'g': // Generate a binary workload
+			if ( (files = atoi(optarg)) <= 0 ) {
+				fprintf( stderr, "Bad file count (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'b': // Largest generated file
+			if ( (size = strtoul(optarg, NULL, 10)) < 2 ) {
+				fprintf( stderr, "Bad file size (%s), aborting.\n", optarg );
+				return( -1 );
+			}
+			break;
+
+		case 'r': // Generator seed
+			seed = strtoul(optarg, NULL, 10);
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	// Setup the log as needed
+	if ( ! log_initialized ) {
+		initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	}
+
+	// Generating needs just the output filename
+	if ( files > 0 ) {
+		if ( optind + 1 > argc ) {
+			fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+			return( -1 );
+		}
+		if ( generate_cart_workload(argv[optind], files, size, seed) != 0 ) {
+			logMessage( LOG_ERROR_LEVEL, "Workload generation failed." );
+			return( -1 );
+		}
+		return( 0 );
+	}
+
+	// The input and output filenames should be the next options
+	if ( optind + 2 > argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Compile the workload
+	if ( compile_cart_workload(argv[optind], argv[optind+1]) != 0 ) {
+		logMessage( LOG_ERROR_LEVEL, "Workload compile failed." );
+		return( -1 );
+	}
+	return( 0 );
+}
@@ -0,0 +1,705 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_workload.c
+//  Description    : This is the implementation of the workload parser used by
+//                   the CART simulator.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Project Includes
+#include <cart_workload.h>
+#include <cart_controller.h>
+#include <cmpsc311_log.h>
+
+//
+// Implementation
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : intern_workload_file
+// Description  : Looks up a filename in the hashed file table, adding it if it
+//                has not been seen before.
+//
+// Inputs       : wl - the workload
+//                name - the filename (not NUL terminated)
+//                length - the length of the filename
+//                hash - the FNV-1a hash of the filename
+// Outputs      : file index if successful, -1 if failure
+
+static int intern_workload_file(CartWorkload *wl, char *name, int length, uint32_t hash) {
+	uint32_t slot = hash & (CART_WORKLOAD_HASH_SIZE - 1);
+	int idx;
+
+	// Linear probe until we find the name or an empty slot
+	while((idx = wl->table[slot]) != -1) {
+		if(wl->hashes[idx] == hash && strncmp(wl->names[idx], name, length) == 0 && wl->names[idx][length] == 0x0) {
+			return idx;
+		}
+		slot = (slot + 1) & (CART_WORKLOAD_HASH_SIZE - 1);
+	}
+
+	// New filename, copy it out of the mapping so it can be handed to cart_open
+	if(wl->files == CART_WORKLOAD_MAX_FILES) {
+		logMessage(LOG_ERROR_LEVEL, "Too many files in workload [%d], line %d", wl->files, wl->linecount);
+		return -1;
+	}
+	idx = wl->files;
+	if((wl->names[idx] = strndup(name, length)) == NULL) {
+		logMessage(LOG_ERROR_LEVEL, "Failed allocating workload filename, line %d", wl->linecount);
+		return -1;
+	}
+	wl->hashes[idx] = hash;
+	wl->table[slot] = idx;
+	wl->files++;
+	return idx;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : parse_workload_int
+// Description  : Parses a decimal integer (with optional sign) at the cursor,
+//                skipping leading blanks.
+//
+// Inputs       : pos - pointer to the cursor, advanced past the number
+//                end - end of the line
+//                val - where to place the parsed value
+// Outputs      : 0 if successful, -1 if failure
+
+static int parse_workload_int(char **pos, char *end, int32_t *val) {
+	char *p = *pos;
+	int32_t sign = 1, v = 0;
+
+	while(p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	if(p < end && *p == '-') {
+		sign = -1;
+		p++;
+	}
+	if(p == end || *p < '0' || *p > '9') {
+		return -1;
+	}
+	while(p < end && *p >= '0' && *p <= '9') {
+		v = (v * 10) + (*p - '0');
+		p++;
+	}
+	*val = v * sign;
+	*pos = p;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_compiled_workload
+// Description  : Checks the header of a compiled workload and sets up the file
+//                table, op records and payload blob from the mapping.
+//
+// Inputs       : wl - the workload (already mapped)
+//                wload - the name of the workload file (for errors)
+// Outputs      : 0 if successful, -1 if failure
+
+static int load_compiled_workload(CartWorkload *wl, char *wload) {
+	CartWorkloadHeader *hdr = (CartWorkloadHeader *)wl->base;
+	char *name, *names_end;
+	uint32_t i;
+
+	// Check the header and that every section is inside the file
+	if((hdr->version != CART_WORKLOAD_VERSION) || (hdr->files > CART_WORKLOAD_MAX_FILES) ||
+			(hdr->namesOffset > hdr->opsOffset) || (hdr->opsOffset % sizeof(uint64_t) != 0) ||
+			(hdr->opsOffset + ((uint64_t)hdr->ops * sizeof(CartWorkloadRecord)) > hdr->dataOffset) ||
+			(hdr->dataOffset + hdr->dataLength > wl->size)) {
+		logMessage(LOG_ERROR_LEVEL, "Compiled workload [%s] has a bad header.", wload);
+		return -1;
+	}
+
+	// Copy out the filename table
+	name = wl->base + hdr->namesOffset;
+	names_end = wl->base + hdr->opsOffset;
+	for(i=0; i<hdr->files; i++) {
+		if((name >= names_end) || (memchr(name, 0x0, names_end - name) == NULL) ||
+				((wl->names[i] = strdup(name)) == NULL)) {
+			logMessage(LOG_ERROR_LEVEL, "Compiled workload [%s] has a bad filename table.", wload);
+			return -1;
+		}
+		wl->files++;
+		name += strlen(name) + 1;
+	}
+
+	wl->compiled = 1;
+	wl->records = (CartWorkloadRecord *)(wl->base + hdr->opsOffset);
+	wl->ops = hdr->ops;
+	wl->nextOp = 0;
+	wl->data = wl->base + hdr->dataOffset;
+	wl->dataLength = hdr->dataLength;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_compiled_workload
+// Description  : Hands back the next op record of a compiled workload
+//
+// Inputs       : wl - the workload
+//                cmd - the command to fill in
+// Outputs      : 1 if a command was returned, 0 at the end, -1 on failure
+
+static int next_compiled_workload(CartWorkload *wl, CartWorkloadCommand *cmd) {
+	CartWorkloadRecord *rec;
+
+	if(wl->nextOp == wl->ops) {
+		return 0;
+	}
+	rec = &wl->records[wl->nextOp++];
+	wl->linecount++;
+	if((rec->op >= CART_WL_MAXVAL) || (rec->file >= wl->files) || (rec->len < 0) ||
+			((uint64_t)rec->data + rec->len > wl->dataLength)) {
+		logMessage(LOG_ERROR_LEVEL, "Compiled workload has a bad op record %d", wl->nextOp - 1);
+		return -1;
+	}
+	cmd->op = rec->op;
+	cmd->file = rec->file;
+	cmd->len = rec->len;
+	cmd->off = rec->off;
+	cmd->data = wl->data + rec->data;
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : open_cart_workload
+// Description  : Map the workload file and prepare it for parsing.  The mapping
+//                is private and writable so payloads can be translated in place.
+//                Compiled workloads are recognized by their magic number.
+//
+// Inputs       : wload - the name of the workload file
+//                wl - the workload to initialize
+// Outputs      : 0 if successful, -1 if failure
+
+int open_cart_workload(char *wload, CartWorkload *wl) {
+	struct stat stats;
+	int fh;
+
+	memset(wl, 0x0, sizeof(CartWorkload));
+	memset(wl->table, 0xff, sizeof(wl->table)); // All slots empty (-1)
+
+	if((fh = open(wload, O_RDONLY)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.", wload, strerror(errno));
+		return -1;
+	}
+	if(fstat(fh, &stats) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure reading the workload file [%s], error: %s.", wload, strerror(errno));
+		close(fh);
+		return -1;
+	}
+
+	// An empty workload has nothing to map
+	wl->size = stats.st_size;
+	if(wl->size > 0) {
+		wl->base = mmap(NULL, wl->size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fh, 0);
+		if(wl->base == MAP_FAILED) {
+			logMessage(LOG_ERROR_LEVEL, "Failure mapping the workload file [%s], error: %s.", wload, strerror(errno));
+			wl->base = NULL;
+			close(fh);
+			return -1;
+		}
+		madvise(wl->base, wl->size, MADV_SEQUENTIAL);
+	}
+	close(fh);
+
+	wl->cursor = wl->base;
+	wl->end = wl->base + wl->size;
+
+	// Compiled workloads are replayed from their op records
+	if((wl->size >= sizeof(CartWorkloadHeader)) && (((CartWorkloadHeader *)wl->base)->magic == CART_WORKLOAD_MAGIC)) {
+		if(load_compiled_workload(wl, wload) == -1) {
+			close_cart_workload(wl);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_cart_workload
+// Description  : Parse the next command out of the workload.  Each line has the
+//                form "<file> <command> <len> <off> :<payload>".  The payload
+//                is returned as a pointer into the mapping, with '^' already
+//                translated to newlines.
+//
+// Inputs       : wl - the workload
+//                cmd - the command to fill in
+// Outputs      : 1 if a command was returned, 0 at the end, -1 on failure
+
+int next_cart_workload(CartWorkload *wl, CartWorkloadCommand *cmd) {
+	char *line, *eol, *p, *name, *sep, *c;
+	uint32_t hash = 2166136261u;
+	int length;
+
+	if(wl->compiled) {
+		return next_compiled_workload(wl, cmd);
+	}
+	if(wl->cursor >= wl->end) {
+		return 0;
+	}
+
+	// Find the end of the line, and move the cursor to the next one
+	line = wl->cursor;
+	eol = memchr(line, '\n', wl->end - line);
+	if(eol == NULL) {
+		eol = wl->end;
+	}
+	wl->cursor = (eol < wl->end) ? eol + 1 : eol;
+	wl->linecount++;
+
+	// Filename, hashed as we scan it
+	p = line;
+	while(p < eol && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	name = p;
+	while(p < eol && *p != ' ' && *p != '\t') {
+		hash = (hash ^ (uint8_t)*p) * 16777619u;
+		p++;
+	}
+	length = p - name;
+
+	// Command
+	while(p < eol && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	c = p;
+	while(p < eol && *p != ' ' && *p != '\t') {
+		p++;
+	}
+	if((p - c >= 7) && (strncmp(c, "WRITEAT", 7) == 0)) {
+		cmd->op = CART_WL_WRITEAT;
+	} else if((p - c >= 5) && (strncmp(c, "WRITE", 5) == 0)) {
+		cmd->op = CART_WL_WRITE;
+	} else if((p - c >= 4) && (strncmp(c, "SEEK", 4) == 0)) {
+		cmd->op = CART_WL_SEEK;
+	} else if((p - c >= 4) && (strncmp(c, "READ", 4) == 0)) {
+		cmd->op = CART_WL_READ;
+	} else {
+		logMessage(LOG_ERROR_LEVEL, "CART un-parsable workload string, unknown command [%.*s], line %d",
+			(int)(p - c), c, wl->linecount);
+		return -1;
+	}
+
+	// Length, offset and the payload separator
+	sep = memchr(p, ':', eol - p);
+	if((length == 0) || (parse_workload_int(&p, eol, &cmd->len) == -1) ||
+			(parse_workload_int(&p, eol, &cmd->off) == -1) || (sep == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "CART un-parsable workload string, aborting [%.*s], line %d",
+			(int)(eol - line), line, wl->linecount);
+		return -1;
+	}
+
+	// Check the payload fits in the line (the newline counts, as it did with fgets)
+	cmd->data = sep + 1;
+	if((cmd->op == CART_WL_WRITEAT) || (cmd->op == CART_WL_WRITE)) {
+		if((cmd->len < 0) || (cmd->len >= CART_WORKLOAD_MAX_LINE) || (wl->cursor - cmd->data < cmd->len)) {
+			logMessage(LOG_ERROR_LEVEL, "Workload payload length %d does not fit, line %d", cmd->len, wl->linecount);
+			return -1;
+		}
+
+		// Translate the line markers in place
+		p = cmd->data;
+		while((p = memchr(p, '^', cmd->data + cmd->len - p)) != NULL) {
+			*p++ = '\n';
+		}
+	}
+
+	// Finally, look the file up in the table
+	if((cmd->file = intern_workload_file(wl, name, length, hash)) == -1) {
+		return -1;
+	}
+	return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cart_workload_filename
+// Description  : Get the interned filename for a file index
+//
+// Inputs       : wl - the workload
+//                file - the file index
+// Outputs      : the filename, or NULL if the index is bad
+
+char * cart_workload_filename(CartWorkload *wl, int file) {
+	if((file < 0) || (file >= wl->files)) {
+		return NULL;
+	}
+	return wl->names[file];
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : close_cart_workload
+// Description  : Unmap the workload and release the file table
+//
+// Inputs       : wl - the workload
+// Outputs      : 0 if successful, -1 if failure
+
+int close_cart_workload(CartWorkload *wl) {
+	int i;
+
+	for(i=0; i<wl->files; i++) {
+		free(wl->names[i]);
+		wl->names[i] = NULL;
+	}
+	wl->files = 0;
+	if(wl->base != NULL) {
+		munmap(wl->base, wl->size);
+		wl->base = NULL;
+	}
+	wl->compiled = 0;
+	wl->records = NULL;
+	wl->data = NULL;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_workload_section
+// Description  : Writes a whole buffer to the output file
+//
+// Inputs       : fh - the output file handle
+//                buf - the buffer to write
+//                len - the number of bytes to write
+// Outputs      : 0 if successful, -1 if failure
+
+static int write_workload_section(int fh, void *buf, size_t len) {
+	ssize_t ret;
+
+	while(len > 0) {
+		if((ret = write(fh, buf, len)) <= 0) {
+			return -1;
+		}
+		buf = (char *)buf + ret;
+		len -= ret;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_compiled_workload
+// Description  : Lay out and write a compiled workload
+//
+// Inputs       : output - the name of the compiled workload to create
+//                names - the filenames, by file index
+//                files - the number of filenames
+//                records - the op records
+//                ops - the number of op records
+//                data - the payload blob
+//                datalen - the length of the payload blob
+// Outputs      : 0 if successful, -1 if failure
+
+static int write_compiled_workload(char *output, char **names, int files, CartWorkloadRecord *records,
+		uint32_t ops, char *data, uint64_t datalen) {
+	CartWorkloadHeader hdr;
+	char pad[sizeof(uint64_t)] = { 0 };
+	uint64_t nameslen = 0;
+	int i, fh, ret;
+
+	// Lay out the sections
+	for(i=0; i<files; i++) {
+		nameslen += strlen(names[i]) + 1;
+	}
+	memset(&hdr, 0x0, sizeof(hdr));
+	hdr.magic = CART_WORKLOAD_MAGIC;
+	hdr.version = CART_WORKLOAD_VERSION;
+	hdr.files = files;
+	hdr.ops = ops;
+	hdr.namesOffset = sizeof(hdr);
+	hdr.opsOffset = (hdr.namesOffset + nameslen + sizeof(uint64_t) - 1) & ~(uint64_t)(sizeof(uint64_t) - 1);
+	hdr.dataOffset = hdr.opsOffset + ((uint64_t)ops * sizeof(CartWorkloadRecord));
+	hdr.dataLength = datalen;
+
+	// Now write it all out
+	if((fh = open(output, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure creating compiled workload [%s], error: %s.", output, strerror(errno));
+		return -1;
+	}
+	ret = write_workload_section(fh, &hdr, sizeof(hdr));
+	for(i=0; (i<files) && (ret == 0); i++) {
+		ret = write_workload_section(fh, names[i], strlen(names[i]) + 1);
+	}
+	if(ret == 0) {
+		ret = write_workload_section(fh, pad, hdr.opsOffset - (hdr.namesOffset + nameslen));
+	}
+	if(ret == 0) {
+		ret = write_workload_section(fh, records, (size_t)ops * sizeof(CartWorkloadRecord));
+	}
+	if(ret == 0) {
+		ret = write_workload_section(fh, data, datalen);
+	}
+	close(fh);
+	if(ret == -1) {
+		logMessage(LOG_ERROR_LEVEL, "Failure writing compiled workload [%s], error: %s.", output, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compile_cart_workload
+// Description  : Compile a text workload into the binary workload format.  The
+//                text is parsed once, the op records and payloads are gathered
+//                in memory and the result is written out in one go.
+//
+// Inputs       : wload - the name of the text workload file
+//                output - the name of the compiled workload to create
+// Outputs      : 0 if successful, -1 if failure
+
+int compile_cart_workload(char *wload, char *output) {
+	CartWorkload wl;
+	CartWorkloadCommand cmd;
+	CartWorkloadRecord *records = NULL, *rrecords;
+	char *data = NULL, *rdata;
+	uint32_t ops = 0, maxops = 0;
+	uint64_t datalen = 0, maxdata = 0;
+	int ret, err = -1;
+
+	if(open_cart_workload(wload, &wl) == -1) {
+		return -1;
+	}
+	if(wl.compiled) {
+		logMessage(LOG_ERROR_LEVEL, "Workload [%s] is already compiled.", wload);
+		close_cart_workload(&wl);
+		return -1;
+	}
+
+	// Parse every command, gathering the records and payload blob
+	while((ret = next_cart_workload(&wl, &cmd)) == 1) {
+		if(ops == maxops) {
+			maxops = (maxops == 0) ? 4096 : maxops * 2;
+			if((rrecords = realloc(records, sizeof(CartWorkloadRecord) * maxops)) == NULL) {
+				logMessage(LOG_ERROR_LEVEL, "Failed allocating workload op records.");
+				goto done;
+			}
+			records = rrecords;
+		}
+		memset(&records[ops], 0x0, sizeof(CartWorkloadRecord));
+		records[ops].op = cmd.op;
+		records[ops].file = cmd.file;
+		records[ops].len = cmd.len;
+		records[ops].off = cmd.off;
+		records[ops].data = datalen;
+
+		// Only writes carry a payload
+		if((cmd.op == CART_WL_WRITEAT) || (cmd.op == CART_WL_WRITE)) {
+			if(datalen + cmd.len > UINT32_MAX) {
+				logMessage(LOG_ERROR_LEVEL, "Workload payload too large to compile.");
+				goto done;
+			}
+			while(datalen + cmd.len > maxdata) {
+				maxdata = (maxdata == 0) ? 65536 : maxdata * 2;
+				if((rdata = realloc(data, maxdata)) == NULL) {
+					logMessage(LOG_ERROR_LEVEL, "Failed allocating workload payload blob.");
+					goto done;
+				}
+				data = rdata;
+			}
+			memcpy(&data[datalen], cmd.data, cmd.len);
+			datalen += cmd.len;
+		}
+		ops++;
+	}
+	if(ret == -1) {
+		goto done;
+	}
+
+	if(write_compiled_workload(output, wl.names, wl.files, records, ops, data, datalen) == -1) {
+		goto done;
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "Compiled workload [%s] to [%s]: %d files, %u ops, %lu payload bytes.",
+		wload, output, wl.files, ops, (unsigned long)datalen);
+	err = 0;
+
+done:
+	free(records);
+	free(data);
+	close_cart_workload(&wl);
+	return err;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_workload_record
+// Description  : Append an op record, growing the record array as needed
+//
+// Inputs       : records - the record array
+//                ops - the number of records
+//                maxops - the allocated size of the array
+//                op, file, len, off, data - the record fields
+// Outputs      : 0 if successful, -1 if failure
+
+static int add_workload_record(CartWorkloadRecord **records, uint32_t *ops, uint32_t *maxops,
+		CartWorkloadOp op, int file, int32_t len, int32_t off, uint32_t data) {
+	CartWorkloadRecord *rrecords;
+
+	if(*ops == *maxops) {
+		*maxops = (*maxops == 0) ? 4096 : *maxops * 2;
+		if((rrecords = realloc(*records, sizeof(CartWorkloadRecord) * *maxops)) == NULL) {
+			logMessage(LOG_ERROR_LEVEL, "Failed allocating workload op records.");
+			return -1;
+		}
+		*records = rrecords;
+	}
+	memset(&(*records)[*ops], 0x0, sizeof(CartWorkloadRecord));
+	(*records)[*ops].op = op;
+	(*records)[*ops].file = file;
+	(*records)[*ops].len = len;
+	(*records)[*ops].off = off;
+	(*records)[*ops].data = data;
+	(*ops)++;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : generate_cart_workload
+// Description  : Generate a compiled workload over binary data.  Each source
+//                file (binaryNN.bin, written next to the output) is random
+//                bytes, a quarter of them NULs, so copies that stop at a NUL
+//                fail validation.  The files are built up by interleaved
+//                appends of up to a frame, some ending exactly on a frame
+//                boundary, with reads and in-place rewrites of earlier data
+//                mixed in.  The payload blob is the source files themselves.
+//
+// Inputs       : output - the name of the compiled workload to create
+//                files - the number of source files
+//                size - the largest source file (each is size/2 to size bytes)
+//                seed - the random seed
+// Outputs      : 0 if successful, -1 if failure
+
+int generate_cart_workload(char *output, int files, uint32_t size, unsigned int seed) {
+	CartWorkloadRecord *records = NULL;
+	char *data = NULL, *names[CART_WORKLOAD_MAX_FILES] = { NULL }, *slash, path[256];
+	uint32_t lengths[CART_WORKLOAD_MAX_FILES], bases[CART_WORKLOAD_MAX_FILES], written[CART_WORKLOAD_MAX_FILES];
+	uint32_t ops = 0, maxops = 0, i, len, off, remaining;
+	uint64_t datalen = 0;
+	int f, fh, dirlen, choice, err = -1;
+
+	if((files <= 0) || (files > CART_WORKLOAD_MAX_FILES) || (size < 2) || (size > INT32_MAX)) {
+		logMessage(LOG_ERROR_LEVEL, "Bad binary workload shape (%d files of up to %u bytes).", files, size);
+		return -1;
+	}
+	srand(seed);
+	slash = strrchr(output, '/');
+	dirlen = (slash == NULL) ? 0 : (int)(slash - output) + 1;
+
+	// Size the files and lay them out back to back in the payload blob
+	for(f=0; f<files; f++) {
+		lengths[f] = (size / 2) + (rand() % (size - (size / 2) + 1));
+		bases[f] = datalen;
+		written[f] = 0;
+		datalen += lengths[f];
+	}
+	if((datalen > UINT32_MAX) || ((data = malloc(datalen)) == NULL)) {
+		logMessage(LOG_ERROR_LEVEL, "Failed allocating binary workload payload blob.");
+		return -1;
+	}
+	for(i=0; i<datalen; i++) {
+		data[i] = ((rand() % 4) == 0) ? 0 : (char)(rand() & 0xff);
+	}
+
+	// Write the source files the simulator validates against
+	for(f=0; f<files; f++) {
+		if((names[f] = malloc(16)) == NULL) {
+			goto done;
+		}
+		snprintf(names[f], 16, "binary%02d.bin", f);
+		snprintf(path, sizeof(path), "%.*s%s", dirlen, output, names[f]);
+		if((fh = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "Failure creating binary source [%s], error: %s.", path, strerror(errno));
+			goto done;
+		}
+		if(write_workload_section(fh, &data[bases[f]], lengths[f]) == -1) {
+			logMessage(LOG_ERROR_LEVEL, "Failure writing binary source [%s], error: %s.", path, strerror(errno));
+			close(fh);
+			goto done;
+		}
+		close(fh);
+	}
+
+	// Build the files up round robin until every one is complete
+	for(remaining=files; remaining>0; ) {
+		for(f=0; f<files; f++) {
+			if(written[f] == lengths[f]) {
+				continue;
+			}
+			choice = rand() % 8;
+
+			if((written[f] > 0) && (choice == 0)) {
+				// Read back some earlier data, then return to the end
+				off = rand() % written[f];
+				len = 1 + (rand() % (((written[f] - off) < 2 * CART_FRAME_SIZE) ? (written[f] - off) : 2 * CART_FRAME_SIZE));
+				if((add_workload_record(&records, &ops, &maxops, CART_WL_SEEK, f, 0, off, 0) == -1) ||
+						(add_workload_record(&records, &ops, &maxops, CART_WL_READ, f, len, 0, 0) == -1) ||
+						(add_workload_record(&records, &ops, &maxops, CART_WL_SEEK, f, 0, written[f], 0) == -1)) {
+					goto done;
+				}
+
+			} else if((written[f] > 0) && (choice == 1)) {
+				// Rewrite some earlier data in place (with the same bytes), then return to the end
+				off = rand() % written[f];
+				len = 1 + (rand() % (((written[f] - off) < CART_FRAME_SIZE) ? (written[f] - off) : CART_FRAME_SIZE));
+				if((add_workload_record(&records, &ops, &maxops, CART_WL_WRITEAT, f, len, off, bases[f] + off) == -1) ||
+						(add_workload_record(&records, &ops, &maxops, CART_WL_SEEK, f, 0, written[f], 0) == -1)) {
+					goto done;
+				}
+
+			} else {
+				// Append, sometimes a whole frame or up to the frame boundary
+				if(choice == 2) {
+					len = CART_FRAME_SIZE - (written[f] % CART_FRAME_SIZE);
+				} else if(choice == 3) {
+					len = CART_FRAME_SIZE;
+				} else {
+					len = 1 + (rand() % CART_FRAME_SIZE);
+				}
+				if(len > lengths[f] - written[f]) {
+					len = lengths[f] - written[f];
+				}
+				if(add_workload_record(&records, &ops, &maxops, CART_WL_WRITE, f, len, 0, bases[f] + written[f]) == -1) {
+					goto done;
+				}
+				written[f] += len;
+				if(written[f] == lengths[f]) {
+					remaining--;
+				}
+			}
+		}
+	}
+
+	if(write_compiled_workload(output, names, files, records, ops, data, datalen) == -1) {
+		goto done;
+	}
+	logMessage(LOG_OUTPUT_LEVEL, "Generated binary workload [%s]: %d files, %u ops, %lu payload bytes.",
+		output, files, ops, (unsigned long)datalen);
+	err = 0;
+
+done:
+	for(f=0; f<files; f++) {
+		free(names[f]);
+	}
+	free(records);
+	free(data);
+	return err;
+}
@@ -0,0 +1,122 @@
+#ifndef CART_WORKLOAD_INCLUDED
+#define CART_WORKLOAD_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : cart_workload.h
+//  Description    : This is the interface for the workload parser used by the
+//                   CART simulator.  The workload file is mapped into memory
+//                   and parsed in a single pass, filenames are interned in a
+//                   hashed file table and payloads are handed back in place.
+//                   Workloads may also be compiled to a binary format that is
+//                   replayed straight out of the mapping.
+//
+//  Author         : James W. Frazier
+//  Last Modified  : Sunday, October 18th
+//
+
+// Includes
+#include <stdint.h>
+#include <stddef.h>
+
+// Defines
+#define CART_WORKLOAD_MAX_FILES 128   // Maximum number of distinct filenames
+#define CART_WORKLOAD_HASH_SIZE 256   // Size of the filename hash table (power of 2)
+#define CART_WORKLOAD_MAX_LINE 1024   // Maximum length of a workload line
+#define CART_WORKLOAD_MAGIC 0x424c5743  // "CWLB", first word of a compiled workload
+#define CART_WORKLOAD_VERSION 1         // Version of the compiled workload format
+
+// These are the commands that can appear in a workload
+typedef enum {
+
+	CART_WL_WRITEAT = 0, // Seek to the offset then write the payload
+	CART_WL_WRITE   = 1, // Write the payload at the current position
+	CART_WL_SEEK    = 2, // Seek to the offset
+	CART_WL_READ    = 3, // Read len bytes at the current position
+	CART_WL_MAXVAL  = 4  // Maximum command value
+
+} CartWorkloadOp;
+
+// This is a single parsed workload command
+typedef struct {
+	CartWorkloadOp op;   // The command to execute
+	int            file; // Index of the file in the workload file table
+	int32_t        len;  // Length field of the command
+	int32_t        off;  // Offset field of the command
+	char          *data; // Payload (len bytes, '^' already translated), not NUL terminated
+} CartWorkloadCommand;
+
+/*
+
+ Compiled workload layout (host byte order, all offsets from the file start)
+
+   CartWorkloadHeader
+   filename table - "files" NUL terminated names, in file index order
+   op records     - "ops" CartWorkloadRecord entries (8 byte aligned)
+   payload blob   - the translated payloads of every WRITE/WRITEAT
+
+*/
+
+// This is the header of a compiled workload
+typedef struct {
+	uint32_t magic;        // CART_WORKLOAD_MAGIC
+	uint32_t version;      // CART_WORKLOAD_VERSION
+	uint32_t files;        // Number of filenames in the table
+	uint32_t ops;          // Number of op records
+	uint64_t namesOffset;  // Offset of the filename table
+	uint64_t opsOffset;    // Offset of the op records
+	uint64_t dataOffset;   // Offset of the payload blob
+	uint64_t dataLength;   // Length of the payload blob
+} CartWorkloadHeader;
+
+// This is a single compiled op record (16 bytes)
+typedef struct {
+	uint8_t  op;    // CartWorkloadOp
+	uint8_t  unused;
+	uint16_t file;  // File index
+	int32_t  len;   // Length field
+	int32_t  off;   // Offset field
+	uint32_t data;  // Offset of the payload in the blob
+} CartWorkloadRecord;
+
+// This is an open workload
+typedef struct {
+	char     *base;      // Start of the mapped workload file
+	char     *cursor;    // Next unparsed byte of the mapping
+	char     *end;       // One past the last byte of the mapping
+	size_t    size;      // Size of the mapping
+	int32_t   linecount; // Number of lines parsed so far
+	int       files;     // Number of distinct filenames seen so far
+	char     *names[CART_WORKLOAD_MAX_FILES];   // Interned filenames, by file index
+	uint32_t  hashes[CART_WORKLOAD_MAX_FILES];  // Hash of each interned filename
+	int16_t   table[CART_WORKLOAD_HASH_SIZE];   // Hash slot -> file index (-1 if empty)
+	int       compiled;  // Non-zero if this is a compiled (binary) workload
+	CartWorkloadRecord *records; // Op records of a compiled workload
+	uint32_t  ops;       // Number of op records
+	uint32_t  nextOp;    // Next op record to replay
+	char     *data;      // Payload blob of a compiled workload
+	uint64_t  dataLength; // Length of the payload blob
+} CartWorkload;
+
+//
+// Functional Prototypes
+
+int open_cart_workload(char *wload, CartWorkload *wl);
+	// Map the workload file (text or compiled) and prepare it for parsing
+
+int next_cart_workload(CartWorkload *wl, CartWorkloadCommand *cmd);
+	// Parse the next command (1 if a command was returned, 0 at end, -1 on error)
+
+char * cart_workload_filename(CartWorkload *wl, int file);
+	// Get the interned filename for a file index
+
+int close_cart_workload(CartWorkload *wl);
+	// Unmap the workload and release the file table
+
+int compile_cart_workload(char *wload, char *output);
+	// Compile a text workload into the binary workload format
+
+int generate_cart_workload(char *output, int files, uint32_t size, unsigned int seed);
+	// Generate a compiled workload (and its source files) over binary data
+
+#endif